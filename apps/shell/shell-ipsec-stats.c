@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2014, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Shell command for the IPsec statistics (see core/net/ipsec/ipsec_stats.h)
+ */
+
+#include "contiki.h"
+#include "shell.h"
+#include "ipsec_stats.h"
+
+#include <string.h>
+
+#define BUFLEN 64
+
+/*---------------------------------------------------------------------------*/
+PROCESS(shell_ipsec_stats_process, "ipsec-stats");
+SHELL_COMMAND(ipsec_stats_command,
+	      "ipsec-stats",
+	      "ipsec-stats [reset]: show IPsec drop reasons, transform timing and SA counters",
+	      &shell_ipsec_stats_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(shell_ipsec_stats_process, ev, data)
+{
+#if WITH_IPSEC_STATS
+  char buf[BUFLEN];
+  uint16_t i;
+#endif
+
+  PROCESS_BEGIN();
+
+#if WITH_IPSEC_STATS
+  if(data != NULL && strncmp(data, "reset", 5) == 0) {
+    ipsec_stats_reset();
+    shell_output_str(&ipsec_stats_command, "IPsec statistics reset", "");
+    PROCESS_EXIT();
+  }
+
+  for(i = 0; ipsec_stats_line(i, buf, BUFLEN) > 0; ++i) {
+    shell_output_str(&ipsec_stats_command, buf, "");
+  }
+#else
+  shell_output_str(&ipsec_stats_command, "IPsec statistics are disabled (WITH_CONF_IPSEC_STATS)", "");
+#endif
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+shell_ipsec_stats_init(void)
+{
+  shell_register_command(&ipsec_stats_command);
+}
+/*---------------------------------------------------------------------------*/
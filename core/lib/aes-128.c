@@ -64,7 +64,9 @@ static const uint8_t sbox[256] =   {
 0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
 0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16 };
 
-static uint8_t round_keys[11][AES_128_KEY_LENGTH];
+static uint8_t own_round_keys[11][AES_128_KEY_LENGTH];
+/* The round keys of the current key, either ours or a loaded key schedule */
+static const uint8_t (*round_keys)[AES_128_KEY_LENGTH] = own_round_keys;
 
 /*---------------------------------------------------------------------------*/
 /* multiplies by 2 in GF(2) */
@@ -80,7 +82,7 @@ galois_mul2(uint8_t value)
 }
 /*---------------------------------------------------------------------------*/
 static void
-set_key(uint8_t *key)
+expand(const uint8_t *key, uint8_t round_keys[][AES_128_KEY_LENGTH])
 {
   uint8_t i;
   uint8_t j;
@@ -101,6 +103,41 @@ set_key(uint8_t *key)
 }
 /*---------------------------------------------------------------------------*/
 static void
+set_key(uint8_t *key)
+{
+  expand(key, own_round_keys);
+  round_keys = own_round_keys;
+}
+/*---------------------------------------------------------------------------*/
+#if AES_128_KEY_SCHEDULE_LENGTH >= 11 * AES_128_KEY_LENGTH
+static void
+expand_key(const uint8_t *key, uint8_t *schedule)
+{
+  expand(key, (uint8_t (*)[AES_128_KEY_LENGTH])schedule);
+}
+/*---------------------------------------------------------------------------*/
+static void
+load_key_schedule(const uint8_t *schedule)
+{
+  round_keys = (const uint8_t (*)[AES_128_KEY_LENGTH])schedule;
+}
+#else /* AES_128_KEY_SCHEDULE_LENGTH >= 11 * AES_128_KEY_LENGTH */
+/* Key schedules are sized for a hardware driver: keep the key and expand it
+   on loading */
+static void
+expand_key(const uint8_t *key, uint8_t *schedule)
+{
+  memcpy(schedule, key, AES_128_KEY_LENGTH);
+}
+/*---------------------------------------------------------------------------*/
+static void
+load_key_schedule(const uint8_t *schedule)
+{
+  set_key((uint8_t *)schedule);
+}
+#endif /* AES_128_KEY_SCHEDULE_LENGTH >= 11 * AES_128_KEY_LENGTH */
+/*---------------------------------------------------------------------------*/
+static void
 encrypt(uint8_t *state)
 {
   uint8_t buf1, buf2, buf3, buf4, round, i;
@@ -193,6 +230,8 @@ aes_128_set_padded_key(uint8_t *key, uint8_t key_len)
 /*---------------------------------------------------------------------------*/
 const struct aes_128_driver aes_128_driver = {
   set_key,
-  encrypt
+  encrypt,
+  expand_key,
+  load_key_schedule
 };
 /*---------------------------------------------------------------------------*/
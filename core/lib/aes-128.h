@@ -51,6 +51,14 @@
 #define AES_128            aes_128_driver
 #endif /* AES_128_CONF */
 
+/* Size of a key schedule. Drivers of AES hardware that expands keys itself
+   only need the key. */
+#ifdef AES_128_CONF_KEY_SCHEDULE_LENGTH
+#define AES_128_KEY_SCHEDULE_LENGTH AES_128_CONF_KEY_SCHEDULE_LENGTH
+#else /* AES_128_CONF_KEY_SCHEDULE_LENGTH */
+#define AES_128_KEY_SCHEDULE_LENGTH (11 * AES_128_KEY_LENGTH)
+#endif /* AES_128_CONF_KEY_SCHEDULE_LENGTH */
+
 /**
  * Structure of AES drivers.
  */
@@ -65,6 +73,18 @@ struct aes_128_driver {
    * \brief Encrypts.
    */
   void (* encrypt)(uint8_t *plaintext_and_result);
+  
+  /**
+   * \brief Precomputes the key schedule of a key into
+   *        AES_128_KEY_SCHEDULE_LENGTH bytes.
+   */
+  void (* expand_key)(const uint8_t *key, uint8_t *schedule);
+  
+  /**
+   * \brief Sets the current key from a precomputed key schedule, which
+   *        must not change until another key is set.
+   */
+  void (* load_key_schedule)(const uint8_t *schedule);
 };
 
 /**
@@ -180,6 +180,24 @@ check_for_tcp_syn(void)
 #endif /* UIP_TCP || UIP_CONF_IP_FORWARD */
 }
 /*---------------------------------------------------------------------------*/
+#if UIP_TCP && UIP_TCP_SNDBUF_SIZE && NETSTACK_CONF_WITH_IPV6
+static void
+tcp_send_window(void)
+{
+  struct uip_conn *conn = uip_conn;
+
+  /* uIP sends one segment at a time, so we poll the connection for the
+     others that its send window allows. */
+  while(conn != NULL && uip_tcp_sndbuf_ready(conn)) {
+    uip_poll_conn(conn);
+    if(uip_len == 0) {
+      break;
+    }
+    tcpip_ipv6_output();
+  }
+}
+#endif /* UIP_TCP && UIP_TCP_SNDBUF_SIZE && NETSTACK_CONF_WITH_IPV6 */
+/*---------------------------------------------------------------------------*/
 static void
 packet_input(void)
 {
@@ -196,6 +214,9 @@ packet_input(void)
 #else /* UIP_CONF_TCP_SPLIT */
 #if NETSTACK_CONF_WITH_IPV6
         tcpip_ipv6_output();
+#if UIP_TCP && UIP_TCP_SNDBUF_SIZE
+        tcp_send_window();
+#endif /* UIP_TCP && UIP_TCP_SNDBUF_SIZE */
 #else
 	PRINTF("tcpip packet_input forward output len %d\n", uip_len);
         tcpip_output();
@@ -215,6 +236,9 @@ packet_input(void)
 #else /* UIP_CONF_TCP_SPLIT */
 #if NETSTACK_CONF_WITH_IPV6
       tcpip_ipv6_output();
+#if UIP_TCP && UIP_TCP_SNDBUF_SIZE
+      tcp_send_window();
+#endif /* UIP_TCP && UIP_TCP_SNDBUF_SIZE */
 #else
       PRINTF("tcpip packet_input output len %d\n", uip_len);
       tcpip_output();
@@ -371,7 +395,7 @@ static void
 eventhandler(process_event_t ev, process_data_t data)
 {
 #if UIP_TCP
-  static unsigned char i;
+  static uint16_t i;
   register struct listenport *l;
 #endif /*UIP_TCP*/
   struct process *p;
@@ -436,6 +460,9 @@ eventhandler(process_event_t ev, process_data_t data)
               uip_periodic(i);
 #if NETSTACK_CONF_WITH_IPV6
               tcpip_ipv6_output();
+#if UIP_TCP_SNDBUF_SIZE
+              tcp_send_window();
+#endif /* UIP_TCP_SNDBUF_SIZE */
 #else
               if(uip_len > 0) {
 		PRINTF("tcpip_output from periodic len %d\n", uip_len);
@@ -493,6 +520,9 @@ eventhandler(process_event_t ev, process_data_t data)
         uip_poll_conn(data);
 #if NETSTACK_CONF_WITH_IPV6
         tcpip_ipv6_output();
+#if UIP_TCP_SNDBUF_SIZE
+        tcp_send_window();
+#endif /* UIP_TCP_SNDBUF_SIZE */
 #else /* NETSTACK_CONF_WITH_IPV6 */
         if(uip_len > 0) {
 	  PRINTF("tcpip_output from tcp poll len %d\n", uip_len);
@@ -541,11 +571,22 @@ tcpip_ipv6_output(void)
 {
   uip_ds6_nbr_t *nbr = NULL;
   uip_ipaddr_t *nexthop;
+#if UIP_CONF_IPV6_RPL
+  uip_ipaddr_t srh_nexthop;
+#endif /* UIP_CONF_IPV6_RPL */
 
   if(uip_len == 0) {
     return;
   }
 
+#if UIP_CONF_IPV6_RPL
+  /* The root of a non-storing DAG source routes packets down the DAG */
+  if(rpl_update_header_srh()) {
+    uip_len = 0;
+    return;
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+
   if(uip_len > UIP_LINK_MTU) {
     UIP_LOG("tcpip_ipv6_output: Packet to big");
     uip_len = 0;
@@ -572,6 +613,13 @@ tcpip_ipv6_output(void)
       /* Check if we have a route to the destination address. */
       route = uip_ds6_route_lookup(&UIP_IP_BUF->destipaddr);
 
+#if UIP_CONF_IPV6_RPL
+      /* A source routed packet goes to the neighbor named by its
+         destination address. */
+      if(route == NULL && rpl_srh_get_next_hop(&srh_nexthop)) {
+        nexthop = &srh_nexthop;
+      } else
+#endif /* UIP_CONF_IPV6_RPL */
       /* No route was found - we send to the default route instead. */
       if(route == NULL) {
         PRINTF("tcpip_ipv6_output: no route found, using default route\n");
@@ -654,27 +702,34 @@ tcpip_ipv6_output(void)
         uip_len = 0;
         return;
       } else {
+        uip_ipaddr_t *src = &UIP_IP_BUF->srcipaddr;
 #if UIP_CONF_IPV6_QUEUE_PKT
-        /* Copy outgoing pkt in the queuing buffer for later transmit. */
-        if(uip_packetqueue_alloc(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME) != NULL) {
-          memcpy(uip_packetqueue_buf(&nbr->packethandle), UIP_IP_BUF, uip_len);
-          uip_packetqueue_set_buflen(&nbr->packethandle, uip_len);
+        /* Queue outgoing pkt for later transmit. It may have left uip_buf. */
+        if(uip_packetqueue_hold(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME)) {
+          src = &((struct uip_ip_hdr *)uip_packetqueue_buf(&nbr->packethandle))->srcipaddr;
         }
 #endif
-      /* RFC4861, 7.2.2:
-       * "If the source address of the packet prompting the solicitation is the
-       * same as one of the addresses assigned to the outgoing interface, that
-       * address SHOULD be placed in the IP Source Address of the outgoing
-       * solicitation.  Otherwise, any one of the addresses assigned to the
-       * interface should be used."*/
-       if(uip_ds6_is_my_addr(&UIP_IP_BUF->srcipaddr)){
-          uip_nd6_ns_output(&UIP_IP_BUF->srcipaddr, NULL, &nbr->ipaddr);
-        } else {
-          uip_nd6_ns_output(NULL, NULL, &nbr->ipaddr);
-        }
+        /* Past the NS rate limit, the periodic processing of neighbors
+           sends the NS in a later period. */
+        if(uip_ds6_nbr_ns_permit()) {
+          /* RFC4861, 7.2.2:
+           * "If the source address of the packet prompting the solicitation is the
+           * same as one of the addresses assigned to the outgoing interface, that
+           * address SHOULD be placed in the IP Source Address of the outgoing
+           * solicitation.  Otherwise, any one of the addresses assigned to the
+           * interface should be used."*/
+          if(uip_ds6_is_my_addr(src)) {
+            uip_nd6_ns_output(src, NULL, &nbr->ipaddr);
+          } else {
+            uip_nd6_ns_output(NULL, NULL, &nbr->ipaddr);
+          }
+          tcpip_output(NULL);
 
-        stimer_set(&nbr->sendns, uip_ds6_if.retrans_timer / 1000);
-        nbr->nscount = 1;
+          stimer_set(&nbr->sendns, uip_ds6_if.retrans_timer / 1000);
+          nbr->nscount = 1;
+        }
+        uip_len = 0;
+        return;
       }
 #endif /* UIP_ND6_SEND_NA */
     } else {
@@ -682,12 +737,8 @@ tcpip_ipv6_output(void)
       if(nbr->state == NBR_INCOMPLETE) {
         PRINTF("tcpip_ipv6_output: nbr cache entry incomplete\n");
 #if UIP_CONF_IPV6_QUEUE_PKT
-        /* Copy outgoing pkt in the queuing buffer for later transmit and set
-           the destination nbr to nbr. */
-        if(uip_packetqueue_alloc(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME) != NULL) {
-          memcpy(uip_packetqueue_buf(&nbr->packethandle), UIP_IP_BUF, uip_len);
-          uip_packetqueue_set_buflen(&nbr->packethandle, uip_len);
-        }
+        /* Queue outgoing pkt for later transmit to nbr. */
+        uip_packetqueue_hold(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME);
 #endif /*UIP_CONF_IPV6_QUEUE_PKT*/
         uip_len = 0;
         return;
@@ -711,12 +762,7 @@ tcpip_ipv6_output(void)
        * NA after sendiong a NS, you receive a NS with SLLAO: the entry moves
        * to STALE, and you must both send a NA and the queued packet.
        */
-      if(uip_packetqueue_buflen(&nbr->packethandle) != 0) {
-        uip_len = uip_packetqueue_buflen(&nbr->packethandle);
-        memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
-        uip_packetqueue_free(&nbr->packethandle);
-        tcpip_output(uip_ds6_nbr_get_ll(nbr));
-      }
+      uip_ds6_nbr_send_queued(nbr);
 #endif /*UIP_CONF_IPV6_QUEUE_PKT*/
 
       uip_len = 0;
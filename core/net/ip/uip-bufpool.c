@@ -0,0 +1,110 @@
+/**
+ * \addtogroup uip
+ * @{
+ */
+
+/**
+ * \file
+ *    Pool of uIP packet buffers
+ */
+
+#include "net/ip/uip-bufpool.h"
+
+#if UIP_BUFPOOL_SIZE > 1
+
+#define DEBUG DEBUG_NONE
+#include "net/ip/uip-debug.h"
+
+extern void *uip_sappdata;
+
+/* The buffers besides uip_aligned_buf */
+static uip_buf_t bufs[UIP_BUFPOOL_SIZE - 1];
+
+/* Number of references to uip_aligned_buf and each of bufs */
+static uint8_t refcount[UIP_BUFPOOL_SIZE] = { 1 };
+
+uip_buf_t *uip_bufp = &uip_aligned_buf;
+
+/*---------------------------------------------------------------------------*/
+static uint8_t *
+refcount_of(uip_buf_t *buf)
+{
+  return &refcount[buf == &uip_aligned_buf ? 0 : buf - bufs + 1];
+}
+/*---------------------------------------------------------------------------*/
+/* Move a pointer into the current uip_buf to the same offset in buf */
+static void
+move_ptr(void **ptr, uip_buf_t *buf)
+{
+  uint8_t *p = *ptr;
+
+  if(p >= uip_bufp->u8 && p < uip_bufp->u8 + UIP_BUFSIZE) {
+    *ptr = buf->u8 + (p - uip_bufp->u8);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+switch_buf(uip_buf_t *buf)
+{
+  move_ptr(&uip_appdata, buf);
+  move_ptr(&uip_sappdata, buf);
+  uip_bufp = buf;
+}
+/*---------------------------------------------------------------------------*/
+uip_buf_t *
+uip_bufpool_alloc(void)
+{
+  uint8_t i;
+
+  for(i = 0; i < UIP_BUFPOOL_SIZE; i++) {
+    if(refcount[i] == 0) {
+      refcount[i] = 1;
+      return i == 0 ? &uip_aligned_buf : &bufs[i - 1];
+    }
+  }
+  PRINTF("uip-bufpool: no free buffer\n");
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_bufpool_ref(uip_buf_t *buf)
+{
+  ++*refcount_of(buf);
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_bufpool_unref(uip_buf_t *buf)
+{
+  uint8_t *count = refcount_of(buf);
+
+  if(*count > 0) {
+    --*count;
+  }
+}
+/*---------------------------------------------------------------------------*/
+uip_buf_t *
+uip_bufpool_hold(void)
+{
+  uip_buf_t *held = uip_bufp;
+  uip_buf_t *buf = uip_bufpool_alloc();
+
+  if(buf == NULL) {
+    return NULL;
+  }
+  switch_buf(buf);
+  return held;
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_bufpool_resume(uip_buf_t *buf)
+{
+  uip_buf_t *previous = uip_bufp;
+
+  switch_buf(buf);
+  uip_bufpool_unref(previous);
+}
+/*---------------------------------------------------------------------------*/
+
+#endif /* UIP_BUFPOOL_SIZE > 1 */
+
+/** @} */
@@ -0,0 +1,74 @@
+/**
+ * \addtogroup uip
+ * @{
+ */
+
+/**
+ * \file
+ *    Pool of uIP packet buffers
+ * \details
+ *    With UIP_BUFPOOL_SIZE greater than one, uip_buf is not a fixed array
+ *    but the current buffer of a pool of UIP_BUFPOOL_SIZE buffers, the
+ *    first of which is uip_aligned_buf. A layer that must keep a packet
+ *    beyond the processing of uip_buf (a packet waiting for address
+ *    resolution, a datagram under 6LoWPAN reassembly) takes over the
+ *    buffer with uip_bufpool_hold() instead of copying it, and uip_buf
+ *    continues with a free buffer. The packet is later handed back to the
+ *    stack with uip_bufpool_resume(), again without copying.
+ *
+ *    The buffers are reference counted: the stack holds one reference to
+ *    the current buffer, and every owner of a held buffer one more.
+ *
+ *    With UIP_BUFPOOL_SIZE of one, the default, uip_buf is uip_aligned_buf
+ *    and the functions of this module are not available. The layers fall
+ *    back to copying the packet.
+ */
+
+#ifndef UIP_BUFPOOL_H_
+#define UIP_BUFPOOL_H_
+
+#include "net/ip/uip.h"
+
+#if UIP_BUFPOOL_SIZE > 1
+
+/**
+ * \brief Allocate a free buffer
+ * \return The buffer with one reference, or NULL if all are in use
+ */
+uip_buf_t *uip_bufpool_alloc(void);
+
+/**
+ * \brief Add a reference to a buffer
+ */
+void uip_bufpool_ref(uip_buf_t *buf);
+
+/**
+ * \brief Release a reference to a buffer
+ *
+ * The buffer returns to the pool when its last reference is released.
+ */
+void uip_bufpool_unref(uip_buf_t *buf);
+
+/**
+ * \brief Take over the current uip_buf
+ * \return The buffer with the stack's reference, or NULL if no free
+ * buffer is left to replace it
+ *
+ * uip_buf is replaced by a free buffer. uip_appdata is moved along, but
+ * uip_len and the contents of the new uip_buf are undefined.
+ */
+uip_buf_t *uip_bufpool_hold(void);
+
+/**
+ * \brief Make a buffer the current uip_buf
+ *
+ * The caller's reference to buf becomes the stack's, and the previous
+ * uip_buf is released. uip_len is left for the caller to set.
+ */
+void uip_bufpool_resume(uip_buf_t *buf);
+
+#endif /* UIP_BUFPOOL_SIZE > 1 */
+
+#endif /* UIP_BUFPOOL_H_ */
+
+/** @} */
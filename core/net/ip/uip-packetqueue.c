@@ -1,13 +1,14 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "net/ip/uip.h"
+#include "net/ip/uip-bufpool.h"
 
 #include "lib/memb.h"
 
 #include "net/ip/uip-packetqueue.h"
 
-#define MAX_NUM_QUEUED_PACKETS 2
-MEMB(packets_memb, struct uip_packetqueue_packet, MAX_NUM_QUEUED_PACKETS);
+MEMB(packets_memb, struct uip_packetqueue_packet, UIP_PACKETQUEUE_NUM);
 
 #define DEBUG 0
 #if DEBUG
@@ -17,15 +18,53 @@ MEMB(packets_memb, struct uip_packetqueue_packet, MAX_NUM_QUEUED_PACKETS);
 #define PRINTF(...)
 #endif
 
+/*---------------------------------------------------------------------------*/
+static void packet_timedout(void *ptr);
+/*---------------------------------------------------------------------------*/
+static void
+packet_link(struct uip_packetqueue_handle *h, struct uip_packetqueue_packet *p,
+            clock_time_t lifetime)
+{
+  struct uip_packetqueue_packet **pp;
+
+  for(pp = &h->packet; *pp != NULL; pp = &(*pp)->next);
+  *pp = p;
+  p->next = NULL;
+  p->handle = h;
+  p->queue_buf_len = 0;
+  h->len++;
+  ctimer_set(&p->lifetimer, lifetime, packet_timedout, p);
+}
+/*---------------------------------------------------------------------------*/
+static void
+packet_unlink(struct uip_packetqueue_packet *p)
+{
+  struct uip_packetqueue_handle *h = p->handle;
+  struct uip_packetqueue_packet **pp;
+
+  for(pp = &h->packet; *pp != p; pp = &(*pp)->next);
+  *pp = p->next;
+  h->len--;
+  ctimer_stop(&p->lifetimer);
+}
+/*---------------------------------------------------------------------------*/
+static void
+packet_free(struct uip_packetqueue_packet *p)
+{
+  packet_unlink(p);
+#if UIP_BUFPOOL_SIZE > 1
+  uip_bufpool_unref(p->buf);
+#endif /* UIP_BUFPOOL_SIZE > 1 */
+  memb_free(&packets_memb, p);
+}
 /*---------------------------------------------------------------------------*/
 static void
 packet_timedout(void *ptr)
 {
-  struct uip_packetqueue_handle *h = ptr;
+  struct uip_packetqueue_packet *p = ptr;
 
-  PRINTF("uip_packetqueue_free timed out %p\n", h);
-  memb_free(&packets_memb, h->packet);
-  h->packet = NULL;
+  PRINTF("uip_packetqueue_free timed out %p\n", p->handle);
+  packet_free(p);
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -33,41 +72,54 @@ uip_packetqueue_new(struct uip_packetqueue_handle *handle)
 {
   PRINTF("uip_packetqueue_new %p\n", handle);
   handle->packet = NULL;
+  handle->len = 0;
 }
 /*---------------------------------------------------------------------------*/
 struct uip_packetqueue_packet *
 uip_packetqueue_alloc(struct uip_packetqueue_handle *handle, clock_time_t lifetime)
 {
+  struct uip_packetqueue_packet *p;
+
   PRINTF("uip_packetqueue_alloc %p\n", handle);
-  if(handle->packet != NULL) {
-    PRINTF("alloced\n");
+  if(handle->len >= UIP_PACKETQUEUE_PER_HANDLE) {
+    PRINTF("full\n");
     return NULL;
   }
-  handle->packet = memb_alloc(&packets_memb);
-  if(handle->packet != NULL) {
-    ctimer_set(&handle->packet->lifetimer, lifetime,
-               packet_timedout, handle);
+  p = memb_alloc(&packets_memb);
+#if UIP_BUFPOOL_SIZE > 1
+  if(p != NULL) {
+    p->buf = uip_bufpool_alloc();
+    if(p->buf == NULL) {
+      memb_free(&packets_memb, p);
+      p = NULL;
+    }
+  }
+#endif /* UIP_BUFPOOL_SIZE > 1 */
+  if(p != NULL) {
+    packet_link(handle, p, lifetime);
   } else {
     PRINTF("uip_packetqueue_alloc failed\n");
   }
-  return handle->packet;
+  return p;
 }
 /*---------------------------------------------------------------------------*/
 void
 uip_packetqueue_free(struct uip_packetqueue_handle *handle)
 {
   PRINTF("uip_packetqueue_free %p\n", handle);
-  if(handle->packet != NULL) {
-    ctimer_stop(&handle->packet->lifetimer);
-    memb_free(&packets_memb, handle->packet);
-    handle->packet = NULL;
+  while(handle->packet != NULL) {
+    packet_free(handle->packet);
   }
 }
 /*---------------------------------------------------------------------------*/
 uint8_t *
 uip_packetqueue_buf(struct uip_packetqueue_handle *h)
 {
+#if UIP_BUFPOOL_SIZE > 1
+  return h->packet != NULL? &h->packet->buf->u8[UIP_LLH_LEN]: NULL;
+#else /* UIP_BUFPOOL_SIZE > 1 */
   return h->packet != NULL? h->packet->queue_buf: NULL;
+#endif /* UIP_BUFPOOL_SIZE > 1 */
 }
 /*---------------------------------------------------------------------------*/
 uint16_t
@@ -84,3 +136,57 @@ uip_packetqueue_set_buflen(struct uip_packetqueue_handle *h, uint16_t len)
   }
 }
 /*---------------------------------------------------------------------------*/
+uint8_t
+uip_packetqueue_hold(struct uip_packetqueue_handle *h, clock_time_t lifetime)
+{
+  struct uip_packetqueue_packet *p;
+#if UIP_BUFPOOL_SIZE > 1
+  uip_buf_t *buf;
+
+  if(h->len >= UIP_PACKETQUEUE_PER_HANDLE) {
+    return 0;
+  }
+  p = memb_alloc(&packets_memb);
+  if(p == NULL) {
+    PRINTF("uip_packetqueue_hold failed\n");
+    return 0;
+  }
+  buf = uip_bufpool_hold();
+  if(buf == NULL) {
+    PRINTF("uip_packetqueue_hold: no buffer\n");
+    memb_free(&packets_memb, p);
+    return 0;
+  }
+  p->buf = buf;
+  packet_link(h, p, lifetime);
+#else /* UIP_BUFPOOL_SIZE > 1 */
+  p = uip_packetqueue_alloc(h, lifetime);
+  if(p == NULL) {
+    return 0;
+  }
+  memcpy(p->queue_buf, &uip_buf[UIP_LLH_LEN], uip_len);
+#endif /* UIP_BUFPOOL_SIZE > 1 */
+  p->queue_buf_len = uip_len;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_packetqueue_resume(struct uip_packetqueue_handle *h)
+{
+  struct uip_packetqueue_packet *p = h->packet;
+
+  if(p == NULL) {
+    uip_len = 0;
+    return;
+  }
+  uip_len = p->queue_buf_len;
+#if UIP_BUFPOOL_SIZE > 1
+  packet_unlink(p);
+  uip_bufpool_resume(p->buf);
+  memb_free(&packets_memb, p);
+#else /* UIP_BUFPOOL_SIZE > 1 */
+  memcpy(&uip_buf[UIP_LLH_LEN], p->queue_buf, uip_len);
+  packet_free(p);
+#endif /* UIP_BUFPOOL_SIZE > 1 */
+}
+/*---------------------------------------------------------------------------*/
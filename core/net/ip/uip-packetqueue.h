@@ -3,33 +3,65 @@
 
 #include "sys/ctimer.h"
 
+/* Number of packets queued at once over all handles. Each one takes a
+   buffer of UIP_BUFSIZE bytes, or one of the buffer pool. */
+#ifdef UIP_PACKETQUEUE_CONF_NUM
+#define UIP_PACKETQUEUE_NUM UIP_PACKETQUEUE_CONF_NUM
+#else /* UIP_PACKETQUEUE_CONF_NUM */
+#define UIP_PACKETQUEUE_NUM 2
+#endif /* UIP_PACKETQUEUE_CONF_NUM */
+
+/* Number of packets queued at once on one handle, so that a single
+   unresolved neighbor cannot take all of them */
+#ifdef UIP_PACKETQUEUE_CONF_PER_HANDLE
+#define UIP_PACKETQUEUE_PER_HANDLE UIP_PACKETQUEUE_CONF_PER_HANDLE
+#else /* UIP_PACKETQUEUE_CONF_PER_HANDLE */
+#define UIP_PACKETQUEUE_PER_HANDLE UIP_PACKETQUEUE_NUM
+#endif /* UIP_PACKETQUEUE_CONF_PER_HANDLE */
+
 struct uip_packetqueue_handle;
 
 struct uip_packetqueue_packet {
-  struct uip_ds6_queued_packet *next;
+  struct uip_packetqueue_packet *next;
+#if UIP_BUFPOOL_SIZE > 1
+  uip_buf_t *buf;
+#else /* UIP_BUFPOOL_SIZE > 1 */
   uint8_t queue_buf[UIP_BUFSIZE - UIP_LLH_LEN];
+#endif /* UIP_BUFPOOL_SIZE > 1 */
   uint16_t queue_buf_len;
   struct ctimer lifetimer;
   struct uip_packetqueue_handle *handle;
 };
 
+/* The packets of a handle are kept oldest first */
 struct uip_packetqueue_handle {
   struct uip_packetqueue_packet *packet;
+  uint8_t len;
 };
 
 void uip_packetqueue_new(struct uip_packetqueue_handle *handle);
 
-
+/* Append a packet to the queue, which is freed after lifetime */
 struct uip_packetqueue_packet *
 uip_packetqueue_alloc(struct uip_packetqueue_handle *handle, clock_time_t lifetime);
 
-
+/* Free all the packets of the queue */
 void
 uip_packetqueue_free(struct uip_packetqueue_handle *handle);
 
+/* The buffer and length of the oldest packet */
 uint8_t *uip_packetqueue_buf(struct uip_packetqueue_handle *h);
 uint16_t uip_packetqueue_buflen(struct uip_packetqueue_handle *h);
 void uip_packetqueue_set_buflen(struct uip_packetqueue_handle *h, uint16_t len);
 
+/* Queue the packet in uip_buf after the others, or return 0 if the handle
+   or the pool is full. With a buffer pool, its buffer is taken over instead
+   of copied, and uip_buf is left with undefined contents. */
+uint8_t uip_packetqueue_hold(struct uip_packetqueue_handle *h, clock_time_t lifetime);
+
+/* Put the oldest queued packet back in uip_buf and uip_len, and remove it
+   from the queue. uip_len is 0 if the queue is empty. */
+void uip_packetqueue_resume(struct uip_packetqueue_handle *h);
+
 
 #endif /* UIP_PACKETQUEUE_H */
@@ -522,8 +522,16 @@ typedef union {
 
 CCIF extern uip_buf_t uip_aligned_buf;
 
+#if UIP_BUFPOOL_SIZE > 1
+/** The current buffer of the pool, uip_aligned_buf initially */
+CCIF extern uip_buf_t *uip_bufp;
+
+/** Macro to access the current buffer as an array of bytes */
+#define uip_buf (uip_bufp->u8)
+#else /* UIP_BUFPOOL_SIZE > 1 */
 /** Macro to access uip_aligned_buf as an array of bytes */
 #define uip_buf (uip_aligned_buf.u8)
+#endif /* UIP_BUFPOOL_SIZE > 1 */
 
 
 /** @} */
@@ -632,7 +640,9 @@ struct uip_conn *uip_connect(uip_ipaddr_t *ripaddr, uint16_t port);
  * arrive at the destination. If the data is lost in the network, the
  * application will be invoked with the uip_rexmit() event being
  * set. The application will then have to resend the data using this
- * function.
+ * function. With a TCP send buffer (UIP_CONF_TCP_SNDBUF_SIZE), uIP
+ * keeps the data in the buffer of the connection and retransmits it
+ * itself.
  *
  * \param data A pointer to the data which is to be sent.
  *
@@ -839,7 +849,14 @@ CCIF void uip_send(const void *data, int len);
  *
  * \hideinitializer
  */
+#if UIP_TCP_SNDBUF_SIZE
+#define uip_mss()             (UIP_TCP_SNDBUF_SIZE - uip_conn->sndbuf_len < \
+                               uip_conn->mss ?                          \
+                               UIP_TCP_SNDBUF_SIZE - uip_conn->sndbuf_len : \
+                               uip_conn->mss)
+#else /* UIP_TCP_SNDBUF_SIZE */
 #define uip_mss()             (uip_conn->mss)
+#endif /* UIP_TCP_SNDBUF_SIZE */
 
 /**
  * Set up a new UDP connection.
@@ -1362,6 +1379,27 @@ struct uip_conn {
   uint8_t timer;         /**< The retransmission timer. */
   uint8_t nrtx;          /**< The number of retransmissions for the last
 			 segment sent. */
+#if UIP_TCP_SNDBUF_SIZE
+  uint16_t snd_wnd;      /**< The window advertised by the remote host. */
+  uint16_t sndbuf_start; /**< Offset of the oldest byte in sndbuf. */
+  uint16_t sndbuf_len;   /**< Number of bytes in sndbuf, in flight (len)
+			 or not yet sent. */
+  uint16_t snd_recover;  /**< Bytes in flight when retransmissions
+			 started that are not acknowledged yet. */
+  uint8_t sndflags;      /**< Send buffer state flags. */
+  uint8_t dupacks;       /**< The number of duplicate acknowledgements
+			 received in a row. */
+  uint16_t rtt_len;      /**< Bytes in flight up to the end of the segment
+			 whose round-trip time is measured, 0 if none is. */
+  uint8_t rtt_ticks;     /**< Timer ticks since that segment was sent. */
+  uint8_t sndbuf[UIP_TCP_SNDBUF_SIZE]; /**< Data not yet acknowledged by
+			 the remote host. */
+#endif /* UIP_TCP_SNDBUF_SIZE */
+
+#if UIP_TCP_CONN_HASH_SIZE
+  struct uip_conn *hash_next; /**< The next connection in the same
+                                 bucket of the demultiplexing hash. */
+#endif /* UIP_TCP_CONN_HASH_SIZE */
 
   /** The application state. */
   uip_tcp_appstate_t appstate;
@@ -1381,6 +1419,23 @@ CCIF extern struct uip_conn *uip_conn;
 CCIF extern struct uip_conn uip_conns[UIP_CONNS];
 #endif
 
+#if UIP_TCP_SNDBUF_SIZE
+/**
+ * Check if a connection can send more right away.
+ *
+ * uIP sends at most one segment each time it processes a
+ * connection. With a send buffer, the caller polls the connection with
+ * uip_poll_conn() as long as this function returns non-zero to send
+ * the other segments that the window of the remote host allows.
+ *
+ * \param conn A pointer to the uip_conn struct for the connection.
+ *
+ * \return Non-zero if the connection has buffered data within the
+ * window, or room in its buffer for the application to fill.
+ */
+uint8_t uip_tcp_sndbuf_ready(struct uip_conn *conn);
+#endif /* UIP_TCP_SNDBUF_SIZE */
+
 /**
  * \addtogroup uiparch
  * @{
@@ -1899,6 +1954,7 @@ struct uip_udp_hdr {
 #define UIP_EXT_HDR_OPT_PAD1  0
 #define UIP_EXT_HDR_OPT_PADN  1
 #define UIP_EXT_HDR_OPT_RPL   0x63
+#define UIP_EXT_HDR_OPT_MPL   0x6D
 
 /** @} */
 
@@ -2186,6 +2242,35 @@ CCIF extern uip_lladdr_t uip_lladdr;
  */
 uint16_t uip_chksum(uint16_t *data, uint16_t len);
 
+/**
+ * Add the 16-bit words of a buffer to a one's complement sum.
+ *
+ * This is the core of all checksums. It adds the words with a 32-bit
+ * accumulator, as they are in memory when data is 16-bit aligned, and
+ * can be taken over by a checksum engine (see UIP_ARCH_CHKSUM_SUM).
+ *
+ * \param sum The sum so far, in host byte order
+ * \param data The buffer, a trailing odd byte is padded with zero
+ * \param len The length of the buffer
+ * \return The sum in host byte order
+ */
+uint16_t uip_chksum_add(uint16_t sum, const uint8_t *data, uint16_t len);
+
+/**
+ * Update a checksum for a change of the data that it covers.
+ *
+ * Instead of computing the checksum over the whole packet again after
+ * rewriting a header field, the sum of the old contents of the field is
+ * taken out of the checksum and the sum of the new contents put in
+ * (RFC 1624).
+ *
+ * \param chksum The checksum as found in the packet, in host byte order
+ * \param old_sum uip_chksum_add() of the data that was replaced
+ * \param new_sum uip_chksum_add() of the data that replaced it
+ * \return The new checksum in host byte order
+ */
+uint16_t uip_chksum_update(uint16_t chksum, uint16_t old_sum, uint16_t new_sum);
+
 /**
  * Calculate the IP header checksum of the packet header in uip_buf.
  *
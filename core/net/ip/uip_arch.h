@@ -103,6 +103,20 @@ void uip_add32(uint8_t *op32, uint16_t op16);
  */
 uint16_t uip_chksum(uint16_t *data, uint16_t len);
 
+/**
+ * Add the 16-bit words of a buffer to a one's complement sum.
+ *
+ * With UIP_ARCH_CHKSUM_SUM set, uip_chksum_add() calls this function,
+ * so that a CPU or radio with a checksum engine computes the sums of
+ * all checksums while the stack keeps track of the pseudo-headers.
+ *
+ * \param sum The sum so far, in host byte order
+ * \param data The buffer, which may be unaligned and of odd length
+ * \param len The length of the buffer
+ * \return The sum in host byte order
+ */
+uint16_t uip_arch_chksum_sum(uint16_t sum, const uint8_t *data, uint16_t len);
+
 /**
  * Calculate the IP header checksum of the packet header in uip_buf.
  *
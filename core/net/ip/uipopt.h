@@ -175,6 +175,22 @@
 #define UIP_BUFSIZE (UIP_CONF_BUFFER_SIZE)
 #endif /* UIP_CONF_BUFFER_SIZE */
 
+/**
+ * The number of uIP packet buffers.
+ *
+ * With more than one buffer, uip_buf is the current buffer of a pool and
+ * a packet that must be kept is handed over along with its buffer instead
+ * of being copied (see uip-bufpool.h). Each buffer takes UIP_BUFSIZE
+ * bytes. One buffer, the default, suits the smallest targets.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_BUFPOOL_SIZE
+#define UIP_BUFPOOL_SIZE (UIP_CONF_BUFPOOL_SIZE)
+#else /* UIP_CONF_BUFPOOL_SIZE */
+#define UIP_BUFPOOL_SIZE 1
+#endif /* UIP_CONF_BUFPOOL_SIZE */
+
 
 /**
  * Determines if statistics support should be compiled in.
@@ -288,7 +304,9 @@ void uip_log(char *msg);
 #endif
 
 #ifndef UIP_CONF_IPV6_QUEUE_PKT
-/** Do we do per %neighbor queuing during address resolution (default: no) */
+/** Do we do per %neighbor queuing during address resolution (default: no).
+    The queues are sized by UIP_PACKETQUEUE_CONF_NUM and
+    UIP_PACKETQUEUE_CONF_PER_HANDLE, see uip-packetqueue.h */
 #define UIP_CONF_IPV6_QUEUE_PKT       0
 #endif
 
@@ -421,6 +439,29 @@ void uip_log(char *msg);
 #define UIP_CONNS (UIP_CONF_MAX_CONNECTIONS)
 #endif /* UIP_CONF_MAX_CONNECTIONS */
 
+/**
+ * The number of buckets of the hash table that finds the connection
+ * of an incoming TCP segment.
+ *
+ * The connections are hashed by their ports and remote address, and
+ * the listening ports are kept in uip_listenports at a position
+ * derived from the port, so that an incoming segment does not scan
+ * every connection and listening port. Each bucket takes a pointer, and
+ * each connection one more.
+ *
+ * Zero makes the IPv6 stack scan the tables as the IPv4 stack
+ * does. The default is one bucket per connection with IPv6.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_TCP_CONN_HASH_SIZE
+#define UIP_TCP_CONN_HASH_SIZE (UIP_CONF_TCP_CONN_HASH_SIZE)
+#elif NETSTACK_CONF_WITH_IPV6
+#define UIP_TCP_CONN_HASH_SIZE UIP_CONNS
+#else /* UIP_CONF_TCP_CONN_HASH_SIZE */
+#define UIP_TCP_CONN_HASH_SIZE 0
+#endif /* UIP_CONF_TCP_CONN_HASH_SIZE */
+
 
 /**
  * The maximum number of simultaneously listening TCP ports.
@@ -500,6 +541,31 @@ void uip_log(char *msg);
 #define UIP_RECEIVE_WINDOW (UIP_CONF_RECEIVE_WINDOW)
 #endif
 
+/**
+ * The size of the send buffer of each TCP connection.
+ *
+ * With a send buffer, uIP keeps the data sent by the application until
+ * the remote host has acknowledged it, and has as many segments in
+ * flight as the window of the remote host allows instead of a single
+ * one. Lost segments are retransmitted from the buffer, after a
+ * time-out or three duplicate acknowledgements, and the application is
+ * never asked to retransmit. Data is acknowledged to the application
+ * (uip_acked()) as soon as it is in the buffer, and uip_mss() is
+ * limited to the free space of the buffer.
+ *
+ * Every connection takes UIP_TCP_SNDBUF_SIZE bytes more memory. Zero,
+ * the default, leaves out the send buffer, and uIP has at most one
+ * segment in flight per connection. Only the IPv6 stack supports the
+ * send buffer.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_TCP_SNDBUF_SIZE
+#define UIP_TCP_SNDBUF_SIZE (UIP_CONF_TCP_SNDBUF_SIZE)
+#else
+#define UIP_TCP_SNDBUF_SIZE 0
+#endif
+
 /**
  * How long a connection should stay in the TIME_WAIT state.
  *
@@ -570,6 +636,19 @@ void uip_log(char *msg);
 #define SICSLOWPAN_REASS_MAXAGE 20
 #endif
 
+/**
+ * Number of datagrams that can be reassembled concurrently at the 6lowpan
+ * layer. Each one takes a buffer of UIP_BUFSIZE bytes, from the uIP buffer
+ * pool if there is one (see UIP_BUFPOOL_SIZE). When all of them are
+ * in use, the first fragment of a new datagram replaces the oldest one.
+ * The default of 1 takes no more RAM than a single reassembly buffer.
+ */
+#ifdef SICSLOWPAN_CONF_REASS_CONTEXTS
+#define SICSLOWPAN_REASS_CONTEXTS (SICSLOWPAN_CONF_REASS_CONTEXTS)
+#else
+#define SICSLOWPAN_REASS_CONTEXTS 1
+#endif
+
 /**
  * Do we compress the IP header or not (default: no)
  */
@@ -47,6 +47,7 @@
 #include "sad.h"
 #include "spd.h"
 #include "common_ipsec.h"
+#include "ipsec_stats.h"
 
 /**
   * Filters incoming traffic in accordance with RFC 4301, section 5.2.
@@ -77,12 +78,14 @@ uint8_t ipsec_filter(sad_entry_t *sad_entry, ipsec_addr_t *addr)
     PRINTF("ADDR:\n");
     PRINTADDR(addr);
     if (ipsec_a_is_member_of_b(addr, &sad_entry->traffic_desc)) {
-      // FIX: Update SA statistics    
+      IPSEC_STATS_SA_PACKET(sad_entry, uip_len - UIP_IPH_LEN);
       return 0;
     }
       
     // Drop the packet
     PRINTF(IPSEC "Dropping incoming packet because the SAD entry's (referenced by the packet's SPI) selector didn't match the address of the packet\n");
+    IPSEC_STATS_SA_INC(sad_entry, policy_drops);
+    IPSEC_STATS_DROP(IPSEC_DROP_SELECTOR);
   }
   else {
     /*
@@ -110,6 +113,7 @@ uint8_t ipsec_filter(sad_entry_t *sad_entry, ipsec_addr_t *addr)
       case SPD_ACTION_DISCARD:
       PRINTF(IPSEC "Dropping unprotected incoming packet (policy DISCARD)\n");
     }
+    IPSEC_STATS_DROP(IPSEC_DROP_UNPROTECTED);
   }
       #define PRINTF
     #define PRINT6ADDR
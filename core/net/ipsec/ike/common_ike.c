@@ -55,6 +55,7 @@
 #include "spd_conf.h"
 #include "common_ike.h"
 #include "auth.h"
+#include "sad_store.h"
 #include "uip.h"
 
 
@@ -295,6 +296,33 @@ transition_return_t ike_statem_send_sa_init_msg(ike_statem_session_t *session, p
 }
 
 
+/**
+  * Computes AUTH over the *SignedOctets in auth_data. IKE SAs that have been resumed are authenticated
+  * using SK_pi / SK_pr (RFC 5723, section 5.1), all others using the pre-shared key.
+  *
+  * \param myauth Compute our AUTH if set to one, the peer's AUTH if set to zero.
+  */
+static void ike_statem_auth(ike_statem_session_t *session, uint8_t myauth, prf_data_t *auth_data)
+{
+#if WITH_IPSEC_IKE_RESUME
+  if (IKE_STATEM_IS_RESUMED(session)) {
+    /**
+      * AUTH = prf(SK_px, <*SignedOctets>)
+      */
+    auth_data->key = myauth ? IKE_STATEM_GET_MY_SK_P(session) : IKE_STATEM_GET_PEER_SK_P(session);
+    auth_data->keylen = SA_PRF_PREFERRED_KEYMATLEN(session);
+    prf(session->sa.prf, auth_data);
+    return;
+  }
+#endif
+
+  /**
+    * AUTH = prf( prf(Shared Secret, "Key Pad for IKEv2"), <*SignedOctets>)
+    */
+  auth_psk(session->sa.prf, auth_data);
+}
+
+
 state_return_t ike_statem_parse_auth_msg(ike_statem_session_t *session)
 {
   ike_payload_ike_hdr_t *ike_hdr = (ike_payload_ike_hdr_t *) msg_buf;  
@@ -302,6 +330,10 @@ state_return_t ike_statem_parse_auth_msg(ike_statem_session_t *session)
   uint8_t id_datalen;
   ike_payload_auth_t *auth_payload = NULL;
   uint8_t transport_mode_not_accepted = 1;
+#if WITH_IPSEC_IKE_RESUME
+  uint8_t *lt_opaque = NULL;
+  uint16_t lt_opaque_len = 0;
+#endif
   
   // Traffic selector
   ike_ts_t *tsi = NULL, *tsr = NULL;
@@ -341,6 +373,14 @@ state_return_t ike_statem_parse_auth_msg(ike_statem_session_t *session)
         ike_payload_notify_t *notify = (ike_payload_notify_t *) payload_start;
         if (uip_ntohs(notify->notify_msg_type) == IKE_PAYLOAD_NOTIFY_USE_TRANSPORT_MODE)
           transport_mode_not_accepted = 0;
+#if WITH_IPSEC_IKE_RESUME
+        if (uip_ntohs(notify->notify_msg_type) == IKE_PAYLOAD_NOTIFY_TICKET_REQUEST && !IKE_STATEM_IS_INITIATOR(session))
+          session->ephemeral_info->resume_flags |= IKE_RESUME_FLAG_TICKET_REQUESTED;
+        if (uip_ntohs(notify->notify_msg_type) == IKE_PAYLOAD_NOTIFY_TICKET_LT_OPAQUE && IKE_STATEM_IS_INITIATOR(session)) {
+          lt_opaque = (uint8_t *) notify + sizeof(ike_payload_notify_t) + notify->spi_size;
+          lt_opaque_len = ((uint8_t *) genpayloadhdr + uip_ntohs(genpayloadhdr->len)) - lt_opaque;
+        }
+#endif
         if (ike_statem_handle_notify(notify))
           goto fail;
       }
@@ -442,15 +482,12 @@ state_return_t ike_statem_parse_auth_msg(ike_statem_session_t *session)
     uint16_t responder_signed_octets_len = ike_statem_get_authdata(session, 0 /* Peer's signed octets */, responder_signed_octets, id_data, id_datalen);
     uint8_t mac[SA_PRF_OUTPUT_LEN(session)];
     
-    /**
-      * AUTH = prf( prf(Shared Secret, "Key Pad for IKEv2"), <InitiatorSignedOctets>)
-      */
     prf_data_t auth_data = {
       .out = mac,
       .data = responder_signed_octets,
       .datalen = responder_signed_octets_len
     };  
-    auth_psk(session->sa.prf, &auth_data);
+    ike_statem_auth(session, 0, &auth_data);
 
     if (memcmp(mac, ((uint8_t *) auth_payload) + sizeof(ike_payload_auth_t), sizeof(mac))) {
       PRINTF(IPSEC_IKE_ERROR "AUTH data mismatch\n");
@@ -459,6 +496,14 @@ state_return_t ike_statem_parse_auth_msg(ike_statem_session_t *session)
     }
     PRINTF(IPSEC_IKE "Peer successfully authenticated\n");
   }
+
+#if WITH_IPSEC_IKE_RESUME
+  // The tickets that we issue are bound to the peer's identity
+  if (!IKE_STATEM_IS_INITIATOR(session) && !ike_resume_bind_peer_id(session, (uint8_t *) id_data, id_datalen)) {
+    fail_notify_type = IKE_PAYLOAD_NOTIFY_AUTHENTICATION_FAILED;
+    goto fail;
+  }
+#endif
   
   
   /**
@@ -549,6 +594,17 @@ state_return_t ike_statem_parse_auth_msg(ike_statem_session_t *session)
   PRINTF("===== Registered incoming Child SA =====\n");
   PRINTSADENTRY(incoming_sad_entry);
   PRINTF("========================================\n");
+
+#if WITH_IPSEC_IKE_RESUME
+  // Keep the ticket (if any) for resuming this IKE SA in the future
+  if (lt_opaque != NULL)
+    ike_resume_store_ticket(session, lt_opaque, lt_opaque_len);
+#endif
+
+#if WITH_IPSEC_SAD_STORE
+  // Checkpoint the new SAs (and the IKE SA, which will have been established by then)
+  sad_store_schedule();
+#endif
   
   return STATE_SUCCESS;
   
@@ -592,15 +648,12 @@ transition_return_t ike_statem_send_auth_msg(ike_statem_session_t *session, payl
   uint8_t *signed_octets = payload_arg->start + SA_PRF_MAX_OUTPUT_LEN;
   uint16_t signed_octets_len = ike_statem_get_authdata(session, 1, signed_octets, id_payload, uip_ntohs(id_genpayloadhdr->len) - sizeof(ike_payload_generic_hdr_t));
   
-  /**
-    * AUTH = prf( prf(Shared Secret, "Key Pad for IKEv2"), <InitiatorSignedOctets>)
-    */
   prf_data_t auth_data = {
     .out = payload_arg->start,
     .data = signed_octets,
     .datalen = signed_octets_len
   };
-  auth_psk(session->sa.prf, &auth_data);
+  ike_statem_auth(session, 1, &auth_data);
   payload_arg->start += SA_PRF_OUTPUT_LEN(session);
   auth_genpayloadhdr->len = uip_htons(payload_arg->start - (uint8_t *) auth_genpayloadhdr); // Length of the AUTH payload
 
@@ -609,6 +662,21 @@ transition_return_t ike_statem_send_auth_msg(ike_statem_session_t *session, payl
     */
   ike_statem_write_notification(payload_arg, SA_PROTO_IKE, 0, IKE_PAYLOAD_NOTIFY_USE_TRANSPORT_MODE, NULL, 0);
 
+#if WITH_IPSEC_IKE_RESUME
+  /**
+    * Session resumption (RFC 5723, section 4.3.1): The initiator asks for a ticket,
+    * the responder hands one out if asked to.
+    */
+  if (IKE_STATEM_IS_INITIATOR(session))
+    ike_statem_write_notification(payload_arg, SA_PROTO_IKE, 0, IKE_PAYLOAD_NOTIFY_TICKET_REQUEST, NULL, 0);
+  else if (session->ephemeral_info->resume_flags & IKE_RESUME_FLAG_TICKET_REQUESTED) {
+    uint8_t lt_opaque[sizeof(uint32_t) + IKE_RESUME_TICKET_MAXLEN];
+    uint8_t lt_opaque_len = ike_resume_write_ticket(session, lt_opaque);
+    if (lt_opaque_len > 0)
+      ike_statem_write_notification(payload_arg, SA_PROTO_IKE, 0, IKE_PAYLOAD_NOTIFY_TICKET_LT_OPAQUE, lt_opaque, lt_opaque_len);
+  }
+#endif
+
   /**
     * Write SAi2 (offer for the child SA)
     */
@@ -806,6 +874,126 @@ state_return_t ike_statem_parse_sa_init_msg(ike_statem_session_t *session, ike_p
 }
 
 
+#if WITH_IPSEC_IKE_RESUME
+/**
+  * Completes a transition that requests or responds to an IKE_SESSION_RESUME exchange (RFC 5723, section 4.3.2):
+  *
+  *   Initiator:  HDR, [N(COOKIE),] Ni, N(TICKET_OPAQUE)
+  *   Responder:  HDR, Nr
+  */
+transition_return_t ike_statem_send_resume_msg(ike_statem_session_t *session, payload_arg_t *payload_arg)
+{
+  // Start nonce payload
+  ike_payload_generic_hdr_t *ninr_genpayloadhdr;
+  SET_GENPAYLOADHDR(ninr_genpayloadhdr, payload_arg, IKE_PAYLOAD_NiNr);
+
+  // Write nonce
+  random_ike(payload_arg->start, IKE_PAYLOAD_MYNONCE_LEN, session->ephemeral_info->my_nonce_seed);
+  MEMPRINTF("My nonce", payload_arg->start, IKE_PAYLOAD_MYNONCE_LEN);
+  payload_arg->start += IKE_PAYLOAD_MYNONCE_LEN;
+  ninr_genpayloadhdr->len = uip_htons(payload_arg->start - (uint8_t *) ninr_genpayloadhdr);
+  // End nonce payload
+
+  if (IKE_STATEM_IS_INITIATOR(session))
+    ike_statem_write_notification(payload_arg, SA_PROTO_IKE, 0, IKE_PAYLOAD_NOTIFY_TICKET_OPAQUE, session->ephemeral_info->ticket, session->ephemeral_info->ticket_len);
+
+  // Wrap up the IKE header and exit state
+  ((ike_payload_ike_hdr_t *) msg_buf)->len = uip_htonl(payload_arg->start - msg_buf);
+  SET_NO_NEXT_PAYLOAD(payload_arg);
+
+  return payload_arg->start - msg_buf;
+}
+
+
+/**
+  * Parse an IKE_SESSION_RESUME message. As responder, the IKE SA is recovered from the initiator's ticket.
+  * Keying material for the new IKE SA is generated upon success.
+  *
+  * \return 1 upon success, 0 if the exchange failed (e.g. the ticket was rejected)
+  */
+state_return_t ike_statem_parse_resume_msg(ike_statem_session_t *session, ike_payload_ike_hdr_t *ike_hdr)
+{
+  // Store a copy of this first message from the peer for later use
+  // in the autentication calculations.
+  COPY_FIRST_MSG(session, ike_hdr);
+
+  uint8_t *ticket = NULL;
+  uint16_t ticket_len = 0;
+  uint8_t got_nonce = 0;
+  uint8_t *ptr = msg_buf + sizeof(ike_payload_ike_hdr_t);
+  uint8_t *end = msg_buf + uip_datalen();
+  ike_payload_type_t payload_type = ike_hdr->next_payload;
+  while (ptr < end) { // Payload loop
+    const ike_payload_generic_hdr_t *genpayloadhdr = (const ike_payload_generic_hdr_t *) ptr;
+    const uint8_t *payload_start = (uint8_t *) genpayloadhdr + sizeof(ike_payload_generic_hdr_t);
+    const uint8_t *payload_end = (uint8_t *) genpayloadhdr + uip_ntohs(genpayloadhdr->len);
+
+    switch (payload_type) {
+      case IKE_PAYLOAD_NiNr:
+      session->ephemeral_info->peernonce_len = payload_end - payload_start;
+      memcpy(&session->ephemeral_info->peernonce, payload_start, session->ephemeral_info->peernonce_len);
+      PRINTF(IPSEC_IKE "Parsed %u B long nonce from the peer\n", session->ephemeral_info->peernonce_len);
+      got_nonce = 1;
+      break;
+
+      case IKE_PAYLOAD_N:
+      {
+        ike_payload_notify_t *notify = (ike_payload_notify_t *) payload_start;
+        switch (uip_ntohs(notify->notify_msg_type)) {
+          case IKE_PAYLOAD_NOTIFY_TICKET_OPAQUE:
+          ticket = (uint8_t *) notify + sizeof(ike_payload_notify_t) + notify->spi_size;
+          ticket_len = payload_end - ticket;
+          break;
+
+          case IKE_PAYLOAD_NOTIFY_TICKET_NACK:
+          PRINTF(IPSEC_IKE "Peer rejected our ticket\n");
+          return 0;
+
+          default:
+          if (ike_statem_handle_notify(notify))
+            return 0;
+        }
+      }
+      break;
+
+      default:
+      if (genpayloadhdr->clear) {
+        PRINTF(IPSEC_IKE_ERROR "Encountered an unknown critical payload\n");
+        return 0;
+      }
+      else
+        PRINTF(IPSEC_IKE "Ignoring unknown non-critical payload of type %u\n", payload_type);
+    }
+
+    ptr = (uint8_t *) payload_end;
+    payload_type = genpayloadhdr->next_payload;
+  } // End payload loop
+
+  if (payload_type != IKE_PAYLOAD_NO_NEXT || !got_nonce) {
+    PRINTF(IPSEC_IKE_ERROR "Could not parse peer message.\n");
+    return 0;
+  }
+
+  if (!IKE_STATEM_IS_INITIATOR(session)) {
+    if (ticket == NULL || !ike_resume_open_ticket(session, ticket, ticket_len)) {
+      PRINTF(IPSEC_IKE_ERROR "Peer's ticket is missing or invalid\n");
+      ike_statem_send_single_notify(session, IKE_PAYLOAD_NOTIFY_TICKET_NACK);
+      return 0;
+    }
+    session->ephemeral_info->resume_flags |= IKE_RESUME_FLAG_RESUMED;
+  }
+  PRINTF(IPSEC_IKE "Resuming IKE SA\n");
+
+  ike_statem_get_resumed_ike_keymat(session);
+
+  // Set our child SPI. To be used during the AUTH exchange.
+  session->ephemeral_info->my_child_spi = SAD_GET_NEXT_SAD_LOCAL_SPI;
+
+  return 1;
+}
+#endif
+
+
 /**
   * Take the offer and write the corresponding SA payload to memory starting at payload_arg->start.
   * Handles IKE SA- as well as Child SA-offers.
@@ -1153,6 +1341,16 @@ uint32_t rerun_init_msg(uint8_t *out, uint8_t initreq, ike_statem_session_t *ses
   // Buffers
   uint8_t *msg_buf_save = msg_buf;  // ike_statem_trans_initreq() writes to the address of msg_buf
   msg_buf = out;
+#if WITH_IPSEC_IKE_RESUME
+  if (IKE_STATEM_IS_RESUMED(session)) {
+    // Our first message was part of the IKE_SESSION_RESUME exchange
+    if (initreq)
+      ike_statem_trans_resumereq(session);
+    else
+      ike_statem_trans_resumeresp(session);
+  }
+  else
+#endif
   if (initreq)
     ike_statem_trans_initreq(session);  // Re-write our first message to assembly_start  
   else
@@ -1676,107 +1874,63 @@ uint8_t ike_statem_handle_notify(ike_payload_notify_t *notify_payload)
 }
 
 /**
-  * Performs the calculations as described in section 2.14
-  *
-    SKEYSEED = prf(Ni | Nr, g^ir)
-
-    {SK_d | SK_ai | SK_ar | SK_ei | SK_er | SK_pi | SK_pr }
-                    = prf+ (SKEYSEED, Ni | Nr | SPIi | SPIr )
+  * Writes Ni | Nr to out
   *
-  * \parameter session The session concerned
-  * \parameter peer_pub_key Address of the beginning of the field "Key Exchange Data" in the peer's KE payload (network byte order).
-  * \return The address that follows the last byte of the nonce
+  * \return The number of bytes written
   */
-void ike_statem_get_ike_keymat(ike_statem_session_t *session, uint8_t *peer_pub_key)
+static uint8_t ike_statem_write_ninr(ike_statem_session_t *session, uint8_t *out)
 {
-  // Calculate the DH exponential: g^ir
-  PRINTF(IPSEC_IKE "Calculating shared ECC Diffie Hellman secret\n");
-  uint8_t gir[IKE_DH_SCALAR_LEN];
-  ecdh_get_shared_secret(gir, peer_pub_key, session->ephemeral_info->my_prv_key);
-  MEMPRINTF("Shared ECC Diffie Hellman secret (g^ir)", gir, IKE_DH_SCALAR_LEN);
-
-  /**
-    * The order of the strings will depend on who's the initiator. Prepare that.
-    */
-  uint8_t first_keylen = IKE_PAYLOAD_MYNONCE_LEN + session->ephemeral_info->peernonce_len;
-  uint8_t first_key[first_keylen];
-
-  uint8_t second_msg[IKE_PAYLOAD_MYNONCE_LEN +   // Ni or Nr
-      session->ephemeral_info->peernonce_len +    // Ni or Nr 
-      2 * 8   // 2 * SPI
-      ];
-  
   uint8_t *mynonce_start, *peernonce_start;
-  uint8_t *ni_start, *nr_start, *spii_start, *spir_start;  
   if (IKE_STATEM_IS_INITIATOR(session)) {
-    mynonce_start = first_key;
+    mynonce_start = out;
     peernonce_start = mynonce_start + IKE_PAYLOAD_MYNONCE_LEN;
-    
-    ni_start = second_msg;
-    nr_start = ni_start + IKE_PAYLOAD_MYNONCE_LEN;
-    spii_start = nr_start + session->ephemeral_info->peernonce_len;
-    spir_start = spii_start + 8;
   }
   else {
-
-    peernonce_start = first_key;
+    peernonce_start = out;
     mynonce_start = peernonce_start + session->ephemeral_info->peernonce_len;
-    
-    nr_start = second_msg;
-    ni_start = nr_start + session->ephemeral_info->peernonce_len;
-    spir_start = ni_start + IKE_PAYLOAD_MYNONCE_LEN;
-    spii_start = spir_start + 8;
-  }  
-  
-  /**
-    * Run the first PRF operation
-    
-      SKEYSEED = prf(Ni | Nr, g^ir)
-    *
-    */
+  }
   random_ike(mynonce_start, IKE_PAYLOAD_MYNONCE_LEN, session->ephemeral_info->my_nonce_seed);
   memcpy(peernonce_start, session->ephemeral_info->peernonce, session->ephemeral_info->peernonce_len);
-  PRINTF("first_keylen: %u peernonce_len: %u\n", first_keylen, session->ephemeral_info->peernonce_len);
 
-  MEMPRINTF("Ni | Nr", first_key, first_keylen);
-  
-  MEMPRINTF("Shared DH secret (g^ir)", gir, IKE_DH_SCALAR_LEN);
+  return IKE_PAYLOAD_MYNONCE_LEN + session->ephemeral_info->peernonce_len;
+}
 
-  uint8_t skeyseed[SA_PRF_OUTPUT_LEN(session)];
 
-  prf_data_t prf_data =
-    {
-      .out = skeyseed,
-      .key = first_key,
-      .keylen = first_keylen,
-      .data = gir,
-      .datalen = IKE_DH_SCALAR_LEN
-    };
-  prf(session->sa.prf, &prf_data);
-
-  MEMPRINTF("SKEYSEED", skeyseed, 20);
-  
+/**
+  * Completes the calculations of section 2.14 once SKEYSEED is known:
+  *
+    {SK_d | SK_ai | SK_ar | SK_ei | SK_er | SK_pi | SK_pr }
+                    = prf+ (SKEYSEED, Ni | Nr | SPIi | SPIr )
+  *
+  * \parameter session The session concerned
+  * \parameter skeyseed SKEYSEED. Its length is that of the negotiated PRF's output.
+  */
+static void ike_statem_get_ike_keymat_from_skeyseed(ike_statem_session_t *session, uint8_t *skeyseed)
+{
   /**
-    * Complete the next step:
-    * 
-      {SK_d | SK_ai | SK_ar | SK_ei | SK_er | SK_pi | SK_pr }
-                  = prf+ (SKEYSEED, Ni | Nr | SPIi | SPIr )
+    * Compile the message (Ni | Nr | SPIi | SPIr)
     */
+  uint8_t second_msg[IKE_PAYLOAD_MYNONCE_LEN +   // Ni or Nr
+      session->ephemeral_info->peernonce_len +    // Ni or Nr 
+      2 * 8   // 2 * SPI
+      ];
+  uint8_t *spii_start = second_msg + ike_statem_write_ninr(session, second_msg);
+  uint8_t *spir_start = spii_start + 8;
+  uint8_t *myspi_start, *peerspi_start;
 
-  /**
-    * Compile the second message (Ni | Nr | SPIi | SPIr)
-    */
-  random_ike(ni_start, IKE_PAYLOAD_MYNONCE_LEN, session->ephemeral_info->my_nonce_seed);      
-  memcpy(nr_start, session->ephemeral_info->peernonce, session->ephemeral_info->peernonce_len);
-  *((uint32_t *) spii_start) = IKE_STATEM_MYSPI_GET_MYSPI_HIGH(session);
-  *(((uint32_t *) spii_start) + 1) = IKE_STATEM_MYSPI_GET_MYSPI_LOW(session);
-  *((uint32_t *) spir_start) = session->peer_spi_high;
-  *(((uint32_t *) spir_start) + 1) = session->peer_spi_low;
+  if (IKE_STATEM_IS_INITIATOR(session)) {
+    myspi_start = spii_start;
+    peerspi_start = spir_start;
+  }
+  else {
+    myspi_start = spir_start;
+    peerspi_start = spii_start;
+  }
+  *((uint32_t *) myspi_start) = IKE_STATEM_MYSPI_GET_MYSPI_HIGH(session);
+  *(((uint32_t *) myspi_start) + 1) = IKE_STATEM_MYSPI_GET_MYSPI_LOW(session);
+  *((uint32_t *) peerspi_start) = session->peer_spi_high;
+  *(((uint32_t *) peerspi_start) + 1) = session->peer_spi_low;
 
-  /**
-    * Run the second, and last, PRF operation
-    */
-        
   // Set up the arguments
   sa_ike_t *sa = &session->sa;
 
@@ -1800,7 +1954,7 @@ void ike_statem_get_ike_keymat(ike_statem_session_t *session, uint8_t *peer_pub_
   prfplus_data_t prfplus_data = {
     .prf = sa->prf,
     .key = skeyseed,
-    .keylen = sizeof(skeyseed),
+    .keylen = SA_PRF_OUTPUT_LEN(session),
     .no_chunks = sizeof(sk_len),
     .data = second_msg,
     .datalen = sizeof(second_msg),
@@ -1817,6 +1971,91 @@ void ike_statem_get_ike_keymat(ike_statem_session_t *session, uint8_t *peer_pub_
 }
 
 
+/**
+  * Performs the calculations as described in section 2.14
+  *
+    SKEYSEED = prf(Ni | Nr, g^ir)
+
+    {SK_d | SK_ai | SK_ar | SK_ei | SK_er | SK_pi | SK_pr }
+                    = prf+ (SKEYSEED, Ni | Nr | SPIi | SPIr )
+  *
+  * \parameter session The session concerned
+  * \parameter peer_pub_key Address of the beginning of the field "Key Exchange Data" in the peer's KE payload (network byte order).
+  */
+void ike_statem_get_ike_keymat(ike_statem_session_t *session, uint8_t *peer_pub_key)
+{
+  // Calculate the DH exponential: g^ir
+  PRINTF(IPSEC_IKE "Calculating shared ECC Diffie Hellman secret\n");
+  uint8_t gir[IKE_DH_SCALAR_LEN];
+  ecdh_get_shared_secret(gir, peer_pub_key, session->ephemeral_info->my_prv_key);
+  MEMPRINTF("Shared ECC Diffie Hellman secret (g^ir)", gir, IKE_DH_SCALAR_LEN);
+
+  /**
+    * Run the first PRF operation
+    
+      SKEYSEED = prf(Ni | Nr, g^ir)
+    *
+    */
+  uint8_t first_keylen = IKE_PAYLOAD_MYNONCE_LEN + session->ephemeral_info->peernonce_len;
+  uint8_t first_key[first_keylen];
+  ike_statem_write_ninr(session, first_key);
+  PRINTF("first_keylen: %u peernonce_len: %u\n", first_keylen, session->ephemeral_info->peernonce_len);
+
+  MEMPRINTF("Ni | Nr", first_key, first_keylen);
+
+  uint8_t skeyseed[SA_PRF_OUTPUT_LEN(session)];
+
+  prf_data_t prf_data =
+    {
+      .out = skeyseed,
+      .key = first_key,
+      .keylen = first_keylen,
+      .data = gir,
+      .datalen = IKE_DH_SCALAR_LEN
+    };
+  prf(session->sa.prf, &prf_data);
+
+  MEMPRINTF("SKEYSEED", skeyseed, 20);
+  
+  ike_statem_get_ike_keymat_from_skeyseed(session, skeyseed);
+}
+
+
+#if WITH_IPSEC_IKE_RESUME
+/**
+  * Generates the keying material of a resumed IKE SA (RFC 5723, section 5.1). session->sa must
+  * hold the algorithms and SK_d of the old IKE SA.
+  *
+    SKEYSEED = prf(SK_d (old), "Resumption" | Ni | Nr)
+  *
+  * The remaining keys are derived as in section 2.14 of RFC 5996.
+  */
+void ike_statem_get_resumed_ike_keymat(ike_statem_session_t *session)
+{
+  static const char label[] = "Resumption";
+  uint8_t data[sizeof(label) - 1 + IKE_PAYLOAD_MYNONCE_LEN + session->ephemeral_info->peernonce_len];
+  uint8_t skeyseed[SA_PRF_OUTPUT_LEN(session)];
+
+  memcpy(data, label, sizeof(label) - 1);
+  ike_statem_write_ninr(session, data + sizeof(label) - 1);
+
+  prf_data_t prf_data =
+    {
+      .out = skeyseed,
+      .key = session->sa.sk_d,
+      .keylen = SA_PRF_PREFERRED_KEYMATLEN(session),
+      .data = data,
+      .datalen = sizeof(data)
+    };
+  prf(session->sa.prf, &prf_data);
+
+  MEMPRINTF("SKEYSEED (resumption)", skeyseed, SA_PRF_OUTPUT_LEN(session));
+
+  ike_statem_get_ike_keymat_from_skeyseed(session, skeyseed);
+}
+#endif
+
+
 /**
   * Get Child SA keying material as outlined in section 2.17
   *
@@ -60,12 +60,16 @@ extern state_return_t ike_statem_state_parse_initreq(ike_statem_session_t *sessi
 extern transition_return_t ike_statem_trans_initresp(ike_statem_session_t *session);
 extern state_return_t ike_statem_state_parse_authreq(ike_statem_session_t *session);
 extern transition_return_t ike_statem_trans_authresp(ike_statem_session_t *session);
+extern state_return_t ike_statem_state_parse_resumereq(ike_statem_session_t *session);
+extern transition_return_t ike_statem_trans_resumeresp(ike_statem_session_t *session);
 
 /**
   * References states of the initiator machine
   */
 extern uint16_t ike_statem_trans_initreq(ike_statem_session_t *session);
 extern uint8_t ike_statem_state_initrespwait(ike_statem_session_t *session);
+extern transition_return_t ike_statem_trans_resumereq(ike_statem_session_t *session);
+extern state_return_t ike_statem_state_resumerespwait(ike_statem_session_t *session);
 
 /**
   * References states of the established machine
@@ -79,6 +83,8 @@ extern uint8_t ike_statem_state_established_handler(ike_statem_session_t *sessio
 extern transition_return_t ike_statem_send_sa_init_msg(ike_statem_session_t *session, payload_arg_t *payload_arg, ike_payload_ike_hdr_t *ike_hdr, spd_proposal_tuple_t *offer);
 extern state_return_t ike_statem_parse_auth_msg(ike_statem_session_t *session);
 extern state_return_t ike_statem_parse_sa_init_msg(ike_statem_session_t *session, ike_payload_ike_hdr_t *ike_hdr, spd_proposal_tuple_t *accepted_offer);
+extern transition_return_t ike_statem_send_resume_msg(ike_statem_session_t *session, payload_arg_t *payload_arg);
+extern state_return_t ike_statem_parse_resume_msg(ike_statem_session_t *session, ike_payload_ike_hdr_t *ike_hdr);
 
 /**
   * Helper functions that parses and writes payloads, generates keying material etc
@@ -92,6 +98,7 @@ extern void ike_statem_write_notification(payload_arg_t *payload_arg,
 extern void ike_statem_set_id_payload(payload_arg_t *payload_arg, ike_payload_type_t payload_type);
 extern void ike_statem_write_sa_payload(payload_arg_t *payload_arg, const spd_proposal_tuple_t *offer, uint32_t spi);
 extern void ike_statem_get_ike_keymat(ike_statem_session_t *session, uint8_t *peer_pub_key);
+extern void ike_statem_get_resumed_ike_keymat(ike_statem_session_t *session);
 extern void ike_statem_get_child_keymat(ike_statem_session_t *session, sa_child_t *incoming, sa_child_t *outgoing);
 extern transition_return_t ike_statem_run_transition(ike_statem_session_t *session, uint8_t retransmit);
 extern transition_return_t ike_statem_send_auth_msg(ike_statem_session_t *session, payload_arg_t *payload_arg, uint32_t child_sa_spi, const spd_proposal_tuple_t *sai2_offer, const ipsec_addr_set_t *ts_instance_addr_set);
@@ -106,6 +106,56 @@ uint8_t ike_statem_state_initrespwait(ike_statem_session_t *session)
 }
 
 
+#if WITH_IPSEC_IKE_RESUME
+// Transmit the IKE_SESSION_RESUME message: HDR, Ni, N(TICKET_OPAQUE)
+transition_return_t ike_statem_trans_resumereq(ike_statem_session_t *session)
+{
+  payload_arg_t payload_arg = {
+    .start = msg_buf,
+    .session = session
+  };
+
+  SET_IKE_HDR_AS_INITIATOR(&payload_arg, IKE_PAYLOADFIELD_IKEHDR_EXCHTYPE_SESSION_RESUME, IKE_PAYLOADFIELD_IKEHDR_FLAGS_REQUEST);
+
+  return ike_statem_send_resume_msg(session, &payload_arg);
+}
+
+
+/**
+  * 
+  * RESUMERESPWAIT --- (AUTHREQ) ---> AUTHRESPWAIT
+  *
+  * If the responder doesn't accept our ticket we forget about it and start over with IKE_SA_INIT.
+  */
+state_return_t ike_statem_state_resumerespwait(ike_statem_session_t *session)
+{
+  // <--  HDR, Nr
+
+  ike_payload_ike_hdr_t *ike_hdr = (ike_payload_ike_hdr_t *) msg_buf;
+
+  // Store the peer's SPI (in network byte order)
+  session->peer_spi_high = ike_hdr->sa_responder_spi_high;
+  session->peer_spi_low = ike_hdr->sa_responder_spi_low;
+
+  if (ike_statem_parse_resume_msg(session, ike_hdr) == 0) {
+    ipsec_addr_t triggering_pkt_addr = { .peer_addr = &session->peer };
+
+    PRINTF(IPSEC_IKE "Session resumption failed. Falling back to IKE_SA_INIT.\n");
+    ike_resume_remove_ticket(&session->peer);
+    ike_statem_setup_initiator_session(&triggering_pkt_addr, session->ephemeral_info->spd_entry);
+    return STATE_FAILURE;
+  }
+
+  session->transition_fn = &ike_statem_trans_authreq;
+  session->next_state_fn = &ike_statem_state_authrespwait;
+
+  IKE_STATEM_TRANSITION(session);
+
+  return STATE_SUCCESS;
+}
+#endif
+
+
 // Transmit the IKE_AUTH message:
 //    HDR, SK {IDi, [CERT,] [CERTREQ,]
 //      [IDr,] AUTH, SAi2, TSi, TSr}
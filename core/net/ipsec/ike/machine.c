@@ -67,6 +67,7 @@
 #include "sys/ctimer.h"
 #include "uip.h"
 #include "string.h"
+#include "sad_store.h"
 
 /**
   * IKEv2's behaviour is implemented as a mealy machine. These are its states:
@@ -82,7 +83,7 @@
   */
 
 #define SET_RETRANSTIMER(session) \
-  ctimer_set(&session->retrans_timer, IKE_STATEM_TIMEOUT, &ike_statem_timeout_handler, (void *) session);
+  ctimer_set(&session->retrans_timer, ike_rtt_backoff(&(session)->peer, (session)->retrans_count), &ike_statem_timeout_handler, (void *) session);
 #define STOP_RETRANSTIMER(session) ctimer_stop(&(session)->retrans_timer)
 
 #define SA_INDEX(arg) arg - 1
@@ -92,11 +93,10 @@
 LIST(sessions);
 
 // Network stuff
-static const uint8_t *udp_buf = &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN];
+#define udp_buf ((const uint8_t *)&uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN])
 uint8_t *msg_buf;
 static struct uip_udp_conn *my_conn;
-const uip_ip6addr_t *my_ip_addr = &((struct uip_ip_hdr *) &uip_buf[UIP_LLH_LEN])->destipaddr;
-const uip_ip6addr_t *peer_ip_addr = &((struct uip_ip_hdr *) &uip_buf[UIP_LLH_LEN])->srcipaddr;
+#define peer_ip_addr ((const uip_ip6addr_t *)&((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])->srcipaddr)
 
 extern uint16_t uip_slen;
 
@@ -116,12 +116,32 @@ void ike_statem_enterstate(ike_statem_session_t *session)
 {                                        	
   /* Stop retransmission timer (if any has been set) */
   PRINTF(IPSEC_IKE "Session %p is entering state %p\n", (session), (session)->next_state_fn);
+
+  /**
+    * Established sessions, including those restored from storage (see sad_store.h), have released
+    * their ephemeral info. They take part in no exchange, so the message is dropped before any
+    * handler can use it.
+    */
+  if (session->ephemeral_info == NULL) {
+    PRINTF(IPSEC_IKE "Ignoring IKE message for established session %p\n", session);
+    return;
+  }
+
 	STOP_RETRANSTIMER((session));                               
 
 	/* Were we waiting for a reply? If so, then our last message must have gone through. Increase our message ID. */
 	if (session->transition_fn != NULL) {
 		IKE_STATEM_INCRMYMSGID(session);                          
 		session->transition_fn = NULL;
+
+    /**
+      * Karn's algorithm: Only sample the RTT of requests that weren't retransmitted. As the
+      * responder, the message we sent was a response and the time until the next request
+      * includes the initiator's computation, so it is no RTT sample.
+      */
+    if (IKE_STATEM_IS_INITIATOR(session) && session->retrans_count == 0)
+      ike_rtt_update(&session->peer, clock_time() - session->transmit_time);
+    session->retrans_count = 0;
 	}
 	                                                            
   state_return_t rtvl = (*(session)->next_state_fn)(session); 
@@ -168,8 +188,11 @@ transition_return_t ike_statem_run_transition(ike_statem_session_t *session, uin
   PRINTF(IPSEC_IKE "Sending data of length %u\n", len);
   /* MEMPRINTF("SENDING", msg_buf, len); */
   ike_statem_send(session, len);
-  if (retransmit)
+  if (retransmit) {
+    if (session->retrans_count == 0)
+      session->transmit_time = clock_time();
     SET_RETRANSTIMER(session);
+  }
   return len;
 }
 
@@ -184,6 +207,10 @@ transition_return_t ike_statem_run_transition(ike_statem_session_t *session, uin
 void ike_statem_init()
 {
   list_init(sessions);
+  ike_rtt_init();
+#if WITH_IPSEC_IKE_RESUME
+  ike_resume_init();
+#endif
   srand(clock_time());
   //next_my_spi = rand16() & ~IKE_STATEM_MYSPI_I_MASK;
   
@@ -198,6 +225,10 @@ void ike_statem_init()
   msg_buf = uip_udp_buffer_dataptr(); //(uint8_t *) udp_buf;       
 
   PRINTF(IPSEC_IKE "State machine initialized. Listening on UDP port %d.\n", uip_ntohs(my_conn->lport));  
+
+#if WITH_IPSEC_SAD_STORE
+  sad_store_restore_ike();
+#endif
 }
 
 ike_statem_session_t *ike_statem_session_init()
@@ -219,6 +250,8 @@ ike_statem_session_t *ike_statem_session_init()
   IKE_STATEM_MYSPI_SET_NEXT(session->initiator_and_my_spi);
 
   session->my_msg_id = session->peer_msg_id = 0;
+  session->retrans_count = 0;
+  session->transition_fn = NULL;
 
 	PRINTF(IPSEC_IKE "Allocating memory for IKE session ephemeral info struct\n");
   // malloc() will do as this memory will soon be freed and thus won't clog up the heap for long.
@@ -231,6 +264,11 @@ ike_statem_session_t *ike_statem_session_init()
 	
   // This random seed will be used for generating our nonce
   session->ephemeral_info->my_nonce_seed = rand16();
+
+#if WITH_IPSEC_IKE_RESUME
+  session->ephemeral_info->resume_flags = 0;
+  session->ephemeral_info->ticket_len = 0;
+#endif
    
   /**
     * Generate the private key
@@ -262,6 +300,10 @@ void ike_statem_setup_responder_session()
 
   // Transition to state initrespwait
   session->next_state_fn = &ike_statem_state_parse_initreq;
+#if WITH_IPSEC_IKE_RESUME
+  if (((ike_payload_ike_hdr_t *) udp_buf)->exchange_type == IKE_PAYLOADFIELD_IKEHDR_EXCHTYPE_SESSION_RESUME)
+    session->next_state_fn = &ike_statem_state_parse_resumereq;
+#endif
   session->my_msg_id = 0;
   session->peer_msg_id = 0;
 
@@ -297,6 +339,15 @@ void ike_statem_setup_initiator_session(ipsec_addr_t *triggering_pkt_addr, spd_e
   session->my_msg_id = 0;
   session->peer_msg_id = 0;
 
+#if WITH_IPSEC_IKE_RESUME
+  // Resume the IKE SA instead if we hold a ticket for the peer
+  if (ike_resume_load_ticket(session)) {
+    session->ephemeral_info->resume_flags |= IKE_RESUME_FLAG_RESUMED;
+    session->transition_fn = &ike_statem_trans_resumereq;
+    session->next_state_fn = &ike_statem_state_resumerespwait;
+  }
+#endif
+
   IKE_STATEM_TRANSITION(session);
 }
 
@@ -314,16 +365,61 @@ void ike_statem_clean_session(ike_statem_session_t *session)
 {
 	PRINTF(IPSEC_IKE "Freeing IKE session's emphemeral information\n");
   ipsec_free(session->ephemeral_info);
+  session->ephemeral_info = NULL;
 }
 
 
 /**
   * Timeout handler for state transitions (i.e. UDP messages that go unanswered)
+  *
+  * The last transition is reissued with an exponentially increased timeout. When the
+  * retransmission limit has been reached the session is removed and its memory freed.
+  */
+void ike_statem_timeout_handler(void *arg)  // Void argument since we're called by ctimer
+{
+  ike_statem_session_t *session = (ike_statem_session_t *) arg;
+
+  if (session->retrans_count >= IKE_STATEM_MAX_RETRANSMISSIONS) {
+    PRINTF(IPSEC_IKE_ERROR "Peer didn't respond after %u retransmissions. Removing IKE session %p\n", session->retrans_count, session);
+    ike_statem_remove_session(session);
+    if (session->ephemeral_info != NULL)
+      ipsec_free(session->ephemeral_info);
+    ipsec_free(session);
+    return;
+  }
+
+  ++session->retrans_count;
+  PRINTF(IPSEC_IKE "Timeout for session %p. Reissuing last transition (retransmission %u).\n", session, session->retrans_count);
+  ike_statem_run_transition(session, 1);
+}
+
+
+/**
+  * Returns the first session of the session list. Use list_item_next() to get the next one.
   */
-void ike_statem_timeout_handler(void *session)  // Void argument since we're called by ctimer
+ike_statem_session_t *ike_statem_get_first_session(void)
 {
-  PRINTF(IPSEC_IKE "Timeout for session %p. Reissuing last transition.\n", session);
-  ike_statem_run_transition((ike_statem_session_t *) session, 1);
+  return list_head(sessions);
+}
+
+
+/**
+  * Allocates an established IKE session whose IKE SA is about to be restored from persistent
+  * storage (see sad_store.h). The caller sets the peer, the SPIs, the message IDs and the SA.
+  */
+ike_statem_session_t *ike_statem_restore_session(void)
+{
+  ike_statem_session_t *session = ipsec_malloc(sizeof(ike_statem_session_t));
+
+  if (session == NULL) {
+    PRINTF(IPSEC_IKE_ERROR "Could not allocate memory for restored IKE session\n");
+    return NULL;
+  }
+
+  memset(session, 0, sizeof(ike_statem_session_t));
+  session->next_state_fn = &ike_statem_state_established_handler;
+  list_push(sessions, session);
+  return session;
 }
 
 
@@ -405,7 +501,7 @@ void ike_statem_incoming_data_handler()//uint32_t *start, uint16_t len)
 
   ike_statem_session_t *session = NULL;
   for (session = list_head(sessions); 
-        session != NULL && !IKE_STATEM_MYSPI_GET_MYSPI(session) == my_spi; 
+        session != NULL && IKE_STATEM_MYSPI_GET_MYSPI(session) != my_spi; 
         session = list_item_next(session))
     PRINTF("SPI in list: %u\n", IKE_STATEM_MYSPI_GET_MYSPI(session));
 
@@ -67,21 +67,32 @@
 #include "ecc/ecc.h"
 #include "ecc/nn.h"
 #include "ipsec_random.h"
+#include "rtt.h"
+#include "resume.h"
 
 #define IKE_UDP_PORT 500
 
 
 /**
   * Protocol-related stuff
+  *
+  * The retransmission timeout is adaptive (see rtt.h). A request is retransmitted with
+  * exponential backoff at most IKE_STATEM_MAX_RETRANSMISSIONS times, after which the
+  * session is torn down.
   */
-#define IKE_STATEM_TIMEOUT 15 * CLOCK_SECOND
+#ifdef IKE_STATEM_CONF_MAX_RETRANSMISSIONS
+#define IKE_STATEM_MAX_RETRANSMISSIONS IKE_STATEM_CONF_MAX_RETRANSMISSIONS
+#else
+#define IKE_STATEM_MAX_RETRANSMISSIONS 5
+#endif
 
 /**
   * Global buffers used for communicating information with the state machine
   */
 extern uint8_t *msg_buf; // Pointing at the first word of the UDP datagram's data areas
 //extern uip_ip6addr_t *uip_addr6_remote; // IPv6 address of remote peer
-extern const uip_ip6addr_t *my_ip_addr;
+// Destination address of the packet in uip_buf (uip_buf may move, see uip-bufpool.h)
+#define my_ip_addr ((const uip_ip6addr_t *)&((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])->destipaddr)
 
 extern uint8_t *global;
 
@@ -197,6 +208,14 @@ typedef struct {
 
   // My private asymmetric key store in small endian ContikiECC format
   NN_DIGIT my_prv_key[IKE_DH_SCALAR_BUF_LEN];
+
+#if WITH_IPSEC_IKE_RESUME
+  // Session resumption (see resume.h). The ticket is the one that we present (initiator) or received (responder).
+  uint8_t resume_flags;
+  uint8_t ticket_len;
+  uint8_t ticket[IKE_RESUME_TICKET_MAXLEN];
+  uint8_t peer_id[IKE_RESUME_PEER_ID_LEN];      // Digest of the peer's identity (responder)
+#endif
 } ike_statem_ephemeral_info_t;
 
 
@@ -252,6 +271,12 @@ typedef struct ike_statem_session {
   // Message retransmission timer
   struct ctimer retrans_timer;
 
+  // Time of the first transmission of the outstanding message (used for RTT sampling)
+  clock_time_t transmit_time;
+
+  // Number of times that the outstanding message has been retransmitted
+  uint8_t retrans_count;
+
   // IKE SA parameters
   // Note for future functionality: We could make the SA and the whole sa_ike_t
   // of variable size (next and length info in the head, cast everything to smallest
@@ -299,6 +324,8 @@ void ike_statem_setup_initiator_session(ipsec_addr_t * triggering_pkt_addr, spd_
 void ike_statem_remove_session(ike_statem_session_t *session);
 extern void ike_statem_clean_session(ike_statem_session_t *session);
 extern void ike_statem_send(ike_statem_session_t *session, uint16_t len);
+ike_statem_session_t *ike_statem_get_first_session(void);
+ike_statem_session_t *ike_statem_restore_session(void);
 
 
 void ike_statem_init();
@@ -116,7 +116,8 @@ typedef enum {
   IKE_PAYLOADFIELD_IKEHDR_EXCHTYPE_SA_INIT = 34,
   IKE_PAYLOADFIELD_IKEHDR_EXCHTYPE_IKE_AUTH,
   IKE_PAYLOADFIELD_IKEHDR_EXCHTYPE_CREATE_CHILD_SA,
-  IKE_PAYLOADFIELD_IKEHDR_EXCHTYPE_INFORMATIONAL
+  IKE_PAYLOADFIELD_IKEHDR_EXCHTYPE_INFORMATIONAL,
+  IKE_PAYLOADFIELD_IKEHDR_EXCHTYPE_SESSION_RESUME   // RFC 5723
 } ike_payloadfield_ikehdr_exchtype_t;
 
 /**
@@ -413,7 +414,14 @@ typedef enum {
   IKE_PAYLOAD_NOTIFY_HTTP_CERT_LOOKUP_SUPPORTED = 16392,
   IKE_PAYLOAD_NOTIFY_REKEY_SA = 16393,
   IKE_PAYLOAD_NOTIFY_ESP_TFC_PADDING_NOT_SUPPORTED = 16394,
-  IKE_PAYLOAD_NOTIFY_NON_FIRST_FRAGMENTS_ALSO = 16395
+  IKE_PAYLOAD_NOTIFY_NON_FIRST_FRAGMENTS_ALSO = 16395,
+
+  // Session resumption (RFC 5723)
+  IKE_PAYLOAD_NOTIFY_TICKET_LT_OPAQUE = 16409,
+  IKE_PAYLOAD_NOTIFY_TICKET_REQUEST = 16410,
+  IKE_PAYLOAD_NOTIFY_TICKET_ACK = 16411,
+  IKE_PAYLOAD_NOTIFY_TICKET_NACK = 16412,
+  IKE_PAYLOAD_NOTIFY_TICKET_OPAQUE = 16413
 } notify_msg_type_t;
 
 #define IKE_PAYLOAD_COOKIE_MAX_LEN 64
@@ -86,6 +86,45 @@ transition_return_t ike_statem_trans_initresp(ike_statem_session_t *session)
 }
 
 
+#if WITH_IPSEC_IKE_RESUME
+/**
+  * Handles an IKE_SESSION_RESUME request, i.e. an initiator that wants to resume an IKE SA using a ticket
+  * that we've issued earlier.
+  */
+state_return_t ike_statem_state_parse_resumereq(ike_statem_session_t *session)
+{
+  ike_payload_ike_hdr_t *ike_hdr = (ike_payload_ike_hdr_t *) msg_buf;
+
+  // Store the peer's SPI (in network byte order)
+  session->peer_spi_high = ike_hdr->sa_initiator_spi_high;
+  session->peer_spi_low = ike_hdr->sa_initiator_spi_low;
+
+  if (ike_statem_parse_resume_msg(session, ike_hdr) == 0)
+    return STATE_FAILURE;
+
+  session->transition_fn = &ike_statem_trans_resumeresp;
+  session->next_state_fn = &ike_statem_state_parse_authreq;
+
+  IKE_STATEM_TRANSITION(session);
+
+  return STATE_SUCCESS;
+}
+
+
+transition_return_t ike_statem_trans_resumeresp(ike_statem_session_t *session)
+{
+  payload_arg_t payload_arg = {
+    .start = msg_buf,
+    .session = session
+  };
+
+  SET_IKE_HDR_AS_RESPONDER(&payload_arg, IKE_PAYLOADFIELD_IKEHDR_EXCHTYPE_SESSION_RESUME, IKE_PAYLOADFIELD_IKEHDR_FLAGS_RESPONSE);
+
+  return ike_statem_send_resume_msg(session, &payload_arg);
+}
+#endif
+
+
 state_return_t ike_statem_state_parse_authreq(ike_statem_session_t *session)
 {
   if (ike_statem_parse_auth_msg(session) == STATE_SUCCESS) { 
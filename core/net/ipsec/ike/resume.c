@@ -0,0 +1,536 @@
+/**
+ * \addtogroup ipsec
+ * @{
+ */
+
+/**
+ * \file
+ * 		IKEv2 session resumption (RFC 5723): ticket issuing, verification and storage
+ */
+
+#include <string.h>
+#include "cfs/cfs.h"
+#include "common_ike.h"
+#include "prf.h"
+#include "transforms/encr.h"
+#include "transforms/integ.h"
+#include "resume.h"
+
+#if WITH_IPSEC_IKE_RESUME
+
+/**
+  * The IKE SA state that is carried by (responder) or stored along with (initiator) a ticket
+  */
+typedef struct {
+  uint32_t expires;       // clock_seconds() of the issuer (network byte order when inside a ticket)
+  uint8_t encr;
+  uint8_t prf;
+  uint8_t integ;
+  uint8_t dh;
+  uint8_t encr_keylen;
+  uint8_t sk_d[SA_PRF_MAX_OUTPUT_LEN];
+  uint8_t peer_id[IKE_RESUME_PEER_ID_LEN];
+} ticket_state_t;
+
+/**
+  * Record of a stored ticket (initiator). One record per CFS file.
+  */
+typedef struct {
+  uip_ip6addr_t peer;
+  unsigned long stored_at;
+  ticket_state_t state;
+  uint8_t ticket_len;
+  uint8_t ticket[IKE_RESUME_TICKET_MAXLEN];
+} ticket_record_t;
+
+/**
+  * Ticket protection (responder). Tickets are encrypted with AES-CTR and integrity protected with AES-XCBC-MAC-96:
+  *
+  *   Key ID (4 B) | IV | ENCR(ticket_state_t | Padding | Pad Length) | ICV
+  */
+#define TICKET_ENCR SA_ENCR_AES_CTR
+#define TICKET_ENCR_KEYLEN 16
+#define TICKET_INTEG SA_INTEG_AES_XCBC_MAC_96
+#define TICKET_KEY_ID_LEN 4
+
+static uint8_t ticket_keys_set;
+static uint32_t ticket_key_id;
+static uint32_t ticket_ops;
+static uint8_t ticket_encr_keymat[SA_ENCR_MAX_KEYMATLEN];
+static uint8_t ticket_integ_keymat[SA_INTEG_MAX_KEYMATLEN];
+
+/**
+  * Record protection (initiator). The records hold SK_d, so they are wrapped like the records of
+  * the SAD store, with keys derived from the device key:
+  *
+  *   IV | ENCR(ticket_record_t | Padding | Pad Length) | ICV
+  *
+  *   {encryption key | integrity key} = prf+(device key, "IKE resume tickets")
+  *
+  * The IV is drawn from IKE_RESUME_GET_ENTROPY, as no counter survives a reboot.
+  */
+#define RECORD_ENCR SA_ENCR_AES_CTR
+#define RECORD_ENCR_KEYLEN 16
+#define RECORD_INTEG SA_INTEG_AES_XCBC_MAC_96
+#define RECORD_IVLEN 8
+
+// Length of a wrapped record (see espsk_pad())
+#define RECORD_WRAPPED_LEN (RECORD_IVLEN + (sizeof(ticket_record_t) + 1) / 4 * 4 + 4 + IPSEC_ICVLEN)
+
+static uint8_t record_keys_derived;
+static uint8_t record_encr_keymat[SA_ENCR_MAX_KEYMATLEN];
+static uint8_t record_integ_keymat[SA_INTEG_MAX_KEYMATLEN];
+
+/**
+  * Tickets are stored in the files ike_tkt0, ike_tkt1, ...
+  */
+#define TICKET_FILENAME "ike_tkt0"
+#define TICKET_FILENAME_LEN sizeof(TICKET_FILENAME)
+
+#if IKE_RESUME_TICKETS > 10
+#error IKE_RESUME_TICKETS must not be greater than 10
+#endif
+
+static void
+ticket_filename(char *name, uint8_t slot)
+{
+  memcpy(name, TICKET_FILENAME, TICKET_FILENAME_LEN);
+  name[TICKET_FILENAME_LEN - 2] += slot;
+}
+
+/**
+  * Compares the ICVs a and b in a time that does not depend on where they differ
+  *
+  * \return 0 if they are equal, non-zero otherwise
+  */
+static uint8_t
+icv_differs(const uint8_t *a, const uint8_t *b, uint8_t len)
+{
+  uint8_t diff = 0;
+
+  while(len--)
+    diff |= a[len] ^ b[len];
+  return diff;
+}
+
+/*---------------------------------------------------------------------------*/
+static void
+state_from_sa(ticket_state_t *state, const sa_ike_t *sa)
+{
+  state->encr = sa->encr;
+  state->prf = sa->prf;
+  state->integ = sa->integ;
+  state->dh = sa->dh;
+  state->encr_keylen = sa->encr_keylen;
+  memcpy(state->sk_d, sa->sk_d, sizeof(state->sk_d));
+}
+
+static void
+state_to_sa(sa_ike_t *sa, const ticket_state_t *state)
+{
+  sa->encr = state->encr;
+  sa->prf = state->prf;
+  sa->integ = state->integ;
+  sa->dh = state->dh;
+  sa->encr_keylen = state->encr_keylen;
+  memcpy(sa->sk_d, state->sk_d, sizeof(sa->sk_d));
+}
+
+/*---------------------------------------------------------------------------*/
+#ifndef IKE_RESUME_GET_ENTROPY
+#include <stdio.h>
+
+static int
+read_urandom(uint8_t *buf, uint16_t len)
+{
+  FILE *f = fopen("/dev/urandom", "rb");
+  int success;
+
+  if(f == NULL)
+    return 0;
+  success = fread(buf, 1, len, f) == len;
+  fclose(f);
+  return success;
+}
+#define IKE_RESUME_GET_ENTROPY read_urandom
+#endif
+
+/*---------------------------------------------------------------------------*/
+void
+ike_resume_init(void)
+{
+  /* The key ID is sent in the clear, so it is drawn independently of the keys */
+  ticket_keys_set = IKE_RESUME_GET_ENTROPY(ticket_encr_keymat, sizeof(ticket_encr_keymat)) &&
+    IKE_RESUME_GET_ENTROPY(ticket_integ_keymat, sizeof(ticket_integ_keymat)) &&
+    IKE_RESUME_GET_ENTROPY((uint8_t *) &ticket_key_id, sizeof(ticket_key_id));
+  ticket_ops = 0;
+  if(!ticket_keys_set)
+    PRINTF(IPSEC_IKE_ERROR "No entropy for the ticket keys. Tickets will be neither issued nor accepted.\n");
+}
+
+/*---------------------------------------------------------------------------*/
+static void
+derive_record_keys(void)
+{
+  static const char label[] = "IKE resume tickets";
+  uint8_t device_key[] = IKE_RESUME_DEVICE_KEY;
+  uint8_t *chunks[] = { record_encr_keymat, record_integ_keymat };
+  uint8_t chunks_len[] = { SA_ENCR_MAX_KEYMATLEN, SA_INTEG_KEYMATLEN_BY_TYPE(RECORD_INTEG) };
+
+  if(record_keys_derived)
+    return;
+
+  prfplus_data_t prfplus_data = {
+    .prf = SA_PRF_HMAC_SHA1,
+    .key = device_key,
+    .keylen = sizeof(device_key),
+    .no_chunks = sizeof(chunks_len),
+    .data = (uint8_t *) label,
+    .datalen = sizeof(label) - 1,
+    .chunks = chunks,
+    .chunks_len = chunks_len
+  };
+  prf_plus(&prfplus_data);
+  record_keys_derived = 1;
+}
+
+/**
+  * Reads, verifies and decrypts the record of slot
+  *
+  * \return 1 upon success, 0 otherwise
+  */
+static uint8_t
+read_record(uint8_t slot, ticket_record_t *record)
+{
+  uint8_t buf[RECORD_WRAPPED_LEN];
+  uint8_t icv[IPSEC_ICVLEN];
+  uint16_t integ_datalen = RECORD_WRAPPED_LEN - IPSEC_ICVLEN;
+  char name[TICKET_FILENAME_LEN];
+  int fd;
+  uint8_t success;
+
+  ticket_filename(name, slot);
+  fd = cfs_open(name, CFS_READ);
+  if(fd < 0)
+    return 0;
+  success = cfs_read(fd, buf, sizeof(buf)) == sizeof(buf);
+  cfs_close(fd);
+  if(!success)
+    return 0;
+
+  derive_record_keys();
+  integ_data_t integ_data = {
+    .type = RECORD_INTEG,
+    .data = buf,
+    .datalen = integ_datalen,
+    .keymat = record_integ_keymat,
+    .out = icv
+  };
+  integ(&integ_data);
+  if(icv_differs(icv, buf + integ_datalen, IPSEC_ICVLEN)) {
+    PRINTF(IPSEC_IKE_ERROR "Ticket file %s failed the integrity check\n", name);
+    return 0;
+  }
+
+  encr_data_t encr_data = {
+    .type = RECORD_ENCR,
+    .keymat = record_encr_keymat,
+    .keylen = RECORD_ENCR_KEYLEN,
+    .integ_data = buf,
+    .encr_data = buf,
+    .encr_datalen = integ_datalen,
+    .ip_next_hdr = NULL
+  };
+  espsk_unpack(&encr_data);
+  memcpy(record, buf + RECORD_IVLEN, sizeof(ticket_record_t));
+  return 1;
+}
+
+/**
+  * Encrypts and integrity protects record, writing the result to the file of slot
+  *
+  * \return 1 upon success, 0 otherwise
+  */
+static uint8_t
+write_record(uint8_t slot, const ticket_record_t *record)
+{
+  uint8_t buf[RECORD_WRAPPED_LEN];
+  uint32_t ops;
+  char name[TICKET_FILENAME_LEN];
+  int fd;
+  uint8_t success;
+
+  /* espsk_pack() writes ops to the first half of the IV */
+  if(!IKE_RESUME_GET_ENTROPY((uint8_t *) &ops, sizeof(ops)) ||
+     !IKE_RESUME_GET_ENTROPY(buf + sizeof(ops), RECORD_IVLEN - sizeof(ops))) {
+    PRINTF(IPSEC_IKE_ERROR "No entropy for the IV of the ticket file\n");
+    return 0;
+  }
+  memcpy(buf + RECORD_IVLEN, record, sizeof(ticket_record_t));
+
+  derive_record_keys();
+  encr_data_t encr_data = {
+    .type = RECORD_ENCR,
+    .keymat = record_encr_keymat,
+    .keylen = RECORD_ENCR_KEYLEN,
+    .integ_data = buf,
+    .encr_data = buf,
+    .encr_datalen = RECORD_IVLEN + sizeof(ticket_record_t),
+    .ip_next_hdr = NULL,
+    .ops = ops
+  };
+  espsk_pack(&encr_data);
+
+  integ_data_t integ_data = {
+    .type = RECORD_INTEG,
+    .data = buf,
+    .datalen = encr_data.encr_datalen,
+    .keymat = record_integ_keymat,
+    .out = buf + encr_data.encr_datalen
+  };
+  integ(&integ_data);
+
+  ticket_filename(name, slot);
+  fd = cfs_open(name, CFS_WRITE);
+  if(fd < 0) {
+    PRINTF(IPSEC_IKE_ERROR "Could not open ticket file\n");
+    return 0;
+  }
+  success = cfs_write(fd, buf, sizeof(buf)) == sizeof(buf);
+  cfs_close(fd);
+  if(!success)
+    PRINTF(IPSEC_IKE_ERROR "Could not write ticket file\n");
+  return success;
+}
+
+static void
+remove_record(uint8_t slot)
+{
+  char name[TICKET_FILENAME_LEN];
+
+  ticket_filename(name, slot);
+  cfs_remove(name);
+}
+
+/*---------------------------------------------------------------------------*/
+uint8_t
+ike_resume_load_ticket(ike_statem_session_t *session)
+{
+  ticket_record_t record;
+  uint8_t slot;
+  unsigned long now = clock_seconds();
+
+  for(slot = 0; slot < IKE_RESUME_TICKETS; ++slot) {
+    if(!read_record(slot, &record) || !uip_ip6addr_cmp(&record.peer, &session->peer))
+      continue;
+
+    /* Our clock restarts at reboot. Tickets stored before that are tried nonetheless; the peer decides. */
+    if(now >= record.stored_at && now > record.state.expires) {
+      PRINTF(IPSEC_IKE "Stored ticket for peer has expired\n");
+      remove_record(slot);
+      return 0;
+    }
+
+    if(record.ticket_len > IKE_RESUME_TICKET_MAXLEN)
+      return 0;
+
+    state_to_sa(&session->sa, &record.state);
+    memcpy(session->ephemeral_info->ticket, record.ticket, record.ticket_len);
+    session->ephemeral_info->ticket_len = record.ticket_len;
+    PRINTF(IPSEC_IKE "Found %u B ticket for peer. Resuming IKE session.\n", record.ticket_len);
+    return 1;
+  }
+  return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+void
+ike_resume_store_ticket(ike_statem_session_t *session, const uint8_t *lt_opaque, uint16_t len)
+{
+  ticket_record_t record;
+  uint8_t slot, victim = 0;
+  unsigned long victim_expires = ~0UL;
+  uint32_t lifetime;
+
+  if(len <= sizeof(lifetime) || len - sizeof(lifetime) > IKE_RESUME_TICKET_MAXLEN) {
+    PRINTF(IPSEC_IKE_ERROR "Can't store ticket of length %u\n", len);
+    return;
+  }
+
+  /* Reuse the slot of the peer, an empty one or the one that expires first */
+  for(slot = 0; slot < IKE_RESUME_TICKETS; ++slot) {
+    if(!read_record(slot, &record)) {
+      victim = slot;
+      break;
+    }
+    if(uip_ip6addr_cmp(&record.peer, &session->peer)) {
+      victim = slot;
+      break;
+    }
+    if(record.state.expires < victim_expires) {
+      victim_expires = record.state.expires;
+      victim = slot;
+    }
+  }
+
+  memcpy(&lifetime, lt_opaque, sizeof(lifetime));
+  memcpy(&record.peer, &session->peer, sizeof(uip_ip6addr_t));
+  record.stored_at = clock_seconds();
+  state_from_sa(&record.state, &session->sa);
+  record.state.expires = record.stored_at + uip_ntohl(lifetime);
+  record.ticket_len = len - sizeof(lifetime);
+  memcpy(record.ticket, lt_opaque + sizeof(lifetime), record.ticket_len);
+
+  remove_record(victim);
+  if(!write_record(victim, &record)) {
+    remove_record(victim);
+    return;
+  }
+  PRINTF(IPSEC_IKE "Stored %u B ticket (lifetime %lu s) in slot %u\n", record.ticket_len, (unsigned long) uip_ntohl(lifetime), victim);
+}
+
+/*---------------------------------------------------------------------------*/
+void
+ike_resume_remove_ticket(const uip_ip6addr_t *peer)
+{
+  ticket_record_t record;
+  uint8_t slot;
+
+  for(slot = 0; slot < IKE_RESUME_TICKETS; ++slot) {
+    if(read_record(slot, &record) && uip_ip6addr_cmp(&record.peer, peer))
+      remove_record(slot);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+uint8_t
+ike_resume_write_ticket(ike_statem_session_t *session, uint8_t *out)
+{
+  ticket_state_t state;
+  uint32_t lifetime = uip_htonl(IKE_RESUME_TICKET_LIFETIME);
+  uint8_t *ticket = out + sizeof(lifetime);
+  uint8_t *iv = ticket + TICKET_KEY_ID_LEN;
+  uint16_t integ_datalen;
+
+  if(!ticket_keys_set)
+    return 0;
+
+  memcpy(out, &lifetime, sizeof(lifetime));
+  memcpy(ticket, &ticket_key_id, TICKET_KEY_ID_LEN);
+
+  state_from_sa(&state, &session->sa);
+  memcpy(state.peer_id, session->ephemeral_info->peer_id, IKE_RESUME_PEER_ID_LEN);
+  state.expires = uip_htonl(clock_seconds() + IKE_RESUME_TICKET_LIFETIME);
+  memset(iv, 0, SA_ENCR_IVLEN_BY_TYPE(TICKET_ENCR));
+  memcpy(iv + SA_ENCR_IVLEN_BY_TYPE(TICKET_ENCR), &state, sizeof(state));
+
+  encr_data_t encr_data = {
+    .type = TICKET_ENCR,
+    .keymat = ticket_encr_keymat,
+    .keylen = TICKET_ENCR_KEYLEN,
+    .integ_data = ticket,
+    .encr_data = iv,
+    .encr_datalen = SA_ENCR_IVLEN_BY_TYPE(TICKET_ENCR) + sizeof(state),
+    .ip_next_hdr = NULL,
+    .ops = ++ticket_ops   // The IV of AES-CTR
+  };
+  espsk_pack(&encr_data);
+
+  integ_datalen = TICKET_KEY_ID_LEN + encr_data.encr_datalen;
+  integ_data_t integ_data = {
+    .type = TICKET_INTEG,
+    .data = ticket,
+    .datalen = integ_datalen,
+    .keymat = ticket_integ_keymat,
+    .out = ticket + integ_datalen
+  };
+  integ(&integ_data);
+
+  return sizeof(lifetime) + integ_datalen + IPSEC_ICVLEN;
+}
+
+/*---------------------------------------------------------------------------*/
+uint8_t
+ike_resume_open_ticket(ike_statem_session_t *session, uint8_t *ticket, uint16_t len)
+{
+  uint8_t buf[IKE_RESUME_TICKET_MAXLEN];
+  uint8_t icv[IPSEC_ICVLEN];
+  ticket_state_t state;
+  uint16_t integ_datalen = len - IPSEC_ICVLEN;
+
+  if(len > sizeof(buf) || len < TICKET_KEY_ID_LEN + SA_ENCR_IVLEN_BY_TYPE(TICKET_ENCR) + sizeof(state) + IPSEC_ICVLEN) {
+    PRINTF(IPSEC_IKE_ERROR "Ticket has invalid length %u\n", len);
+    return 0;
+  }
+  if(!ticket_keys_set || memcmp(ticket, &ticket_key_id, TICKET_KEY_ID_LEN)) {
+    PRINTF(IPSEC_IKE_ERROR "Ticket was protected by an unknown key\n");
+    return 0;
+  }
+
+  /* Work on a copy as the ticket is part of the peer's first message, which we need for AUTH */
+  memcpy(buf, ticket, len);
+
+  integ_data_t integ_data = {
+    .type = TICKET_INTEG,
+    .data = buf,
+    .datalen = integ_datalen,
+    .keymat = ticket_integ_keymat,
+    .out = icv
+  };
+  integ(&integ_data);
+  if(icv_differs(icv, buf + integ_datalen, IPSEC_ICVLEN)) {
+    PRINTF(IPSEC_IKE_ERROR "Ticket integrity check failed\n");
+    return 0;
+  }
+
+  encr_data_t encr_data = {
+    .type = TICKET_ENCR,
+    .keymat = ticket_encr_keymat,
+    .keylen = TICKET_ENCR_KEYLEN,
+    .integ_data = buf,
+    .encr_data = buf + TICKET_KEY_ID_LEN,
+    .encr_datalen = integ_datalen - TICKET_KEY_ID_LEN,
+    .ip_next_hdr = NULL
+  };
+  espsk_unpack(&encr_data);
+  memcpy(&state, buf + TICKET_KEY_ID_LEN + SA_ENCR_IVLEN_BY_TYPE(TICKET_ENCR), sizeof(state));
+
+  if(clock_seconds() > uip_ntohl(state.expires)) {
+    PRINTF(IPSEC_IKE_ERROR "Ticket has expired\n");
+    return 0;
+  }
+
+  state_to_sa(&session->sa, &state);
+  memcpy(session->ephemeral_info->peer_id, state.peer_id, IKE_RESUME_PEER_ID_LEN);
+  return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+uint8_t
+ike_resume_bind_peer_id(ike_statem_session_t *session, const uint8_t *id, uint16_t len)
+{
+  uint8_t digest[HMAC_SHA1_OUTPUT_LEN];
+
+  hmac_data_t hmac_data = {
+    .out = digest,
+    .key = ticket_integ_keymat,
+    .keylen = sizeof(ticket_integ_keymat),
+    .data = (uint8_t *) id,
+    .datalen = len
+  };
+  hmac_sha1(&hmac_data);
+
+  if(IKE_STATEM_IS_RESUMED(session)) {
+    if(icv_differs(digest, session->ephemeral_info->peer_id, IKE_RESUME_PEER_ID_LEN)) {
+      PRINTF(IPSEC_IKE_ERROR "Peer's identity differs from that of its ticket\n");
+      return 0;
+    }
+    return 1;
+  }
+  memcpy(session->ephemeral_info->peer_id, digest, IKE_RESUME_PEER_ID_LEN);
+  return 1;
+}
+
+#endif /* WITH_IPSEC_IKE_RESUME */
+
+/** @} */
@@ -0,0 +1,150 @@
+/**
+ * \addtogroup ipsec
+ * @{
+ */
+
+/**
+ * \file
+ * 		IKEv2 session resumption (RFC 5723)
+ * \details
+ * 		As initiator we request a ticket in every IKE_AUTH exchange and store it, together with
+ * 		the IKE SA's algorithms and SK_d, in CFS (Coffee on most platforms). The stored records are
+ * 		encrypted and integrity protected with keys derived from IKE_RESUME_DEVICE_KEY. When a new IKE SA is
+ * 		to be created with a peer that we hold a ticket for, we use the IKE_SESSION_RESUME exchange
+ * 		instead of IKE_SA_INIT. No Diffie-Hellman computations are required. If the peer rejects the
+ * 		ticket we forget it and fall back to IKE_SA_INIT.
+ *
+ * 		As responder we issue tickets "by value" (section 4.3.1 in the RFC), protected by random
+ * 		keys that are drawn from IKE_RESUME_GET_ENTROPY at boot. Tickets issued before a reboot are
+ * 		therefore rejected. A ticket carries a digest of the peer's identity (IDi), and a resumed
+ * 		session must present the same identity.
+ */
+
+#ifndef __RESUME_H__
+#define __RESUME_H__
+
+#include "contiki-net.h"
+#include "ipsec.h"
+
+#if WITH_IPSEC_IKE_RESUME
+
+/**
+  * Maximum length of a ticket that we can store, including our own
+  */
+#ifdef IKE_RESUME_CONF_TICKET_MAXLEN
+#define IKE_RESUME_TICKET_MAXLEN IKE_RESUME_CONF_TICKET_MAXLEN
+#else
+#define IKE_RESUME_TICKET_MAXLEN 96
+#endif
+
+/**
+  * Number of tickets (i.e. peers) that we store in flash as initiator
+  */
+#ifdef IKE_RESUME_CONF_TICKETS
+#define IKE_RESUME_TICKETS IKE_RESUME_CONF_TICKETS
+#else
+#define IKE_RESUME_TICKETS 2
+#endif
+
+/**
+  * Lifetime (seconds) of the tickets that we issue as responder
+  */
+#ifdef IKE_RESUME_CONF_TICKET_LIFETIME
+#define IKE_RESUME_TICKET_LIFETIME IKE_RESUME_CONF_TICKET_LIFETIME
+#else
+#define IKE_RESUME_TICKET_LIFETIME 86400UL
+#endif
+
+/**
+  * Source of entropy for the keys that protect the tickets that we issue, called as
+  * IKE_RESUME_GET_ENTROPY(uint8_t *buf, uint16_t len) and returning non-zero on success. rand16()
+  * and random_ike() are predictable and must not be used. Native builds read /dev/urandom.
+  */
+#ifdef IKE_RESUME_CONF_GET_ENTROPY
+#define IKE_RESUME_GET_ENTROPY IKE_RESUME_CONF_GET_ENTROPY
+#elif !CONTIKI_TARGET_NATIVE
+#error "IKEv2 session resumption needs a source of entropy. Define IKE_RESUME_CONF_GET_ENTROPY."
+#endif
+
+/**
+  * 16 byte device key (array initializer) from which the keys protecting the stored tickets are
+  * derived. It must be unique per device and kept secret, so there is no default. The device key
+  * of the SAD store is used if it is set.
+  */
+#ifdef IKE_RESUME_CONF_DEVICE_KEY
+#define IKE_RESUME_DEVICE_KEY IKE_RESUME_CONF_DEVICE_KEY
+#elif defined(IPSEC_SAD_STORE_CONF_DEVICE_KEY)
+#define IKE_RESUME_DEVICE_KEY IPSEC_SAD_STORE_CONF_DEVICE_KEY
+#else
+#error "IKEv2 session resumption needs a device key. Define IKE_RESUME_CONF_DEVICE_KEY."
+#endif
+
+/**
+  * Length of the digest of the peer's identity that a ticket is bound to
+  */
+#define IKE_RESUME_PEER_ID_LEN 12
+
+/**
+  * Flags in ike_statem_ephemeral_info_t's member resume_flags
+  */
+#define IKE_RESUME_FLAG_RESUMED           0x01  // This IKE SA is negotiated through IKE_SESSION_RESUME
+#define IKE_RESUME_FLAG_TICKET_REQUESTED  0x02  // The peer has requested a ticket (responder)
+
+#define IKE_STATEM_IS_RESUMED(session) ((session)->ephemeral_info->resume_flags & IKE_RESUME_FLAG_RESUMED)
+
+struct ike_statem_session;
+
+void ike_resume_init(void);
+
+/**
+  * Initiator: Looks up a stored ticket for the session's peer. If found, the ticket is copied to the
+  * session's ephemeral info and the algorithms and SK_d of the old IKE SA are written to session->sa.
+  *
+  * \return 1 if a ticket was found, 0 otherwise
+  */
+uint8_t ike_resume_load_ticket(struct ike_statem_session *session);
+
+/**
+  * Initiator: Stores the ticket of the notification data of a TICKET_LT_OPAQUE notification
+  * along with the current IKE SA of the session.
+  */
+void ike_resume_store_ticket(struct ike_statem_session *session, const uint8_t *lt_opaque, uint16_t len);
+
+/**
+  * Initiator: Forget the ticket that we hold for peer (if any)
+  */
+void ike_resume_remove_ticket(const uip_ip6addr_t *peer);
+
+/**
+  * Responder: Writes the notification data of a TICKET_LT_OPAQUE notification (lifetime followed by
+  * a ticket protecting the session's IKE SA) to out.
+  *
+  * \return The length of the data written, or 0 if we have no keys to protect tickets with
+  */
+uint8_t ike_resume_write_ticket(struct ike_statem_session *session, uint8_t *out);
+
+/**
+  * Responder: Verifies and decrypts the ticket. Upon success the algorithms and SK_d of the
+  * old IKE SA are written to session->sa.
+  *
+  * \return 1 if the ticket is valid, 0 otherwise
+  */
+uint8_t ike_resume_open_ticket(struct ike_statem_session *session, uint8_t *ticket, uint16_t len);
+
+/**
+  * Responder: Binds the session to the identity in the peer's ID payload. The tickets that we issue
+  * for the session carry it, and a resumed session must present the identity of its ticket.
+  *
+  * \return 0 if the session is resumed and the identity differs from that of the ticket, 1 otherwise
+  */
+uint8_t ike_resume_bind_peer_id(struct ike_statem_session *session, const uint8_t *id, uint16_t len);
+
+#else
+
+#define IKE_STATEM_IS_RESUMED(session) 0
+
+#endif /* WITH_IPSEC_IKE_RESUME */
+
+#endif
+
+/** @} */
@@ -0,0 +1,146 @@
+/**
+ * \addtogroup ipsec
+ * @{
+ */
+
+/**
+ * \file
+ * 		Per-peer round-trip time estimation for the IKEv2 retransmission timer
+ */
+
+#include <string.h>
+#include "contiki-net.h"
+#include "net/ipv6/uip-ds6-nbr.h"
+#if UIP_CONF_IPV6_RPL
+#include "net/rpl/rpl.h"
+#endif
+#include "ipsec.h"
+#include "rtt.h"
+
+/**
+  * Estimator state. srtt and rttvar are stored in fixed point, scaled by
+  * 8 and 4 respectively (the same scaling as in Jacobson's TCP code).
+  * A zero srtt signifies that the peer hasn't been measured yet, in which
+  * case rto holds the seed value.
+  */
+typedef struct {
+  uip_ip6addr_t peer;
+  uint32_t srtt;
+  uint32_t rttvar;
+  clock_time_t rto;
+  clock_time_t last_used;
+  uint8_t used;
+} ike_rtt_entry_t;
+
+static ike_rtt_entry_t rtt_table[IKE_RTT_PEERS];
+
+static clock_time_t
+clamp_rto(uint32_t rto)
+{
+  if(rto < IKE_RTT_RTO_MIN)
+    return IKE_RTT_RTO_MIN;
+  if(rto > IKE_RTT_RTO_MAX)
+    return IKE_RTT_RTO_MAX;
+  return (clock_time_t) rto;
+}
+
+/**
+  * Guess an initial RTO for a peer that we haven't measured. The guess is based on
+  * the number of hops to the peer, as far as the network layer can tell.
+  */
+static clock_time_t
+seed_rto(const uip_ip6addr_t *peer)
+{
+  if(uip_ds6_nbr_lookup(peer) != NULL)
+    return clamp_rto(IKE_RTT_RTO_NEIGHBOR);
+
+#if UIP_CONF_IPV6_RPL
+  {
+    rpl_dag_t *dag = rpl_get_any_dag();
+    if(dag != NULL && dag->instance != NULL && dag->instance->min_hoprankinc > 0 &&
+       dag->rank != 0xffff /* INFINITE_RANK */) {
+      /* Most IKE peers are found beyond the DAG root */
+      uint32_t hops = dag->rank / dag->instance->min_hoprankinc;
+      if(hops < 1)
+        hops = 1;
+      return clamp_rto(IKE_RTT_RTO_NEIGHBOR + (hops - 1) * IKE_RTT_RTO_PER_HOP);
+    }
+  }
+#endif
+
+  return clamp_rto(IKE_RTT_RTO_INITIAL);
+}
+
+static ike_rtt_entry_t *
+get_entry(const uip_ip6addr_t *peer)
+{
+  ike_rtt_entry_t *entry, *victim = NULL;
+
+  for(entry = rtt_table; entry < rtt_table + IKE_RTT_PEERS; ++entry) {
+    if(entry->used && uip_ip6addr_cmp(&entry->peer, peer)) {
+      entry->last_used = clock_time();
+      return entry;
+    }
+    if(victim == NULL || !entry->used ||
+       (victim->used && (clock_time_t)(clock_time() - entry->last_used) > (clock_time_t)(clock_time() - victim->last_used)))
+      victim = entry;
+  }
+
+  memcpy(&victim->peer, peer, sizeof(uip_ip6addr_t));
+  victim->srtt = 0;
+  victim->rttvar = 0;
+  victim->rto = seed_rto(peer);
+  victim->last_used = clock_time();
+  victim->used = 1;
+
+  PRINTF(IKE "RTT estimator for peer seeded with RTO %u\n", (unsigned)victim->rto);
+  return victim;
+}
+
+void
+ike_rtt_init(void)
+{
+  memset(rtt_table, 0, sizeof(rtt_table));
+}
+
+clock_time_t
+ike_rtt_get_rto(const uip_ip6addr_t *peer)
+{
+  return get_entry(peer)->rto;
+}
+
+void
+ike_rtt_update(const uip_ip6addr_t *peer, clock_time_t rtt)
+{
+  ike_rtt_entry_t *entry = get_entry(peer);
+  uint32_t r = rtt > 0 ? rtt : 1;
+
+  if(entry->srtt == 0) {
+    /* First measurement (RFC 6298, section 2.2) */
+    entry->srtt = r << 3;
+    entry->rttvar = r << 1;
+  } else {
+    /* Subsequent measurements (RFC 6298, section 2.3) */
+    int32_t err = (int32_t)r - (int32_t)(entry->srtt >> 3);
+    entry->srtt += err;
+    if(err < 0)
+      err = -err;
+    entry->rttvar += err - (entry->rttvar >> 2);
+  }
+
+  entry->rto = clamp_rto((entry->srtt >> 3) + entry->rttvar);
+  PRINTF(IKE "RTT sample %u, new RTO %u\n", (unsigned)rtt, (unsigned)entry->rto);
+}
+
+clock_time_t
+ike_rtt_backoff(const uip_ip6addr_t *peer, uint8_t retrans_count)
+{
+  uint32_t rto = ike_rtt_get_rto(peer);
+
+  while(retrans_count-- > 0 && rto < IKE_RTT_RTO_MAX)
+    rto <<= 1;
+
+  return clamp_rto(rto);
+}
+
+/** @} */
@@ -0,0 +1,98 @@
+/**
+ * \addtogroup ipsec
+ * @{
+ */
+
+/**
+ * \file
+ * 		Per-peer round-trip time estimation for the IKEv2 retransmission timer
+ * \details
+ * 		The retransmission timeout (RTO) is computed as described in RFC 6298.
+ * 		Estimates are kept per peer, independent of the IKE sessions, so that
+ * 		a new session with a known peer starts out with a good timeout value.
+ *
+ * 		Peers that we haven't measured yet are seeded from the network layer:
+ * 		an on-link neighbor in the ND cache is assumed to be close, otherwise
+ * 		the distance is guessed from our rank in the RPL DAG.
+ */
+
+#ifndef __RTT_H__
+#define __RTT_H__
+
+#include "contiki-net.h"
+
+/**
+  * Number of peers for which we keep RTT estimates. The least recently
+  * used estimate is recycled when the table is full.
+  */
+#ifdef IKE_RTT_CONF_PEERS
+#define IKE_RTT_PEERS IKE_RTT_CONF_PEERS
+#else
+#define IKE_RTT_PEERS 4
+#endif
+
+/**
+  * Bounds of the RTO. Please note that the peer's computation time (e.g. ECDH)
+  * is part of the observed RTT, hence the rather generous upper bound.
+  */
+#ifdef IKE_RTT_CONF_RTO_MIN
+#define IKE_RTT_RTO_MIN IKE_RTT_CONF_RTO_MIN
+#else
+#define IKE_RTT_RTO_MIN (1 * CLOCK_SECOND)
+#endif
+
+#ifdef IKE_RTT_CONF_RTO_MAX
+#define IKE_RTT_RTO_MAX IKE_RTT_CONF_RTO_MAX
+#else
+#define IKE_RTT_RTO_MAX (60 * CLOCK_SECOND)
+#endif
+
+/**
+  * Initial RTO for peers that we know nothing about
+  */
+#ifdef IKE_RTT_CONF_RTO_INITIAL
+#define IKE_RTT_RTO_INITIAL IKE_RTT_CONF_RTO_INITIAL
+#else
+#define IKE_RTT_RTO_INITIAL (15 * CLOCK_SECOND)
+#endif
+
+/**
+  * Seed values derived from the network layer. A peer at n hops is seeded with
+  * IKE_RTT_RTO_NEIGHBOR + (n - 1) * IKE_RTT_RTO_PER_HOP.
+  */
+#ifdef IKE_RTT_CONF_RTO_NEIGHBOR
+#define IKE_RTT_RTO_NEIGHBOR IKE_RTT_CONF_RTO_NEIGHBOR
+#else
+#define IKE_RTT_RTO_NEIGHBOR (3 * CLOCK_SECOND)
+#endif
+
+#ifdef IKE_RTT_CONF_RTO_PER_HOP
+#define IKE_RTT_RTO_PER_HOP IKE_RTT_CONF_RTO_PER_HOP
+#else
+#define IKE_RTT_RTO_PER_HOP (CLOCK_SECOND / 2)
+#endif
+
+void ike_rtt_init(void);
+
+/**
+  * Returns the current RTO for the peer (before any backoff is applied)
+  */
+clock_time_t ike_rtt_get_rto(const uip_ip6addr_t *peer);
+
+/**
+  * Feeds a new RTT measurement into the estimator of the peer.
+  *
+  * In accordance with Karn's algorithm this must only be called with
+  * samples from requests that weren't retransmitted, i.e. from exchanges
+  * that we initiated.
+  */
+void ike_rtt_update(const uip_ip6addr_t *peer, clock_time_t rtt);
+
+/**
+  * Returns the RTO of the peer after retrans_count exponential backoffs
+  */
+clock_time_t ike_rtt_backoff(const uip_ip6addr_t *peer, uint8_t retrans_count);
+
+#endif
+
+/** @} */
@@ -35,8 +35,29 @@
 #define WITH_IPSEC_IKE  0
 #endif
 
+/* IKEv2 session resumption (RFC 5723). Tickets are stored using CFS. */
+#if WITH_CONF_IPSEC_IKE_RESUME && WITH_IPSEC_IKE
+#define WITH_IPSEC_IKE_RESUME  1
+#else
+#define WITH_IPSEC_IKE_RESUME  0
+#endif
+
+/* Persistent SAD / IKE SA store for warm restarts. Uses CFS. */
+#if WITH_CONF_IPSEC_SAD_STORE && WITH_IPSEC_IKE
+#define WITH_IPSEC_SAD_STORE  1
+#else
+#define WITH_IPSEC_SAD_STORE  0
+#endif
+
 #define WITH_IPSEC    (WITH_IPSEC_ESP | WITH_IPSEC_AH)
 
+/* Per-SA counters, drop reasons and transform timing. See ipsec_stats.h */
+#if WITH_CONF_IPSEC_STATS && WITH_IPSEC
+#define WITH_IPSEC_STATS  1
+#else
+#define WITH_IPSEC_STATS  0
+#endif
+
 
 #define IPSEC_KEYSIZE_FIXTHIS   16  // Old bad code. Make the key size dynamic.
 /*
@@ -53,9 +74,16 @@
 /**
 	* IPsec / IKEv2 debug configuration options are set here!
 	*
-	* There are more debuging options in uip6.c
+	* There are more debuging options in uip6.c. Set IPSEC_CONF_DEBUG to 0 in order to silence
+	* both, e.g. when measuring performance.
 	*/
-#define DEBUG 1
+#ifdef IPSEC_CONF_DEBUG
+#define IPSEC_DEBUG IPSEC_CONF_DEBUG
+#else
+#define IPSEC_DEBUG 1
+#endif
+
+#define DEBUG IPSEC_DEBUG
 
 #if DEBUG
 #include <stdio.h>
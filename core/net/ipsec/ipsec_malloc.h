@@ -48,6 +48,7 @@
 #include <stddef.h>
 
 void *ipsec_malloc(size_t size);
+void ipsec_free(void *ptr);
 
 #endif
 
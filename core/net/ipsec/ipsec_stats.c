@@ -0,0 +1,134 @@
+/**
+ * \addtogroup ipsec
+ * @{
+ */
+
+/**
+ * \file
+ * 		IPsec statistics: per-SA counters, drop reasons and transform cost
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "contiki.h"
+#include "lib/list.h"
+#include "ipsec.h"
+#include "sad.h"
+#include "ipsec_stats.h"
+
+#if WITH_IPSEC_STATS
+
+uint32_t ipsec_drops[IPSEC_DROP_REASONS];
+
+static ipsec_xform_stats_t xform_stats[IPSEC_STATS_XFORMS];
+
+static const char *const drop_names[IPSEC_DROP_REASONS] = {
+  "no-sa",
+  "icv",
+  "replay",
+  "selector",
+  "unprotected",
+  "out-no-sa",
+  "out-discard",
+  "seqno-overflow"
+};
+
+static const char *const op_names[] = { "encrypt", "decrypt", "integ" };
+
+/*---------------------------------------------------------------------------*/
+void
+ipsec_stats_xform(uint8_t op, uint8_t type, uint16_t len, rtimer_clock_t start)
+{
+  rtimer_clock_t ticks = RTIMER_NOW() - start;
+  ipsec_xform_stats_t *xs;
+
+  for(xs = xform_stats; xs < xform_stats + IPSEC_STATS_XFORMS; ++xs) {
+    if(xs->calls == 0) {
+      xs->op = op;
+      xs->type = type;
+    } else if(xs->op != op || xs->type != type) {
+      continue;
+    }
+    ++xs->calls;
+    xs->bytes += len;
+    xs->ticks += ticks;
+    return;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+ipsec_stats_reset(void)
+{
+  sad_entry_t *entry;
+
+  memset(ipsec_drops, 0, sizeof(ipsec_drops));
+  memset(xform_stats, 0, sizeof(xform_stats));
+  for(entry = sad_get_first_incoming_entry(); entry != NULL; entry = list_item_next(entry))
+    IPSEC_STATS_SA_RESET(entry);
+  for(entry = sad_get_first_outgoing_entry(); entry != NULL; entry = list_item_next(entry))
+    IPSEC_STATS_SA_RESET(entry);
+}
+/*---------------------------------------------------------------------------*/
+static int
+sa_line(uint16_t index, char *buf, uint16_t len)
+{
+  sad_entry_t *entry;
+  uint8_t outgoing;
+
+  for(outgoing = 0; outgoing < 2; ++outgoing) {
+    for(entry = outgoing ? sad_get_first_outgoing_entry() : sad_get_first_incoming_entry();
+        entry != NULL; entry = list_item_next(entry)) {
+      if(index-- == 0) {
+        return snprintf(buf, len, "sa %s %lx %lu %lu %lu %lu %lu",
+                        outgoing ? "out" : "in",
+                        (unsigned long)uip_ntohl(entry->spi),
+                        (unsigned long)entry->stats.packets,
+                        (unsigned long)entry->bytes_transported,
+                        (unsigned long)entry->stats.replay_drops,
+                        (unsigned long)entry->stats.icv_failures,
+                        (unsigned long)entry->stats.policy_drops);
+      }
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+ipsec_stats_line(uint16_t index, char *buf, uint16_t len)
+{
+  int ret;
+  uint8_t i;
+
+  if(index < IPSEC_DROP_REASONS) {
+    ret = snprintf(buf, len, "drop %s %lu", drop_names[index], (unsigned long)ipsec_drops[index]);
+  } else {
+    index -= IPSEC_DROP_REASONS;
+
+    /* Only the transforms that have been used */
+    for(i = 0; i < IPSEC_STATS_XFORMS && xform_stats[i].calls > 0; ++i) {
+      if(index == i) {
+        break;
+      }
+    }
+    if(i < IPSEC_STATS_XFORMS && xform_stats[i].calls > 0) {
+      ret = snprintf(buf, len, "xform %s %u %lu %lu %lu",
+                     op_names[xform_stats[i].op],
+                     xform_stats[i].type,
+                     (unsigned long)xform_stats[i].calls,
+                     (unsigned long)xform_stats[i].bytes,
+                     (unsigned long)xform_stats[i].ticks);
+    } else {
+      ret = sa_line(index - i, buf, len);
+    }
+  }
+
+  if(ret < 0) {
+    return 0;
+  }
+  return ret < len ? ret : len - 1;
+}
+/*---------------------------------------------------------------------------*/
+
+#endif /* WITH_IPSEC_STATS */
+
+/** @} */
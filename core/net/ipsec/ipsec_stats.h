@@ -0,0 +1,134 @@
+/**
+ * \addtogroup ipsec
+ * @{
+ */
+
+/**
+ * \file
+ * 		IPsec statistics: per-SA counters, drop reasons and transform cost
+ * \details
+ * 		Every SAD entry counts its packets (bytes are kept in bytes_transported), replayed packets,
+ * 		ICV failures and packets rejected by its selector. Packets that are dropped by uIP's IPsec
+ * 		processing are also counted per reason, regardless of whether an SA is involved.
+ *
+ * 		The ESP transforms are timed with the rtimer; the time spent (in rtimer ticks, see
+ * 		RTIMER_ARCH_SECOND), number of calls and bytes processed are accumulated per operation
+ * 		and transform type.
+ *
+ * 		The statistics are presented one record per line by ipsec_stats_line(), which is used
+ * 		by the shell command ipsec-stats and the CoAP resource of the er-rest-example.
+ */
+
+#ifndef __IPSEC_STATS_H__
+#define __IPSEC_STATS_H__
+
+#include "ipsec.h"
+
+#if WITH_IPSEC_STATS
+
+#include <string.h>
+#include "sys/rtimer.h"
+
+/**
+  * Number of (operation, transform) pairs that we keep accounts for
+  */
+#ifdef IPSEC_STATS_CONF_XFORMS
+#define IPSEC_STATS_XFORMS IPSEC_STATS_CONF_XFORMS
+#else
+#define IPSEC_STATS_XFORMS 4
+#endif
+
+/**
+  * Reasons for dropping a packet in uIP's IPsec processing
+  */
+typedef enum {
+  IPSEC_DROP_NO_SA,           // Incoming: Unknown SPI
+  IPSEC_DROP_ICV,             // Incoming: ICV mismatch
+  IPSEC_DROP_REPLAY,          // Incoming: Replayed sequence number
+  IPSEC_DROP_SELECTOR,        // Incoming: Protected packet outside of its SA's selector
+  IPSEC_DROP_UNPROTECTED,     // Incoming: Unprotected packet with policy PROTECT or DISCARD
+  IPSEC_DROP_OUT_NO_SA,       // Outgoing: Policy PROTECT, but no SA (yet)
+  IPSEC_DROP_OUT_DISCARD,     // Outgoing: Policy DISCARD
+  IPSEC_DROP_SEQNO_OVERFLOW,  // Outgoing: Sequence number overflow
+  IPSEC_DROP_REASONS
+} ipsec_drop_reason_t;
+
+/**
+  * Per-SA counters. Member of sad_entry_t.
+  */
+typedef struct {
+  uint32_t packets;
+  uint32_t replay_drops;
+  uint32_t icv_failures;
+  uint32_t policy_drops;
+} ipsec_sa_stats_t;
+
+/**
+  * Operations of the transforms
+  */
+#define IPSEC_STATS_OP_ENCRYPT  0
+#define IPSEC_STATS_OP_DECRYPT  1
+#define IPSEC_STATS_OP_INTEG    2
+
+typedef struct {
+  uint8_t op;       // IPSEC_STATS_OP_*
+  uint8_t type;     // SA_ENCR_* or SA_INTEG_*
+  uint32_t calls;
+  uint32_t bytes;
+  uint32_t ticks;   // rtimer ticks
+} ipsec_xform_stats_t;
+
+extern uint32_t ipsec_drops[IPSEC_DROP_REASONS];
+
+#define IPSEC_STATS_DROP(reason) (++ipsec_drops[reason])
+#define IPSEC_STATS_SA_INC(entry, counter) (++(entry)->stats.counter)
+#define IPSEC_STATS_SA_PACKET(entry, len)   \
+  do {                                      \
+    ++(entry)->stats.packets;               \
+    (entry)->bytes_transported += (len);    \
+  } while(0)
+#define IPSEC_STATS_SA_RESET(entry) memset(&(entry)->stats, 0, sizeof(ipsec_sa_stats_t))
+
+/**
+  * Declares the variable var and stores the current time in it. To be placed before the
+  * invocation of a transform that is recorded with IPSEC_STATS_XFORM().
+  */
+#define IPSEC_STATS_TIMESTAMP(var) rtimer_clock_t var = RTIMER_NOW()
+#define IPSEC_STATS_XFORM(op, type, len, start) ipsec_stats_xform(op, type, len, start)
+
+/**
+  * Adds one call to transform type with len bytes of data that was started at the given time.
+  * Transforms beyond the first IPSEC_STATS_XFORMS are not accounted for.
+  */
+void ipsec_stats_xform(uint8_t op, uint8_t type, uint16_t len, rtimer_clock_t start);
+
+/**
+  * Resets the drop reason and transform counters as well as the counters of all SAs
+  */
+void ipsec_stats_reset(void);
+
+/**
+  * Writes record number index of the statistics as a line of text (without line break) to buf.
+  * The records are drop reasons ("drop <reason> <count>"), transforms
+  * ("xform <op> <type> <calls> <bytes> <ticks>") and SAs
+  * ("sa <in|out> <SPI> <packets> <bytes> <replay drops> <ICV failures> <policy drops>"),
+  * in that order.
+  *
+  * \return The length of the line, or 0 if there's no such record
+  */
+uint16_t ipsec_stats_line(uint16_t index, char *buf, uint16_t len);
+
+#else
+
+#define IPSEC_STATS_DROP(reason)
+#define IPSEC_STATS_SA_INC(entry, counter)
+#define IPSEC_STATS_SA_PACKET(entry, len)
+#define IPSEC_STATS_SA_RESET(entry)
+#define IPSEC_STATS_TIMESTAMP(var)
+#define IPSEC_STATS_XFORM(op, type, len, start)
+
+#endif /* WITH_IPSEC_STATS */
+
+#endif
+
+/** @} */
@@ -51,6 +51,7 @@
 #include "ipsec_malloc.h"
 #include "sad.h"
 #include "spd.h"
+#include "sad_store.h"
 
 
 // Security Association Database
@@ -80,6 +81,10 @@ void sad_init()
 	#if WITH_CONF_MANUAL_SA
   sad_conf();
 	#endif
+
+  #if WITH_IPSEC_SAD_STORE
+  sad_store_restore();
+  #endif
 }
 
 
@@ -145,6 +150,9 @@ sad_entry_t *sad_create_outgoing_entry(uint32_t time_of_creation)
   
   // Outgoing entry's SPI is usually decided by the other party
   SAD_RESET_ENTRY(newentry, time_of_creation);
+#if WITH_IPSEC_SAD_STORE
+  newentry->seqno_hwm = time_of_creation ? 0 : 0xffffffffUL;  // Manual SAs are not stored
+#endif
   list_push(sad_outgoing, newentry);
   return newentry;
 }
@@ -166,6 +174,9 @@ sad_entry_t *sad_create_incoming_entry(uint32_t time_of_creation)
 	}
 
   SAD_RESET_ENTRY(newentry, time_of_creation);
+#if WITH_IPSEC_SAD_STORE
+  newentry->seqno_hwm = time_of_creation ? 0 : 0xffffffffUL;  // Manual SAs are not stored
+#endif
   newentry->spi = uip_htonl(next_sad_local_spi++);
   list_push(sad_incoming, newentry);
 
@@ -235,6 +246,10 @@ sad_entry_t *sad_get_incoming_entry(uint32_t spi)
 void sad_remove_outgoing_entry(sad_entry_t *sad_entry)
 {
   list_remove(sad_outgoing, sad_entry);
+  #if WITH_IPSEC_SAD_STORE
+  if (sad_entry->time_of_creation)
+    sad_store_schedule();
+  #endif
 }
 
 /**
@@ -243,6 +258,23 @@ void sad_remove_outgoing_entry(sad_entry_t *sad_entry)
 void sad_remove_incoming_entry(sad_entry_t *sad_entry)
 {
   list_remove(sad_incoming, sad_entry);
+  #if WITH_IPSEC_SAD_STORE
+  if (sad_entry->time_of_creation)
+    sad_store_schedule();
+  #endif
+}
+
+/**
+  * Iteration over the SAD. Use list_item_next() to get the next entry.
+  */
+sad_entry_t *sad_get_first_incoming_entry(void)
+{
+  return list_head(sad_incoming);
+}
+
+sad_entry_t *sad_get_first_outgoing_entry(void)
+{
+  return list_head(sad_outgoing);
 }
 
 /** @} */
@@ -48,6 +48,7 @@
 #include "sa.h"
 #include "ipsec.h"
 #include "common_ipsec.h"
+#include "ipsec_stats.h"
 
 extern uint32_t next_sad_local_spi;
 
@@ -89,6 +90,7 @@ extern uint32_t next_sad_local_spi;
   entry->seqno = 0;                                   \
   entry->time_of_creation = seconds;                  \
   entry->bytes_transported = 0;                       \
+  IPSEC_STATS_SA_RESET(entry);                        \
   entry->win = 0
 
 
@@ -171,6 +173,15 @@ typedef struct x2 {
 
   // The number of bytes transported over the SA
   uint32_t bytes_transported;
+
+#if WITH_IPSEC_SAD_STORE
+  // Sequence number high-water mark of the last checkpoint (see sad_store.h)
+  uint32_t seqno_hwm;
+#endif
+
+#if WITH_IPSEC_STATS
+  ipsec_sa_stats_t stats;
+#endif
 } sad_entry_t;
 
 
@@ -187,6 +198,8 @@ sad_entry_t *sad_create_incoming_entry(uint32_t time_of_creation);
 sad_entry_t *sad_create_outgoing_entry(uint32_t time_of_creation);
 void sad_remove_outgoing_entry(sad_entry_t *sad_entry);
 void sad_remove_incoming_entry(sad_entry_t *sad_entry);
+sad_entry_t *sad_get_first_incoming_entry(void);
+sad_entry_t *sad_get_first_outgoing_entry(void);
 void sad_conf();
 
 #endif
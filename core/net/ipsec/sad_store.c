@@ -0,0 +1,472 @@
+/**
+ * \addtogroup ipsec
+ * @{
+ */
+
+/**
+ * \file
+ * 		Persistent storage of the SAD and of established IKE SAs
+ */
+
+#include <string.h>
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "sys/ctimer.h"
+#include "lib/list.h"
+#include "sad_store.h"
+
+#if WITH_IPSEC_SAD_STORE
+
+#include "ipsec_random.h"
+#include "transforms/encr.h"
+#include "transforms/integ.h"
+#include "ike/prf.h"
+#include "ike/machine.h"
+#include "ike/common_ike.h"
+
+/**
+  * File format
+  *
+  * A checkpoint is a header followed by the incoming SAs, the outgoing SAs and the IKE SAs.
+  * Every record is wrapped in the same way as an SK payload:
+  *
+  *   IV | ENCR(Record | Padding | Pad Length) | ICV
+  */
+#define STORE_MAGIC 0x53414431UL  // "SAD1"
+#define STORE_FILENAME "ipsec_sad0"
+#define STORE_FILENAME_LEN sizeof(STORE_FILENAME)
+
+#define STORE_ENCR SA_ENCR_AES_CTR
+#define STORE_ENCR_KEYLEN 16
+#define STORE_INTEG SA_INTEG_AES_XCBC_MAC_96
+#define STORE_IVLEN 8
+
+// Length of a wrapped record of len bytes (see espsk_pad())
+#define WRAPPED_LEN(len) (STORE_IVLEN + ((len) + 1) / 4 * 4 + 4 + IPSEC_ICVLEN)
+
+typedef struct {
+  uint32_t magic;
+  uint32_t generation;
+  uint32_t ops;             // Next IV (counter) value to be used after this checkpoint
+  uint32_t next_local_spi;
+  uint8_t incoming;
+  uint8_t outgoing;
+  uint8_t ike;
+} store_hdr_t;
+
+typedef struct {
+  uip_ip6addr_t peer;
+  uint32_t spi;
+  sa_child_t sa;
+  uint32_t seqno;
+  uint32_t time_of_creation;
+  uint8_t nextlayer_proto;
+  uint16_t my_port_from, my_port_to;
+  uint16_t peer_port_from, peer_port_to;
+} store_sa_t;
+
+typedef struct {
+  uip_ip6addr_t peer;
+  uint16_t initiator_and_my_spi;
+  uint32_t peer_spi_high, peer_spi_low;
+  uint8_t my_msg_id, peer_msg_id;
+  sa_ike_t sa;
+} store_ike_t;
+
+#define RECORD_MAXLEN (sizeof(store_ike_t) > sizeof(store_sa_t) ? sizeof(store_ike_t) : sizeof(store_sa_t))
+
+static uint8_t encr_keymat[SA_ENCR_MAX_KEYMATLEN];
+static uint8_t integ_keymat[SA_INTEG_MAX_KEYMATLEN];
+static uint8_t keys_derived;
+static uint32_t generation;
+static uint32_t store_ops;
+static struct ctimer checkpoint_timer;
+
+/*---------------------------------------------------------------------------*/
+static void
+store_filename(char *name, uint32_t gen)
+{
+  memcpy(name, STORE_FILENAME, STORE_FILENAME_LEN);
+  name[STORE_FILENAME_LEN - 2] += gen & 1;
+}
+
+/**
+  * Derives the store's keys from the device key:
+  *
+  *   {encryption key | integrity key} = prf+(device key, "IPsec SAD store")
+  */
+static void
+derive_keys(void)
+{
+  static const char label[] = "IPsec SAD store";
+  uint8_t device_key[] = IPSEC_SAD_STORE_DEVICE_KEY;
+  uint8_t *chunks[] = { encr_keymat, integ_keymat };
+  uint8_t chunks_len[] = { SA_ENCR_MAX_KEYMATLEN, SA_INTEG_KEYMATLEN_BY_TYPE(STORE_INTEG) };
+
+  if (keys_derived)
+    return;
+
+  prfplus_data_t prfplus_data = {
+    .prf = SA_PRF_HMAC_SHA1,
+    .key = device_key,
+    .keylen = sizeof(device_key),
+    .no_chunks = sizeof(chunks_len),
+    .data = (uint8_t *) label,
+    .datalen = sizeof(label) - 1,
+    .chunks = chunks,
+    .chunks_len = chunks_len
+  };
+  prf_plus(&prfplus_data);
+  keys_derived = 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  * Encrypts and integrity protects record, writing the result to fd
+  *
+  * \return 1 upon success, 0 otherwise
+  */
+static uint8_t
+write_record(int fd, const void *record, uint8_t len)
+{
+  uint8_t buf[WRAPPED_LEN(RECORD_MAXLEN)];
+
+  memset(buf, 0, STORE_IVLEN);
+  memcpy(buf + STORE_IVLEN, record, len);
+
+  encr_data_t encr_data = {
+    .type = STORE_ENCR,
+    .keymat = encr_keymat,
+    .keylen = STORE_ENCR_KEYLEN,
+    .integ_data = buf,
+    .encr_data = buf,
+    .encr_datalen = STORE_IVLEN + len,
+    .ip_next_hdr = NULL,
+    .ops = store_ops++
+  };
+  espsk_pack(&encr_data);
+
+  integ_data_t integ_data = {
+    .type = STORE_INTEG,
+    .data = buf,
+    .datalen = encr_data.encr_datalen,
+    .keymat = integ_keymat,
+    .out = buf + encr_data.encr_datalen
+  };
+  integ(&integ_data);
+
+  return cfs_write(fd, buf, WRAPPED_LEN(len)) == WRAPPED_LEN(len);
+}
+
+/**
+  * Reads, verifies and decrypts a record of len bytes from fd
+  *
+  * \return 1 upon success, 0 otherwise
+  */
+static uint8_t
+read_record(int fd, void *record, uint8_t len)
+{
+  uint8_t buf[WRAPPED_LEN(RECORD_MAXLEN)];
+  uint8_t icv[IPSEC_ICVLEN];
+  uint16_t integ_datalen = WRAPPED_LEN(len) - IPSEC_ICVLEN;
+
+  if (cfs_read(fd, buf, WRAPPED_LEN(len)) != WRAPPED_LEN(len))
+    return 0;
+
+  integ_data_t integ_data = {
+    .type = STORE_INTEG,
+    .data = buf,
+    .datalen = integ_datalen,
+    .keymat = integ_keymat,
+    .out = icv
+  };
+  integ(&integ_data);
+  if (memcmp(icv, buf + integ_datalen, IPSEC_ICVLEN))
+    return 0;
+
+  encr_data_t encr_data = {
+    .type = STORE_ENCR,
+    .keymat = encr_keymat,
+    .keylen = STORE_ENCR_KEYLEN,
+    .integ_data = buf,
+    .encr_data = buf,
+    .encr_datalen = integ_datalen,
+    .ip_next_hdr = NULL
+  };
+  espsk_unpack(&encr_data);
+  memcpy(record, buf + STORE_IVLEN, len);
+  return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+  * Opens the most recent valid checkpoint and reads its header
+  *
+  * \return A file descriptor positioned after the header, or -1 if there's no valid checkpoint
+  */
+static int
+open_checkpoint(store_hdr_t *hdr)
+{
+  char name[STORE_FILENAME_LEN];
+  store_hdr_t candidate;
+  uint8_t file;
+  int fd, best = -1;
+
+  derive_keys();
+
+  for (file = 0; file < 2; ++file) {
+    store_filename(name, file);
+    fd = cfs_open(name, CFS_READ);
+    if (fd < 0)
+      continue;
+    if (read_record(fd, &candidate, sizeof(candidate)) && candidate.magic == STORE_MAGIC &&
+        (best < 0 || (int32_t) (candidate.generation - hdr->generation) > 0)) {
+      memcpy(hdr, &candidate, sizeof(candidate));
+      best = file;
+    }
+    cfs_close(fd);
+  }
+
+  if (best < 0)
+    return -1;
+
+  store_filename(name, best);
+  fd = cfs_open(name, CFS_READ);
+  if (fd >= 0 && !read_record(fd, &candidate, sizeof(candidate))) {
+    cfs_close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/*---------------------------------------------------------------------------*/
+static void
+sa_to_record(store_sa_t *record, const sad_entry_t *entry)
+{
+  memcpy(&record->peer, &entry->peer, sizeof(uip_ip6addr_t));
+  record->spi = entry->spi;
+  memcpy(&record->sa, &entry->sa, sizeof(sa_child_t));
+  record->time_of_creation = entry->time_of_creation;
+  record->nextlayer_proto = entry->traffic_desc.nextlayer_proto;
+  record->my_port_from = entry->traffic_desc.my_port_from;
+  record->my_port_to = entry->traffic_desc.my_port_to;
+  record->peer_port_from = entry->traffic_desc.peer_port_from;
+  record->peer_port_to = entry->traffic_desc.peer_port_to;
+}
+
+static void
+record_to_sa(sad_entry_t *entry, const store_sa_t *record)
+{
+  memcpy(&entry->peer, &record->peer, sizeof(uip_ip6addr_t));
+  entry->spi = record->spi;
+  memcpy(&entry->sa, &record->sa, sizeof(sa_child_t));
+  entry->seqno = entry->seqno_hwm = record->seqno;
+  entry->time_of_creation = record->time_of_creation;
+  entry->traffic_desc.peer_addr_from = entry->traffic_desc.peer_addr_to = &entry->peer;
+  entry->traffic_desc.nextlayer_proto = record->nextlayer_proto;
+  entry->traffic_desc.my_port_from = record->my_port_from;
+  entry->traffic_desc.my_port_to = record->my_port_to;
+  entry->traffic_desc.peer_port_from = record->peer_port_from;
+  entry->traffic_desc.peer_port_to = record->peer_port_to;
+}
+
+#define IKE_SESSION_IS_ESTABLISHED(session) ((session)->next_state_fn == &ike_statem_state_established_handler)
+
+/*---------------------------------------------------------------------------*/
+void
+sad_store_restore(void)
+{
+  store_hdr_t hdr;
+  store_sa_t record;
+  sad_entry_t *entry;
+  uint8_t i;
+  int fd;
+
+  fd = open_checkpoint(&hdr);
+  if (fd < 0) {
+    PRINTF(IPSEC "SAD store: No checkpoint found\n");
+    // Our IV counter is lost. Continue at a random offset.
+    store_ops = ((uint32_t) rand16() << 16) | rand16();
+    return;
+  }
+  generation = hdr.generation;
+  store_ops = hdr.ops;
+  if (hdr.next_local_spi > next_sad_local_spi)
+    next_sad_local_spi = hdr.next_local_spi;
+
+  for (i = 0; i < hdr.incoming + hdr.outgoing; ++i) {
+    if (!read_record(fd, &record, sizeof(record))) {
+      PRINTF(IPSEC_ERROR "SAD store: Corrupt SA record\n");
+      break;
+    }
+    if (i < hdr.incoming) {
+      entry = sad_create_incoming_entry(record.time_of_creation);
+      if (entry == NULL)
+        break;
+      record_to_sa(entry, &record);
+      // Every sequence number up to the high-water mark is regarded as seen
+      entry->win = 0xffffffffUL;
+    }
+    else {
+      entry = sad_create_outgoing_entry(record.time_of_creation);
+      if (entry == NULL)
+        break;
+      // The sequence number continues at the high-water mark
+      record_to_sa(entry, &record);
+    }
+    PRINTF(IPSEC "SAD store: Restored %s SA with SPI %x at sequence number %u\n", i < hdr.incoming ? "incoming" : "outgoing", uip_ntohl(entry->spi), entry->seqno);
+  }
+  cfs_close(fd);
+}
+
+/*---------------------------------------------------------------------------*/
+void
+sad_store_restore_ike(void)
+{
+  store_hdr_t hdr;
+  store_ike_t record;
+  ike_statem_session_t *session;
+  uint8_t i;
+  int fd;
+
+  fd = open_checkpoint(&hdr);
+  if (fd < 0)
+    return;
+
+  // Skip the SAD records
+  cfs_seek(fd, (hdr.incoming + hdr.outgoing) * WRAPPED_LEN(sizeof(store_sa_t)), CFS_SEEK_CUR);
+
+  for (i = 0; i < hdr.ike; ++i) {
+    if (!read_record(fd, &record, sizeof(record))) {
+      PRINTF(IPSEC_ERROR "SAD store: Corrupt IKE SA record\n");
+      break;
+    }
+    session = ike_statem_restore_session();
+    if (session == NULL)
+      break;
+    memcpy(&session->peer, &record.peer, sizeof(uip_ip6addr_t));
+    session->initiator_and_my_spi = record.initiator_and_my_spi;
+    session->peer_spi_high = record.peer_spi_high;
+    session->peer_spi_low = record.peer_spi_low;
+    session->my_msg_id = record.my_msg_id;
+    session->peer_msg_id = record.peer_msg_id;
+    memcpy(&session->sa, &record.sa, sizeof(sa_ike_t));
+    PRINTF(IPSEC "SAD store: Restored IKE SA with local SPI %u\n", IKE_STATEM_MYSPI_GET_MYSPI(session));
+  }
+  cfs_close(fd);
+}
+
+/*---------------------------------------------------------------------------*/
+void
+sad_store_checkpoint(void)
+{
+  char name[STORE_FILENAME_LEN];
+  store_hdr_t hdr;
+  store_sa_t sa_record;
+  store_ike_t ike_record;
+  sad_entry_t *entry;
+  ike_statem_session_t *session;
+  uint8_t pass;
+  int fd;
+
+  ctimer_stop(&checkpoint_timer);
+  derive_keys();
+
+  memset(&hdr, 0, sizeof(hdr));
+  for (entry = sad_get_first_incoming_entry(); entry != NULL; entry = list_item_next(entry))
+    hdr.incoming += entry->time_of_creation != 0;
+  for (entry = sad_get_first_outgoing_entry(); entry != NULL; entry = list_item_next(entry))
+    hdr.outgoing += entry->time_of_creation != 0;
+  for (session = ike_statem_get_first_session(); session != NULL; session = list_item_next(session))
+    hdr.ike += IKE_SESSION_IS_ESTABLISHED(session);
+
+  hdr.magic = STORE_MAGIC;
+  hdr.generation = ++generation;
+  hdr.next_local_spi = next_sad_local_spi;
+  hdr.ops = store_ops + 1 + hdr.incoming + hdr.outgoing + hdr.ike;
+
+  // Overwrite the older of the two checkpoints
+  store_filename(name, generation);
+  cfs_remove(name);
+  fd = cfs_open(name, CFS_WRITE);
+  if (fd < 0) {
+    PRINTF(IPSEC_ERROR "SAD store: Could not open %s\n", name);
+    return;
+  }
+
+  if (!write_record(fd, &hdr, sizeof(hdr)))
+    goto fail;
+
+  for (pass = 0; pass < 2; ++pass) {
+    for (entry = pass ? sad_get_first_outgoing_entry() : sad_get_first_incoming_entry(); entry != NULL; entry = list_item_next(entry)) {
+      if (!entry->time_of_creation)
+        continue;   // Manual SA
+      sa_to_record(&sa_record, entry);
+      entry->seqno_hwm = entry->seqno + IPSEC_SAD_STORE_SEQNO_GAP;
+      sa_record.seqno = entry->seqno_hwm;
+      if (!write_record(fd, &sa_record, sizeof(sa_record)))
+        goto fail;
+    }
+  }
+
+  for (session = ike_statem_get_first_session(); session != NULL; session = list_item_next(session)) {
+    if (!IKE_SESSION_IS_ESTABLISHED(session))
+      continue;
+    memcpy(&ike_record.peer, &session->peer, sizeof(uip_ip6addr_t));
+    ike_record.initiator_and_my_spi = session->initiator_and_my_spi;
+    ike_record.peer_spi_high = session->peer_spi_high;
+    ike_record.peer_spi_low = session->peer_spi_low;
+    ike_record.my_msg_id = session->my_msg_id;
+    ike_record.peer_msg_id = session->peer_msg_id;
+    memcpy(&ike_record.sa, &session->sa, sizeof(sa_ike_t));
+    if (!write_record(fd, &ike_record, sizeof(ike_record)))
+      goto fail;
+  }
+
+  cfs_close(fd);
+  store_ops = hdr.ops;
+  PRINTF(IPSEC "SAD store: Checkpoint %u written (%u incoming, %u outgoing, %u IKE SAs)\n", generation, hdr.incoming, hdr.outgoing, hdr.ike);
+  return;
+
+  fail:
+  PRINTF(IPSEC_ERROR "SAD store: Could not write checkpoint\n");
+  cfs_close(fd);
+  cfs_remove(name);
+  --generation;
+  store_ops = hdr.ops;
+}
+
+/*---------------------------------------------------------------------------*/
+static void
+checkpoint_timeout(void *ptr)
+{
+  sad_store_checkpoint();
+}
+
+void
+sad_store_schedule(void)
+{
+  if (ctimer_expired(&checkpoint_timer))
+    ctimer_set(&checkpoint_timer, IPSEC_SAD_STORE_DELAY, checkpoint_timeout, NULL);
+}
+
+void
+sad_store_seqno_reached(sad_entry_t *entry, uint8_t outgoing)
+{
+  if (!entry->time_of_creation)
+    return;   // Manual SAs are not stored
+
+  /**
+    * An outgoing SA must never pass its high-water mark as the sequence number serves as the IV of
+    * AES-CTR. The packets of an incoming SA past the mark could be replayed after a reset. If a
+    * scheduled checkpoint hasn't been taken yet we take it now.
+    */
+  if (entry->seqno >= entry->seqno_hwm)
+    sad_store_checkpoint();
+  else
+    sad_store_schedule();
+}
+
+#endif /* WITH_IPSEC_SAD_STORE */
+
+/** @} */
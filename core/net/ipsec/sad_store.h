@@ -0,0 +1,104 @@
+/**
+ * \addtogroup ipsec
+ * @{
+ */
+
+/**
+ * \file
+ * 		Persistent storage of the SAD and of established IKE SAs
+ * \details
+ * 		SAs negotiated by IKE live in RAM and are lost upon reboot, forcing every peer to
+ * 		renegotiate. When this store is enabled, the dynamic SAD entries and the established
+ * 		IKE SAs are checkpointed to CFS (Coffee on most platforms) and restored by sad_init()
+ * 		and ike_statem_init(), respectively.
+ *
+ * 		Every record is encrypted (AES-CTR) and integrity protected (AES-XCBC-MAC-96) with keys
+ * 		derived from the device key IPSEC_SAD_STORE_DEVICE_KEY. Checkpoints alternate between
+ * 		two files so that a reset in the middle of a write leaves the previous one intact.
+ *
+ * 		Sequence numbers are not written for every packet. An SA is instead stored with a
+ * 		high-water mark of its sequence number plus IPSEC_SAD_STORE_SEQNO_GAP, and restored at that
+ * 		value. A new checkpoint is taken before the mark is reached. An outgoing SA thus never
+ * 		reuses a sequence number. An incoming SA is restored with a full replay window at the mark,
+ * 		so that no packet received before the reset can be replayed. The peer's packets below the
+ * 		mark are dropped as replays until its sequence number passes it.
+ *
+ * 		IKE SAs are restored as established sessions, which take part in no exchange.
+ */
+
+#ifndef __SAD_STORE_H__
+#define __SAD_STORE_H__
+
+#include "sad.h"
+
+#if WITH_IPSEC_SAD_STORE
+
+/**
+  * The distance between the sequence number of an outgoing SA and the high-water mark that
+  * is written to storage. Half of it is consumed before a new checkpoint is scheduled.
+  */
+#ifdef IPSEC_SAD_STORE_CONF_SEQNO_GAP
+#define IPSEC_SAD_STORE_SEQNO_GAP IPSEC_SAD_STORE_CONF_SEQNO_GAP
+#else
+#define IPSEC_SAD_STORE_SEQNO_GAP 256
+#endif
+
+/**
+  * Delay of scheduled checkpoints. Coalesces the writes caused by a burst of SA changes.
+  */
+#ifdef IPSEC_SAD_STORE_CONF_DELAY
+#define IPSEC_SAD_STORE_DELAY IPSEC_SAD_STORE_CONF_DELAY
+#else
+#define IPSEC_SAD_STORE_DELAY (2 * CLOCK_SECOND)
+#endif
+
+/**
+  * 16 byte device key (array initializer) from which the keys protecting the store are derived.
+  * It must be unique per device and kept secret, so there is no default.
+  */
+#ifdef IPSEC_SAD_STORE_CONF_DEVICE_KEY
+#define IPSEC_SAD_STORE_DEVICE_KEY IPSEC_SAD_STORE_CONF_DEVICE_KEY
+#else
+#error "The SAD store needs a device key. Define IPSEC_SAD_STORE_CONF_DEVICE_KEY."
+#endif
+
+/**
+  * To be called after the sequence number of a dynamic SA has been updated (sent or received)
+  */
+#define SAD_STORE_SEQNO_UPDATED(entry, outgoing)                                  \
+  do {                                                                            \
+    if ((entry)->seqno + IPSEC_SAD_STORE_SEQNO_GAP / 2 >= (entry)->seqno_hwm)     \
+      sad_store_seqno_reached(entry, outgoing);                                   \
+  } while(0)
+
+/**
+  * Restores the SAD from storage. Called by sad_init().
+  */
+void sad_store_restore(void);
+
+/**
+  * Restores the established IKE SAs from storage. Called by ike_statem_init().
+  */
+void sad_store_restore_ike(void);
+
+/**
+  * Schedules a checkpoint IPSEC_SAD_STORE_DELAY from now
+  */
+void sad_store_schedule(void);
+
+/**
+  * Writes all dynamic SAs and established IKE SAs to storage immediately
+  */
+void sad_store_checkpoint(void);
+
+void sad_store_seqno_reached(sad_entry_t *entry, uint8_t outgoing);
+
+#else
+
+#define SAD_STORE_SEQNO_UPDATED(entry, outgoing)
+
+#endif /* WITH_IPSEC_SAD_STORE */
+
+#endif
+
+/** @} */
@@ -80,6 +80,9 @@
 		      this #ifndef removes the entire compilation
 		      output of the uip.c file */
 
+#if UIP_TCP_SNDBUF_SIZE
+#error The TCP send buffer (UIP_CONF_TCP_SNDBUF_SIZE) requires NETSTACK_CONF_WITH_IPV6
+#endif /* UIP_TCP_SNDBUF_SIZE */
 
 #if NETSTACK_CONF_WITH_IPV6
 #include "net/ipv4/uip-neighbor.h"
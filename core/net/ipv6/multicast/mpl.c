@@ -0,0 +1,1163 @@
+/**
+ * \addtogroup mpl
+ * @{
+ */
+/**
+ * \file
+ *    Implementation of the MPL multicast engine
+ */
+
+#include "contiki.h"
+#include "contiki-lib.h"
+#include "contiki-net.h"
+#include "lib/trickle-timer.h"
+#include "net/ipv6/uip-icmp6.h"
+#include "net/ipv6/multicast/uip-mcast6.h"
+#include "net/ipv6/multicast/mpl.h"
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/ip/uip-debug.h"
+
+/*---------------------------------------------------------------------------*/
+/* Data Representation */
+/*---------------------------------------------------------------------------*/
+/*
+ * A seed ID of 16, 64 or 128 bits. The seed ID of a datagram with S=0 is
+ * its source address, which is kept as a 128-bit seed ID.
+ */
+typedef struct seed_id {
+  uint8_t len;
+  uint8_t id[16];
+} seed_id_t;
+
+#define seed_id_cmp(a, b) \
+  ((a)->len == (b)->len && memcmp((a)->id, (b)->id, (a)->len) == 0)
+#define PRINT_SEED(s) PRINTF("0x%02x%02x/%u", (s)->id[(s)->len - 2], \
+                             (s)->id[(s)->len - 1], (s)->len)
+
+/* Length of the seed ID for each value of S in an MPL option... */
+static const uint8_t hbho_seed_id_len[4] = { 0, 2, 8, 16 };
+/* ...and in an MPL Seed Info, where S=0 stands for a source address */
+static const uint8_t seed_info_id_len[4] = { 16, 2, 8, 16 };
+
+/*
+ * Sequence Values: serial number arithmetic (RFC 1982) with 8 bits.
+ * A sequence value is lower than the next 127 ones.
+ */
+#define SEQ_VAL_IS_LT(a, b)  ((int8_t)((uint8_t)(a) - (uint8_t)(b)) < 0)
+#define SEQ_VAL_IS_GEQ(a, b) (!SEQ_VAL_IS_LT(a, b))
+
+/* MPL Domains */
+struct mpl_domain {
+  uip_ipaddr_t addr;
+  struct trickle_timer tt;      /* Control messages */
+  uint8_t e;                    /* Expirations of tt since its last reset */
+  uint8_t seq;                  /* Our next sequence value as a seed */
+  uint8_t used;
+};
+
+/* Seed Set entries, chained in the buckets of the seed index */
+struct mpl_seed {
+  struct mpl_seed *next;
+  struct mpl_domain *domain;
+  LIST_STRUCT(msgs);            /* Buffered datagrams, by sequence value */
+  seed_id_t seed_id;
+  uint8_t min_seq;              /* Lower sequence values count as received */
+  uint8_t advanced;             /* min_seq has passed a received datagram */
+  uint8_t count;
+  uint8_t lifetime;             /* Minutes */
+  uint8_t listed;               /* Listed in the current ICMP message */
+};
+
+/* Buffered Message Set entries */
+struct mpl_msg {
+  struct mpl_msg *next;
+  struct mpl_seed *seed;
+  struct trickle_timer tt;
+  uint16_t buff_len;
+  uint8_t opt_offset;           /* Offset of the MPL option in buff */
+  uint8_t seq;
+  uint8_t e;                    /* Expirations of tt since its last reset */
+  uint8_t age;                  /* Minutes since tt stopped */
+  uint8_t buff[UIP_BUFSIZE - UIP_LLH_LEN];
+};
+
+/**
+ * \brief Get the TTL of a buffered datagram
+ * m: pointer to a struct mpl_msg
+ */
+#define MPL_MSG_TTL(m) (((struct uip_ip_hdr *)(m)->buff)->ttl)
+/*---------------------------------------------------------------------------*/
+/* MPL HBH Option */
+struct mpl_hbho {
+  uint8_t type;
+  uint8_t len;
+  uint8_t flags;                /* S (2 bits), M, V, reserved */
+  uint8_t seq;
+  /* Followed by a seed ID of 0, 2, 8 or 16 bytes */
+};
+
+#define HBHO_BASE_LEN            2
+#define HBHO_GET_S(h)            ((h)->flags >> 6)
+#define HBHO_M_BIT            0x20
+#define HBHO_V_BIT            0x10
+#define HBHO_SEED_ID(h)          ((uint8_t *)(h) + sizeof(struct mpl_hbho))
+/*---------------------------------------------------------------------------*/
+/* MPL Seed Info, in control messages */
+struct seed_info {
+  uint8_t min_seq;
+  uint8_t bm_len_s;             /* Length of the bitmap (6 bits), S */
+  /* Followed by the seed ID and the bitmap of buffered datagrams */
+};
+
+#define SEED_INFO_GET_BM_LEN(i)  ((i)->bm_len_s >> 2)
+#define SEED_INFO_GET_S(i)       ((i)->bm_len_s & 0x03)
+/* Longer bitmaps cover more sequence values than the 8-bit space can hold */
+#define SEED_INFO_MAX_BM_LEN       16
+/*---------------------------------------------------------------------------*/
+/* Maintain Stats */
+#if UIP_MCAST6_STATS
+static struct mpl_stats stats;
+
+#define MPL_STATS_ADD(x) stats.x++
+#define MPL_STATS_INIT() do { memset(&stats, 0, sizeof(stats)); } while(0)
+#else /* UIP_MCAST6_STATS */
+#define MPL_STATS_ADD(x)
+#define MPL_STATS_INIT()
+#endif
+/*---------------------------------------------------------------------------*/
+/* Internal Data Structures */
+/*---------------------------------------------------------------------------*/
+static struct mpl_domain domains[MPL_DOMAIN_SET_SIZE];
+MEMB(seed_memb, struct mpl_seed, MPL_SEED_SET_SIZE);
+MEMB(msg_memb, struct mpl_msg, MPL_BUFFERED_MESSAGE_SET_SIZE);
+static struct mpl_seed *seed_index[MPL_SEED_HASH_SIZE];
+static struct ctimer lifetime_timer;
+/*---------------------------------------------------------------------------*/
+/* uIPv6 Pointers */
+/*---------------------------------------------------------------------------*/
+#define UIP_EXT_BUF       ((struct uip_ext_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+#define UIP_IP_BUF        ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_ICMP_BUF      ((struct uip_icmp_hdr *)&uip_buf[uip_l2_l3_hdr_len])
+#define UIP_ICMP_PAYLOAD  ((unsigned char *)&uip_buf[uip_l2_l3_icmp_hdr_len])
+extern uint16_t uip_slen;
+/*---------------------------------------------------------------------------*/
+/* Local function prototypes */
+/*---------------------------------------------------------------------------*/
+static void icmp_input(void);
+static void control_timer_expired(void *ptr, uint8_t suppress);
+static void msg_timer_expired(void *ptr, uint8_t suppress);
+static void msg_free(struct mpl_msg *m);
+/*---------------------------------------------------------------------------*/
+/* MPL ICMPv6 handler declaration */
+UIP_ICMP6_HANDLER(mpl_icmp_handler, ICMP6_MPL,
+                  UIP_ICMP6_HANDLER_CODE_ANY, icmp_input);
+/*---------------------------------------------------------------------------*/
+/* MPL Domains */
+/*---------------------------------------------------------------------------*/
+/* The link-scoped address with the group ID of a domain */
+static void
+domain_link_scoped_addr(uip_ipaddr_t *dst, const uip_ipaddr_t *addr)
+{
+  uip_ipaddr_copy(dst, addr);
+  dst->u8[1] = (addr->u8[1] & 0xF0) | UIP_MCAST6_SCOPE_LINK_LOCAL;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The domain of a multicast address. Unless exact, the scope of the
+ * address is ignored, to find the domain of a control message.
+ */
+static struct mpl_domain *
+domain_lookup(const uip_ipaddr_t *addr, uint8_t exact)
+{
+  struct mpl_domain *d;
+
+  for(d = domains; d < &domains[MPL_DOMAIN_SET_SIZE]; d++) {
+    if(d->used &&
+       addr->u8[0] == d->addr.u8[0] &&
+       (exact ? addr->u8[1] == d->addr.u8[1] :
+        (addr->u8[1] & 0xF0) == (d->addr.u8[1] & 0xF0)) &&
+       memcmp(&addr->u8[2], &d->addr.u8[2], sizeof(uip_ipaddr_t) - 2) == 0) {
+      return d;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static struct mpl_domain *
+domain_add(const uip_ipaddr_t *addr)
+{
+  struct mpl_domain *d;
+  uip_ipaddr_t link_scoped;
+
+  for(d = domains; d < &domains[MPL_DOMAIN_SET_SIZE]; d++) {
+    if(!d->used) {
+      /* Control messages come to the link-scoped address */
+      domain_link_scoped_addr(&link_scoped, addr);
+      if(!uip_ds6_is_my_maddr(&link_scoped) &&
+         uip_ds6_maddr_add(&link_scoped) == NULL) {
+        PRINTF("MPL: No room for the domain's link-scoped address\n");
+        return NULL;
+      }
+      uip_ipaddr_copy(&d->addr, addr);
+      trickle_timer_config(&d->tt, MPL_CONTROL_MESSAGE_IMIN,
+                           MPL_CONTROL_MESSAGE_IMAX, MPL_CONTROL_MESSAGE_K);
+      trickle_timer_stop(&d->tt);
+      d->e = 0;
+      /*
+       * Neighbors that still remember our previous life drop what we send
+       * below their min_seq until its buffered datagrams and then its seed
+       * entry expire. Starting from a random value makes that less likely.
+       */
+      d->seq = random_rand();
+      d->used = 1;
+      PRINTF("MPL: New domain ");
+      PRINT6ADDR(addr);
+      PRINTF("\n");
+      return d;
+    }
+  }
+  PRINTF("MPL: No room for a new domain\n");
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Start the control message timer, or bring it back to Imin */
+static void
+control_timer_reset(struct mpl_domain *d)
+{
+  d->e = 0;
+  if(trickle_timer_is_running(&d->tt)) {
+    trickle_timer_reset_event(&d->tt);
+  } else {
+    trickle_timer_set(&d->tt, control_timer_expired, d);
+    /* A reset starts from Imin, not from a random I up to Imax */
+    trickle_timer_reset_event(&d->tt);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Seed Set */
+/*---------------------------------------------------------------------------*/
+static uint8_t
+seed_hash(const seed_id_t *s)
+{
+  return (s->id[s->len - 2] ^ s->id[s->len - 1]) & (MPL_SEED_HASH_SIZE - 1);
+}
+/*---------------------------------------------------------------------------*/
+static struct mpl_seed *
+seed_lookup(const struct mpl_domain *d, const seed_id_t *s)
+{
+  struct mpl_seed *seed;
+
+  for(seed = seed_index[seed_hash(s)]; seed != NULL; seed = seed->next) {
+    if(seed->domain == d && seed_id_cmp(&seed->seed_id, s)) {
+      return seed;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+seed_free(struct mpl_seed *seed)
+{
+  struct mpl_seed **prev;
+
+  PRINTF("MPL: Free seed ");
+  PRINT_SEED(&seed->seed_id);
+  PRINTF("\n");
+
+  for(prev = &seed_index[seed_hash(&seed->seed_id)]; *prev != NULL;
+      prev = &(*prev)->next) {
+    if(*prev == seed) {
+      *prev = seed->next;
+      break;
+    }
+  }
+  memb_free(&seed_memb, seed);
+}
+/*---------------------------------------------------------------------------*/
+/* Free the seed without buffered datagrams that is closest to expiring */
+static uint8_t
+seed_reclaim(void)
+{
+  struct mpl_seed *seed;
+  struct mpl_seed *oldest;
+  uint8_t i;
+
+  oldest = NULL;
+  for(i = 0; i < MPL_SEED_HASH_SIZE; i++) {
+    for(seed = seed_index[i]; seed != NULL; seed = seed->next) {
+      if(seed->count == 0 &&
+         (oldest == NULL || seed->lifetime < oldest->lifetime)) {
+        oldest = seed;
+      }
+    }
+  }
+  if(oldest == NULL) {
+    return 0;
+  }
+  seed_free(oldest);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static struct mpl_seed *
+seed_add(struct mpl_domain *d, const seed_id_t *s, uint8_t seq)
+{
+  struct mpl_seed *seed;
+  uint8_t h;
+
+  seed = memb_alloc(&seed_memb);
+  if(seed == NULL && seed_reclaim()) {
+    seed = memb_alloc(&seed_memb);
+  }
+  if(seed == NULL) {
+    PRINTF("MPL: No room for a new seed\n");
+    return NULL;
+  }
+
+  seed->domain = d;
+  LIST_STRUCT_INIT(seed, msgs);
+  memcpy(&seed->seed_id, s, sizeof(seed_id_t));
+  seed->min_seq = seq;
+  seed->advanced = 0;
+  seed->count = 0;
+  seed->lifetime = MPL_SEED_SET_ENTRY_LIFETIME;
+  seed->listed = 0;
+
+  h = seed_hash(s);
+  seed->next = seed_index[h];
+  seed_index[h] = seed;
+
+  PRINTF("MPL: New seed ");
+  PRINT_SEED(s);
+  PRINTF(" from %u\n", seq);
+  return seed;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Age the buffered datagrams whose timer has stopped and the seeds without
+ * buffered datagrams, and forget those that expired. Datagrams leave from
+ * the oldest on, so that min_seq keeps counting them as received.
+ */
+static void
+lifetime_tick(void *ptr)
+{
+  struct mpl_seed *seed;
+  struct mpl_seed *next;
+  struct mpl_msg *m;
+  uint8_t i;
+
+  for(i = 0; i < MPL_SEED_HASH_SIZE; i++) {
+    for(seed = seed_index[i]; seed != NULL; seed = next) {
+      next = seed->next;
+      for(m = list_head(seed->msgs); m != NULL; m = list_item_next(m)) {
+        if(!trickle_timer_is_running(&m->tt) &&
+           m->age < MPL_BUFFERED_MESSAGE_LIFETIME) {
+          m->age++;
+        }
+      }
+      while((m = list_head(seed->msgs)) != NULL &&
+            m->age >= MPL_BUFFERED_MESSAGE_LIFETIME) {
+        PRINTF("MPL: Expire seq. val %u\n", m->seq);
+        seed->min_seq = m->seq + 1;
+        seed->advanced = 1;
+        msg_free(m);
+      }
+      if(seed->count == 0) {
+        if(seed->lifetime > 0) {
+          seed->lifetime--;
+        }
+        if(seed->lifetime == 0) {
+          seed_free(seed);
+        }
+      }
+    }
+  }
+  ctimer_reset(&lifetime_timer);
+}
+/*---------------------------------------------------------------------------*/
+/* Buffered Message Set */
+/*---------------------------------------------------------------------------*/
+static struct mpl_msg *
+msg_lookup(const struct mpl_seed *seed, uint8_t seq)
+{
+  struct mpl_msg *m;
+
+  for(m = list_head(seed->msgs); m != NULL; m = list_item_next(m)) {
+    if(m->seq == seq) {
+      return m;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+msg_insert(struct mpl_seed *seed, struct mpl_msg *m)
+{
+  struct mpl_msg *prev;
+  struct mpl_msg *it;
+
+  prev = NULL;
+  for(it = list_head(seed->msgs); it != NULL && SEQ_VAL_IS_LT(it->seq, m->seq);
+      it = list_item_next(it)) {
+    prev = it;
+  }
+  if(prev == NULL) {
+    list_push(seed->msgs, m);
+  } else {
+    list_insert(seed->msgs, prev, m);
+  }
+  m->seed = seed;
+  seed->count++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+msg_free(struct mpl_msg *m)
+{
+  trickle_timer_stop(&m->tt);
+  list_remove(m->seed->msgs, m);
+  m->seed->count--;
+  memb_free(&msg_memb, m);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Make room for a new datagram. Only the oldest datagram of a seed can go,
+ * so that min_seq can move past it, and only once its timer has stopped.
+ * Datagrams that no lower missing sequence value precedes go first, then
+ * the one that stopped first. The seed then regards it as received.
+ * Datagrams still being forwarded are never dropped: the new datagram is
+ * refused instead, and a neighbor will forward it again.
+ */
+static struct mpl_msg *
+msg_reclaim(void)
+{
+  struct mpl_seed *seed;
+  struct mpl_msg *m;
+  struct mpl_msg *oldest;
+  uint8_t gap;
+  uint8_t oldest_gap;
+  uint8_t i;
+
+  oldest = NULL;
+  oldest_gap = 0;
+  for(i = 0; i < MPL_SEED_HASH_SIZE; i++) {
+    for(seed = seed_index[i]; seed != NULL; seed = seed->next) {
+      m = list_head(seed->msgs);
+      if(m == NULL || trickle_timer_is_running(&m->tt)) {
+        continue;
+      }
+      gap = m->seq != seed->min_seq;
+      if(oldest == NULL || gap < oldest_gap ||
+         (gap == oldest_gap && (m->age > oldest->age ||
+                                (m->age == oldest->age &&
+                                 seed->count > oldest->seed->count)))) {
+        oldest = m;
+        oldest_gap = gap;
+      }
+    }
+  }
+  if(oldest == NULL) {
+    return NULL;
+  }
+
+  seed = oldest->seed;
+  PRINTF("MPL: Reclaim seq. val %u from seed ", oldest->seq);
+  PRINT_SEED(&seed->seed_id);
+  PRINTF(", count was %u\n", seed->count);
+
+  seed->min_seq = oldest->seq + 1;
+  seed->advanced = 1;
+  msg_free(oldest);
+  MPL_STATS_ADD(evicted);
+  return memb_alloc(&msg_memb);
+}
+/*---------------------------------------------------------------------------*/
+/* Start the timer of a datagram, or bring it back to Imin */
+static void
+msg_timer_reset(struct mpl_msg *m)
+{
+  m->e = 0;
+  m->age = 0;
+  if(trickle_timer_is_running(&m->tt)) {
+    trickle_timer_reset_event(&m->tt);
+  } else {
+    trickle_timer_set(&m->tt, msg_timer_expired, m);
+    /* A reset starts from Imin, not from a random I up to Imax */
+    trickle_timer_reset_event(&m->tt);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+msg_send(struct mpl_msg *m)
+{
+  struct mpl_hbho *opt;
+
+  if(MPL_MSG_TTL(m) == 0) {
+    return;
+  }
+
+  /* M: no greater sequence value of the seed is buffered */
+  opt = (struct mpl_hbho *)&m->buff[m->opt_offset];
+  if(list_item_next(m) == NULL) {
+    opt->flags |= HBHO_M_BIT;
+  } else {
+    opt->flags &= ~HBHO_M_BIT;
+  }
+
+  PRINTF("MPL: Sending seq. val %u from seed ", m->seq);
+  PRINT_SEED(&m->seed->seed_id);
+  PRINTF("\n");
+
+  uip_len = m->buff_len;
+  memcpy(UIP_IP_BUF, m->buff, uip_len);
+  UIP_MCAST6_STATS_ADD(mcast_fwd);
+  tcpip_output(NULL);
+}
+/*---------------------------------------------------------------------------*/
+/* Called at time t within each interval of the timer of a datagram */
+static void
+msg_timer_expired(void *ptr, uint8_t suppress)
+{
+  struct mpl_msg *m = (struct mpl_msg *)ptr;
+
+  if(suppress == TRICKLE_TIMER_TX_OK) {
+    msg_send(m);
+  }
+  if(++m->e >= MPL_DATA_MESSAGE_TIMER_EXPIRATIONS) {
+    trickle_timer_stop(&m->tt);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Control Messages */
+/*---------------------------------------------------------------------------*/
+/* Append the Seed Info of seed at buffer, or return 0 if it does not fit */
+static uint16_t
+seed_info_output(struct mpl_seed *seed, uint8_t *buffer, uint16_t room)
+{
+  struct seed_info *info;
+  struct mpl_msg *m;
+  uint8_t *bitmap;
+  uint8_t bm_len;
+  uint8_t s;
+  uint8_t i;
+
+  bm_len = 0;
+  m = list_tail(seed->msgs);
+  if(m != NULL) {
+    bm_len = (uint8_t)(m->seq - seed->min_seq) / 8 + 1;
+    if(bm_len > SEED_INFO_MAX_BM_LEN) {
+      bm_len = SEED_INFO_MAX_BM_LEN;
+    }
+  }
+  if(sizeof(struct seed_info) + seed->seed_id.len + bm_len > room) {
+    return 0;
+  }
+
+  s = seed->seed_id.len == 2 ? 1 : (seed->seed_id.len == 8 ? 2 : 0);
+  info = (struct seed_info *)buffer;
+  info->min_seq = seed->min_seq;
+  info->bm_len_s = (bm_len << 2) | s;
+  memcpy(buffer + sizeof(struct seed_info), seed->seed_id.id, seed->seed_id.len);
+
+  bitmap = buffer + sizeof(struct seed_info) + seed->seed_id.len;
+  memset(bitmap, 0, bm_len);
+  for(m = list_head(seed->msgs); m != NULL; m = list_item_next(m)) {
+    i = m->seq - seed->min_seq;
+    if(i < bm_len * 8) {
+      bitmap[i >> 3] |= 0x80 >> (i & 7);
+    }
+  }
+  return sizeof(struct seed_info) + seed->seed_id.len + bm_len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+icmp_output(struct mpl_domain *d)
+{
+  struct mpl_seed *seed;
+  uint16_t payload_len;
+  uint16_t len;
+  uint8_t i;
+
+  /* Bail out pronto if our uIPv6 stack is not ready to send messages */
+  if(uip_ds6_get_link_local(ADDR_PREFERRED) == NULL) {
+    PRINTF("MPL: Suppressing ICMPv6 Out. Stack not ready\n");
+    return;
+  }
+
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->tcflow = 0;
+  UIP_IP_BUF->flow = 0;
+  UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
+  UIP_IP_BUF->ttl = MPL_IP_HOP_LIMIT;
+
+  payload_len = 0;
+  for(i = 0; i < MPL_SEED_HASH_SIZE; i++) {
+    for(seed = seed_index[i]; seed != NULL; seed = seed->next) {
+      if(seed->domain == d) {
+        len = seed_info_output(seed, UIP_ICMP_PAYLOAD + payload_len,
+                               UIP_BUFSIZE - uip_l2_l3_icmp_hdr_len - payload_len);
+        payload_len += len;
+      }
+    }
+  }
+
+  domain_link_scoped_addr(&UIP_IP_BUF->destipaddr, &d->addr);
+  uip_ds6_select_src(&UIP_IP_BUF->srcipaddr, &UIP_IP_BUF->destipaddr);
+
+  UIP_IP_BUF->len[0] = (UIP_ICMPH_LEN + payload_len) >> 8;
+  UIP_IP_BUF->len[1] = (UIP_ICMPH_LEN + payload_len) & 0xff;
+
+  UIP_ICMP_BUF->type = ICMP6_MPL;
+  UIP_ICMP_BUF->icode = MPL_ICMP_CODE;
+
+  UIP_ICMP_BUF->icmpchksum = 0;
+  UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+
+  uip_len = UIP_IPH_LEN + UIP_ICMPH_LEN + payload_len;
+
+  PRINTF("MPL: ICMPv6 Out - %u bytes\n", payload_len);
+
+  tcpip_ipv6_output();
+  MPL_STATS_ADD(icmp_out);
+}
+/*---------------------------------------------------------------------------*/
+/* Called at time t within each interval of the timer of a domain */
+static void
+control_timer_expired(void *ptr, uint8_t suppress)
+{
+  struct mpl_domain *d = (struct mpl_domain *)ptr;
+
+  if(suppress == TRICKLE_TIMER_TX_OK) {
+    icmp_output(d);
+  }
+  if(++d->e >= MPL_CONTROL_MESSAGE_TIMER_EXPIRATIONS) {
+    trickle_timer_stop(&d->tt);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Compare the Seed Info of a neighbor with our seed. Datagrams the
+ * neighbor lacks are sent again; datagrams we lack make us inconsistent.
+ *
+ * \return 1 if the neighbor and we buffer different datagrams
+ */
+static uint8_t
+seed_info_input(struct mpl_seed *seed, const struct seed_info *info,
+                const uint8_t *bitmap)
+{
+  struct mpl_msg *m;
+  uint8_t bm_len;
+  uint8_t inconsistency;
+  uint16_t i;
+  uint8_t seq;
+
+  bm_len = SEED_INFO_GET_BM_LEN(info);
+  inconsistency = 0;
+
+  /* They have new: a datagram they list that we have not received */
+  for(i = 0; i < bm_len * 8; i++) {
+    if(bitmap[i >> 3] == 0) {
+      i |= 7;
+      continue;
+    }
+    if(bitmap[i >> 3] & (0x80 >> (i & 7))) {
+      seq = info->min_seq + i;
+      if((!seed->advanced || SEQ_VAL_IS_GEQ(seq, seed->min_seq)) &&
+         msg_lookup(seed, seq) == NULL) {
+        PRINTF("MPL: Inconsistency - Seq. %u listed, not buffered\n", seq);
+        inconsistency = 1;
+        /*
+         * Until min_seq has advanced, it is only our first datagram. Lower
+         * it, so that our Seed Info tells the neighbor we lack this one.
+         */
+        if(SEQ_VAL_IS_LT(seq, seed->min_seq)) {
+          seed->min_seq = seq;
+        }
+      }
+    }
+  }
+
+  /* We have new: a buffered datagram they have not received */
+  for(m = list_head(seed->msgs); m != NULL; m = list_item_next(m)) {
+    if(SEQ_VAL_IS_LT(m->seq, info->min_seq)) {
+      continue;
+    }
+    i = (uint8_t)(m->seq - info->min_seq);
+    if(i >= bm_len * 8 || !(bitmap[i >> 3] & (0x80 >> (i & 7)))) {
+      PRINTF("MPL: Inconsistency - Seq. %u buffered, not listed\n", m->seq);
+      msg_timer_reset(m);
+      inconsistency = 1;
+    }
+  }
+  return inconsistency;
+}
+/*---------------------------------------------------------------------------*/
+/* MPL ICMPv6 Input Handler */
+static void
+icmp_input(void)
+{
+  struct mpl_domain *d;
+  struct mpl_seed *seed;
+  struct mpl_msg *m;
+  struct seed_info *info;
+  seed_id_t seed_id;
+  uint8_t *p;
+  uint8_t *end;
+  uint8_t inconsistency;
+  uint8_t i;
+
+#if UIP_CONF_IPV6_CHECKS
+  if(!uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr)) {
+    PRINTF("MPL: ICMPv6 In, bad source ");
+    PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
+    PRINTF(" to ");
+    PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+    PRINTF("\n");
+    MPL_STATS_ADD(icmp_bad);
+    goto discard;
+  }
+
+  if(uip_mcast6_get_address_scope(&UIP_IP_BUF->destipaddr) !=
+     UIP_MCAST6_SCOPE_LINK_LOCAL) {
+    PRINTF("MPL: ICMPv6 In, bad destination\n");
+    MPL_STATS_ADD(icmp_bad);
+    goto discard;
+  }
+
+  if(UIP_ICMP_BUF->icode != MPL_ICMP_CODE) {
+    PRINTF("MPL: ICMPv6 In, bad ICMP code\n");
+    MPL_STATS_ADD(icmp_bad);
+    goto discard;
+  }
+
+  if(UIP_IP_BUF->ttl != MPL_IP_HOP_LIMIT) {
+    PRINTF("MPL: ICMPv6 In, bad TTL\n");
+    MPL_STATS_ADD(icmp_bad);
+    goto discard;
+  }
+#endif
+
+  PRINTF("MPL: ICMPv6 In from ");
+  PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
+  PRINTF(" len %u, ext %u\n", uip_len, uip_ext_len);
+
+  MPL_STATS_ADD(icmp_in);
+
+  d = domain_lookup(&UIP_IP_BUF->destipaddr, 0);
+  if(d == NULL) {
+    PRINTF("MPL: ICMPv6 In, unknown domain\n");
+    goto discard;
+  }
+
+  for(i = 0; i < MPL_SEED_HASH_SIZE; i++) {
+    for(seed = seed_index[i]; seed != NULL; seed = seed->next) {
+      seed->listed = 0;
+    }
+  }
+
+  inconsistency = 0;
+  p = UIP_ICMP_PAYLOAD;
+  end = (uint8_t *)UIP_ICMP_PAYLOAD + uip_len - uip_l2_l3_icmp_hdr_len;
+  while(p < end) {
+    info = (struct seed_info *)p;
+    if(p + sizeof(struct seed_info) > end) {
+      break;
+    }
+    seed_id.len = seed_info_id_len[SEED_INFO_GET_S(info)];
+    if(p + sizeof(struct seed_info) + seed_id.len +
+       SEED_INFO_GET_BM_LEN(info) > end) {
+      break;
+    }
+    memcpy(seed_id.id, p + sizeof(struct seed_info), seed_id.len);
+
+    if(SEED_INFO_GET_BM_LEN(info) > SEED_INFO_MAX_BM_LEN) {
+      PRINTF("MPL: ICMPv6 In, Seed Info bitmap too long\n");
+      MPL_STATS_ADD(icmp_bad);
+      p += sizeof(struct seed_info) + seed_id.len + SEED_INFO_GET_BM_LEN(info);
+      continue;
+    }
+
+    seed = seed_lookup(d, &seed_id);
+    if(seed == NULL) {
+      /* Any datagram they list from a seed unknown to us is new */
+      if(SEED_INFO_GET_BM_LEN(info) > 0) {
+        PRINTF("MPL: Inconsistency - Seed ");
+        PRINT_SEED(&seed_id);
+        PRINTF(" unknown\n");
+        inconsistency = 1;
+      }
+    } else {
+      seed->listed = 1;
+      inconsistency |= seed_info_input(seed, info, p + sizeof(struct seed_info)
+                                       + seed_id.len);
+    }
+    p += sizeof(struct seed_info) + seed_id.len + SEED_INFO_GET_BM_LEN(info);
+  }
+  if(p != end) {
+    PRINTF("MPL: ICMPv6 In, truncated Seed Info\n");
+    MPL_STATS_ADD(icmp_bad);
+    goto discard;
+  }
+
+  /* All the datagrams of the seeds they did not list are new to them */
+  for(i = 0; i < MPL_SEED_HASH_SIZE; i++) {
+    for(seed = seed_index[i]; seed != NULL; seed = seed->next) {
+      if(seed->domain == d && !seed->listed && seed->count > 0) {
+        PRINTF("MPL: Inconsistency - Seed ");
+        PRINT_SEED(&seed->seed_id);
+        PRINTF(" was not listed\n");
+        for(m = list_head(seed->msgs); m != NULL; m = list_item_next(m)) {
+          msg_timer_reset(m);
+        }
+        inconsistency = 1;
+      }
+    }
+  }
+
+  if(inconsistency) {
+    control_timer_reset(d);
+  } else {
+    trickle_timer_consistency(&d->tt);
+  }
+
+discard:
+  uip_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Datagrams */
+/*---------------------------------------------------------------------------*/
+/* Find the MPL option in the HBH header of the datagram in uip_buf */
+static struct mpl_hbho *
+hbho_lookup(void)
+{
+  uint16_t offset;
+  uint16_t len;
+  uint8_t *opt;
+
+  len = (UIP_EXT_BUF->len << 3) + 8;
+  offset = 2;
+  while(offset < len) {
+    opt = (uint8_t *)UIP_EXT_BUF + offset;
+    if(opt[0] == UIP_EXT_HDR_OPT_PAD1) {
+      offset++;
+    } else if(opt[0] == UIP_EXT_HDR_OPT_MPL) {
+      return offset + sizeof(struct mpl_hbho) <= len ?
+        (struct mpl_hbho *)opt : NULL;
+    } else {
+      offset += opt[1] + 2;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief Processes an incoming or outgoing multicast datagram and determines
+ * whether it should be dropped or accepted
+ *
+ * \param in 1: Incoming packet, 0: Outgoing (we are the seed)
+ *
+ * \return 0: Drop, 1: Accept
+ */
+static uint8_t
+accept(uint8_t in)
+{
+  struct mpl_domain *d;
+  struct mpl_seed *seed;
+  struct mpl_msg *m;
+  struct mpl_hbho *opt;
+  seed_id_t seed_id;
+  uint8_t s;
+
+  PRINTF("MPL: Multicast I/O\n");
+
+#if UIP_CONF_IPV6_CHECKS
+  if(uip_is_addr_mcast_non_routable(&UIP_IP_BUF->destipaddr)) {
+    PRINTF("MPL: Mcast I/O, bad destination\n");
+    UIP_MCAST6_STATS_ADD(mcast_bad);
+    return UIP_MCAST6_DROP;
+  }
+  /*
+   * Abort transmission if the v6 src is unspecified. This may happen if the
+   * seed tries to TX while it's still performing DAD or waiting for a prefix
+   */
+  if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
+    PRINTF("MPL: Mcast I/O, bad source\n");
+    UIP_MCAST6_STATS_ADD(mcast_bad);
+    return UIP_MCAST6_DROP;
+  }
+#endif
+
+  /* Check the Next Header field: Must be HBHO, with an MPL option */
+  if(UIP_IP_BUF->proto != UIP_PROTO_HBHO) {
+    PRINTF("MPL: Mcast I/O, bad proto\n");
+    UIP_MCAST6_STATS_ADD(mcast_bad);
+    return UIP_MCAST6_DROP;
+  }
+  opt = hbho_lookup();
+  if(opt == NULL) {
+    PRINTF("MPL: Mcast I/O, no MPL option\n");
+    UIP_MCAST6_STATS_ADD(mcast_bad);
+    return UIP_MCAST6_DROP;
+  }
+
+  s = HBHO_GET_S(opt);
+  if((opt->flags & HBHO_V_BIT) ||
+     opt->len != HBHO_BASE_LEN + hbho_seed_id_len[s]) {
+    PRINTF("MPL: Mcast I/O, bad MPL option\n");
+    UIP_MCAST6_STATS_ADD(mcast_bad);
+    return UIP_MCAST6_DROP;
+  }
+
+  if(s == 0) {
+    seed_id.len = sizeof(uip_ipaddr_t);
+    memcpy(seed_id.id, &UIP_IP_BUF->srcipaddr, seed_id.len);
+  } else {
+    seed_id.len = hbho_seed_id_len[s];
+    memcpy(seed_id.id, HBHO_SEED_ID(opt), seed_id.len);
+  }
+
+  PRINTF("MPL: HBHO S=%u, M=%u, Seq=%u, Seed ", s,
+         (opt->flags & HBHO_M_BIT) != 0, opt->seq);
+  PRINT_SEED(&seed_id);
+  PRINTF("\n");
+
+#if UIP_MCAST6_STATS
+  if(in == MPL_DGRAM_IN) {
+    UIP_MCAST6_STATS_ADD(mcast_in_all);
+  }
+#endif
+
+  d = domain_lookup(&UIP_IP_BUF->destipaddr, 1);
+  if(d == NULL) {
+    d = domain_add(&UIP_IP_BUF->destipaddr);
+  }
+  if(d == NULL) {
+    UIP_MCAST6_STATS_ADD(mcast_dropped);
+    return UIP_MCAST6_DROP;
+  }
+
+  /*
+   * Is this a datagram we have seen? The first datagram we get from a seed
+   * need not be its oldest one, so lower values count as received only
+   * once min_seq has passed a datagram we did receive.
+   */
+  seed = seed_lookup(d, &seed_id);
+  if(seed != NULL) {
+    if(seed->advanced && SEQ_VAL_IS_LT(opt->seq, seed->min_seq)) {
+      PRINTF("MPL: Too old\n");
+      UIP_MCAST6_STATS_ADD(mcast_dropped);
+      return UIP_MCAST6_DROP;
+    }
+    m = msg_lookup(seed, opt->seq);
+    if(m != NULL) {
+      PRINTF("MPL: Seen before\n");
+      trickle_timer_consistency(&m->tt);
+      UIP_MCAST6_STATS_ADD(mcast_dropped);
+      return UIP_MCAST6_DROP;
+    }
+  } else {
+    seed = seed_add(d, &seed_id, opt->seq);
+    if(seed == NULL) {
+      UIP_MCAST6_STATS_ADD(mcast_dropped);
+      return UIP_MCAST6_DROP;
+    }
+  }
+
+  PRINTF("MPL: New datagram\n");
+
+  /* Allocate a buffer */
+  m = memb_alloc(&msg_memb);
+  if(m == NULL) {
+    PRINTF("MPL: Buffer allocation failed, reclaiming\n");
+    m = msg_reclaim();
+  }
+  if(m == NULL) {
+    PRINTF("MPL: Buffer reclaim failed\n");
+    UIP_MCAST6_STATS_ADD(mcast_dropped);
+    return UIP_MCAST6_DROP;
+  }
+  /* The reclaimed datagram may have been a newer one of this seed */
+  if(seed->advanced && SEQ_VAL_IS_LT(opt->seq, seed->min_seq)) {
+    memb_free(&msg_memb, m);
+    UIP_MCAST6_STATS_ADD(mcast_dropped);
+    return UIP_MCAST6_DROP;
+  }
+
+#if UIP_MCAST6_STATS
+  if(in == MPL_DGRAM_IN) {
+    UIP_MCAST6_STATS_ADD(mcast_in_unique);
+  }
+#endif
+
+  memcpy(m->buff, UIP_IP_BUF, uip_len);
+  m->buff_len = uip_len;
+  m->opt_offset = (uint8_t *)opt - (uint8_t *)UIP_IP_BUF;
+  m->seq = opt->seq;
+  m->e = 0;
+  m->age = 0;
+  trickle_timer_config(&m->tt, MPL_DATA_MESSAGE_IMIN, MPL_DATA_MESSAGE_IMAX,
+                       MPL_DATA_MESSAGE_K);
+  trickle_timer_stop(&m->tt);
+  msg_insert(seed, m);
+  if(SEQ_VAL_IS_LT(m->seq, seed->min_seq)) {
+    seed->min_seq = m->seq;
+  }
+  seed->lifetime = MPL_SEED_SET_ENTRY_LIFETIME;
+
+  /*
+   * We forward a datagram we received with a lower hop limit. Our own
+   * datagrams are sent by the caller and then retransmitted as others.
+   */
+  if(in == MPL_DGRAM_IN && MPL_MSG_TTL(m) > 0) {
+    MPL_MSG_TTL(m)--;
+  }
+  if(in == MPL_DGRAM_OUT || MPL_PROACTIVE_FORWARDING) {
+    msg_timer_reset(m);
+  }
+
+  /* Tell the neighbors about the new datagram */
+  control_timer_reset(d);
+
+  return UIP_MCAST6_ACCEPT;
+}
+/*---------------------------------------------------------------------------*/
+static void
+out(void)
+{
+  struct mpl_domain *d;
+  struct mpl_hbho *opt;
+  uint8_t *pad;
+  uint8_t opt_len;
+  uint8_t hbho_len;
+
+  d = domain_lookup(&UIP_IP_BUF->destipaddr, 1);
+  if(d == NULL) {
+    d = domain_add(&UIP_IP_BUF->destipaddr);
+  }
+  if(d == NULL) {
+    PRINTF("MPL: Multicast Out without a domain\n");
+    goto drop;
+  }
+
+  /* The HBH header is padded to a multiple of 8 bytes */
+  opt_len = sizeof(struct mpl_hbho) + (MPL_SEED_ID_TYPE == 0 ? 0 :
+                                       hbho_seed_id_len[MPL_SEED_ID_TYPE]);
+  hbho_len = (2 + opt_len + 7) & ~7;
+
+  if(uip_len + hbho_len > UIP_BUFSIZE - UIP_LLH_LEN) {
+    PRINTF("MPL: Multicast Out can not add HBHO. Packet too long\n");
+    goto drop;
+  }
+
+  /* Slide 'right' by hbho_len bytes */
+  memmove((uint8_t *)UIP_EXT_BUF + hbho_len, UIP_EXT_BUF, uip_len - UIP_IPH_LEN);
+  memset(UIP_EXT_BUF, 0, hbho_len);
+
+  UIP_EXT_BUF->next = UIP_IP_BUF->proto;
+  UIP_EXT_BUF->len = (hbho_len >> 3) - 1;
+
+  opt = (struct mpl_hbho *)((uint8_t *)UIP_EXT_BUF + 2);
+  opt->type = UIP_EXT_HDR_OPT_MPL;
+  opt->len = opt_len - 2;
+  opt->flags = (MPL_SEED_ID_TYPE << 6) | HBHO_M_BIT;
+  opt->seq = d->seq++;
+#if MPL_SEED_ID_TYPE == 1
+  memcpy(HBHO_SEED_ID(opt), &uip_lladdr.addr[UIP_LLADDR_LEN - 2], 2);
+#elif MPL_SEED_ID_TYPE == 2
+  memcpy(HBHO_SEED_ID(opt), &UIP_IP_BUF->srcipaddr.u8[8], 8);
+#elif MPL_SEED_ID_TYPE == 3
+  memcpy(HBHO_SEED_ID(opt), &UIP_IP_BUF->srcipaddr, 16);
+#endif
+
+  /* Pad1 is all zeroes; a longer padding needs PadN */
+  pad = (uint8_t *)opt + opt_len;
+  if(hbho_len - 2 - opt_len > 1) {
+    pad[0] = UIP_EXT_HDR_OPT_PADN;
+    pad[1] = hbho_len - 2 - opt_len - 2;
+  }
+
+  uip_ext_len += hbho_len;
+  uip_len += hbho_len;
+
+  /* Update the proto and length field in the v6 header */
+  UIP_IP_BUF->proto = UIP_PROTO_HBHO;
+  UIP_IP_BUF->len[0] = ((uip_len - UIP_IPH_LEN) >> 8);
+  UIP_IP_BUF->len[1] = ((uip_len - UIP_IPH_LEN) & 0xff);
+
+  PRINTF("MPL: Multicast Out, HBHO: S=%u, Seq=%u\n", MPL_SEED_ID_TYPE,
+         opt->seq);
+
+  /*
+   * We buffer our own datagram, to list it in our control messages and to
+   * retransmit it. We send it at once and then set uip_len = 0 to stop the
+   * core from re-sending it.
+   */
+  if(accept(MPL_DGRAM_OUT)) {
+    tcpip_output(NULL);
+    UIP_MCAST6_STATS_ADD(mcast_out);
+  }
+
+drop:
+  uip_slen = 0;
+  uip_len = 0;
+  uip_ext_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+in(void)
+{
+  /*
+   * We call accept() which will sort out caching and forwarding. Depending
+   * on accept()'s return value, we then need to signal the core
+   * whether to deliver this to higher layers
+   */
+  if(accept(MPL_DGRAM_IN) == UIP_MCAST6_DROP) {
+    return UIP_MCAST6_DROP;
+  }
+
+  if(!uip_ds6_is_my_maddr(&UIP_IP_BUF->destipaddr)) {
+    PRINTF("MPL: Not a group member. No further processing\n");
+    return UIP_MCAST6_DROP;
+  } else {
+    PRINTF("MPL: Ours. Deliver to upper layers\n");
+    UIP_MCAST6_STATS_ADD(mcast_in_ours);
+    return UIP_MCAST6_ACCEPT;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+  uip_ipaddr_t all_mpl_forwarders;
+
+  PRINTF("MPL: Multicast Protocol for LLNs - RFC 7731\n");
+
+  memset(domains, 0, sizeof(domains));
+  memset(seed_index, 0, sizeof(seed_index));
+  memb_init(&seed_memb);
+  memb_init(&msg_memb);
+
+  MPL_STATS_INIT();
+  UIP_MCAST6_STATS_INIT(&stats);
+
+  /* Register the ICMPv6 input handler */
+  uip_icmp6_register_input_handler(&mpl_icmp_handler);
+
+  /* Every forwarder takes part in the ALL_MPL_FORWARDERS domain */
+  uip_ip6addr(&all_mpl_forwarders, 0xff03, 0, 0, 0, 0, 0, 0, 0x00fc);
+  domain_add(&all_mpl_forwarders);
+
+  ctimer_set(&lifetime_timer, 60 * CLOCK_SECOND, lifetime_tick, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief The MPL engine driver
+ */
+const struct uip_mcast6_driver mpl_driver = {
+  "MPL",
+  init,
+  out,
+  in,
+};
+/*---------------------------------------------------------------------------*/
+/** @} */
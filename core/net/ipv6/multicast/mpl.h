@@ -0,0 +1,204 @@
+/**
+ * \addtogroup uip6-multicast
+ * @{
+ */
+/**
+ * \defgroup mpl Multicast Protocol for Low-Power and Lossy Networks (MPL)
+ *
+ * IPv6 multicast according to RFC 7731, the successor of the trickle
+ * multicast draft implemented by ROLL TM.
+ *
+ * The MPL domain of a datagram is its destination address: datagrams are
+ * not encapsulated, and a forwarder takes part in the domain of every
+ * routable multicast destination it sees, up to #MPL_DOMAIN_SET_SIZE
+ * domains. The control messages of a domain go to the link-scoped
+ * address with its group ID, to which the forwarder subscribes.
+ *
+ * A forwarder retransmits every new datagram with a trickle timer of its
+ * own (proactive forwarding), and with its control messages asks its
+ * neighbors for the datagrams it misses or sends them the datagrams they
+ * miss (reactive forwarding).
+ * @{
+ */
+/**
+ * \file
+ *    Header file for the implementation of the MPL multicast engine
+ */
+
+#ifndef MPL_H_
+#define MPL_H_
+
+#include "contiki-conf.h"
+#include "net/ipv6/multicast/uip-mcast6-stats.h"
+
+#include <stdint.h>
+/*---------------------------------------------------------------------------*/
+/* Protocol Constants */
+/*---------------------------------------------------------------------------*/
+#define MPL_ICMP_CODE                  0   /**< MPL control message code */
+#define MPL_IP_HOP_LIMIT            0xFF   /**< Hop limit for ICMP messages */
+#define MPL_DGRAM_OUT                  0
+#define MPL_DGRAM_IN                   1
+
+/*
+ * The parameters of the trickle timers of RFC 7731, section 5.4. Imin is in
+ * clock ticks, Imax in doublings of Imin.
+ *
+ * The data message timer runs for a few intervals after a new datagram;
+ * the control message timer stops after CONTROL_MESSAGE_TIMER_EXPIRATIONS
+ * intervals without news.
+ */
+#ifdef MPL_CONF_DATA_MESSAGE_IMIN
+#define MPL_DATA_MESSAGE_IMIN MPL_CONF_DATA_MESSAGE_IMIN
+#else
+#define MPL_DATA_MESSAGE_IMIN          (CLOCK_SECOND / 4)
+#endif
+
+#ifdef MPL_CONF_DATA_MESSAGE_IMAX
+#define MPL_DATA_MESSAGE_IMAX MPL_CONF_DATA_MESSAGE_IMAX
+#else
+#define MPL_DATA_MESSAGE_IMAX          1
+#endif
+
+#ifdef MPL_CONF_DATA_MESSAGE_K
+#define MPL_DATA_MESSAGE_K MPL_CONF_DATA_MESSAGE_K
+#else
+#define MPL_DATA_MESSAGE_K             1
+#endif
+
+#ifdef MPL_CONF_DATA_MESSAGE_TIMER_EXPIRATIONS
+#define MPL_DATA_MESSAGE_TIMER_EXPIRATIONS MPL_CONF_DATA_MESSAGE_TIMER_EXPIRATIONS
+#else
+#define MPL_DATA_MESSAGE_TIMER_EXPIRATIONS 3
+#endif
+
+#ifdef MPL_CONF_CONTROL_MESSAGE_IMIN
+#define MPL_CONTROL_MESSAGE_IMIN MPL_CONF_CONTROL_MESSAGE_IMIN
+#else
+#define MPL_CONTROL_MESSAGE_IMIN       (CLOCK_SECOND / 2)
+#endif
+
+#ifdef MPL_CONF_CONTROL_MESSAGE_IMAX
+#define MPL_CONTROL_MESSAGE_IMAX MPL_CONF_CONTROL_MESSAGE_IMAX
+#else
+#define MPL_CONTROL_MESSAGE_IMAX       9  /* Imax = 256 secs */
+#endif
+
+#ifdef MPL_CONF_CONTROL_MESSAGE_K
+#define MPL_CONTROL_MESSAGE_K MPL_CONF_CONTROL_MESSAGE_K
+#else
+#define MPL_CONTROL_MESSAGE_K          1
+#endif
+
+#ifdef MPL_CONF_CONTROL_MESSAGE_TIMER_EXPIRATIONS
+#define MPL_CONTROL_MESSAGE_TIMER_EXPIRATIONS MPL_CONF_CONTROL_MESSAGE_TIMER_EXPIRATIONS
+#else
+#define MPL_CONTROL_MESSAGE_TIMER_EXPIRATIONS 10
+#endif
+/*---------------------------------------------------------------------------*/
+/* Configuration */
+/*---------------------------------------------------------------------------*/
+/**
+ * Retransmit new datagrams with their trickle timer. With 0, datagrams are
+ * only retransmitted when the control messages of a neighbor show that it
+ * misses them.
+ */
+#ifdef MPL_CONF_PROACTIVE_FORWARDING
+#define MPL_PROACTIVE_FORWARDING MPL_CONF_PROACTIVE_FORWARDING
+#else
+#define MPL_PROACTIVE_FORWARDING 1
+#endif
+/*---------------------------------------------------------------------------*/
+/**
+ * Seed ID of our own datagrams, as the S field of the MPL option:
+ * 0: our IPv6 source address, elided from the option (default)
+ * 1: the last 16 bits of our link-layer address
+ * 2: the last 64 bits of our IPv6 source address
+ * 3: our IPv6 source address, carried in the option
+ */
+#ifdef MPL_CONF_SEED_ID_TYPE
+#define MPL_SEED_ID_TYPE MPL_CONF_SEED_ID_TYPE
+#else
+#define MPL_SEED_ID_TYPE 0
+#endif
+/*---------------------------------------------------------------------------*/
+/**
+ * Number of MPL domains, i.e. of multicast destinations, we forward for.
+ * The ALL_MPL_FORWARDERS domain (FF03::FC) takes one of them.
+ */
+#ifdef MPL_CONF_DOMAIN_SET_SIZE
+#define MPL_DOMAIN_SET_SIZE MPL_CONF_DOMAIN_SET_SIZE
+#else
+#define MPL_DOMAIN_SET_SIZE 2
+#endif
+/*---------------------------------------------------------------------------*/
+/**
+ * Number of seeds we remember, across all domains, and the number of
+ * buckets of the index over them (a power of two)
+ */
+#ifdef MPL_CONF_SEED_SET_SIZE
+#define MPL_SEED_SET_SIZE MPL_CONF_SEED_SET_SIZE
+#else
+#define MPL_SEED_SET_SIZE 4
+#endif
+
+#ifdef MPL_CONF_SEED_HASH_SIZE
+#define MPL_SEED_HASH_SIZE MPL_CONF_SEED_HASH_SIZE
+#else
+#define MPL_SEED_HASH_SIZE 8
+#endif
+/*---------------------------------------------------------------------------*/
+/**
+ * Minutes a seed is remembered after its last datagram has left the buffer
+ */
+#ifdef MPL_CONF_SEED_SET_ENTRY_LIFETIME
+#define MPL_SEED_SET_ENTRY_LIFETIME MPL_CONF_SEED_SET_ENTRY_LIFETIME
+#else
+#define MPL_SEED_SET_ENTRY_LIFETIME 30
+#endif
+/*---------------------------------------------------------------------------*/
+/**
+ * Minutes a buffered datagram is kept after its timer has stopped. Until
+ * then, neighbors that missed it can still get it by listing its absence.
+ */
+#ifdef MPL_CONF_BUFFERED_MESSAGE_LIFETIME
+#define MPL_BUFFERED_MESSAGE_LIFETIME MPL_CONF_BUFFERED_MESSAGE_LIFETIME
+#else
+#define MPL_BUFFERED_MESSAGE_LIFETIME 5
+#endif
+/*---------------------------------------------------------------------------*/
+/**
+ * Maximum Number of Buffered Datagrams, shared by all seeds. When the
+ * buffer is full, the oldest datagram of a seed whose timer has stopped
+ * makes room for a new one. If every timer still runs, the new datagram
+ * is dropped.
+ */
+#ifdef MPL_CONF_BUFFERED_MESSAGE_SET_SIZE
+#define MPL_BUFFERED_MESSAGE_SET_SIZE MPL_CONF_BUFFERED_MESSAGE_SET_SIZE
+#else
+#define MPL_BUFFERED_MESSAGE_SET_SIZE 6
+#endif
+/*---------------------------------------------------------------------------*/
+/* Stats datatype */
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief Multicast stats extension for the MPL engine
+ */
+struct mpl_stats {
+  /** Number of received ICMP datagrams */
+  UIP_MCAST6_STATS_DATATYPE icmp_in;
+
+  /** Number of ICMP datagrams sent */
+  UIP_MCAST6_STATS_DATATYPE icmp_out;
+
+  /** Number of malformed ICMP datagrams seen by us */
+  UIP_MCAST6_STATS_DATATYPE icmp_bad;
+
+  /** Number of buffered datagrams evicted to make room for new ones */
+  UIP_MCAST6_STATS_DATATYPE evicted;
+};
+/*---------------------------------------------------------------------------*/
+#endif /* MPL_H_ */
+/*---------------------------------------------------------------------------*/
+/** @} */
+/** @} */
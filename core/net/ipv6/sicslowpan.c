@@ -62,12 +62,18 @@
 
 #include "contiki.h"
 #include "dev/watchdog.h"
+#include "lib/list.h"
+#include "lib/memb.h"
 #include "net/ip/tcpip.h"
 #include "net/ip/uip.h"
+#include "net/ip/uip-bufpool.h"
 #include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-icmp6.h"
 #include "net/rime/rime.h"
 #include "net/ipv6/sicslowpan.h"
 #include "net/netstack.h"
+#include "net/llsec/llsec802154.h"
+#include "ipsec/ike/machine.h"
 
 #include <stdio.h>
 
@@ -81,13 +87,11 @@ uint8_t p;
 #define PRINTFO(...) PRINTF(__VA_ARGS__)
 #define PRINTPACKETBUF() PRINTF("packetbuf buffer: "); for(p = 0; p < packetbuf_datalen(); p++){PRINTF("%.2X", *(packetbuf_ptr + p));} PRINTF("\n")
 #define PRINTUIPBUF() PRINTF("UIP buffer: "); for(p = 0; p < uip_len; p++){PRINTF("%.2X", uip_buf[p]);}PRINTF("\n")
-#define PRINTSICSLOWPANBUF() PRINTF("SICSLOWPAN buffer: "); for(p = 0; p < sicslowpan_len; p++){PRINTF("%.2X", sicslowpan_buf[p]);}PRINTF("\n")
 #else
 #define PRINTFI(...)
 #define PRINTFO(...)
 #define PRINTPACKETBUF()
 #define PRINTUIPBUF()
-#define PRINTSICSLOWPANBUF()
 #endif /* DEBUG == 1*/
 
 #if UIP_LOGGING
@@ -104,6 +108,16 @@ void uip_log(char *msg);
 #define SICSLOWPAN_MAX_MAC_TRANSMISSIONS 4
 #endif
 
+/**
+ * Number of times a fragment that the MAC layer failed to deliver is
+ * handed to it again. 0 disables keeping copies of the fragments.
+ */
+#ifdef SICSLOWPAN_CONF_FRAG_RETRANSMISSIONS
+#define SICSLOWPAN_FRAG_RETRANSMISSIONS SICSLOWPAN_CONF_FRAG_RETRANSMISSIONS
+#else
+#define SICSLOWPAN_FRAG_RETRANSMISSIONS 1
+#endif
+
 #ifndef SICSLOWPAN_COMPRESSION
 #ifdef SICSLOWPAN_CONF_COMPRESSION
 #define SICSLOWPAN_COMPRESSION SICSLOWPAN_CONF_COMPRESSION
@@ -174,6 +188,15 @@ void uip_log(char *msg);
 #define COMPRESSION_THRESHOLD 0
 #endif
 
+/** \brief Longest routing header that is compressed as a LOWPAN_NHC
+    extension header. The compressed headers must fit in the first
+    fragment, so longer ones are sent inline as payload. */
+#ifdef SICSLOWPAN_CONF_NHC_EXT_HDR_MAX_LEN
+#define NHC_EXT_HDR_MAX_LEN SICSLOWPAN_CONF_NHC_EXT_HDR_MAX_LEN
+#else
+#define NHC_EXT_HDR_MAX_LEN 48
+#endif
+
 /** \name General variables
  *  @{
  */
@@ -209,11 +232,6 @@ static int packetbuf_payload_len;
  * is used this includes the UDP header in addition to the IP header).
  */
 static uint8_t uncomp_hdr_len;
-
-/**
- * the result of the last transmitted fragment
- */
-static int last_tx_status;
 /** @} */
 
 #if SICSLOWPAN_CONF_FRAG
@@ -221,42 +239,89 @@ static int last_tx_status;
  *  @{
  */
 
-static uint16_t sicslowpan_len;
+/** Number of 8-octet units of a datagram of size bytes */
+#define REASS_UNITS(size) (((size) + 7) >> 3)
+
+/** Largest datagram that fits in a reassembly buffer */
+#define REASS_MAX_SIZE (UIP_BUFSIZE - UIP_LLH_LEN)
 
 /**
- * The buffer used for the 6lowpan reassembly.
- * This buffer contains only the IPv6 packet (no MAC header, 6lowpan, etc).
- * It has a fix size as we do not use dynamic memory allocation.
+ * A datagram under reassembly. Its fragments are identified by the
+ * sender's link-layer address, the datagram tag and the datagram size
+ * (RFC 4944, section 5.3).
+ *
+ * buf contains only the IPv6 packet (no MAC header, 6lowpan, etc).
+ * With a uIP buffer pool, it is taken from the pool when the first
+ * fragment arrives and becomes uip_buf once the packet is complete.
+ * Each bit of units tells whether the corresponding 8-octet unit of the
+ * packet has been received, which allows fragments to arrive out of order
+ * and duplicates to be recognized.
  */
-static uip_buf_t sicslowpan_aligned_buf;
-#define sicslowpan_buf (sicslowpan_aligned_buf.u8)
+struct reass_context {
+#if UIP_BUFPOOL_SIZE > 1
+  uip_buf_t *buf;
+#else /* UIP_BUFPOOL_SIZE > 1 */
+  uip_buf_t buf;
+#endif /* UIP_BUFPOOL_SIZE > 1 */
+  /** Discards the datagram after SICSLOWPAN_REASS_MAXAGE */
+  struct ctimer timer;
+  linkaddr_t sender;
+  uint16_t tag;
+  /** Size of the IPv6 packet, 0 if the context is free */
+  uint16_t size;
+  /** Number of units received so far */
+  uint16_t received;
+  uint8_t units[(REASS_UNITS(REASS_MAX_SIZE) + 7) >> 3];
+};
 
-/** The total length of the IPv6 packet in the sicslowpan_buf. */
+/**
+ * The reassembly contexts, along with their buffers.
+ * They have a fix size as we do not use dynamic memory allocation.
+ */
+static struct reass_context reass_contexts[SICSLOWPAN_REASS_CONTEXTS];
+
+/** The context of the fragment being processed, NULL if it isn't one */
+static struct reass_context *reass;
 
 /**
- * length of the ip packet already sent / received.
- * It includes IP and transport headers.
+ * The buffer that the packet being processed is put together in: uip_buf
+ * if the packet is not fragmented, the buffer of its reassembly context
+ * otherwise.
  */
-static uint16_t processed_ip_in_len;
+static uint8_t *sicslowpan_buf;
 
 /** Datagram tag to be put in the fragments I send. */
 static uint16_t my_tag;
 
-/** When reassembling, the tag in the fragments being merged. */
-static uint16_t reass_tag;
+/**
+ * A fragment handed to the MAC layer, kept until the MAC reports
+ * its transmission so that it can be retransmitted on failure.
+ */
+struct frag_buf {
+  struct frag_buf *next;
+  struct queuebuf *buf;
+  uint16_t tag;
+  uint8_t retransmissions;
+  uint8_t failed;
+};
+
+#if SICSLOWPAN_FRAG_RETRANSMISSIONS > 0
+MEMB(frag_memb, struct frag_buf, QUEUEBUF_NUM);
 
-/** When reassembling, the source address of the fragments being merged */
-linkaddr_t frag_sender;
+/** Fragments that the MAC layer is done with */
+LIST(frag_sent_list);
+static struct ctimer frag_sent_timer;
 
-/** Reassembly %process %timer. */
-static struct timer reass_timer;
+/** Tag of the last datagram that a fragment was lost of */
+static uint16_t lost_tag;
+static uint8_t lost_tag_valid;
+#endif /* SICSLOWPAN_FRAG_RETRANSMISSIONS > 0 */
 
 /** @} */
 #else /* SICSLOWPAN_CONF_FRAG */
 /** The buffer used for the 6lowpan processing is uip_buf.
     We do not use any additional buffer.*/
 #define sicslowpan_buf uip_buf
-#define sicslowpan_len uip_len
 #endif /* SICSLOWPAN_CONF_FRAG */
 
 static int last_rssi;
@@ -308,6 +373,35 @@ set_packet_attrs()
 
 }
 
+/**
+ * \brief Set the priority of the packet in the MAC queues: routing and
+ * neighbor discovery first, then key management, then all other data
+ */
+static void
+set_packet_priority(void)
+{
+  int priority = PACKETBUF_ATTR_PRIORITY_DATA;
+
+  if(UIP_IP_BUF->proto == UIP_PROTO_ICMP6) {
+    switch(UIP_ICMP_BUF->type) {
+    case ICMP6_RS:
+    case ICMP6_RA:
+    case ICMP6_NS:
+    case ICMP6_NA:
+    case ICMP6_REDIRECT:
+    case ICMP6_RPL:
+    case ICMP6_MPL:
+      priority = PACKETBUF_ATTR_PRIORITY_CONTROL;
+      break;
+    }
+  } else if(UIP_IP_BUF->proto == UIP_PROTO_UDP &&
+            (UIP_UDP_BUF->srcport == UIP_HTONS(IKE_UDP_PORT) ||
+             UIP_UDP_BUF->destport == UIP_HTONS(IKE_UDP_PORT))) {
+    priority = PACKETBUF_ATTR_PRIORITY_KEY_MANAGEMENT;
+  }
+  packetbuf_set_attr(PACKETBUF_ATTR_PRIORITY, priority);
+}
+
 
 
 #if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
@@ -489,10 +583,31 @@ uncompress_addr(uip_ipaddr_t *ipaddr, uint8_t const prefix[],
  * \param link_destaddr L2 destination address, needed to compress IP
  * dest
  */
+/* Length of the routing header after the IPv6 header if it is to be
+   compressed, 0 otherwise */
+static uint16_t
+compressable_ext_hdr_len(void)
+{
+  uint16_t len;
+
+  if(UIP_IP_BUF->proto != UIP_PROTO_ROUTING ||
+     uip_len < UIP_LLH_LEN + UIP_IPH_LEN + 2) {
+    return 0;
+  }
+  len = (uip_buf[UIP_LLIPH_LEN + 1] + 1) * 8;
+  if(len > NHC_EXT_HDR_MAX_LEN || uip_len < UIP_LLH_LEN + UIP_IPH_LEN + len ||
+     UIP_IPH_LEN + len + UIP_UDPH_LEN > 0xff) {
+    return 0;
+  }
+  return len;
+}
+/*--------------------------------------------------------------------*/
 static void
 compress_hdr_hc06(linkaddr_t *link_destaddr)
 {
   uint8_t tmp, iphc0, iphc1;
+  uint8_t proto;
+  uint16_t ext_len;
 #if DEBUG
   { uint16_t ndx;
     PRINTF("before compression (%d): ", UIP_IP_BUF->len[1]);
@@ -579,12 +694,16 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
 
   /* Note that the payload length is always compressed */
 
-  /* Next header. We compress it if UDP */
+  /* Next header. We compress it if UDP or a short routing header */
 #if UIP_CONF_UDP || UIP_CONF_ROUTER
   if(UIP_IP_BUF->proto == UIP_PROTO_UDP) {
     iphc0 |= SICSLOWPAN_IPHC_NH_C;
   }
 #endif /*UIP_CONF_UDP*/
+  ext_len = compressable_ext_hdr_len();
+  if(ext_len > 0) {
+    iphc0 |= SICSLOWPAN_IPHC_NH_C;
+  }
 #ifdef SICSLOWPAN_NH_COMPRESSOR 
   if(SICSLOWPAN_NH_COMPRESSOR.is_compressable(UIP_IP_BUF->proto)) {
     iphc0 |= SICSLOWPAN_IPHC_NH_C;
@@ -701,52 +820,80 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
   }
 
   uncomp_hdr_len = UIP_IPH_LEN;
+  proto = UIP_IP_BUF->proto;
+
+  /* Routing header compression (RFC 6282, LOWPAN_NHC_EH) */
+  if(ext_len > 0) {
+    uint8_t *ext = &uip_buf[UIP_LLIPH_LEN];
+
+    proto = ext[0];
+    *hc06_ptr = SICSLOWPAN_NHC_EXT_HDR | SICSLOWPAN_NHC_EXT_HDR_EID_ROUTING;
+#if UIP_CONF_UDP || UIP_CONF_ROUTER
+    if(proto == UIP_PROTO_UDP) {
+      *hc06_ptr |= SICSLOWPAN_NHC_EXT_HDR_NH;
+      hc06_ptr += 1;
+    } else
+#endif /*UIP_CONF_UDP*/
+    {
+      *(hc06_ptr + 1) = proto;
+      hc06_ptr += 2;
+    }
+    /* the length excludes the next header and length octets */
+    *hc06_ptr = ext_len - 2;
+    memcpy(hc06_ptr + 1, ext + 2, ext_len - 2);
+    hc06_ptr += ext_len - 1;
+    uncomp_hdr_len += ext_len;
+    PRINTF("IPHC: compressed a routing header of %u bytes\n", ext_len);
+  }
 
 #if UIP_CONF_UDP || UIP_CONF_ROUTER
   /* UDP header compression */
-  if(UIP_IP_BUF->proto == UIP_PROTO_UDP) {
+  if(proto == UIP_PROTO_UDP) {
+    struct uip_udp_hdr *udp_buf =
+      (struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + uncomp_hdr_len];
+
     PRINTF("IPHC: Uncompressed UDP ports on send side: %x, %x\n",
-	   UIP_HTONS(UIP_UDP_BUF->srcport), UIP_HTONS(UIP_UDP_BUF->destport));
+	   UIP_HTONS(udp_buf->srcport), UIP_HTONS(udp_buf->destport));
     /* Mask out the last 4 bits can be used as a mask */
-    if(((UIP_HTONS(UIP_UDP_BUF->srcport) & 0xfff0) == SICSLOWPAN_UDP_4_BIT_PORT_MIN) &&
-       ((UIP_HTONS(UIP_UDP_BUF->destport) & 0xfff0) == SICSLOWPAN_UDP_4_BIT_PORT_MIN)) {
+    if(((UIP_HTONS(udp_buf->srcport) & 0xfff0) == SICSLOWPAN_UDP_4_BIT_PORT_MIN) &&
+       ((UIP_HTONS(udp_buf->destport) & 0xfff0) == SICSLOWPAN_UDP_4_BIT_PORT_MIN)) {
       /* we can compress 12 bits of both source and dest */
       *hc06_ptr = SICSLOWPAN_NHC_UDP_CS_P_11;
       PRINTF("IPHC: remove 12 b of both source & dest with prefix 0xFOB\n");
       *(hc06_ptr + 1) =
-	(uint8_t)((UIP_HTONS(UIP_UDP_BUF->srcport) -
+	(uint8_t)((UIP_HTONS(udp_buf->srcport) -
 		SICSLOWPAN_UDP_4_BIT_PORT_MIN) << 4) +
-	(uint8_t)((UIP_HTONS(UIP_UDP_BUF->destport) -
+	(uint8_t)((UIP_HTONS(udp_buf->destport) -
 		SICSLOWPAN_UDP_4_BIT_PORT_MIN));
       hc06_ptr += 2;
-    } else if((UIP_HTONS(UIP_UDP_BUF->destport) & 0xff00) == SICSLOWPAN_UDP_8_BIT_PORT_MIN) {
+    } else if((UIP_HTONS(udp_buf->destport) & 0xff00) == SICSLOWPAN_UDP_8_BIT_PORT_MIN) {
       /* we can compress 8 bits of dest, leave source. */
       *hc06_ptr = SICSLOWPAN_NHC_UDP_CS_P_01;
       PRINTF("IPHC: leave source, remove 8 bits of dest with prefix 0xF0\n");
-      memcpy(hc06_ptr + 1, &UIP_UDP_BUF->srcport, 2);
+      memcpy(hc06_ptr + 1, &udp_buf->srcport, 2);
       *(hc06_ptr + 3) =
-	(uint8_t)((UIP_HTONS(UIP_UDP_BUF->destport) -
+	(uint8_t)((UIP_HTONS(udp_buf->destport) -
 		SICSLOWPAN_UDP_8_BIT_PORT_MIN));
       hc06_ptr += 4;
-    } else if((UIP_HTONS(UIP_UDP_BUF->srcport) & 0xff00) == SICSLOWPAN_UDP_8_BIT_PORT_MIN) {
+    } else if((UIP_HTONS(udp_buf->srcport) & 0xff00) == SICSLOWPAN_UDP_8_BIT_PORT_MIN) {
       /* we can compress 8 bits of src, leave dest. Copy compressed port */
       *hc06_ptr = SICSLOWPAN_NHC_UDP_CS_P_10;
       PRINTF("IPHC: remove 8 bits of source with prefix 0xF0, leave dest. hch: %i\n", *hc06_ptr);
       *(hc06_ptr + 1) =
-	(uint8_t)((UIP_HTONS(UIP_UDP_BUF->srcport) -
+	(uint8_t)((UIP_HTONS(udp_buf->srcport) -
 		SICSLOWPAN_UDP_8_BIT_PORT_MIN));
-      memcpy(hc06_ptr + 2, &UIP_UDP_BUF->destport, 2);
+      memcpy(hc06_ptr + 2, &udp_buf->destport, 2);
       hc06_ptr += 4;
     } else {
       /* we cannot compress. Copy uncompressed ports, full checksum  */
       *hc06_ptr = SICSLOWPAN_NHC_UDP_CS_P_00;
       PRINTF("IPHC: cannot compress headers\n");
-      memcpy(hc06_ptr + 1, &UIP_UDP_BUF->srcport, 4);
+      memcpy(hc06_ptr + 1, &udp_buf->srcport, 4);
       hc06_ptr += 5;
     }
     /* always inline the checksum  */
     if(1) {
-      memcpy(hc06_ptr, &UIP_UDP_BUF->udpchksum, 2);
+      memcpy(hc06_ptr, &udp_buf->udpchksum, 2);
       hc06_ptr += 2;
     }
     uncomp_hdr_len += UIP_UDPH_LEN;
@@ -786,6 +933,7 @@ static void
 uncompress_hdr_hc06(uint16_t ip_len)
 {
   uint8_t tmp, iphc0, iphc1;
+  struct uip_udp_hdr *udp_buf = NULL;
   /* at least two byte will be used for the encoding */
   hc06_ptr = packetbuf_ptr + packetbuf_hdr_len + 2;
 
@@ -931,51 +1079,96 @@ uncompress_hdr_hc06(uint16_t ip_len)
 
   /* Next header processing - continued */
   if((iphc0 & SICSLOWPAN_IPHC_NH_C)) {
+    uint8_t *next_hdr = &SICSLOWPAN_IP_BUF->proto;
+    uint8_t nhc = 1;
+
+    /* A compressed extension header, possibly followed by NHC */
+    if((*hc06_ptr & SICSLOWPAN_NHC_MASK) == SICSLOWPAN_NHC_EXT_HDR) {
+      uint8_t *ext = &sicslowpan_buf[UIP_LLH_LEN + uncomp_hdr_len];
+      uint8_t len;
+
+      switch(*hc06_ptr & SICSLOWPAN_NHC_EXT_HDR_EID_MASK) {
+      case SICSLOWPAN_NHC_EXT_HDR_EID_HBHO:
+        *next_hdr = UIP_PROTO_HBHO;
+        break;
+      case SICSLOWPAN_NHC_EXT_HDR_EID_ROUTING:
+        *next_hdr = UIP_PROTO_ROUTING;
+        break;
+      case SICSLOWPAN_NHC_EXT_HDR_EID_DESTO:
+        *next_hdr = UIP_PROTO_DESTO;
+        break;
+      default:
+        PRINTF("sicslowpan uncompress_hdr: error unsupported extension header\n");
+        return;
+      }
+      nhc = *hc06_ptr & SICSLOWPAN_NHC_EXT_HDR_NH;
+      hc06_ptr += 1;
+      if(!nhc) {
+        ext[0] = *hc06_ptr;
+        hc06_ptr += 1;
+      }
+      len = *hc06_ptr;
+      hc06_ptr += 1;
+      /* uIP only handles extension headers of whole 8-octet units */
+      if((len + 2) % 8 != 0 ||
+         uncomp_hdr_len + len + 2 + UIP_UDPH_LEN > 0xff ||
+         hc06_ptr + len > packetbuf_ptr + packetbuf_datalen()) {
+        PRINTF("sicslowpan uncompress_hdr: error bad extension header length %u\n", len);
+        return;
+      }
+      ext[1] = (len + 2) / 8 - 1;
+      memcpy(ext + 2, hc06_ptr, len);
+      hc06_ptr += len;
+      uncomp_hdr_len += len + 2;
+      next_hdr = &ext[0];
+    }
+
     /* The next header is compressed, NHC is following */
-    if((*hc06_ptr & SICSLOWPAN_NHC_UDP_MASK) == SICSLOWPAN_NHC_UDP_ID) {
+    if(nhc && (*hc06_ptr & SICSLOWPAN_NHC_UDP_MASK) == SICSLOWPAN_NHC_UDP_ID) {
       uint8_t checksum_compressed;
-      SICSLOWPAN_IP_BUF->proto = UIP_PROTO_UDP;
+      udp_buf = (struct uip_udp_hdr *)&sicslowpan_buf[UIP_LLH_LEN + uncomp_hdr_len];
+      *next_hdr = UIP_PROTO_UDP;
       checksum_compressed = *hc06_ptr & SICSLOWPAN_NHC_UDP_CHECKSUMC;
       PRINTF("IPHC: Incoming header value: %i\n", *hc06_ptr);
       switch(*hc06_ptr & SICSLOWPAN_NHC_UDP_CS_P_11) {
       case SICSLOWPAN_NHC_UDP_CS_P_00:
 	/* 1 byte for NHC, 4 byte for ports, 2 bytes chksum */
-	memcpy(&SICSLOWPAN_UDP_BUF->srcport, hc06_ptr + 1, 2);
-	memcpy(&SICSLOWPAN_UDP_BUF->destport, hc06_ptr + 3, 2);
+	memcpy(&udp_buf->srcport, hc06_ptr + 1, 2);
+	memcpy(&udp_buf->destport, hc06_ptr + 3, 2);
 	PRINTF("IPHC: Uncompressed UDP ports (ptr+5): %x, %x\n",
-	       UIP_HTONS(SICSLOWPAN_UDP_BUF->srcport), UIP_HTONS(SICSLOWPAN_UDP_BUF->destport));
+	       UIP_HTONS(udp_buf->srcport), UIP_HTONS(udp_buf->destport));
 	hc06_ptr += 5;
 	break;
 
       case SICSLOWPAN_NHC_UDP_CS_P_01:
         /* 1 byte for NHC + source 16bit inline, dest = 0xF0 + 8 bit inline */
 	PRINTF("IPHC: Decompressing destination\n");
-	memcpy(&SICSLOWPAN_UDP_BUF->srcport, hc06_ptr + 1, 2);
-	SICSLOWPAN_UDP_BUF->destport = UIP_HTONS(SICSLOWPAN_UDP_8_BIT_PORT_MIN + (*(hc06_ptr + 3)));
+	memcpy(&udp_buf->srcport, hc06_ptr + 1, 2);
+	udp_buf->destport = UIP_HTONS(SICSLOWPAN_UDP_8_BIT_PORT_MIN + (*(hc06_ptr + 3)));
 	PRINTF("IPHC: Uncompressed UDP ports (ptr+4): %x, %x\n",
-	       UIP_HTONS(SICSLOWPAN_UDP_BUF->srcport), UIP_HTONS(SICSLOWPAN_UDP_BUF->destport));
+	       UIP_HTONS(udp_buf->srcport), UIP_HTONS(udp_buf->destport));
 	hc06_ptr += 4;
 	break;
 
       case SICSLOWPAN_NHC_UDP_CS_P_10:
         /* 1 byte for NHC + source = 0xF0 + 8bit inline, dest = 16 bit inline*/
 	PRINTF("IPHC: Decompressing source\n");
-	SICSLOWPAN_UDP_BUF->srcport = UIP_HTONS(SICSLOWPAN_UDP_8_BIT_PORT_MIN +
+	udp_buf->srcport = UIP_HTONS(SICSLOWPAN_UDP_8_BIT_PORT_MIN +
 					    (*(hc06_ptr + 1)));
-	memcpy(&SICSLOWPAN_UDP_BUF->destport, hc06_ptr + 2, 2);
+	memcpy(&udp_buf->destport, hc06_ptr + 2, 2);
 	PRINTF("IPHC: Uncompressed UDP ports (ptr+4): %x, %x\n",
-	       UIP_HTONS(SICSLOWPAN_UDP_BUF->srcport), UIP_HTONS(SICSLOWPAN_UDP_BUF->destport));
+	       UIP_HTONS(udp_buf->srcport), UIP_HTONS(udp_buf->destport));
 	hc06_ptr += 4;
 	break;
 
       case SICSLOWPAN_NHC_UDP_CS_P_11:
 	/* 1 byte for NHC, 1 byte for ports */
-	SICSLOWPAN_UDP_BUF->srcport = UIP_HTONS(SICSLOWPAN_UDP_4_BIT_PORT_MIN +
+	udp_buf->srcport = UIP_HTONS(SICSLOWPAN_UDP_4_BIT_PORT_MIN +
 					    (*(hc06_ptr + 1) >> 4));
-	SICSLOWPAN_UDP_BUF->destport = UIP_HTONS(SICSLOWPAN_UDP_4_BIT_PORT_MIN +
+	udp_buf->destport = UIP_HTONS(SICSLOWPAN_UDP_4_BIT_PORT_MIN +
 					     ((*(hc06_ptr + 1)) & 0x0F));
 	PRINTF("IPHC: Uncompressed UDP ports (ptr+2): %x, %x\n",
-	       UIP_HTONS(SICSLOWPAN_UDP_BUF->srcport), UIP_HTONS(SICSLOWPAN_UDP_BUF->destport));
+	       UIP_HTONS(udp_buf->srcport), UIP_HTONS(udp_buf->destport));
 	hc06_ptr += 2;
 	break;
 
@@ -984,7 +1177,7 @@ uncompress_hdr_hc06(uint16_t ip_len)
 	return;
       }
       if(!checksum_compressed) { /* has_checksum, default  */
-	memcpy(&SICSLOWPAN_UDP_BUF->udpchksum, hc06_ptr, 2);
+	memcpy(&udp_buf->udpchksum, hc06_ptr, 2);
 	hc06_ptr += 2;
 	PRINTF("IPHC: sicslowpan uncompress_hdr: checksum included\n");
       } else {
@@ -993,7 +1186,7 @@ uncompress_hdr_hc06(uint16_t ip_len)
       uncomp_hdr_len += UIP_UDPH_LEN;
     }
 #ifdef SICSLOWPAN_NH_COMPRESSOR
-    else {
+    else if(nhc) {
       hc06_ptr += SICSLOWPAN_NH_COMPRESSOR.uncompress(hc06_ptr, sicslowpan_buf, &uncomp_hdr_len);
     }
 #endif
@@ -1013,9 +1206,11 @@ uncompress_hdr_hc06(uint16_t ip_len)
     SICSLOWPAN_IP_BUF->len[1] = (ip_len - UIP_IPH_LEN) & 0x00FF;
   }
   
-  /* length field in UDP header */
-  if(SICSLOWPAN_IP_BUF->proto == UIP_PROTO_UDP) {
-    memcpy(&SICSLOWPAN_UDP_BUF->udplen, &SICSLOWPAN_IP_BUF->len[0], 2);
+  /* length field in UDP header, which follows any extension header */
+  if(udp_buf != NULL) {
+    uint16_t len = ((SICSLOWPAN_IP_BUF->len[0] << 8) | SICSLOWPAN_IP_BUF->len[1]) -
+      ((uint8_t *)udp_buf - (uint8_t *)SICSLOWPAN_IP_BUF - UIP_IPH_LEN);
+    udp_buf->udplen = UIP_HTONS(len);
   }
 
   return;
@@ -1302,6 +1497,56 @@ compress_hdr_ipv6(linkaddr_t *link_destaddr)
 /*--------------------------------------------------------------------*/
 /** \name Input/output functions common to all compression schemes
  * @{                                                                 */
+#if SICSLOWPAN_CONF_FRAG && SICSLOWPAN_FRAG_RETRANSMISSIONS > 0
+static void send_packet(linkaddr_t *dest, void *ptr);
+/*--------------------------------------------------------------------*/
+/**
+ * Hands the fragments that failed to the MAC layer once more, and
+ * releases the others
+ */
+static void
+process_sent_fragments(void *ptr)
+{
+  struct frag_buf *f;
+
+  while((f = list_pop(frag_sent_list)) != NULL) {
+    if(!f->failed) {
+      queuebuf_free(f->buf);
+      memb_free(&frag_memb, f);
+    } else if(f->retransmissions < SICSLOWPAN_FRAG_RETRANSMISSIONS
+              && !(lost_tag_valid && f->tag == lost_tag)) {
+      PRINTFO("sicslowpan output: retransmitting fragment (tag %d)\n", f->tag);
+      f->retransmissions++;
+      queuebuf_to_packetbuf(f->buf);
+      packetbuf_set_attr(PACKETBUF_ATTR_PENDING, 0);
+      send_packet((linkaddr_t *)queuebuf_addr(f->buf, PACKETBUF_ADDR_RECEIVER), f);
+    } else {
+      /* The receiver won't be able to reassemble the datagram, don't
+         bother retransmitting its other fragments */
+      PRINTFO("sicslowpan output: fragment lost (tag %d)\n", f->tag);
+      lost_tag = f->tag;
+      lost_tag_valid = 1;
+      queuebuf_free(f->buf);
+      memb_free(&frag_memb, f);
+    }
+  }
+}
+/*--------------------------------------------------------------------*/
+/**
+ * Called when the MAC layer is done with a fragment that we kept a
+ * copy of. We may be called from within send_fragment() or the MAC
+ * layer, which are still using the packetbuf and the copy, so the
+ * fragment is dealt with later on.
+ */
+static void
+fragment_sent(struct frag_buf *f, int status)
+{
+  f->failed = (status == MAC_TX_COLLISION || status == MAC_TX_NOACK
+               || status == MAC_TX_ERR);
+  list_add(frag_sent_list, f);
+  ctimer_set(&frag_sent_timer, 0, process_sent_fragments, NULL);
+}
+#endif /* SICSLOWPAN_CONF_FRAG && SICSLOWPAN_FRAG_RETRANSMISSIONS > 0 */
 /*--------------------------------------------------------------------*/
 /**
  * Callback function for the MAC packet sent callback
@@ -1314,16 +1559,22 @@ packet_sent(void *ptr, int status, int transmissions)
   if(callback != NULL) {
     callback->output_callback(status);
   }
-  last_tx_status = status;
+
+#if SICSLOWPAN_CONF_FRAG && SICSLOWPAN_FRAG_RETRANSMISSIONS > 0
+  if(ptr != NULL) {
+    fragment_sent(ptr, status);
+  }
+#endif /* SICSLOWPAN_CONF_FRAG && SICSLOWPAN_FRAG_RETRANSMISSIONS > 0 */
 }
 /*--------------------------------------------------------------------*/
 /**
  * \brief This function is called by the 6lowpan code to send out a
  * packet.
  * \param dest the link layer destination address of the packet
+ * \param ptr the fragment that is sent, or NULL
  */
 static void
-send_packet(linkaddr_t *dest)
+send_packet(linkaddr_t *dest, void *ptr)
 {
   /* Set the link layer destination address for the packet as a
    * packetbuf attribute. The MAC layer can access the destination
@@ -1343,12 +1594,59 @@ send_packet(linkaddr_t *dest)
 
   /* Provide a callback function to receive the result of
      a packet transmission. */
-  NETSTACK_LLSEC.send(&packet_sent, NULL);
+  NETSTACK_LLSEC.send(&packet_sent, ptr);
 
   /* If we are sending multiple packets in a row, we need to let the
      watchdog know that we are still alive. */
   watchdog_periodic();
 }
+#if SICSLOWPAN_CONF_FRAG
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Hand the fragment in packetbuf to the MAC layer
+ * \param dest the link layer destination address of the fragment
+ * \param last whether this is the last fragment of the datagram
+ * \param keep whether to keep a copy of the fragment for retransmissions
+ * \return 0 if we're out of queuebufs
+ *
+ * The fragments of a datagram are handed to the MAC layer one after
+ * the other, without waiting for their transmission. All but the last
+ * one have the frame pending bit set, so that the MAC layer can send
+ * them in a single burst, waking up the receiver only once.
+ */
+static int
+send_fragment(linkaddr_t *dest, uint8_t last, uint8_t keep)
+{
+  struct queuebuf *q;
+  struct frag_buf *f = NULL;
+
+  packetbuf_set_attr(PACKETBUF_ATTR_PENDING, !last);
+
+  /* The MAC layer may change the packetbuf, which holds the headers
+     of the subsequent fragments: save it */
+  q = queuebuf_new_from_packetbuf();
+  if(q == NULL) {
+    return 0;
+  }
+#if SICSLOWPAN_FRAG_RETRANSMISSIONS > 0
+  if(keep) {
+    f = memb_alloc(&frag_memb);
+    if(f != NULL) {
+      f->buf = q;
+      f->tag = my_tag;
+      f->retransmissions = 0;
+    }
+  }
+#endif /* SICSLOWPAN_FRAG_RETRANSMISSIONS > 0 */
+
+  send_packet(dest, f);
+  queuebuf_to_packetbuf(q);
+  if(f == NULL) {
+    queuebuf_free(q);
+  }
+  return 1;
+}
+#endif /* SICSLOWPAN_CONF_FRAG */
 /*--------------------------------------------------------------------*/
 /** \brief Take an IP packet and format it to be sent on an 802.15.4
  *  network using 6lowpan.
@@ -1381,6 +1679,7 @@ output(const uip_lladdr_t *localdest)
 
   packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
                      SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+  set_packet_priority();
 
   if(callback) {
     /* call the attribution when the callback comes, but set attributes
@@ -1450,7 +1749,6 @@ output(const uip_lladdr_t *localdest)
 
   if((int)uip_len - (int)uncomp_hdr_len > max_payload - (int)packetbuf_hdr_len) {
 #if SICSLOWPAN_CONF_FRAG
-    struct queuebuf *q;
     /*
      * The outbound IPv6 packet is too large to fit into a single 15.4
      * packet, so we fragment it into multiple packets and send them.
@@ -1460,6 +1758,9 @@ output(const uip_lladdr_t *localdest)
      */
     int estimated_fragments = ((int)uip_len) / ((int)MAC_MAX_PAYLOAD - SICSLOWPAN_FRAGN_HDR_LEN) + 1;
     int freebuf = queuebuf_numfree() - 1;
+    /* Keep copies of the fragments for retransmissions if the MAC layer
+       is still left with a queuebuf for each fragment */
+    uint8_t keep = freebuf >= 2 * estimated_fragments;
     PRINTFO("uip_len: %d, fragments: %d, free bufs: %d\n", uip_len, estimated_fragments, freebuf);
     if(freebuf < estimated_fragments) {
       PRINTFO("Dropping packet, not enough free bufs\n");
@@ -1484,7 +1785,6 @@ output(const uip_lladdr_t *localdest)
           ((SICSLOWPAN_DISPATCH_FRAG1 << 8) | uip_len));
 /*     PACKETBUF_FRAG_BUF->tag = uip_htons(my_tag); */
     SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, my_tag);
-    my_tag++;
 
     /* Copy payload and send */
     packetbuf_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
@@ -1493,21 +1793,9 @@ output(const uip_lladdr_t *localdest)
     memcpy(packetbuf_ptr + packetbuf_hdr_len,
            (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, packetbuf_payload_len);
     packetbuf_set_datalen(packetbuf_payload_len + packetbuf_hdr_len);
-    q = queuebuf_new_from_packetbuf();
-    if(q == NULL) {
+    if(!send_fragment(&dest, 0, keep)) {
       PRINTFO("could not allocate queuebuf for first fragment, dropping packet\n");
-      return 0;
-    }
-    send_packet(&dest);
-    queuebuf_to_packetbuf(q);
-    queuebuf_free(q);
-    q = NULL;
-
-    /* Check tx result. */
-    if((last_tx_status == MAC_TX_COLLISION) ||
-       (last_tx_status == MAC_TX_ERR) ||
-       (last_tx_status == MAC_TX_ERR_FATAL)) {
-      PRINTFO("error in fragment tx, dropping subsequent fragments.\n");
+      my_tag++;
       return 0;
     }
 
@@ -1539,25 +1827,14 @@ output(const uip_lladdr_t *localdest)
       memcpy(packetbuf_ptr + packetbuf_hdr_len,
              (uint8_t *)UIP_IP_BUF + processed_ip_out_len, packetbuf_payload_len);
       packetbuf_set_datalen(packetbuf_payload_len + packetbuf_hdr_len);
-      q = queuebuf_new_from_packetbuf();
-      if(q == NULL) {
-        PRINTFO("could not allocate queuebuf, dropping fragment\n");
-        return 0;
-      }
-      send_packet(&dest);
-      queuebuf_to_packetbuf(q);
-      queuebuf_free(q);
-      q = NULL;
       processed_ip_out_len += packetbuf_payload_len;
-
-      /* Check tx result. */
-      if((last_tx_status == MAC_TX_COLLISION) ||
-         (last_tx_status == MAC_TX_ERR) ||
-         (last_tx_status == MAC_TX_ERR_FATAL)) {
-        PRINTFO("error in fragment tx, dropping subsequent fragments.\n");
+      if(!send_fragment(&dest, processed_ip_out_len >= uip_len, keep)) {
+        PRINTFO("could not allocate queuebuf, dropping fragment\n");
+        my_tag++;
         return 0;
       }
     }
+    my_tag++;
 #else /* SICSLOWPAN_CONF_FRAG */
     PRINTFO("sicslowpan output: Packet too large to be sent without fragmentation support; dropping packet\n");
     return 0;
@@ -1565,17 +1842,133 @@ output(const uip_lladdr_t *localdest)
   } else {
 
     /*
-     * The packet does not need to be fragmented
-     * copy "payload" and send
+     * The packet does not need to be fragmented.
+     * If the link-layer headers fit in front of the compressed headers,
+     * these become the packetbuf header and the payload is borrowed from
+     * uip_buf: a MAC layer that queues the packet copies it from there,
+     * and one that sends it right away makes the packetbuf copy it.
+     * Otherwise, copy "payload" after the compressed headers, and send.
+     * CCM* only encrypts the packetbuf data, so with encryption the
+     * compressed headers have to stay in the data.
      */
-    memcpy(packetbuf_ptr + packetbuf_hdr_len, (uint8_t *)UIP_IP_BUF + uncomp_hdr_len,
-           uip_len - uncomp_hdr_len);
-    packetbuf_set_datalen(uip_len - uncomp_hdr_len + packetbuf_hdr_len);
-    send_packet(&dest);
+    if(!LLSEC802154_USES_ENCRYPTION
+       && packetbuf_hdr_len + framer_hdrlen + NETSTACK_LLSEC.get_overhead()
+       <= PACKETBUF_HDR_SIZE) {
+      packetbuf_hdralloc(packetbuf_hdr_len);
+      memcpy(packetbuf_hdrptr(), packetbuf_ptr, packetbuf_hdr_len);
+      packetbuf_borrow((uint8_t *)UIP_IP_BUF + uncomp_hdr_len,
+                       uip_len - uncomp_hdr_len);
+    } else {
+      memcpy(packetbuf_ptr + packetbuf_hdr_len, (uint8_t *)UIP_IP_BUF + uncomp_hdr_len,
+             uip_len - uncomp_hdr_len);
+      packetbuf_set_datalen(uip_len - uncomp_hdr_len + packetbuf_hdr_len);
+    }
+    send_packet(&dest, NULL);
   }
   return 1;
 }
 
+#if SICSLOWPAN_CONF_FRAG
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Find the reassembly context of a fragment
+ * \return The context, or NULL if this is the first fragment of the
+ * datagram that we have received
+ */
+static struct reass_context *
+reass_lookup(const linkaddr_t *sender, uint16_t tag, uint16_t size)
+{
+  struct reass_context *r;
+
+  for(r = reass_contexts; r < reass_contexts + SICSLOWPAN_REASS_CONTEXTS; r++) {
+    if(r->size == size && r->tag == tag && linkaddr_cmp(&r->sender, sender)) {
+      return r;
+    }
+  }
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Free a reassembly context, and return its buffer to the pool
+ */
+static void
+reass_free(struct reass_context *r)
+{
+  ctimer_stop(&r->timer);
+#if UIP_BUFPOOL_SIZE > 1
+  if(r->buf != NULL) {
+    uip_bufpool_unref(r->buf);
+    r->buf = NULL;
+  }
+#endif /* UIP_BUFPOOL_SIZE > 1 */
+  r->size = 0;
+}
+/*--------------------------------------------------------------------*/
+static void
+reass_timeout(void *ptr)
+{
+  struct reass_context *r = ptr;
+
+  PRINTFI("sicslowpan input: reassembly of datagram (tag %d) timed out\n",
+          r->tag);
+  reass_free(r);
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Get a reassembly context for a new datagram
+ * \param evict Replace the oldest datagram if there's no free context
+ *
+ * We discard the oldest datagram for the first fragment of a new one only.
+ * The first fragment is the most likely to be followed by the rest of its
+ * datagram, and this lessens the negative impacts of too high
+ * SICSLOWPAN_REASS_MAXAGE.
+ */
+static struct reass_context *
+reass_alloc(uint8_t evict)
+{
+  struct reass_context *r, *oldest = NULL;
+
+  for(r = reass_contexts; r < reass_contexts + SICSLOWPAN_REASS_CONTEXTS; r++) {
+    if(r->size == 0) {
+      return r;
+    }
+    if(oldest == NULL || timer_remaining(&r->timer.etimer.timer) <
+       timer_remaining(&oldest->timer.etimer.timer)) {
+      oldest = r;
+    }
+  }
+  if(evict) {
+    PRINTFI("sicslowpan input: discarding datagram (tag %d) being reassembled\n",
+            oldest->tag);
+    reass_free(oldest);
+    return oldest;
+  }
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Record the bytes start to end (exclusive) of a datagram as received
+ * \return 0 if they all had been received before
+ */
+static uint8_t
+reass_mark(struct reass_context *r, uint16_t start, uint16_t end)
+{
+  uint16_t unit, last;
+  uint8_t mask, new_data = 0;
+
+  /* Only the last fragment may end in the middle of a unit */
+  last = end >= r->size ? REASS_UNITS(r->size) : end >> 3;
+  for(unit = start >> 3; unit < last; unit++) {
+    mask = 1 << (unit & 7);
+    if(!(r->units[unit >> 3] & mask)) {
+      r->units[unit >> 3] |= mask;
+      r->received++;
+      new_data = 1;
+    }
+  }
+  return new_data;
+}
+#endif /* SICSLOWPAN_CONF_FRAG */
 /*--------------------------------------------------------------------*/
 /** \brief Process a received 6lowpan packet.
  *  \param r The MAC layer
@@ -1583,11 +1976,14 @@ output(const uip_lladdr_t *localdest)
  *  The 6lowpan packet is put in packetbuf by the MAC. If its a frag1 or
  *  a non-fragmented packet we first uncompress the IP header. The
  *  6lowpan payload and possibly the uncompressed IP header are then
- *  copied in siclowpan_buf. If the IP packet is complete it is copied
- *  to uip_buf and the IP layer is called.
+ *  copied in siclowpan_buf, which is uip_buf for non-fragmented packets
+ *  and the buffer of a reassembly context for fragments. Once a
+ *  fragmented packet is complete it is copied to uip_buf. The IP layer
+ *  is then called.
  *
- * \note We do not check for overlapping sicslowpan fragments
- * (it is a SHALL in the RFC 4944 and should never happen)
+ * \note Overlapping fragments are not discarded (it is a SHALL in the
+ * RFC 4944 and should never happen), but fragments that do not bring any
+ * new data are ignored as duplicates.
  */
 static void
 input(void)
@@ -1600,7 +1996,7 @@ input(void)
 #if SICSLOWPAN_CONF_FRAG
   /* tag of the fragment */
   uint16_t frag_tag = 0;
-  uint8_t first_fragment = 0, last_fragment = 0;
+  uint8_t first_fragment = 0;
 #endif /*SICSLOWPAN_CONF_FRAG*/
 
   /* init */
@@ -1614,11 +2010,6 @@ input(void)
      want to query us for it later. */
   last_rssi = (signed short)packetbuf_attr(PACKETBUF_ATTR_RSSI);
 #if SICSLOWPAN_CONF_FRAG
-  /* if reassembly timed out, cancel it */
-  if(timer_expired(&reass_timer)) {
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  }
   /*
    * Since we don't support the mesh and broadcast header, the first header
    * we look for is the fragmentation header
@@ -1634,7 +2025,6 @@ input(void)
       PRINTFI("size %d, tag %d, offset %d)\n",
              frag_size, frag_tag, frag_offset);
       packetbuf_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
-      /*      printf("frag1 %d %d\n", reass_tag, frag_tag);*/
       first_fragment = 1;
       is_fragment = 1;
       break;
@@ -1650,77 +2040,50 @@ input(void)
       PRINTFI("size %d, tag %d, offset %d)\n",
              frag_size, frag_tag, frag_offset);
       packetbuf_hdr_len += SICSLOWPAN_FRAGN_HDR_LEN;
-
-      /* If this is the last fragment, we may shave off any extrenous
-         bytes at the end. We must be liberal in what we accept. */
-      PRINTFI("last_fragment?: processed_ip_in_len %d packetbuf_payload_len %d frag_size %d\n",
-              processed_ip_in_len, packetbuf_datalen() - packetbuf_hdr_len, frag_size);
-
-      if(processed_ip_in_len + packetbuf_datalen() - packetbuf_hdr_len >= frag_size) {
-        last_fragment = 1;
-      }
       is_fragment = 1;
       break;
     default:
       break;
   }
 
-  /* We are currently reassembling a packet, but have just received the first
-   * fragment of another packet. We can either ignore it and hope to receive
-   * the rest of the under-reassembly packet fragments, or we can discard the
-   * previous packet altogether, and start reassembling the new packet.
-   *
-   * We discard the previous packet, and start reassembling the new packet.
-   * This lessens the negative impacts of too high SICSLOWPAN_REASS_MAXAGE.
-   */
-#define PRIORITIZE_NEW_PACKETS 1
-#if PRIORITIZE_NEW_PACKETS
-
-  if(!is_fragment) {
-    /* Prioritize non-fragment packets too. */
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  } else if(processed_ip_in_len > 0 && first_fragment
-      && !linkaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  }
-#endif /* PRIORITIZE_NEW_PACKETS */
-
-  if(processed_ip_in_len > 0) {
-    /* reassembly is ongoing */
-    /*    printf("frag %d %d\n", reass_tag, frag_tag);*/
-    if((frag_size > 0 &&
-        (frag_size != sicslowpan_len ||
-         reass_tag  != frag_tag ||
-         !linkaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))))  ||
-       frag_size == 0) {
-      /*
-       * the packet is a fragment that does not belong to the packet
-       * being reassembled or the packet is not a fragment.
-       */
-      PRINTFI("sicslowpan input: Dropping 6lowpan packet that is not a fragment of the packet currently being reassembled\n");
+  reass = NULL;
+  if(is_fragment) {
+    if(frag_size == 0 || frag_size > REASS_MAX_SIZE) {
+      PRINTFI("sicslowpan input: Dropping fragment of a %d bytes packet\n", frag_size);
       return;
     }
-  } else {
-    /*
-     * reassembly is off
-     * start it if we received a fragment
-     */
-    if((frag_size > 0) && (frag_size <= UIP_BUFSIZE)) {
-      /* We are currently not reassembling a packet, but have received a packet fragment
-       * that is not the first one. */
-      if(is_fragment && !first_fragment) {
+
+    reass = reass_lookup(packetbuf_addr(PACKETBUF_ADDR_SENDER), frag_tag, frag_size);
+    if(reass == NULL) {
+      /* A fragment that is not the first one may take a free context only */
+      reass = reass_alloc(first_fragment);
+      if(reass == NULL) {
+        PRINTFI("sicslowpan input: Dropping fragment, no free reassembly context\n");
         return;
       }
-
-      sicslowpan_len = frag_size;
-      reass_tag = frag_tag;
-      timer_set(&reass_timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
+#if UIP_BUFPOOL_SIZE > 1
+      if((reass->buf = uip_bufpool_alloc()) == NULL) {
+        PRINTFI("sicslowpan input: Dropping fragment, no free buffer\n");
+        return;
+      }
+#endif /* UIP_BUFPOOL_SIZE > 1 */
+      linkaddr_copy(&reass->sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+      reass->tag = frag_tag;
+      reass->size = frag_size;
+      reass->received = 0;
+      memset(reass->units, 0, sizeof(reass->units));
+      ctimer_set(&reass->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND,
+                 reass_timeout, reass);
       PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
-             sicslowpan_len, reass_tag);
-      linkaddr_copy(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+             reass->size, reass->tag);
     }
+#if UIP_BUFPOOL_SIZE > 1
+    sicslowpan_buf = reass->buf->u8;
+#else /* UIP_BUFPOOL_SIZE > 1 */
+    sicslowpan_buf = reass->buf.u8;
+#endif /* UIP_BUFPOOL_SIZE > 1 */
+  } else {
+    sicslowpan_buf = uip_buf;
   }
 
   if(packetbuf_hdr_len == SICSLOWPAN_FRAGN_HDR_LEN) {
@@ -1778,81 +2141,97 @@ input(void)
   }
   packetbuf_payload_len = packetbuf_datalen() - packetbuf_hdr_len;
 
+#if SICSLOWPAN_CONF_FRAG
+  if(reass != NULL) {
+    uint16_t start = (uint16_t)(frag_offset << 3);
+    uint16_t end = start + uncomp_hdr_len + packetbuf_payload_len;
+
+    /* The last fragment may carry extraneous bytes at the end of the
+       packet. We must be liberal in what we accept. */
+    if(end > reass->size) {
+      if(start + uncomp_hdr_len > reass->size) {
+        PRINTFI("sicslowpan input: Dropping fragment beyond the end of the packet\n");
+        return;
+      }
+      packetbuf_payload_len -= end - reass->size;
+      end = reass->size;
+    }
+    if(!reass_mark(reass, start, end)) {
+      PRINTFI("sicslowpan input: Dropping duplicate fragment (tag %d, offset %d)\n",
+              reass->tag, frag_offset);
+      return;
+    }
+  }
+#endif /* SICSLOWPAN_CONF_FRAG */
+
   /* Sanity-check size of incoming packet to avoid buffer overflow */
   {
     int req_size = UIP_LLH_LEN + uncomp_hdr_len + (uint16_t)(frag_offset << 3)
         + packetbuf_payload_len;
-    if(req_size > sizeof(sicslowpan_buf)) {
+    if(req_size > UIP_BUFSIZE) {
       PRINTF(
           "SICSLOWPAN: packet dropped, minimum required SICSLOWPAN_IP_BUF size: %d+%d+%d+%d=%d (current size: %d)\n",
           UIP_LLH_LEN, uncomp_hdr_len, (uint16_t)(frag_offset << 3),
-          packetbuf_payload_len, req_size, sizeof(sicslowpan_buf));
+          packetbuf_payload_len, req_size, UIP_BUFSIZE);
       return;
     }
   }
 
+  /* Copy the payload behind the decompressed headers. Unlike output(),
+     the receive path cannot borrow: the frame is in packetbuf before the
+     length of the decompressed headers, and so the offset of the payload
+     in uip_buf, is known. uip_buf always starts a whole buffer of the
+     pool (see uip-bufpool.h), so it cannot be moved to where the payload
+     already is, and moving the payload in place would move as many
+     bytes as this copy. */
   memcpy((uint8_t *)SICSLOWPAN_IP_BUF + uncomp_hdr_len + (uint16_t)(frag_offset << 3), packetbuf_ptr + packetbuf_hdr_len, packetbuf_payload_len);
-  
-  /* update processed_ip_in_len if fragment, sicslowpan_len otherwise */
 
 #if SICSLOWPAN_CONF_FRAG
-  if(frag_size > 0) {
-    /* Add the size of the header only for the first fragment. */
-    if(first_fragment != 0) {
-      processed_ip_in_len += uncomp_hdr_len;
-    }
-    /* For the last fragment, we are OK if there is extrenous bytes at
-       the end of the packet. */
-    if(last_fragment != 0) {
-      processed_ip_in_len = frag_size;
-    } else {
-      processed_ip_in_len += packetbuf_payload_len;
+  if(reass != NULL) {
+    PRINTF("sicslowpan input: %d of %d units received (tag %d)\n",
+           reass->received, REASS_UNITS(reass->size), reass->tag);
+    if(reass->received < REASS_UNITS(reass->size)) {
+      return;
     }
-    PRINTF("processed_ip_in_len %d, packetbuf_payload_len %d\n", processed_ip_in_len, packetbuf_payload_len);
 
+    /* We have a full IP packet, deliver it to the IP stack */
+    PRINTFI("sicslowpan input: IP packet ready (length %d)\n",
+           reass->size);
+#if UIP_BUFPOOL_SIZE > 1
+    /* The stack takes over the reference of the context */
+    uip_bufpool_resume(reass->buf);
+    reass->buf = NULL;
+#else /* UIP_BUFPOOL_SIZE > 1 */
+    memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, reass->size);
+#endif /* UIP_BUFPOOL_SIZE > 1 */
+    uip_len = reass->size;
+    reass_free(reass);
   } else {
-#endif /* SICSLOWPAN_CONF_FRAG */
-    sicslowpan_len = packetbuf_payload_len + uncomp_hdr_len;
-#if SICSLOWPAN_CONF_FRAG
+    uip_len = packetbuf_payload_len + uncomp_hdr_len;
   }
-
-  /*
-   * If we have a full IP packet in sicslowpan_buf, deliver it to
-   * the IP stack
-   */
-  PRINTF("sicslowpan_init processed_ip_in_len %d, sicslowpan_len %d\n",
-         processed_ip_in_len, sicslowpan_len);
-  if(processed_ip_in_len == 0 || (processed_ip_in_len == sicslowpan_len)) {
-    PRINTFI("sicslowpan input: IP packet ready (length %d)\n",
-           sicslowpan_len);
-    memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, sicslowpan_len);
-    uip_len = sicslowpan_len;
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
+#else /* SICSLOWPAN_CONF_FRAG */
+  uip_len = packetbuf_payload_len + uncomp_hdr_len;
 #endif /* SICSLOWPAN_CONF_FRAG */
 
 #if DEBUG
-    {
-      uint16_t ndx;
-      PRINTF("after decompression %u:", SICSLOWPAN_IP_BUF->len[1]);
-      for (ndx = 0; ndx < SICSLOWPAN_IP_BUF->len[1] + 40; ndx++) {
-        uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[ndx];
-        PRINTF("%02x", data);
-      }
-      PRINTF("\n");
+  {
+    uint16_t ndx;
+    PRINTF("after decompression %u:", SICSLOWPAN_IP_BUF->len[1]);
+    for (ndx = 0; ndx < SICSLOWPAN_IP_BUF->len[1] + 40; ndx++) {
+      uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[ndx];
+      PRINTF("%02x", data);
     }
+    PRINTF("\n");
+  }
 #endif
 
-    /* if callback is set then set attributes and call */
-    if(callback) {
-      set_packet_attrs();
-      callback->input_callback();
-    }
-
-    tcpip_input();
-#if SICSLOWPAN_CONF_FRAG
+  /* if callback is set then set attributes and call */
+  if(callback) {
+    set_packet_attrs();
+    callback->input_callback();
   }
-#endif /* SICSLOWPAN_CONF_FRAG */
+
+  tcpip_input();
 }
 /** @} */
 
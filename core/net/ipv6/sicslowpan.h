@@ -144,6 +144,13 @@
 /* NHC_EXT_HDR */
 #define SICSLOWPAN_NHC_MASK                         0xF0
 #define SICSLOWPAN_NHC_EXT_HDR                      0xE0
+/* 1110 EID(3) NH(1): the EID names the header, NH is set when the next
+   header is NHC-compressed and elided from the extension header */
+#define SICSLOWPAN_NHC_EXT_HDR_EID_MASK             0x0E
+#define SICSLOWPAN_NHC_EXT_HDR_NH                   0x01
+#define SICSLOWPAN_NHC_EXT_HDR_EID_HBHO             0x00
+#define SICSLOWPAN_NHC_EXT_HDR_EID_ROUTING          0x02
+#define SICSLOWPAN_NHC_EXT_HDR_EID_DESTO            0x06
 
 /**
  * \name LOWPAN_UDP encoding (works together with IPHC)
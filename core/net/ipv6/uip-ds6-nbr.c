@@ -49,6 +49,7 @@
 #include "lib/list.h"
 #include "net/linkaddr.h"
 #include "net/packetbuf.h"
+#include "net/ip/tcpip.h"
 #include "net/ipv6/uip-ds6-nbr.h"
 
 #define DEBUG DEBUG_NONE
@@ -70,6 +71,40 @@ void LINK_NEIGHBOR_CALLBACK(const linkaddr_t *addr, int status, int numtx);
 
 NBR_TABLE_GLOBAL(uip_ds6_nbr_t, ds6_neighbors);
 
+#if UIP_DS6_NBR_HASH_SIZE
+/* Index of the neighbors by IPv6 address, hashed over the interface ID */
+static uip_ds6_nbr_t *ipaddr_hash[UIP_DS6_NBR_HASH_SIZE];
+
+/*---------------------------------------------------------------------------*/
+static uip_ds6_nbr_t **
+hash_bucket(const uip_ipaddr_t *ipaddr)
+{
+  unsigned hash = 0;
+  int i;
+  for(i = 8; i < 16; i++) {
+    hash = hash * 31 + ipaddr->u8[i];
+  }
+  return &ipaddr_hash[hash % UIP_DS6_NBR_HASH_SIZE];
+}
+/*---------------------------------------------------------------------------*/
+static void
+hash_remove(uip_ds6_nbr_t *nbr)
+{
+  uip_ds6_nbr_t **prev;
+  for(prev = hash_bucket(&nbr->ipaddr); *prev != NULL; prev = &(*prev)->hash_next) {
+    if(*prev == nbr) {
+      *prev = nbr->hash_next;
+      return;
+    }
+  }
+}
+#endif /* UIP_DS6_NBR_HASH_SIZE */
+
+#if UIP_DS6_NBR_NS_PER_PERIOD
+/* NS that may still be sent in the current period */
+static uint8_t ns_budget = UIP_DS6_NBR_NS_PER_PERIOD;
+#endif /* UIP_DS6_NBR_NS_PER_PERIOD */
+
 /*---------------------------------------------------------------------------*/
 void
 uip_ds6_neighbors_init(void)
@@ -81,9 +116,28 @@ uip_ds6_nbr_t *
 uip_ds6_nbr_add(const uip_ipaddr_t *ipaddr, const uip_lladdr_t *lladdr,
                 uint8_t isrouter, uint8_t state)
 {
-  uip_ds6_nbr_t *nbr = nbr_table_add_lladdr(ds6_neighbors, (linkaddr_t*)lladdr);
+  uip_ds6_nbr_t *nbr;
+#if UIP_DS6_NBR_HASH_SIZE
+  uip_ds6_nbr_t **bucket;
+
+  /* The entry of a known link-layer address is reinitialized, while
+     entries without one are always new */
+  if(lladdr != NULL) {
+    nbr = nbr_table_get_from_lladdr(ds6_neighbors, (linkaddr_t*)lladdr);
+    if(nbr != NULL) {
+      hash_remove(nbr);
+    }
+  }
+#endif /* UIP_DS6_NBR_HASH_SIZE */
+
+  nbr = nbr_table_add_lladdr(ds6_neighbors, (linkaddr_t*)lladdr);
   if(nbr) {
     uip_ipaddr_copy(&nbr->ipaddr, ipaddr);
+#if UIP_DS6_NBR_HASH_SIZE
+    bucket = hash_bucket(ipaddr);
+    nbr->hash_next = *bucket;
+    *bucket = nbr;
+#endif /* UIP_DS6_NBR_HASH_SIZE */
     nbr->isrouter = isrouter;
     nbr->state = state;
   #if UIP_CONF_IPV6_QUEUE_PKT
@@ -119,6 +173,9 @@ uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
     uip_packetqueue_free(&nbr->packethandle);
 #endif /* UIP_CONF_IPV6_QUEUE_PKT */
     NEIGHBOR_STATE_CHANGED(nbr);
+#if UIP_DS6_NBR_HASH_SIZE
+    hash_remove(nbr);
+#endif /* UIP_DS6_NBR_HASH_SIZE */
     nbr_table_remove(ds6_neighbors, nbr);
   }
   return;
@@ -138,6 +195,28 @@ uip_ds6_nbr_get_ll(const uip_ds6_nbr_t *nbr)
   return (const uip_lladdr_t *)nbr_table_get_lladdr(ds6_neighbors, nbr);
 }
 /*---------------------------------------------------------------------------*/
+void
+uip_ds6_nbr_set_ll(uip_ds6_nbr_t *nbr, const uip_lladdr_t *lladdr)
+{
+  linkaddr_t addr;
+
+  linkaddr_copy(&addr, nbr_table_get_lladdr(ds6_neighbors, nbr));
+  memcpy(&addr, lladdr, UIP_LLADDR_LEN);
+  nbr_table_set_lladdr(ds6_neighbors, nbr, &addr);
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_CONF_IPV6_QUEUE_PKT
+void
+uip_ds6_nbr_send_queued(uip_ds6_nbr_t *nbr)
+{
+  while(uip_packetqueue_buflen(&nbr->packethandle) != 0) {
+    uip_packetqueue_resume(&nbr->packethandle);
+    tcpip_output(uip_ds6_nbr_get_ll(nbr));
+  }
+  uip_len = 0;
+}
+#endif /* UIP_CONF_IPV6_QUEUE_PKT */
+/*---------------------------------------------------------------------------*/
 int
 uip_ds6_nbr_num(void)
 {
@@ -156,6 +235,16 @@ uip_ds6_nbr_num(void)
 uip_ds6_nbr_t *
 uip_ds6_nbr_lookup(const uip_ipaddr_t *ipaddr)
 {
+#if UIP_DS6_NBR_HASH_SIZE
+  uip_ds6_nbr_t *nbr;
+  if(ipaddr != NULL) {
+    for(nbr = *hash_bucket(ipaddr); nbr != NULL; nbr = nbr->hash_next) {
+      if(uip_ipaddr_cmp(&nbr->ipaddr, ipaddr)) {
+        return nbr;
+      }
+    }
+  }
+#else /* UIP_DS6_NBR_HASH_SIZE */
   uip_ds6_nbr_t *nbr = nbr_table_head(ds6_neighbors);
   if(ipaddr != NULL) {
     while(nbr != NULL) {
@@ -165,6 +254,7 @@ uip_ds6_nbr_lookup(const uip_ipaddr_t *ipaddr)
       nbr = nbr_table_next(ds6_neighbors, nbr);
     }
   }
+#endif /* UIP_DS6_NBR_HASH_SIZE */
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
@@ -236,6 +326,10 @@ uip_ds6_neighbor_periodic(void)
 {
   /* Periodic processing on neighbors */
   uip_ds6_nbr_t *nbr = nbr_table_head(ds6_neighbors);
+
+#if UIP_DS6_NBR_NS_PER_PERIOD
+  ns_budget = UIP_DS6_NBR_NS_PER_PERIOD;
+#endif /* UIP_DS6_NBR_NS_PER_PERIOD */
   while(nbr != NULL) {
     switch(nbr->state) {
     case NBR_REACHABLE:
@@ -272,11 +366,15 @@ uip_ds6_neighbor_periodic(void)
     case NBR_INCOMPLETE:
       if(nbr->nscount >= UIP_ND6_MAX_MULTICAST_SOLICIT) {
         uip_ds6_nbr_rm(nbr);
-      } else if(stimer_expired(&nbr->sendns) && (uip_len == 0)) {
+      } else if(stimer_expired(&nbr->sendns) && (uip_len == 0) &&
+                uip_ds6_nbr_ns_permit()) {
         nbr->nscount++;
         PRINTF("NBR_INCOMPLETE: NS %u\n", nbr->nscount);
         uip_nd6_ns_output(NULL, NULL, &nbr->ipaddr);
         stimer_set(&nbr->sendns, uip_ds6_if.retrans_timer / 1000);
+        /* Send it now, so that the NS due to other neighbors go out in
+           the same period */
+        tcpip_ipv6_output();
       }
       break;
     case NBR_DELAY:
@@ -297,11 +395,13 @@ uip_ds6_neighbor_periodic(void)
           }
         }
         uip_ds6_nbr_rm(nbr);
-      } else if(stimer_expired(&nbr->sendns) && (uip_len == 0)) {
+      } else if(stimer_expired(&nbr->sendns) && (uip_len == 0) &&
+                uip_ds6_nbr_ns_permit()) {
         nbr->nscount++;
         PRINTF("PROBE: NS %u\n", nbr->nscount);
         uip_nd6_ns_output(NULL, &nbr->ipaddr, &nbr->ipaddr);
         stimer_set(&nbr->sendns, uip_ds6_if.retrans_timer / 1000);
+        tcpip_ipv6_output();
       }
       break;
 #endif /* UIP_ND6_SEND_NA */
@@ -312,6 +412,19 @@ uip_ds6_neighbor_periodic(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+int
+uip_ds6_nbr_ns_permit(void)
+{
+#if UIP_DS6_NBR_NS_PER_PERIOD
+  if(ns_budget == 0) {
+    PRINTF("NS rate limit reached\n");
+    return 0;
+  }
+  ns_budget--;
+#endif /* UIP_DS6_NBR_NS_PER_PERIOD */
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
 uip_ds6_nbr_t *
 uip_ds6_get_least_lifetime_neighbor(void)
 {
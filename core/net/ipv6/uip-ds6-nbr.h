@@ -64,11 +64,30 @@
 #define  NBR_DELAY 3
 #define  NBR_PROBE 4
 
+/** \brief Number of buckets of the IPv6 address index of the nbr cache,
+ *  0 to look up neighbors by scanning the table */
+#ifdef UIP_DS6_NBR_CONF_HASH_SIZE
+#define UIP_DS6_NBR_HASH_SIZE UIP_DS6_NBR_CONF_HASH_SIZE
+#else
+#define UIP_DS6_NBR_HASH_SIZE NBR_TABLE_HASH_SIZE
+#endif
+
+/** \brief Number of NS sent for address resolution and unreachability
+ *  detection per UIP_DS6_PERIOD, over all neighbors, 0 for no limit */
+#ifdef UIP_DS6_NBR_CONF_NS_PER_PERIOD
+#define UIP_DS6_NBR_NS_PER_PERIOD UIP_DS6_NBR_CONF_NS_PER_PERIOD
+#else
+#define UIP_DS6_NBR_NS_PER_PERIOD 2
+#endif
+
 NBR_TABLE_DECLARE(ds6_neighbors);
 
 /** \brief An entry in the nbr cache */
 typedef struct uip_ds6_nbr {
   uip_ipaddr_t ipaddr;
+#if UIP_DS6_NBR_HASH_SIZE
+  struct uip_ds6_nbr *hash_next;
+#endif /* UIP_DS6_NBR_HASH_SIZE */
   struct stimer reachable;
   struct stimer sendns;
   uint8_t nscount;
@@ -88,6 +107,12 @@ uip_ds6_nbr_t *uip_ds6_nbr_add(const uip_ipaddr_t *ipaddr, const uip_lladdr_t *l
                                uint8_t isrouter, uint8_t state);
 void uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr);
 const uip_lladdr_t *uip_ds6_nbr_get_ll(const uip_ds6_nbr_t *nbr);
+void uip_ds6_nbr_set_ll(uip_ds6_nbr_t *nbr, const uip_lladdr_t *lladdr);
+#if UIP_CONF_IPV6_QUEUE_PKT
+/** \brief Send the packets queued during address resolution, oldest
+ *  first. uip_buf is overwritten. */
+void uip_ds6_nbr_send_queued(uip_ds6_nbr_t *nbr);
+#endif /* UIP_CONF_IPV6_QUEUE_PKT */
 const uip_ipaddr_t *uip_ds6_nbr_get_ipaddr(const uip_ds6_nbr_t *nbr);
 uip_ds6_nbr_t *uip_ds6_nbr_lookup(const uip_ipaddr_t *ipaddr);
 uip_ds6_nbr_t *uip_ds6_nbr_ll_lookup(const uip_lladdr_t *lladdr);
@@ -95,6 +120,17 @@ uip_ipaddr_t *uip_ds6_nbr_ipaddr_from_lladdr(const uip_lladdr_t *lladdr);
 const uip_lladdr_t *uip_ds6_nbr_lladdr_from_ipaddr(const uip_ipaddr_t *ipaddr);
 void uip_ds6_link_neighbor_callback(int status, int numtx);
 void uip_ds6_neighbor_periodic(void);
+
+/**
+ * \brief
+ *    Takes one NS from those that may be sent in the current period. A
+ *    neighbor whose NS is refused gets it from uip_ds6_neighbor_periodic()
+ *    in a later period.
+ *
+ * \return
+ *    1 if the NS may be sent, 0 if the limit is reached.
+ */
+int uip_ds6_nbr_ns_permit(void);
 int uip_ds6_nbr_num(void);
 
 /**
@@ -72,6 +72,15 @@ LIST(notificationlist);
 
 static int num_routes = 0;
 
+#if UIP_DS6_ROUTE_INDEX
+/* Host routes are hashed on their address. The other routes are kept
+   on a chain ordered by decreasing prefix length, so that the first
+   one that matches is the longest match. Both are linked through the
+   index_next field. */
+static uip_ds6_route_t *host_routes[UIP_DS6_ROUTE_HASH_SIZE];
+static uip_ds6_route_t *prefix_routes;
+#endif /* UIP_DS6_ROUTE_INDEX */
+
 #undef DEBUG
 #define DEBUG DEBUG_NONE
 #include "net/ip/uip-debug.h"
@@ -143,11 +152,98 @@ uip_ds6_notification_rm(struct uip_ds6_notification *n)
 }
 #endif
 /*---------------------------------------------------------------------------*/
+#if UIP_DS6_ROUTE_INDEX
+static uip_ds6_route_t **
+index_chain(const uip_ipaddr_t *addr, uint8_t length)
+{
+  uint16_t hash;
+  uint8_t i;
+
+  if(length < 128) {
+    return &prefix_routes;
+  }
+  /* The routes of a network share their prefix, hash the interface
+     identifier only */
+  hash = 0;
+  for(i = 8; i < 16; i++) {
+    hash = (hash << 3) + (hash >> 13) + addr->u8[i];
+  }
+  return &host_routes[hash % UIP_DS6_ROUTE_HASH_SIZE];
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_add(uip_ds6_route_t *r)
+{
+  uip_ds6_route_t **p;
+
+  p = index_chain(&r->ipaddr, r->length);
+  while(*p != NULL && (*p)->length > r->length) {
+    p = &(*p)->index_next;
+  }
+  r->index_next = *p;
+  *p = r;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_rm(uip_ds6_route_t *r)
+{
+  uip_ds6_route_t **p;
+
+  for(p = index_chain(&r->ipaddr, r->length); *p != NULL; p = &(*p)->index_next) {
+    if(*p == r) {
+      *p = r->index_next;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+index_lookup(uip_ipaddr_t *addr)
+{
+  uip_ds6_route_t *r;
+
+  for(r = *index_chain(addr, 128); r != NULL; r = r->index_next) {
+    if(uip_ipaddr_cmp(addr, &r->ipaddr)) {
+      return r;
+    }
+  }
+  for(r = prefix_routes; r != NULL; r = r->index_next) {
+    if(uip_ipaddr_prefixcmp(addr, &r->ipaddr, r->length)) {
+      return r;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Without reordering the route list on lookups, the least recently
+   used route is approximated by the oldest route that was not looked
+   up since the last time a route had to be dropped. */
+static uip_ds6_route_t *
+least_recently_used(void)
+{
+  uip_ds6_route_t *r;
+  uip_ds6_route_t *oldest;
+
+  oldest = NULL;
+  for(r = list_head(routelist); r != NULL; r = list_item_next(r)) {
+    if(!r->used) {
+      oldest = r;
+    }
+    r->used = 0;
+  }
+  return oldest != NULL ? oldest : list_tail(routelist);
+}
+#endif /* UIP_DS6_ROUTE_INDEX */
+/*---------------------------------------------------------------------------*/
 void
 uip_ds6_route_init(void)
 {
   memb_init(&routememb);
   list_init(routelist);
+#if UIP_DS6_ROUTE_INDEX
+  memset(host_routes, 0, sizeof(host_routes));
+  prefix_routes = NULL;
+#endif /* UIP_DS6_ROUTE_INDEX */
   nbr_table_register(nbr_routes,
                      (nbr_table_callback *)rm_routelist_callback);
 
@@ -205,15 +301,20 @@ uip_ds6_route_num_routes(void)
 uip_ds6_route_t *
 uip_ds6_route_lookup(uip_ipaddr_t *addr)
 {
-  uip_ds6_route_t *r;
   uip_ds6_route_t *found_route;
+#if !UIP_DS6_ROUTE_INDEX
+  uip_ds6_route_t *r;
   uint8_t longestmatch;
+#endif /* !UIP_DS6_ROUTE_INDEX */
 
   PRINTF("uip-ds6-route: Looking up route for ");
   PRINT6ADDR(addr);
   PRINTF("\n");
 
 
+#if UIP_DS6_ROUTE_INDEX
+  found_route = index_lookup(addr);
+#else /* UIP_DS6_ROUTE_INDEX */
   found_route = NULL;
   longestmatch = 0;
   for(r = uip_ds6_route_head();
@@ -229,6 +330,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
       }
     }
   }
+#endif /* UIP_DS6_ROUTE_INDEX */
 
   if(found_route != NULL) {
     PRINTF("uip-ds6-route: Found route: ");
@@ -240,6 +342,11 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
     PRINTF("uip-ds6-route: No route found\n");
   }
 
+#if UIP_DS6_ROUTE_INDEX
+  if(found_route != NULL) {
+    found_route->used = 1;
+  }
+#else /* UIP_DS6_ROUTE_INDEX */
   if(found_route != NULL && found_route != list_head(routelist)) {
     /* If we found a route, we put it at the start of the routeslist
        list. The list is ordered by how recently we looked them up:
@@ -249,6 +356,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
     list_remove(routelist, found_route);
     list_push(routelist, found_route);
   }
+#endif /* UIP_DS6_ROUTE_INDEX */
 
   return found_route;
 }
@@ -275,8 +383,13 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
 
   /* First make sure that we don't add a route twice. If we find an
      existing route for our destination, we'll delete the old
-     one first. */
+     one first. A route for a longer or shorter prefix is a different
+     route. */
   r = uip_ds6_route_lookup(ipaddr);
+  if(r != NULL && (r->length != length ||
+                   !uip_ipaddr_prefixcmp(ipaddr, &r->ipaddr, length))) {
+    r = NULL;
+  }
   if(r != NULL) {
     uip_ipaddr_t *current_nexthop;
     current_nexthop = uip_ds6_route_nexthop(r);
@@ -301,7 +414,11 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
          least recently used route is the first route on the list. */
       uip_ds6_route_t *oldest;
 
+#if UIP_DS6_ROUTE_INDEX
+      oldest = least_recently_used();
+#else /* UIP_DS6_ROUTE_INDEX */
       oldest = list_tail(routelist); /* uip_ds6_route_head(); */
+#endif /* UIP_DS6_ROUTE_INDEX */
       PRINTF("uip_ds6_route_add: dropping route to ");
       PRINT6ADDR(&oldest->ipaddr);
       PRINTF("\n");
@@ -371,6 +488,10 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
 
   uip_ipaddr_copy(&(r->ipaddr), ipaddr);
   r->length = length;
+#if UIP_DS6_ROUTE_INDEX
+  r->used = 1;
+  index_add(r);
+#endif /* UIP_DS6_ROUTE_INDEX */
 
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   memset(&r->state, 0, sizeof(UIP_DS6_ROUTE_STATE_TYPE));
@@ -409,6 +530,9 @@ uip_ds6_route_rm(uip_ds6_route_t *route)
 
     /* Remove the route from the route list */
     list_remove(routelist, route);
+#if UIP_DS6_ROUTE_INDEX
+    index_rm(route);
+#endif /* UIP_DS6_ROUTE_INDEX */
 
     /* Find the corresponding neighbor_route and remove it. */
     for(neighbor_route = list_head(route->neighbor_routes->route_list);
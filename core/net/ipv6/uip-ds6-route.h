@@ -88,6 +88,21 @@ void uip_ds6_notification_rm(struct uip_ds6_notification *n);
 #define UIP_DS6_ROUTE_NB UIP_CONF_MAX_ROUTES
 #endif /* UIP_CONF_MAX_ROUTES */
 
+/** \brief Index the routing table for longest prefix match lookups
+ *  instead of scanning it, for border routers with many routes. Host
+ *  routes (/128) are hashed into UIP_DS6_ROUTE_HASH_SIZE buckets. */
+#ifdef UIP_DS6_ROUTE_CONF_INDEX
+#define UIP_DS6_ROUTE_INDEX UIP_DS6_ROUTE_CONF_INDEX
+#else
+#define UIP_DS6_ROUTE_INDEX 0
+#endif
+
+#ifdef UIP_DS6_ROUTE_CONF_HASH_SIZE
+#define UIP_DS6_ROUTE_HASH_SIZE UIP_DS6_ROUTE_CONF_HASH_SIZE
+#else
+#define UIP_DS6_ROUTE_HASH_SIZE 32
+#endif
+
 /** \brief define some additional RPL related route state and
  *  neighbor callback for RPL - if not a DS6_ROUTE_STATE is already set */
 #ifndef UIP_DS6_ROUTE_STATE_TYPE
@@ -120,6 +135,12 @@ typedef struct uip_ds6_route {
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   UIP_DS6_ROUTE_STATE_TYPE state;
 #endif
+#if UIP_DS6_ROUTE_INDEX
+  /* Next route in the same hash bucket or on the prefix route chain */
+  struct uip_ds6_route *index_next;
+  /* Looked up since the last time a route had to be dropped */
+  uint8_t used;
+#endif /* UIP_DS6_ROUTE_INDEX */
   uint8_t length;
 } uip_ds6_route_t;
 
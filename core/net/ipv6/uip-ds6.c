@@ -83,9 +83,46 @@ static uip_ipaddr_t loc_fipaddr;
 /* Pointers used in this file */
 static uip_ds6_addr_t *locaddr;
 static uip_ds6_maddr_t *locmaddr;
-static uip_ds6_aaddr_t *locaaddr;
 static uip_ds6_prefix_t *locprefix;
 
+/* Lookup index of a DS6 list: a bitmap of the used slots and, for the lists
+ * of full addresses, a one-byte hash of each slot's address. Lookups only
+ * compare the addresses of the used slots whose hash matches. */
+#if UIP_DS6_PREFIX_NB > 32 || UIP_DS6_ADDR_NB > 32 || UIP_DS6_MADDR_NB > 32 || UIP_DS6_AADDR_NB > 32
+#error "The DS6 lists are limited to 32 entries"
+#endif
+struct ds6_index {
+  uip_ds6_element_t *list;
+  uint16_t elementsize;
+  uint8_t size;
+  uint32_t used;
+  uint8_t *hash;
+};
+
+static uint8_t addr_hash[UIP_DS6_ADDR_NB];
+static uint8_t maddr_hash[UIP_DS6_MADDR_NB];
+static uint8_t aaddr_hash[UIP_DS6_AADDR_NB];
+
+static struct ds6_index prefix_index = {
+  (uip_ds6_element_t *)uip_ds6_prefix_list, sizeof(uip_ds6_prefix_t),
+  UIP_DS6_PREFIX_NB, 0, NULL
+};
+static struct ds6_index addr_index = {
+  (uip_ds6_element_t *)uip_ds6_if.addr_list, sizeof(uip_ds6_addr_t),
+  UIP_DS6_ADDR_NB, 0, addr_hash
+};
+static struct ds6_index maddr_index = {
+  (uip_ds6_element_t *)uip_ds6_if.maddr_list, sizeof(uip_ds6_maddr_t),
+  UIP_DS6_MADDR_NB, 0, maddr_hash
+};
+static struct ds6_index aaddr_index = {
+  (uip_ds6_element_t *)uip_ds6_if.aaddr_list, sizeof(uip_ds6_aaddr_t),
+  UIP_DS6_AADDR_NB, 0, aaddr_hash
+};
+
+#define INDEX_ELEMENT(index, i) \
+  ((uip_ds6_element_t *)((uint8_t *)(index)->list + (i) * (index)->elementsize))
+
 /*---------------------------------------------------------------------------*/
 void
 uip_ds6_init(void)
@@ -100,6 +137,10 @@ uip_ds6_init(void)
      UIP_DS6_ADDR_NB, UIP_DS6_MADDR_NB, UIP_DS6_AADDR_NB);
   memset(uip_ds6_prefix_list, 0, sizeof(uip_ds6_prefix_list));
   memset(&uip_ds6_if, 0, sizeof(uip_ds6_if));
+  prefix_index.used = 0;
+  addr_index.used = 0;
+  maddr_index.used = 0;
+  aaddr_index.used = 0;
   uip_ds6_addr_size = sizeof(struct uip_ds6_addr);
   uip_ds6_netif_addr_list_offset = offsetof(struct uip_ds6_netif, addr_list);
 
@@ -222,6 +263,71 @@ uip_ds6_list_loop(uip_ds6_element_t *list, uint8_t size,
 
   return *out_element != NULL ? FREESPACE : NOSPACE;
 }
+/*---------------------------------------------------------------------------*/
+/* Hash of the interface ID, mixed with the first 16 bits of the address so
+ * that link-local and global addresses with the same IID differ */
+static uint8_t
+index_hash(const uip_ipaddr_t *ipaddr)
+{
+  uint16_t hash = ipaddr->u16[0];
+  uint8_t i;
+
+  for(i = 4; i < 8; i++) {
+    hash ^= ipaddr->u16[i];
+  }
+  return (hash >> 8) ^ hash;
+}
+/*---------------------------------------------------------------------------*/
+/* Find the used element whose address has the first ipaddrlen bits of ipaddr */
+static uip_ds6_element_t *
+index_lookup(const struct ds6_index *index, const uip_ipaddr_t *ipaddr,
+             uint8_t ipaddrlen)
+{
+  uint32_t used;
+  uint8_t i;
+  uint8_t hash = index->hash != NULL ? index_hash(ipaddr) : 0;
+
+  for(used = index->used, i = 0; used != 0; used >>= 1, i++) {
+    if((used & 1) && (index->hash == NULL || index->hash[i] == hash) &&
+       uip_ipaddr_prefixcmp(&INDEX_ELEMENT(index, i)->ipaddr, ipaddr, ipaddrlen)) {
+      return INDEX_ELEMENT(index, i);
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Take a free element for ipaddr, unless ipaddrlen bits of it are already in the list */
+static uip_ds6_element_t *
+index_add(struct ds6_index *index, const uip_ipaddr_t *ipaddr, uint8_t ipaddrlen)
+{
+  uip_ds6_element_t *element;
+  uint8_t i;
+
+  if(index_lookup(index, ipaddr, ipaddrlen) != NULL) {
+    return NULL;
+  }
+  for(i = 0; i < index->size; i++) {
+    if((index->used & ((uint32_t)1 << i)) == 0) {
+      element = INDEX_ELEMENT(index, i);
+      element->isused = 1;
+      uip_ipaddr_copy(&element->ipaddr, ipaddr);
+      index->used |= (uint32_t)1 << i;
+      if(index->hash != NULL) {
+        index->hash[i] = index_hash(ipaddr);
+      }
+      return element;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_rm(struct ds6_index *index, void *element)
+{
+  ((uip_ds6_element_t *)element)->isused = 0;
+  index->used &= ~((uint32_t)1 <<
+                   (((uint8_t *)element - (uint8_t *)index->list) / index->elementsize));
+}
 
 /*---------------------------------------------------------------------------*/
 #if UIP_CONF_ROUTER
@@ -231,12 +337,8 @@ uip_ds6_prefix_add(uip_ipaddr_t *ipaddr, uint8_t ipaddrlen,
                    uint8_t advertise, uint8_t flags, unsigned long vtime,
                    unsigned long ptime)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *)uip_ds6_prefix_list, UIP_DS6_PREFIX_NB,
-      sizeof(uip_ds6_prefix_t), ipaddr, ipaddrlen,
-      (uip_ds6_element_t **)&locprefix) == FREESPACE) {
-    locprefix->isused = 1;
-    uip_ipaddr_copy(&locprefix->ipaddr, ipaddr);
+  locprefix = (uip_ds6_prefix_t *)index_add(&prefix_index, ipaddr, ipaddrlen);
+  if(locprefix != NULL) {
     locprefix->length = ipaddrlen;
     locprefix->advertise = advertise;
     locprefix->l_a_reserved = flags;
@@ -259,12 +361,8 @@ uip_ds6_prefix_t *
 uip_ds6_prefix_add(uip_ipaddr_t *ipaddr, uint8_t ipaddrlen,
                    unsigned long interval)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *)uip_ds6_prefix_list, UIP_DS6_PREFIX_NB,
-      sizeof(uip_ds6_prefix_t), ipaddr, ipaddrlen,
-      (uip_ds6_element_t **)&locprefix) == FREESPACE) {
-    locprefix->isused = 1;
-    uip_ipaddr_copy(&locprefix->ipaddr, ipaddr);
+  locprefix = (uip_ds6_prefix_t *)index_add(&prefix_index, ipaddr, ipaddrlen);
+  if(locprefix != NULL) {
     locprefix->length = ipaddrlen;
     if(interval != 0) {
       stimer_set(&(locprefix->vlifetime), interval);
@@ -285,7 +383,7 @@ void
 uip_ds6_prefix_rm(uip_ds6_prefix_t *prefix)
 {
   if(prefix != NULL) {
-    prefix->isused = 0;
+    index_rm(&prefix_index, prefix);
   }
   return;
 }
@@ -293,22 +391,18 @@ uip_ds6_prefix_rm(uip_ds6_prefix_t *prefix)
 uip_ds6_prefix_t *
 uip_ds6_prefix_lookup(uip_ipaddr_t *ipaddr, uint8_t ipaddrlen)
 {
-  if(uip_ds6_list_loop((uip_ds6_element_t *)uip_ds6_prefix_list,
-		       UIP_DS6_PREFIX_NB, sizeof(uip_ds6_prefix_t),
-		       ipaddr, ipaddrlen,
-		       (uip_ds6_element_t **)&locprefix) == FOUND) {
-    return locprefix;
-  }
-  return NULL;
+  return (uip_ds6_prefix_t *)index_lookup(&prefix_index, ipaddr, ipaddrlen);
 }
 
 /*---------------------------------------------------------------------------*/
 uint8_t
 uip_ds6_is_addr_onlink(uip_ipaddr_t *ipaddr)
 {
-  for(locprefix = uip_ds6_prefix_list;
-      locprefix < uip_ds6_prefix_list + UIP_DS6_PREFIX_NB; locprefix++) {
-    if(locprefix->isused &&
+  uint32_t used;
+
+  for(used = prefix_index.used, locprefix = uip_ds6_prefix_list;
+      used != 0; used >>= 1, locprefix++) {
+    if((used & 1) &&
        uip_ipaddr_prefixcmp(&locprefix->ipaddr, ipaddr, locprefix->length)) {
       return 1;
     }
@@ -320,12 +414,8 @@ uip_ds6_is_addr_onlink(uip_ipaddr_t *ipaddr)
 uip_ds6_addr_t *
 uip_ds6_addr_add(uip_ipaddr_t *ipaddr, unsigned long vlifetime, uint8_t type)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *)uip_ds6_if.addr_list, UIP_DS6_ADDR_NB,
-      sizeof(uip_ds6_addr_t), ipaddr, 128,
-      (uip_ds6_element_t **)&locaddr) == FREESPACE) {
-    locaddr->isused = 1;
-    uip_ipaddr_copy(&locaddr->ipaddr, ipaddr);
+  locaddr = (uip_ds6_addr_t *)index_add(&addr_index, ipaddr, 128);
+  if(locaddr != NULL) {
     locaddr->type = type;
     if(vlifetime == 0) {
       locaddr->isinfinite = 1;
@@ -358,7 +448,7 @@ uip_ds6_addr_rm(uip_ds6_addr_t *addr)
     if((locmaddr = uip_ds6_maddr_lookup(&loc_fipaddr)) != NULL) {
       uip_ds6_maddr_rm(locmaddr);
     }
-    addr->isused = 0;
+    index_rm(&addr_index, addr);
   }
   return;
 }
@@ -367,13 +457,7 @@ uip_ds6_addr_rm(uip_ds6_addr_t *addr)
 uip_ds6_addr_t *
 uip_ds6_addr_lookup(uip_ipaddr_t *ipaddr)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *)uip_ds6_if.addr_list, UIP_DS6_ADDR_NB,
-      sizeof(uip_ds6_addr_t), ipaddr, 128,
-      (uip_ds6_element_t **)&locaddr) == FOUND) {
-    return locaddr;
-  }
-  return NULL;
+  return (uip_ds6_addr_t *)index_lookup(&addr_index, ipaddr, 128);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -418,15 +502,7 @@ uip_ds6_get_global(int8_t state)
 uip_ds6_maddr_t *
 uip_ds6_maddr_add(const uip_ipaddr_t *ipaddr)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *)uip_ds6_if.maddr_list, UIP_DS6_MADDR_NB,
-      sizeof(uip_ds6_maddr_t), (void*)ipaddr, 128,
-      (uip_ds6_element_t **)&locmaddr) == FREESPACE) {
-    locmaddr->isused = 1;
-    uip_ipaddr_copy(&locmaddr->ipaddr, ipaddr);
-    return locmaddr;
-  }
-  return NULL;
+  return (uip_ds6_maddr_t *)index_add(&maddr_index, ipaddr, 128);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -434,7 +510,7 @@ void
 uip_ds6_maddr_rm(uip_ds6_maddr_t *maddr)
 {
   if(maddr != NULL) {
-    maddr->isused = 0;
+    index_rm(&maddr_index, maddr);
   }
   return;
 }
@@ -443,13 +519,7 @@ uip_ds6_maddr_rm(uip_ds6_maddr_t *maddr)
 uip_ds6_maddr_t *
 uip_ds6_maddr_lookup(const uip_ipaddr_t *ipaddr)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *)uip_ds6_if.maddr_list, UIP_DS6_MADDR_NB,
-      sizeof(uip_ds6_maddr_t), (void*)ipaddr, 128,
-      (uip_ds6_element_t **)&locmaddr) == FOUND) {
-    return locmaddr;
-  }
-  return NULL;
+  return (uip_ds6_maddr_t *)index_lookup(&maddr_index, ipaddr, 128);
 }
 
 
@@ -457,15 +527,7 @@ uip_ds6_maddr_lookup(const uip_ipaddr_t *ipaddr)
 uip_ds6_aaddr_t *
 uip_ds6_aaddr_add(uip_ipaddr_t *ipaddr)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *)uip_ds6_if.aaddr_list, UIP_DS6_AADDR_NB,
-      sizeof(uip_ds6_aaddr_t), ipaddr, 128,
-      (uip_ds6_element_t **)&locaaddr) == FREESPACE) {
-    locaaddr->isused = 1;
-    uip_ipaddr_copy(&locaaddr->ipaddr, ipaddr);
-    return locaaddr;
-  }
-  return NULL;
+  return (uip_ds6_aaddr_t *)index_add(&aaddr_index, ipaddr, 128);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -473,7 +535,7 @@ void
 uip_ds6_aaddr_rm(uip_ds6_aaddr_t *aaddr)
 {
   if(aaddr != NULL) {
-    aaddr->isused = 0;
+    index_rm(&aaddr_index, aaddr);
   }
   return;
 }
@@ -482,12 +544,7 @@ uip_ds6_aaddr_rm(uip_ds6_aaddr_t *aaddr)
 uip_ds6_aaddr_t *
 uip_ds6_aaddr_lookup(uip_ipaddr_t *ipaddr)
 {
-  if(uip_ds6_list_loop((uip_ds6_element_t *)uip_ds6_if.aaddr_list,
-		       UIP_DS6_AADDR_NB, sizeof(uip_ds6_aaddr_t), ipaddr, 128,
-		       (uip_ds6_element_t **)&locaaddr) == FOUND) {
-    return locaaddr;
-  }
-  return NULL;
+  return (uip_ds6_aaddr_t *)index_lookup(&aaddr_index, ipaddr, 128);
 }
 
 /*---------------------------------------------------------------------------*/
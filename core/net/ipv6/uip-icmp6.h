@@ -64,6 +64,7 @@
 #define ICMP6_REDIRECT                  137  /**< Redirect */
 
 #define ICMP6_RPL                       155  /**< RPL */
+#define ICMP6_MPL                       159  /**< MPL */
 #define ICMP6_PRIV_EXP_100              100  /**< Private Experimentation */
 #define ICMP6_PRIV_EXP_101              101  /**< Private Experimentation */
 #define ICMP6_PRIV_EXP_200              200  /**< Private Experimentation */
@@ -77,11 +77,16 @@
 #include "net/ipv6/uip-nd6.h"
 #include "net/ipv6/uip-ds6.h"
 #include "net/ipv6/multicast/uip-mcast6.h"
+#if UIP_ARCH_CHKSUM_SUM
+#include "net/ip/uip_arch.h"
+#endif /* UIP_ARCH_CHKSUM_SUM */
 
 #include "ipsec.h"
 #include "ipsec/common_ipsec.h"
 #include "ipsec/spd.h"
 #include "ipsec/sad.h"
+#include "ipsec/sad_store.h"
+#include "ipsec/ipsec_stats.h"
 #include "ipsec/filter.h"
 #include "ipsec/transforms/encr.h"
 #include "ipsec/transforms/integ.h"
@@ -97,10 +102,13 @@
 #include "net/ip/uip-debug.h"
 
 // IPsec stuff start
+#if IPSEC_DEBUG
 #define IPSECDBG_PRINTF(...) printf(__VA_ARGS__)
 #define MEMPRINT(...) memprint(__VA_ARGS__)
-//#define IPSECDBG_PRINTF(...) 
-//#define MEMPRINT(...) 
+#else
+#define IPSECDBG_PRINTF(...) 
+#define MEMPRINT(...) 
+#endif
 // IPsec stuff ends
 
 #if UIP_CONF_IPV6_RPL
@@ -269,6 +277,13 @@ uint16_t uip_listenports[UIP_LISTENPORTS];
 /* The iss variable is used for the TCP initial sequence number. */
 static uint8_t iss[4];
 
+#if UIP_TCP_CONN_HASH_SIZE
+/* Heads of the chains of connections with the same hash of their ports
+   and remote address. A closed connection stays in its chain until it
+   is reused. */
+static struct uip_conn *conn_hash[UIP_TCP_CONN_HASH_SIZE];
+#endif /* UIP_TCP_CONN_HASH_SIZE */
+
 /* Temporary variables. */
 uint8_t uip_acc32[4];
 static uint8_t opt;
@@ -333,43 +348,67 @@ uip_add32(uint8_t *op32, uint16_t op16)
 
 #endif /* UIP_ARCH_ADD32 && UIP_TCP */
 
-#if ! UIP_ARCH_CHKSUM
 /*---------------------------------------------------------------------------*/
-static uint16_t
-chksum(uint16_t sum, const uint8_t *data, uint16_t len)
+uint16_t
+uip_chksum_add(uint16_t sum, const uint8_t *data, uint16_t len)
 {
-  uint16_t t;
-  const uint8_t *dataptr;
-  const uint8_t *last_byte;
-
-  dataptr = data;
-  last_byte = data + len - 1;
-  
-  while(dataptr < last_byte) {   /* At least two more bytes */
-    t = (dataptr[0] << 8) + dataptr[1];
-    sum += t;
-    if(sum < t) {
-      sum++;      /* carry */
+#if UIP_ARCH_CHKSUM_SUM
+  return uip_arch_chksum_sum(sum, data, len);
+#else /* UIP_ARCH_CHKSUM_SUM */
+  uint32_t acc;
+  const uint16_t *word;
+
+  if(((uintptr_t)data & 1) == 0) {
+    /* Add aligned 16-bit words as they are. The one's complement sum is
+       independent of byte order (RFC 1071), so only the result needs to
+       be swapped to host byte order. */
+    acc = UIP_HTONS(sum);
+    for(word = (const uint16_t *)data; len >= 8; word += 4, len -= 8) {
+      acc += (uint32_t)word[0] + word[1] + word[2] + word[3];
     }
-    dataptr += 2;
-  }
-  
-  if(dataptr == last_byte) {
-    t = (dataptr[0] << 8) + 0;
-    sum += t;
-    if(sum < t) {
-      sum++;      /* carry */
+    for(; len >= 2; word++, len -= 2) {
+      acc += *word;
     }
+    if(len == 1) {
+      acc += UIP_HTONS((uint16_t)*(const uint8_t *)word << 8);
+    }
+    acc = (acc >> 16) + (acc & 0xffff);
+    acc += acc >> 16;
+    return UIP_HTONS((uint16_t)acc);
   }
 
+  acc = sum;
+  for(; len >= 2; data += 2, len -= 2) {
+    acc += ((uint16_t)data[0] << 8) | data[1];
+  }
+  if(len == 1) {
+    acc += (uint16_t)data[0] << 8;
+  }
+  acc = (acc >> 16) + (acc & 0xffff);
+  acc += acc >> 16;
+
   /* Return sum in host byte order. */
-  return sum;
+  return (uint16_t)acc;
+#endif /* UIP_ARCH_CHKSUM_SUM */
 }
 /*---------------------------------------------------------------------------*/
 uint16_t
+uip_chksum_update(uint16_t chksum, uint16_t old_sum, uint16_t new_sum)
+{
+  /* RFC 1624, eqn. 3: HC' = ~(~HC + ~m + m') */
+  uint32_t acc = (uint32_t)(uint16_t)~chksum + (uint16_t)~old_sum + new_sum;
+
+  acc = (acc >> 16) + (acc & 0xffff);
+  acc += acc >> 16;
+  return ~(uint16_t)acc;
+}
+/*---------------------------------------------------------------------------*/
+#if ! UIP_ARCH_CHKSUM
+/*---------------------------------------------------------------------------*/
+uint16_t
 uip_chksum(uint16_t *data, uint16_t len)
 {
-  return uip_htons(chksum(0, (uint8_t *)data, len));
+  return uip_htons(uip_chksum_add(0, (uint8_t *)data, len));
 }
 /*---------------------------------------------------------------------------*/
 #ifndef UIP_ARCH_IPCHKSUM
@@ -378,7 +417,7 @@ uip_ipchksum(void)
 {
   uint16_t sum;
 
-  sum = chksum(0, &uip_buf[UIP_LLH_LEN], UIP_IPH_LEN);
+  sum = uip_chksum_add(0, &uip_buf[UIP_LLH_LEN], UIP_IPH_LEN);
   PRINTF("uip_ipchksum: sum 0x%04x\n", sum);
   return (sum == 0) ? 0xffff : uip_htons(sum);
 }
@@ -412,10 +451,10 @@ upper_layer_chksum(uint8_t proto)
   /* IP protocol and length fields. This addition cannot carry. */
   sum = upper_layer_len + proto;
   /* Sum IP source and destination addresses. */
-  sum = chksum(sum, (uint8_t *)&UIP_IP_BUF->srcipaddr, 2 * sizeof(uip_ipaddr_t));
+  sum = uip_chksum_add(sum, (uint8_t *)&UIP_IP_BUF->srcipaddr, 2 * sizeof(uip_ipaddr_t));
 
   /* Sum TCP header and data. */
-  sum = chksum(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN],
+  sum = uip_chksum_add(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN],
                upper_layer_len);
     
   return (sum == 0) ? 0xffff : uip_htons(sum);
@@ -445,10 +484,309 @@ uip_udpchksum(void)
 #endif /* UIP_UDP && UIP_UDP_CHECKSUMS */
 #endif /* UIP_ARCH_CHKSUM */
 /*---------------------------------------------------------------------------*/
+#if UIP_TCP
+/* Update the retransmission time-out with the round-trip time m, in
+   timer ticks, of a segment that was just acknowledged. */
+static void
+update_rto(struct uip_conn *conn, signed char m)
+{
+  /* This is taken directly from VJs original code in his paper */
+  m = m - (conn->sa >> 3);
+  conn->sa += m;
+  if(m < 0) {
+    m = -m;
+  }
+  m = m - (conn->sv >> 2);
+  conn->sv += m;
+  conn->rto = (conn->sa >> 3) + conn->sv;
+}
+#endif /* UIP_TCP */
+/*---------------------------------------------------------------------------*/
+#if UIP_TCP && UIP_TCP_CONN_HASH_SIZE
+static struct uip_conn **
+conn_bucket(uint16_t lport, uint16_t rport, const uip_ipaddr_t *ripaddr)
+{
+  uint16_t h;
+
+  h = lport ^ rport ^ ripaddr->u16[0] ^ ripaddr->u16[4] ^
+    ripaddr->u16[5] ^ ripaddr->u16[6] ^ ripaddr->u16[7];
+  h ^= h >> 8;
+  return &conn_hash[h % UIP_TCP_CONN_HASH_SIZE];
+}
+/*---------------------------------------------------------------------------*/
+static void
+conn_hash_add(struct uip_conn *conn)
+{
+  struct uip_conn **bucket;
+
+  bucket = conn_bucket(conn->lport, conn->rport, &conn->ripaddr);
+  conn->hash_next = *bucket;
+  *bucket = conn;
+}
+/*---------------------------------------------------------------------------*/
+/* Remove a connection that is about to be reused from its chain, if it
+   was ever hashed */
+static void
+conn_hash_rm(struct uip_conn *conn)
+{
+  struct uip_conn **p;
+
+  for(p = conn_bucket(conn->lport, conn->rport, &conn->ripaddr);
+      *p != NULL; p = &(*p)->hash_next) {
+    if(*p == conn) {
+      *p = conn->hash_next;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* A listening port is kept in uip_listenports at the first free position
+   from listen_slot() on, wrapping around. */
+static uint8_t
+listen_slot(uint16_t port)
+{
+  return (port ^ (port >> 8)) % UIP_LISTENPORTS;
+}
+/*---------------------------------------------------------------------------*/
+/* Return the position of a listening port, or UIP_LISTENPORTS */
+static uint8_t
+listen_find(uint16_t port)
+{
+  uint8_t i, n;
+
+  i = listen_slot(port);
+  for(n = 0; n < UIP_LISTENPORTS && uip_listenports[i] != 0; ++n) {
+    if(uip_listenports[i] == port) {
+      return i;
+    }
+    if(++i == UIP_LISTENPORTS) {
+      i = 0;
+    }
+  }
+  return UIP_LISTENPORTS;
+}
+#endif /* UIP_TCP && UIP_TCP_CONN_HASH_SIZE */
+/*---------------------------------------------------------------------------*/
+#if UIP_TCP && UIP_TCP_SNDBUF_SIZE
+/* The number of duplicate acknowledgements that trigger a fast
+   retransmit. */
+#define UIP_TCP_DUPACKS 3
+
+/* Flags of uip_conn->sndflags */
+#define UIP_SNDBUF_ACKED    0x01 /* The application has not yet been told
+                                    that its data was buffered. */
+#define UIP_SNDBUF_CLOSE    0x02 /* The application has closed the
+                                    connection, the FIN follows the
+                                    buffered data. */
+
+/* Offset from snd_nxt of the segment being sent. */
+static uint16_t sndbuf_seqoff;
+/* Set to retransmit the oldest segment in flight instead of new data. */
+static uint8_t sndbuf_rexmit;
+
+/*---------------------------------------------------------------------------*/
+static void
+sndbuf_reset(struct uip_conn *conn)
+{
+  conn->snd_wnd = 0;
+  conn->sndbuf_start = 0;
+  conn->sndbuf_len = 0;
+  conn->snd_recover = 0;
+  conn->sndflags = 0;
+  conn->dupacks = 0;
+  conn->rtt_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Retransmit the oldest segment in flight, and the next ones as partial
+   acknowledgements come in until all that was in flight is
+   acknowledged. */
+static void
+sndbuf_recover(struct uip_conn *conn)
+{
+  conn->snd_recover = conn->len;
+  sndbuf_rexmit = 1;
+  /* Karn's rule: the acknowledgement of a retransmitted segment does not
+     tell which transmission it answers, so it is not timed. */
+  conn->rtt_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+seq32(const uint8_t *seq)
+{
+  return ((uint32_t)seq[0] << 24) | ((uint32_t)seq[1] << 16) |
+    ((uint32_t)seq[2] << 8) | seq[3];
+}
+/*---------------------------------------------------------------------------*/
+/* The number of buffered bytes that can be sent now as new data */
+static uint16_t
+sndbuf_sendable(struct uip_conn *conn)
+{
+  uint16_t wnd = conn->snd_wnd;
+
+  if(wnd == 0 && conn->len == 0) {
+    /* Probe a zero window with a single byte, which is retransmitted
+       until the window opens. */
+    wnd = 1;
+  }
+  if(wnd <= conn->len) {
+    return 0;
+  }
+  wnd -= conn->len;
+  return conn->sndbuf_len - conn->len < wnd ?
+    conn->sndbuf_len - conn->len : wnd;
+}
+/*---------------------------------------------------------------------------*/
+/* Append what the application sent to the buffer */
+static void
+sndbuf_write(struct uip_conn *conn, const uint8_t *data, uint16_t len)
+{
+  uint16_t end, n;
+
+  if(len > UIP_TCP_SNDBUF_SIZE - conn->sndbuf_len) {
+    len = UIP_TCP_SNDBUF_SIZE - conn->sndbuf_len;
+  }
+  end = conn->sndbuf_start + conn->sndbuf_len;
+  if(end >= UIP_TCP_SNDBUF_SIZE) {
+    end -= UIP_TCP_SNDBUF_SIZE;
+  }
+  n = UIP_TCP_SNDBUF_SIZE - end < len ? UIP_TCP_SNDBUF_SIZE - end : len;
+  memcpy(&conn->sndbuf[end], data, n);
+  memcpy(conn->sndbuf, data + n, len - n);
+  conn->sndbuf_len += len;
+  if(len > 0) {
+    conn->sndflags |= UIP_SNDBUF_ACKED;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Copy the next segment to send to uip_appdata and return its length */
+static uint16_t
+sndbuf_read(struct uip_conn *conn)
+{
+  uint16_t start, len, n;
+
+  if(sndbuf_rexmit) {
+    sndbuf_rexmit = 0;
+    sndbuf_seqoff = 0;
+    len = conn->len < conn->sndbuf_len ? conn->len : conn->sndbuf_len;
+  } else {
+    sndbuf_seqoff = conn->len;
+    len = sndbuf_sendable(conn);
+  }
+  if(len > conn->mss) {
+    len = conn->mss;
+  }
+  if(sndbuf_seqoff == conn->len) {
+    conn->len += len;
+    /* Time one segment at a time, and none sent during recovery. */
+    if(len > 0 && conn->rtt_len == 0 && conn->snd_recover == 0) {
+      conn->rtt_len = conn->len;
+      conn->rtt_ticks = 0;
+    }
+  }
+
+  start = conn->sndbuf_start + sndbuf_seqoff;
+  if(start >= UIP_TCP_SNDBUF_SIZE) {
+    start -= UIP_TCP_SNDBUF_SIZE;
+  }
+  n = UIP_TCP_SNDBUF_SIZE - start < len ? UIP_TCP_SNDBUF_SIZE - start : len;
+  memcpy(uip_appdata, &conn->sndbuf[start], n);
+  memcpy((uint8_t *)uip_appdata + n, conn->sndbuf, len - n);
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+/* Process the acknowledgement of an incoming segment, setting
+   UIP_ACKDATA if it acknowledges data in flight */
+static void
+sndbuf_ack(struct uip_conn *conn)
+{
+  uint32_t acked;
+  uint16_t wnd;
+
+  wnd = ((uint16_t)UIP_TCP_BUF->wnd[0] << 8) + UIP_TCP_BUF->wnd[1];
+  acked = seq32(UIP_TCP_BUF->ackno) - seq32(conn->snd_nxt);
+
+  if(acked == 0) {
+    /* A duplicate acknowledgement tells that a segment after the first
+       one in flight has arrived, and after a few of them we retransmit
+       the first one without waiting for the time-out. */
+    if(conn->len > 0 && conn->snd_recover == 0 && uip_len == 0 &&
+       wnd == conn->snd_wnd &&
+       (UIP_TCP_BUF->flags & (TCP_SYN | TCP_FIN)) == 0 &&
+       ++conn->dupacks == UIP_TCP_DUPACKS) {
+      sndbuf_recover(conn);
+      UIP_STAT(++uip_stat.tcp.rexmit);
+    }
+    conn->snd_wnd = wnd;
+    return;
+  }
+  if(acked > conn->len) {
+    /* Old or bogus */
+    return;
+  }
+
+  conn->snd_wnd = wnd;
+  uip_add32(conn->snd_nxt, acked);
+  conn->snd_nxt[0] = uip_acc32[0];
+  conn->snd_nxt[1] = uip_acc32[1];
+  conn->snd_nxt[2] = uip_acc32[2];
+  conn->snd_nxt[3] = uip_acc32[3];
+
+  /* Do RTT estimation once the timed segment is acknowledged. */
+  if(conn->rtt_len > 0) {
+    if(acked >= conn->rtt_len) {
+      conn->rtt_len = 0;
+      update_rto(conn, conn->rtt_ticks < 127 ? conn->rtt_ticks : 127);
+    } else {
+      conn->rtt_len -= acked;
+    }
+  }
+  /* New data was acknowledged: restart the timer for what remains in
+     flight, as in RFC 6298. */
+  conn->timer = conn->rto;
+  conn->nrtx = 0;
+  conn->dupacks = 0;
+  conn->len -= acked;
+
+  /* A SYN or FIN takes a sequence number but no room in the buffer. */
+  if(acked > conn->sndbuf_len) {
+    acked = conn->sndbuf_len;
+  }
+  conn->sndbuf_start += acked;
+  if(conn->sndbuf_start >= UIP_TCP_SNDBUF_SIZE) {
+    conn->sndbuf_start -= UIP_TCP_SNDBUF_SIZE;
+  }
+  conn->sndbuf_len -= acked;
+
+  if(conn->snd_recover > 0) {
+    if(acked >= conn->snd_recover) {
+      conn->snd_recover = 0;
+    } else {
+      conn->snd_recover -= acked;
+      sndbuf_rexmit = 1;
+    }
+  }
+  uip_flags = UIP_ACKDATA;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+uip_tcp_sndbuf_ready(struct uip_conn *conn)
+{
+  if((conn->tcpstateflags & UIP_TS_MASK) != UIP_ESTABLISHED) {
+    return 0;
+  }
+  return sndbuf_sendable(conn) > 0 ||
+    ((conn->sndflags & (UIP_SNDBUF_ACKED | UIP_SNDBUF_CLOSE)) ==
+     UIP_SNDBUF_ACKED && conn->sndbuf_len < UIP_TCP_SNDBUF_SIZE);
+}
+#endif /* UIP_TCP && UIP_TCP_SNDBUF_SIZE */
+/*---------------------------------------------------------------------------*/
 void
 uip_init(void)
 {
-   
+#if UIP_TCP
+  struct uip_conn *conn;
+#endif /* UIP_TCP */
+
   uip_ds6_init();
   uip_icmp6_init();
   uip_nd6_init();
@@ -463,9 +801,12 @@ uip_init(void)
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     uip_listenports[c] = 0;
   }
-  for(c = 0; c < UIP_CONNS; ++c) {
-    uip_conns[c].tcpstateflags = UIP_CLOSED;
+  for(conn = &uip_conns[0]; conn <= &uip_conns[UIP_CONNS - 1]; ++conn) {
+    conn->tcpstateflags = UIP_CLOSED;
   }
+#if UIP_TCP_CONN_HASH_SIZE
+  memset(conn_hash, 0, sizeof(conn_hash));
+#endif /* UIP_TCP_CONN_HASH_SIZE */
 #endif /* UIP_TCP */
 
 #if UIP_ACTIVE_OPEN || UIP_UDP
@@ -508,8 +849,7 @@ uip_connect(uip_ipaddr_t *ripaddr, uint16_t rport)
 
   /* Check if this port is already in use, and if so try to find
      another one. */
-  for(c = 0; c < UIP_CONNS; ++c) {
-    conn = &uip_conns[c];
+  for(conn = &uip_conns[0]; conn <= &uip_conns[UIP_CONNS - 1]; ++conn) {
     if(conn->tcpstateflags != UIP_CLOSED &&
        conn->lport == uip_htons(lastport)) {
       goto again;
@@ -517,8 +857,7 @@ uip_connect(uip_ipaddr_t *ripaddr, uint16_t rport)
   }
 
   conn = 0;
-  for(c = 0; c < UIP_CONNS; ++c) {
-    cconn = &uip_conns[c];
+  for(cconn = &uip_conns[0]; cconn <= &uip_conns[UIP_CONNS - 1]; ++cconn) {
     if(cconn->tcpstateflags == UIP_CLOSED) {
       conn = cconn;
       break;
@@ -534,6 +873,9 @@ uip_connect(uip_ipaddr_t *ripaddr, uint16_t rport)
   if(conn == 0) {
     return 0;
   }
+#if UIP_TCP_CONN_HASH_SIZE
+  conn_hash_rm(conn);
+#endif /* UIP_TCP_CONN_HASH_SIZE */
   
   conn->tcpstateflags = UIP_SYN_SENT;
 
@@ -558,6 +900,12 @@ uip_connect(uip_ipaddr_t *ripaddr, uint16_t rport)
   conn->lport = uip_htons(lastport);
   conn->rport = rport;
   uip_ipaddr_copy(&conn->ripaddr, ripaddr);
+#if UIP_TCP_SNDBUF_SIZE
+  sndbuf_reset(conn);
+#endif /* UIP_TCP_SNDBUF_SIZE */
+#if UIP_TCP_CONN_HASH_SIZE
+  conn_hash_add(conn);
+#endif /* UIP_TCP_CONN_HASH_SIZE */
   
   return conn;
 }
@@ -638,6 +986,54 @@ uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport)
 #endif /* UIP_UDP */
 /*---------------------------------------------------------------------------*/
 #if UIP_TCP
+#if UIP_TCP_CONN_HASH_SIZE
+void
+uip_unlisten(uint16_t port)
+{
+  uint8_t i, j, k;
+
+  i = listen_find(port);
+  if(i == UIP_LISTENPORTS) {
+    return;
+  }
+  /* Move later ports of the same run into the hole, unless their
+     slot lies after it, so that listen_find() still reaches them. */
+  for(j = i;;) {
+    uip_listenports[i] = 0;
+    do {
+      if(++j == UIP_LISTENPORTS) {
+        j = 0;
+      }
+      if(uip_listenports[j] == 0) {
+        return;
+      }
+      k = listen_slot(uip_listenports[j]);
+    } while(i <= j ? (i < k && k <= j) : (i < k || k <= j));
+    uip_listenports[i] = uip_listenports[j];
+    i = j;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_listen(uint16_t port)
+{
+  uint8_t i, n;
+
+  if(listen_find(port) < UIP_LISTENPORTS) {
+    return;
+  }
+  i = listen_slot(port);
+  for(n = 0; n < UIP_LISTENPORTS; ++n) {
+    if(uip_listenports[i] == 0) {
+      uip_listenports[i] = port;
+      return;
+    }
+    if(++i == UIP_LISTENPORTS) {
+      i = 0;
+    }
+  }
+}
+#else /* UIP_TCP_CONN_HASH_SIZE */
 void
 uip_unlisten(uint16_t port)
 {
@@ -659,6 +1055,7 @@ uip_listen(uint16_t port)
     }
   }
 }
+#endif /* UIP_TCP_CONN_HASH_SIZE */
 #endif
 /*---------------------------------------------------------------------------*/
 
@@ -935,6 +1332,13 @@ ext_hdr_options_process(void)
 #endif /* UIP_CONF_IPV6_RPL */
         uip_ext_opt_offset += (UIP_EXT_HDR_OPT_BUF->len) + 2;
         return 0;
+#if UIP_MCAST6_ENGINE == UIP_MCAST6_ENGINE_MPL
+      case UIP_EXT_HDR_OPT_MPL:
+        /* Checked by the MPL engine once the header is processed */
+        PRINTF("Processing MPL option\n");
+        uip_ext_opt_offset += (UIP_EXT_HDR_OPT_BUF->len) + 2;
+        break;
+#endif /* UIP_MCAST6_ENGINE == UIP_MCAST6_ENGINE_MPL */
       default:
         /*
          * check the two highest order bits of the option
@@ -979,6 +1383,7 @@ uip_process(uint8_t flag)
 {
 #if UIP_TCP
   register struct uip_conn *uip_connr = uip_conn;
+  struct uip_conn *cconn;
 #endif /* UIP_TCP */
 #if UIP_UDP
   if(flag == UIP_UDP_SEND_CONN) {
@@ -986,11 +1391,35 @@ uip_process(uint8_t flag)
   }
 #endif /* UIP_UDP */
   uip_sappdata = uip_appdata = &uip_buf[UIP_IPTCPH_LEN + UIP_LLH_LEN];
+#if UIP_TCP && UIP_TCP_SNDBUF_SIZE
+  sndbuf_seqoff = 0;
+  sndbuf_rexmit = 0;
+#endif /* UIP_TCP && UIP_TCP_SNDBUF_SIZE */
    
   /* Check if we were invoked because of a poll request for a
      particular connection. */
   if(flag == UIP_POLL_REQUEST) {
 #if UIP_TCP
+#if UIP_TCP_SNDBUF_SIZE
+    if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
+    tcp_poll_sndbuf:
+      /* Buffered data that the window allows goes out first. The
+         application is polled when that is done, as long as there is
+         room in the buffer for more data. */
+      uip_len = uip_slen = 0;
+      uip_flags = 0;
+      if(sndbuf_sendable(uip_connr) > 0 ||
+         (uip_connr->sndflags & UIP_SNDBUF_CLOSE) ||
+         uip_connr->sndbuf_len == UIP_TCP_SNDBUF_SIZE) {
+        goto tcp_send_sndbuf;
+      }
+      uip_flags = UIP_POLL | (uip_connr->sndflags & UIP_SNDBUF_ACKED ?
+                              UIP_ACKDATA : 0);
+      uip_connr->sndflags &= ~UIP_SNDBUF_ACKED;
+      UIP_APPCALL();
+      goto appsend;
+    } else
+#endif /* UIP_TCP_SNDBUF_SIZE */
     if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED &&
        !uip_outstanding(uip_connr)) {
       uip_flags = UIP_POLL;
@@ -1034,6 +1463,11 @@ uip_process(uint8_t flag)
         uip_connr->tcpstateflags = UIP_CLOSED;
       }
     } else if(uip_connr->tcpstateflags != UIP_CLOSED) {
+#if UIP_TCP_SNDBUF_SIZE
+      if(uip_connr->rtt_len > 0 && uip_connr->rtt_ticks < 255) {
+        ++(uip_connr->rtt_ticks);
+      }
+#endif /* UIP_TCP_SNDBUF_SIZE */
       /*
        * If the connection has outstanding data, we increase the
        * connection's timer and see if it has reached the RTO value
@@ -1088,6 +1522,16 @@ uip_process(uint8_t flag)
 #endif /* UIP_ACTIVE_OPEN */
                      
             case UIP_ESTABLISHED:
+#if UIP_TCP_SNDBUF_SIZE
+              /*
+               * With a send buffer, we retransmit the oldest segment
+               * in flight from the buffer, and the next ones as they
+               * are acknowledged.
+               */
+              sndbuf_recover(uip_connr);
+              uip_flags = 0;
+              goto tcp_send_sndbuf;
+#else /* UIP_TCP_SNDBUF_SIZE */
               /*
                * In the ESTABLISHED state, we call upon the application
                * to do the actual retransmit after which we jump into
@@ -1097,6 +1541,7 @@ uip_process(uint8_t flag)
               uip_flags = UIP_REXMIT;
               UIP_APPCALL();
               goto apprexmit;
+#endif /* UIP_TCP_SNDBUF_SIZE */
                      
             case UIP_FIN_WAIT_1:
             case UIP_CLOSING:
@@ -1105,6 +1550,16 @@ uip_process(uint8_t flag)
               goto tcp_send_finack;
           }
         }
+#if UIP_TCP_SNDBUF_SIZE
+      }
+      if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
+        /*
+         * With a send buffer, the application is polled for new data
+         * while there is data in flight as well.
+         */
+        goto tcp_poll_sndbuf;
+      }
+#else /* UIP_TCP_SNDBUF_SIZE */
       } else if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
         /*
          * If there was no need for a retransmission, we poll the
@@ -1114,6 +1569,7 @@ uip_process(uint8_t flag)
         UIP_APPCALL();
         goto appsend;
       }
+#endif /* UIP_TCP_SNDBUF_SIZE */
     }
     goto drop;
 #endif /* UIP_TCP */
@@ -1316,134 +1772,6 @@ uip_process(uint8_t flag)
   process:
 #endif
 
-  while(1) {
-    switch(*uip_next_hdr){
-#if UIP_TCP
-      case UIP_PROTO_TCP:
-        /* TCP, for both IPv4 and IPv6 */
-        goto tcp_input;
-#endif /* UIP_TCP */
-#if UIP_UDP
-      case UIP_PROTO_UDP:
-        /* UDP, for both IPv4 and IPv6 */
-        goto udp_input;
-#endif /* UIP_UDP */
-      case UIP_PROTO_ICMP6:
-        /* ICMPv6 */
-        goto icmp6_input;
-      case UIP_PROTO_HBHO:
-        PRINTF("Processing hbh header\n");
-        /* Hop by hop option header */
-#if UIP_CONF_IPV6_CHECKS
-        /* Hop by hop option header. If we saw one HBH already, drop */
-        if(uip_ext_bitmap & UIP_EXT_HDR_BITMAP_HBHO) {
-          goto bad_hdr;
-        } else {
-          uip_ext_bitmap |= UIP_EXT_HDR_BITMAP_HBHO;
-        }
-#endif /*UIP_CONF_IPV6_CHECKS*/
-        switch(ext_hdr_options_process()) {
-          case 0:
-            /*continue*/
-            uip_next_hdr = &UIP_EXT_BUF->next;
-            uip_ext_len += (UIP_EXT_BUF->len << 3) + 8;
-            break;
-          case 1:
-            /*silently discard*/
-            goto drop;
-          case 2:
-            /* send icmp error message (created in ext_hdr_options_process)
-             * and discard*/
-            goto send;
-        }
-        break;
-      case UIP_PROTO_DESTO:
-#if UIP_CONF_IPV6_CHECKS
-        /* Destination option header. if we saw two already, drop */
-        PRINTF("Processing desto header\n");
-        if(uip_ext_bitmap & UIP_EXT_HDR_BITMAP_DESTO1) {
-          if(uip_ext_bitmap & UIP_EXT_HDR_BITMAP_DESTO2) {
-            goto bad_hdr;
-          } else{
-            uip_ext_bitmap |= UIP_EXT_HDR_BITMAP_DESTO2;
-          }
-        } else {
-          uip_ext_bitmap |= UIP_EXT_HDR_BITMAP_DESTO1;
-        }
-#endif /*UIP_CONF_IPV6_CHECKS*/
-        switch(ext_hdr_options_process()) {
-          case 0:
-            /*continue*/
-            uip_next_hdr = &UIP_EXT_BUF->next;
-            uip_ext_len += (UIP_EXT_BUF->len << 3) + 8;
-            break;
-          case 1:
-            /*silently discard*/
-            goto drop;
-          case 2:
-            /* send icmp error message (created in ext_hdr_options_process)
-             * and discard*/
-            goto send;
-        }
-        break;
-      case UIP_PROTO_ROUTING:
-#if UIP_CONF_IPV6_CHECKS
-        /* Routing header. If we saw one already, drop */
-        if(uip_ext_bitmap & UIP_EXT_HDR_BITMAP_ROUTING) {
-          goto bad_hdr;
-        } else {
-          uip_ext_bitmap |= UIP_EXT_HDR_BITMAP_ROUTING;
-        }
-#endif /*UIP_CONF_IPV6_CHECKS*/
-        /*
-         * Routing Header  length field is in units of 8 bytes, excluding
-         * As per RFC2460 section 4.4, if routing type is unrecognized:
-         * if segments left = 0, ignore the header
-         * if segments left > 0, discard packet and send icmp error pointing
-         * to the routing type
-         */
-
-        PRINTF("Processing Routing header\n");
-        if(UIP_ROUTING_BUF->seg_left > 0) {
-          uip_icmp6_error_output(ICMP6_PARAM_PROB, ICMP6_PARAMPROB_HEADER, UIP_IPH_LEN + uip_ext_len + 2);
-          UIP_STAT(++uip_stat.ip.drop);
-          UIP_LOG("ip6: unrecognized routing type");
-          goto send;
-        }
-        uip_next_hdr = &UIP_EXT_BUF->next;
-        uip_ext_len += (UIP_EXT_BUF->len << 3) + 8;
-        break;
-      case UIP_PROTO_FRAG:
-        /* Fragmentation header:call the reassembly function, then leave */
-#if UIP_CONF_IPV6_REASSEMBLY
-        PRINTF("Processing frag header\n");
-        uip_len = uip_reass();
-        if(uip_len == 0) {
-          goto drop;
-        }
-        if(uip_reassflags & UIP_REASS_FLAG_ERROR_MSG){
-          /* we are not done with reassembly, this is an error message */
-          goto send;
-        }
-        /*packet is reassembled, reset the next hdr to the beginning
-           of the IP header and restart the parsing of the reassembled pkt*/
-        PRINTF("Processing reassembled packet\n");
-        uip_ext_len = 0;
-        uip_ext_bitmap = 0;
-        uip_next_hdr = &UIP_IP_BUF->proto;
-        break;
-#else /* UIP_CONF_IPV6_REASSEMBLY */
-        UIP_STAT(++uip_stat.ip.drop);
-        UIP_STAT(++uip_stat.ip.fragerr);
-        UIP_LOG("ip: fragment dropped.");
-        goto drop;
-#endif /* UIP_CONF_IPV6_REASSEMBLY */
-      case UIP_PROTO_NONE:
-        goto drop;
-      default:
-        goto bad_hdr;
-    }
-  }
 	{
 	#if WITH_IPSEC
 	IPSECDBG_PRINTF("INCOMING IPsec PACKET PROCESSING\n");
@@ -1545,6 +1873,7 @@ uip_process(uint8_t flag)
 	      	  if ((sad_entry = sad_get_incoming_entry(esp_header->spi)) == NULL) {
 	      	    // Protected packets whose SAD entry we cannot find must be discarded according to the RFC.
 	      	    IPSECDBG_PRINTF(IPSEC "Dropping incoming protected packet because of missing SAD entry\n");
+	      	    IPSEC_STATS_DROP(IPSEC_DROP_NO_SA);
 	      	    goto drop;
 	      	  }
 	      	
@@ -1569,7 +1898,9 @@ uip_process(uint8_t flag)
 	      	    integ_data.datalen = auth_data_len;
 	      	    integ_data.keymat = &sad_entry->sa.sk_a[0];
 	      	    integ_data.out = (uint8_t *) &encr_data.icv;          
+	      	    IPSEC_STATS_TIMESTAMP(integ_start);
 	      	    integ(&integ_data);
+	      	    IPSEC_STATS_XFORM(IPSEC_STATS_OP_INTEG, integ_data.type, integ_data.datalen, integ_start);
 	      	  }
 	      	
 	      	  // Confidentiality
@@ -1583,7 +1914,9 @@ uip_process(uint8_t flag)
 	      	  encr_data.encr_data = iv;
 	      	  encr_data.encr_datalen = auth_data_len - sizeof(struct uip_esp_header);
 	      	  encr_data.ip_next_hdr = uip_next_hdr; // Non-zero to indicate ESP header
+	      	  IPSEC_STATS_TIMESTAMP(decrypt_start);
 	      	  espsk_unpack(&encr_data);
+	      	  IPSEC_STATS_XFORM(IPSEC_STATS_OP_DECRYPT, encr_data.type, encr_data.encr_datalen, decrypt_start);
 	      	
 	      	  IPSECDBG_PRINTF("Incoming after unpack\n");
 	      	  MEMPRINT("", esp_header, 100);
@@ -1601,6 +1934,8 @@ uip_process(uint8_t flag)
 	      	
 	      	  if (memcmp((uint8_t *) esp_header + auth_data_len, &encr_data.icv, sizeof(encr_data.icv))) {
 	      	    IPSECDBG_PRINTF("IPsec: ICV mismatch, dropping packet.\n");
+	      	    IPSEC_STATS_SA_INC(sad_entry, icv_failures);
+	      	    IPSEC_STATS_DROP(IPSEC_DROP_ICV);
 	      	    goto drop;
 	      	  }
 	      	
@@ -1609,8 +1944,11 @@ uip_process(uint8_t flag)
 	      	    */
 	      	  if (SAD_ENTRY_IS_DYNAMIC(sad_entry) && sad_incoming_replay(sad_entry, uip_ntohl(esp_header->seqno))) {          
 	      	    IPSECDBG_PRINTF(IPSEC "Error: This packet is a replay\n");
+	      	    IPSEC_STATS_SA_INC(sad_entry, replay_drops);
+	      	    IPSEC_STATS_DROP(IPSEC_DROP_REPLAY);
 	      	    goto drop;
 	      	  }
+	      	  SAD_STORE_SEQNO_UPDATED(sad_entry, 0);
 	      	
 	      	
 	      	  /**
@@ -1755,6 +2093,13 @@ uip_process(uint8_t flag)
 	
 	        PRINTF("Processing Routing header\n");
 	        if(UIP_ROUTING_BUF->seg_left > 0) {
+	#if UIP_CONF_IPV6_RPL
+	          /* An RPL source routing header names the next hop */
+	          if(rpl_process_srh_header()) {
+	            UIP_STAT(++uip_stat.ip.forwarded);
+	            goto send;
+	          }
+	#endif /* UIP_CONF_IPV6_RPL */
 	          uip_icmp6_error_output(ICMP6_PARAM_PROB, ICMP6_PARAMPROB_HEADER, UIP_IPH_LEN + uip_ext_len + 2);
 	          UIP_STAT(++uip_stat.ip.drop);
 	          UIP_LOG("ip6: unrecognized routing type");
@@ -1808,7 +2153,13 @@ uip_process(uint8_t flag)
   /* End of headers processing */
   
   icmp6_input:
-  //remove_ext_hdr();
+  /* As for UDP and TCP, the checksum covers what follows the IPv6 header
+     once the extension headers are gone. Routers add RPL headers on the
+     way, which the sender could not include. */
+  if(uip_ext_len > 0) {
+    remove_ext_hdr();
+    UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
+  }
   /* This is IPv6 ICMPv6 processing code. */
   PRINTF("icmp6_input: length %d type: %d \n", uip_len - uip_ext_end_len, UIP_ICMP_BUF->type);
 
@@ -2019,8 +2370,14 @@ uip_process(uint8_t flag)
 
   /* Demultiplex this segment. */
   /* First check any active connections. */
+#if UIP_TCP_CONN_HASH_SIZE
+  for(uip_connr = *conn_bucket(UIP_TCP_BUF->destport, UIP_TCP_BUF->srcport,
+                               &UIP_IP_BUF->srcipaddr);
+      uip_connr != NULL; uip_connr = uip_connr->hash_next) {
+#else /* UIP_TCP_CONN_HASH_SIZE */
   for(uip_connr = &uip_conns[0]; uip_connr <= &uip_conns[UIP_CONNS - 1];
       ++uip_connr) {
+#endif /* UIP_TCP_CONN_HASH_SIZE */
     if(uip_connr->tcpstateflags != UIP_CLOSED &&
        UIP_TCP_BUF->destport == uip_connr->lport &&
        UIP_TCP_BUF->srcport == uip_connr->rport &&
@@ -2039,11 +2396,17 @@ uip_process(uint8_t flag)
   
   tmp16 = UIP_TCP_BUF->destport;
   /* Next, check listening connections. */
+#if UIP_TCP_CONN_HASH_SIZE
+  if(listen_find(tmp16) < UIP_LISTENPORTS) {
+    goto found_listen;
+  }
+#else /* UIP_TCP_CONN_HASH_SIZE */
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     if(tmp16 == uip_listenports[c]) {
       goto found_listen;
     }
   }
+#endif /* UIP_TCP_CONN_HASH_SIZE */
   
   /* No matching connection found, so we send a RST packet. */
   UIP_STAT(++uip_stat.tcp.synrst);
@@ -2112,15 +2475,15 @@ uip_process(uint8_t flag)
      CLOSED connections are found. Thanks to Eddie C. Dost for a very
      nice algorithm for the TIME_WAIT search. */
   uip_connr = 0;
-  for(c = 0; c < UIP_CONNS; ++c) {
-    if(uip_conns[c].tcpstateflags == UIP_CLOSED) {
-      uip_connr = &uip_conns[c];
+  for(cconn = &uip_conns[0]; cconn <= &uip_conns[UIP_CONNS - 1]; ++cconn) {
+    if(cconn->tcpstateflags == UIP_CLOSED) {
+      uip_connr = cconn;
       break;
     }
-    if(uip_conns[c].tcpstateflags == UIP_TIME_WAIT) {
+    if(cconn->tcpstateflags == UIP_TIME_WAIT) {
       if(uip_connr == 0 ||
-         uip_conns[c].timer > uip_connr->timer) {
-        uip_connr = &uip_conns[c];
+         cconn->timer > uip_connr->timer) {
+        uip_connr = cconn;
       }
     }
   }
@@ -2134,6 +2497,9 @@ uip_process(uint8_t flag)
     goto drop;
   }
   uip_conn = uip_connr;
+#if UIP_TCP_CONN_HASH_SIZE
+  conn_hash_rm(uip_connr);
+#endif /* UIP_TCP_CONN_HASH_SIZE */
   
   /* Fill in the necessary fields for the new connection. */
   uip_connr->rto = uip_connr->timer = UIP_RTO;
@@ -2144,6 +2510,15 @@ uip_process(uint8_t flag)
   uip_connr->rport = UIP_TCP_BUF->srcport;
   uip_ipaddr_copy(&uip_connr->ripaddr, &UIP_IP_BUF->srcipaddr);
   uip_connr->tcpstateflags = UIP_SYN_RCVD;
+#if UIP_TCP_SNDBUF_SIZE
+  sndbuf_reset(uip_connr);
+  /* The MSS is not taken from the window with a send buffer, so it needs
+     a value if the SYN has no MSS option. */
+  uip_connr->initialmss = uip_connr->mss = UIP_TCP_MSS;
+#endif /* UIP_TCP_SNDBUF_SIZE */
+#if UIP_TCP_CONN_HASH_SIZE
+  conn_hash_add(uip_connr);
+#endif /* UIP_TCP_CONN_HASH_SIZE */
 
   uip_connr->snd_nxt[0] = iss[0];
   uip_connr->snd_nxt[1] = iss[1];
@@ -2267,6 +2642,11 @@ uip_process(uint8_t flag)
      data. If so, we update the sequence number, reset the length of
      the outstanding data, calculate RTT estimations, and reset the
      retransmission timer. */
+#if UIP_TCP_SNDBUF_SIZE
+  if(UIP_TCP_BUF->flags & TCP_ACK) {
+    sndbuf_ack(uip_connr);
+  }
+#else /* UIP_TCP_SNDBUF_SIZE */
   if((UIP_TCP_BUF->flags & TCP_ACK) && uip_outstanding(uip_connr)) {
     uip_add32(uip_connr->snd_nxt, uip_connr->len);
 
@@ -2282,18 +2662,7 @@ uip_process(uint8_t flag)
    
       /* Do RTT estimation, unless we have done retransmissions. */
       if(uip_connr->nrtx == 0) {
-        signed char m;
-        m = uip_connr->rto - uip_connr->timer;
-        /* This is taken directly from VJs original code in his paper */
-        m = m - (uip_connr->sa >> 3);
-        uip_connr->sa += m;
-        if(m < 0) {
-          m = -m;
-        }
-        m = m - (uip_connr->sv >> 2);
-        uip_connr->sv += m;
-        uip_connr->rto = (uip_connr->sa >> 3) + uip_connr->sv;
-
+        update_rto(uip_connr, uip_connr->rto - uip_connr->timer);
       }
       /* Set the acknowledged flag. */
       uip_flags = UIP_ACKDATA;
@@ -2305,6 +2674,7 @@ uip_process(uint8_t flag)
     }
     
   }
+#endif /* UIP_TCP_SNDBUF_SIZE */
 
   /* Do different things depending on in what state the connection is. */
   switch(uip_connr->tcpstateflags & UIP_TS_MASK) {
@@ -2409,9 +2779,15 @@ uip_process(uint8_t flag)
          sequence numbers will be screwed up. */
 
       if(UIP_TCP_BUF->flags & TCP_FIN && !(uip_connr->tcpstateflags & UIP_STOPPED)) {
+#if UIP_TCP_SNDBUF_SIZE
+        if(uip_connr->sndbuf_len > 0) {
+          goto drop;
+        }
+#else /* UIP_TCP_SNDBUF_SIZE */
         if(uip_outstanding(uip_connr)) {
           goto drop;
         }
+#endif /* UIP_TCP_SNDBUF_SIZE */
         uip_add_rcv_nxt(1 + uip_len);
         uip_flags |= UIP_CLOSE;
         if(uip_len > 0) {
@@ -2469,12 +2845,32 @@ uip_process(uint8_t flag)
          and the application will retransmit it. This is called the
          "persistent timer" and uses the retransmission mechanim.
       */
+#if UIP_TCP_SNDBUF_SIZE
+      /* With a send buffer, the window is kept in snd_wnd instead, and
+         the MSS stays the initial one. If the application has closed
+         the connection, it is not called anymore, and the FIN is sent
+         once all buffered data is acknowledged. */
+      if(uip_connr->sndflags & UIP_SNDBUF_CLOSE) {
+        if(uip_connr->sndbuf_len == 0) {
+          uip_slen = 0;
+          uip_flags = UIP_CLOSE;
+          goto appsend;
+        }
+        uip_flags &= UIP_NEWDATA;
+        goto tcp_send_sndbuf;
+      }
+      if(uip_connr->sndflags & UIP_SNDBUF_ACKED) {
+        uip_flags |= UIP_ACKDATA;
+        uip_connr->sndflags &= ~UIP_SNDBUF_ACKED;
+      }
+#else /* UIP_TCP_SNDBUF_SIZE */
       tmp16 = ((uint16_t)UIP_TCP_BUF->wnd[0] << 8) + (uint16_t)UIP_TCP_BUF->wnd[1];
       if(tmp16 > uip_connr->initialmss ||
          tmp16 == 0) {
         tmp16 = uip_connr->initialmss;
       }
       uip_connr->mss = tmp16;
+#endif /* UIP_TCP_SNDBUF_SIZE */
 
       /* If this packet constitutes an ACK for outstanding data (flagged
          by the UIP_ACKDATA flag, we should call the application since it
@@ -2505,6 +2901,21 @@ uip_process(uint8_t flag)
           goto tcp_send_nodata;
         }
 
+#if UIP_TCP_SNDBUF_SIZE
+        /* What the application sent goes to the buffer, and the
+           application learns with uip_acked() that it may send more. */
+        if(uip_slen > 0) {
+          sndbuf_write(uip_connr, uip_sappdata, uip_slen);
+          uip_slen = 0;
+        }
+        if((uip_flags & UIP_CLOSE) && uip_connr->sndbuf_len > 0) {
+          /* The FIN has to wait for the buffered data. Acknowledge what
+             the remote host sent, as the FIN would have. */
+          uip_connr->sndflags |= UIP_SNDBUF_CLOSE;
+          uip_flags = UIP_NEWDATA;
+        }
+#endif /* UIP_TCP_SNDBUF_SIZE */
+
         if(uip_flags & UIP_CLOSE) {
           uip_slen = 0;
           uip_connr->len = 1;
@@ -2514,6 +2925,9 @@ uip_process(uint8_t flag)
           goto tcp_send_nodata;
         }
 
+#if UIP_TCP_SNDBUF_SIZE
+        goto tcp_send_sndbuf;
+#else /* UIP_TCP_SNDBUF_SIZE */
         /* If uip_slen > 0, the application has data to be sent. */
         if(uip_slen > 0) {
 
@@ -2567,7 +2981,26 @@ uip_process(uint8_t flag)
           UIP_TCP_BUF->flags = TCP_ACK;
           goto tcp_send_noopts;
         }
+#endif /* UIP_TCP_SNDBUF_SIZE */
+      }
+#if UIP_TCP_SNDBUF_SIZE
+      /* Send the next segment from the buffer: a retransmission, or new
+         data that the window allows. Otherwise, send a pure ACK if
+         there is newdata. */
+    tcp_send_sndbuf:
+      uip_appdata = uip_sappdata;
+      uip_slen = sndbuf_read(uip_connr);
+      if(uip_slen > 0) {
+        uip_len = uip_slen + UIP_TCPIP_HLEN;
+        UIP_TCP_BUF->flags = TCP_ACK | TCP_PSH;
+        goto tcp_send_noopts;
+      }
+      if(uip_flags & UIP_NEWDATA) {
+        uip_len = UIP_TCPIP_HLEN;
+        UIP_TCP_BUF->flags = TCP_ACK;
+        goto tcp_send_noopts;
       }
+#endif /* UIP_TCP_SNDBUF_SIZE */
       goto drop;
     case UIP_LAST_ACK:
       /* We can close this connection if the peer has acknowledged our
@@ -2659,10 +3092,18 @@ uip_process(uint8_t flag)
   UIP_TCP_BUF->ackno[2] = uip_connr->rcv_nxt[2];
   UIP_TCP_BUF->ackno[3] = uip_connr->rcv_nxt[3];
   
+#if UIP_TCP_SNDBUF_SIZE
+  uip_add32(uip_connr->snd_nxt, sndbuf_seqoff);
+  UIP_TCP_BUF->seqno[0] = uip_acc32[0];
+  UIP_TCP_BUF->seqno[1] = uip_acc32[1];
+  UIP_TCP_BUF->seqno[2] = uip_acc32[2];
+  UIP_TCP_BUF->seqno[3] = uip_acc32[3];
+#else /* UIP_TCP_SNDBUF_SIZE */
   UIP_TCP_BUF->seqno[0] = uip_connr->snd_nxt[0];
   UIP_TCP_BUF->seqno[1] = uip_connr->snd_nxt[1];
   UIP_TCP_BUF->seqno[2] = uip_connr->snd_nxt[2];
   UIP_TCP_BUF->seqno[3] = uip_connr->snd_nxt[3];
+#endif /* UIP_TCP_SNDBUF_SIZE */
 
   UIP_TCP_BUF->srcport  = uip_connr->lport;
   UIP_TCP_BUF->destport = uip_connr->rport;
@@ -2757,6 +3198,7 @@ uip_process(uint8_t flag)
   	    #else
 				IPSECDBG_PRINTF(IPSEC "SPD: Outgoing packet targeted for PROTECT, but no SAD entry could be found. Dropping packet.");
   	    #endif
+  	    IPSEC_STATS_DROP(IPSEC_DROP_OUT_NO_SA);
 
   	    /**
   	      * RFC 4301 grants us the permission to drop the packet triggering an IKE handshake
@@ -2777,6 +3219,7 @@ uip_process(uint8_t flag)
   	
   	    case SPD_ACTION_DISCARD:
   	    IPSECDBG_PRINTF(IPSEC "SPD: Outgoing packet targeted for DISCARD\n");
+  	    IPSEC_STATS_DROP(IPSEC_DROP_OUT_DISCARD);
   	    goto drop;
   	  }
   	}
@@ -2808,8 +3251,10 @@ uip_process(uint8_t flag)
   	  if (!esp_header->seqno) {
   	    IPSECDBG_PRINTF(IPSEC "Error: Sequence number overflow. Removing SAD entry.\n");
   	    sad_remove_outgoing_entry(sad_entry);
+  	    IPSEC_STATS_DROP(IPSEC_DROP_SEQNO_OVERFLOW);
   	    goto drop;
   	  }
+  	  SAD_STORE_SEQNO_UPDATED(sad_entry, 1);
   	  
   	  //IPSECDBG_PRINTF("Outgoing before pack:\n");
   	  MEMPRINT("Outgoing before pack:\n", (uint8_t *) esp_header, data_len + 30);
@@ -2823,7 +3268,9 @@ uip_process(uint8_t flag)
   	    .ops = sad_entry->seqno,
   	    .ip_next_hdr = &next_header
   	  };
+  	  IPSEC_STATS_TIMESTAMP(encrypt_start);
   	  espsk_pack(&encr_data);
+  	  IPSEC_STATS_XFORM(IPSEC_STATS_OP_ENCRYPT, encr_data.type, encr_data.encr_datalen, encrypt_start);
   	  //IPSECDBG_PRINTF("Outgoing after pack:\n");
   	  MEMPRINT("Outgoing after pack:\n", (uint8_t *) esp_header, data_len + 30);
   	  
@@ -2849,7 +3296,9 @@ uip_process(uint8_t flag)
   	      .keymat = sad_entry->sa.sk_a,                     // The start of the KEYMAT
   	      .out = (uint8_t *) esp_header + data_len              // Where the output will be written. Always IPSEC_ICVLEN bytes.
   	    };
+  	    IPSEC_STATS_TIMESTAMP(integ_start);
   	    integ(&integ_data);
+  	    IPSEC_STATS_XFORM(IPSEC_STATS_OP_INTEG, integ_data.type, integ_data.datalen, integ_start);
   	    MEMPRINT("After integ:\n", (uint8_t *) esp_header, data_len + 30);
   	
   	    /**
@@ -2858,6 +3307,7 @@ uip_process(uint8_t flag)
   	    data_len += IPSEC_ICVLEN;
   	  }
   	  uip_len = data_len + UIP_IPH_LEN;
+  	  IPSEC_STATS_SA_PACKET(sad_entry, data_len);
   	
   	  // Update IP header length after ESP processing
   	  UIP_IP_BUF->len[0] = ((uip_len - UIP_IPH_LEN) >> 8);
@@ -0,0 +1,247 @@
+/**
+ * \addtogroup adaptivesec
+ * @{
+ */
+
+/**
+ * \file
+ *         802.15.4 security implementation, which uses pairwise keys
+ */
+
+#include "net/llsec/adaptivesec/adaptivesec.h"
+#include "net/llsec/anti-replay.h"
+#include "net/llsec/llsec802154.h"
+#include "net/llsec/ccm-star.h"
+#include "net/mac/frame802154.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/nbr-table.h"
+#include "net/linkaddr.h"
+#include "lib/aes-128.h"
+#include <string.h>
+
+/* Key of broadcast frames */
+#ifdef ADAPTIVESEC_CONF_GROUP_KEY
+#define ADAPTIVESEC_GROUP_KEY ADAPTIVESEC_CONF_GROUP_KEY
+#else /* ADAPTIVESEC_CONF_GROUP_KEY */
+#define ADAPTIVESEC_GROUP_KEY { 0x00 , 0x01 , 0x02 , 0x03 , \
+                                0x04 , 0x05 , 0x06 , 0x07 , \
+                                0x08 , 0x09 , 0x0A , 0x0B , \
+                                0x0C , 0x0D , 0x0E , 0x0F }
+#endif /* ADAPTIVESEC_CONF_GROUP_KEY */
+
+/* Key the pairwise keys are derived from */
+#ifdef ADAPTIVESEC_CONF_MASTER_KEY
+#define ADAPTIVESEC_MASTER_KEY ADAPTIVESEC_CONF_MASTER_KEY
+#else /* ADAPTIVESEC_CONF_MASTER_KEY */
+#define ADAPTIVESEC_MASTER_KEY { 0x10 , 0x11 , 0x12 , 0x13 , \
+                                 0x14 , 0x15 , 0x16 , 0x17 , \
+                                 0x18 , 0x19 , 0x1A , 0x1B , \
+                                 0x1C , 0x1D , 0x1E , 0x1F }
+#endif /* ADAPTIVESEC_CONF_MASTER_KEY */
+
+#define SECURITY_HEADER_LENGTH 5
+#define EXTENDED_ADDRESS_LENGTH 8
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else /* DEBUG */
+#define PRINTF(...)
+#endif /* DEBUG */
+
+struct neighbor {
+  struct anti_replay_info anti_replay_info;
+  /* key schedule of the pairwise key */
+  uint8_t key_schedule[AES_128_KEY_SCHEDULE_LENGTH];
+};
+
+NBR_TABLE(struct neighbor, neighbors);
+static uint8_t group_key_schedule[AES_128_KEY_SCHEDULE_LENGTH];
+static uint8_t master_key_schedule[AES_128_KEY_SCHEDULE_LENGTH];
+/* key schedule of the pairwise key of a node that is not a neighbor yet */
+static uint8_t stranger_key_schedule[AES_128_KEY_SCHEDULE_LENGTH];
+
+/*---------------------------------------------------------------------------*/
+static const uint8_t *
+get_extended_address(const linkaddr_t *addr)
+#if LINKADDR_SIZE == 2
+{
+  /* workaround for short addresses: derive EUI64 as in RFC 6282 */
+  static linkaddr_extended_t template = { { 0x00 , 0x00 , 0x00 ,
+                                            0xFF , 0xFE , 0x00 , 0x00 , 0x00 } };
+
+  template.u16[3] = LLSEC802154_HTONS(addr->u16);
+
+  return template.u8;
+}
+#else /* LINKADDR_SIZE == 2 */
+{
+  return addr->u8;
+}
+#endif /* LINKADDR_SIZE == 2 */
+/*---------------------------------------------------------------------------*/
+/*
+ * Derives the pairwise key shared with addr by encrypting the two extended
+ * addresses, lower one first, with the master key, and expands it.
+ */
+static void
+expand_pairwise_key(const linkaddr_t *addr, uint8_t *schedule)
+{
+  uint8_t block[AES_128_BLOCK_SIZE];
+  uint8_t *lower;
+  uint8_t *higher;
+
+  lower = block;
+  higher = block + EXTENDED_ADDRESS_LENGTH;
+  memcpy(lower, get_extended_address(&linkaddr_node_addr), EXTENDED_ADDRESS_LENGTH);
+  memcpy(higher, get_extended_address(addr), EXTENDED_ADDRESS_LENGTH);
+  if(memcmp(lower, higher, EXTENDED_ADDRESS_LENGTH) > 0) {
+    memcpy(higher, lower, EXTENDED_ADDRESS_LENGTH);
+    memcpy(lower, get_extended_address(addr), EXTENDED_ADDRESS_LENGTH);
+  }
+
+  AES_128.load_key_schedule(master_key_schedule);
+  AES_128.encrypt(block);
+  AES_128.expand_key(block, schedule);
+}
+/*---------------------------------------------------------------------------*/
+/* Sets the key of the frame in the packetbuf, exchanged with addr */
+static void
+load_key(const linkaddr_t *addr, struct neighbor *neighbor)
+{
+  if(packetbuf_holds_broadcast()) {
+    AES_128.load_key_schedule(group_key_schedule);
+  } else if(neighbor) {
+    AES_128.load_key_schedule(neighbor->key_schedule);
+  } else {
+    expand_pairwise_key(addr, stranger_key_schedule);
+    AES_128.load_key_schedule(stranger_key_schedule);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send(mac_callback_t sent, void *ptr)
+{
+  packetbuf_set_attr(PACKETBUF_ATTR_FRAME_TYPE, FRAME802154_DATAFRAME);
+  packetbuf_set_attr(PACKETBUF_ATTR_SECURITY_LEVEL, LLSEC802154_SECURITY_LEVEL);
+  anti_replay_set_counter();
+  NETSTACK_MAC.send(sent, ptr);
+}
+/*---------------------------------------------------------------------------*/
+static int
+on_frame_created(void)
+{
+  const linkaddr_t *receiver;
+  uint8_t *dataptr;
+  uint8_t data_len;
+
+  receiver = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
+  load_key(receiver, nbr_table_get_from_lladdr(neighbors, receiver));
+
+  dataptr = packetbuf_dataptr();
+  data_len = packetbuf_datalen();
+
+  CCM_STAR.aead(get_extended_address(&linkaddr_node_addr), dataptr + data_len, LLSEC802154_MIC_LENGTH, 1);
+  packetbuf_set_datalen(data_len + LLSEC802154_MIC_LENGTH);
+
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+  uint8_t generated_mic[LLSEC802154_MIC_LENGTH];
+  uint8_t *received_mic;
+  const linkaddr_t *sender;
+  struct neighbor *neighbor;
+
+  if(packetbuf_attr(PACKETBUF_ATTR_SECURITY_LEVEL) != LLSEC802154_SECURITY_LEVEL) {
+    PRINTF("adaptivesec: received frame with wrong security level\n");
+    return;
+  }
+  sender = packetbuf_addr(PACKETBUF_ADDR_SENDER);
+  if(linkaddr_cmp(sender, &linkaddr_node_addr)) {
+    PRINTF("adaptivesec: frame from ourselves\n");
+    return;
+  }
+
+  neighbor = nbr_table_get_from_lladdr(neighbors, sender);
+  load_key(sender, neighbor);
+
+  packetbuf_set_datalen(packetbuf_datalen() - LLSEC802154_MIC_LENGTH);
+
+  CCM_STAR.aead(get_extended_address(sender), generated_mic, LLSEC802154_MIC_LENGTH, 0);
+
+  received_mic = ((uint8_t *) packetbuf_dataptr()) + packetbuf_datalen();
+  if(memcmp(generated_mic, received_mic, LLSEC802154_MIC_LENGTH) != 0) {
+    PRINTF("adaptivesec: received nonauthentic frame %"PRIu32"\n",
+        anti_replay_get_counter());
+    return;
+  }
+
+  if(!neighbor) {
+    neighbor = nbr_table_add_lladdr(neighbors, sender);
+    if(!neighbor) {
+      PRINTF("adaptivesec: could not get nbr_table_item\n");
+      return;
+    }
+
+    /*
+     * As in noncoresec, locking avoids replay attacks due to removed
+     * neighbor table items. Pairwise keys are derived, not negotiated,
+     * so they do not make it unnecessary.
+     */
+    if(!nbr_table_lock(neighbors, neighbor)) {
+      nbr_table_remove(neighbors, neighbor);
+      PRINTF("adaptivesec: could not lock\n");
+      return;
+    }
+
+    anti_replay_init_info(&neighbor->anti_replay_info);
+    if(packetbuf_holds_broadcast()) {
+      expand_pairwise_key(sender, neighbor->key_schedule);
+    } else {
+      memcpy(neighbor->key_schedule, stranger_key_schedule, AES_128_KEY_SCHEDULE_LENGTH);
+    }
+  } else {
+    if(anti_replay_was_replayed(&neighbor->anti_replay_info)) {
+       PRINTF("adaptivesec: received replayed frame %"PRIu32"\n",
+           anti_replay_get_counter());
+       return;
+    }
+  }
+
+  NETSTACK_NETWORK.input();
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+get_overhead(void)
+{
+  return SECURITY_HEADER_LENGTH + LLSEC802154_MIC_LENGTH;
+}
+/*---------------------------------------------------------------------------*/
+static void
+bootstrap(llsec_on_bootstrapped_t on_bootstrapped)
+{
+  uint8_t group_key[AES_128_KEY_LENGTH] = ADAPTIVESEC_GROUP_KEY;
+  uint8_t master_key[AES_128_KEY_LENGTH] = ADAPTIVESEC_MASTER_KEY;
+
+  AES_128.expand_key(group_key, group_key_schedule);
+  AES_128.expand_key(master_key, master_key_schedule);
+  nbr_table_register(neighbors, NULL);
+  on_bootstrapped();
+}
+/*---------------------------------------------------------------------------*/
+const struct llsec_driver adaptivesec_driver = {
+  "adaptivesec",
+  bootstrap,
+  send,
+  on_frame_created,
+  input,
+  get_overhead
+};
+/*---------------------------------------------------------------------------*/
+
+/** @} */
@@ -0,0 +1,43 @@
+/**
+ * \addtogroup llsec
+ * @{
+ */
+
+/**
+ * \defgroup adaptivesec LLSEC driver using pairwise keys (ADAPTIVESEC)
+ *
+ * 802.15.4 security that adapts the key to the frame: unicast frames are
+ * secured with a key shared by the sender and the receiver only, broadcast
+ * frames with a network-wide group key.
+ *
+ * The pairwise key of two nodes is derived from a master key and their
+ * extended addresses, so that it needs no key exchange. Every node holds
+ * the master key, so this does not protect against captured nodes, but a
+ * unicast frame is bound to its sender and receiver and cannot be
+ * redirected to another node. With a security level that encrypts, this
+ * protects every hop of unicast traffic, which applications that do not
+ * need end-to-end protection may use instead of ESP.
+ *
+ * The key schedule of a pairwise key is computed once, when the neighbor
+ * enters the neighbor table, and loaded from there for every frame. Frames
+ * are secured and checked in a single pass of CCM*.
+ *
+ * @{
+ */
+
+/**
+ * \file
+ *         802.15.4 security implementation, which uses pairwise keys
+ */
+
+#ifndef ADAPTIVESEC_H_
+#define ADAPTIVESEC_H_
+
+#include "net/llsec/llsec.h"
+
+extern const struct llsec_driver adaptivesec_driver;
+
+#endif /* ADAPTIVESEC_H_ */
+
+/** @} */
+/** @} */
@@ -181,9 +181,103 @@ ctr(const uint8_t *extended_source_address)
   }
 }
 /*---------------------------------------------------------------------------*/
+static void
+aead(const uint8_t *extended_source_address,
+    uint8_t *result,
+    uint8_t mic_len,
+    int forward)
+{
+  uint8_t x[AES_128_BLOCK_SIZE];
+  uint8_t a[AES_128_BLOCK_SIZE];
+  uint8_t s[AES_128_BLOCK_SIZE];
+  uint8_t pos;
+  uint8_t i;
+  uint8_t block_len;
+  uint8_t a_len;
+  uint8_t m_len;
+  uint8_t *hdr;
+  uint8_t *m;
+  
+#if LLSEC802154_USES_ENCRYPTION
+  if(packetbuf_attr(PACKETBUF_ATTR_SECURITY_LEVEL) & (1 << 2)) {
+    a_len = packetbuf_hdrlen();
+    m_len = packetbuf_datalen();
+  } else
+#endif /* LLSEC802154_USES_ENCRYPTION */
+  {
+    a_len = packetbuf_totlen();
+    m_len = 0;
+  }
+  hdr = packetbuf_hdrptr();
+  m = hdr + a_len;
+  
+  /* CBC-MAC over the additional data, as in mic() */
+  set_nonce(x,
+      CCM_STAR_AUTH_FLAGS(a_len, mic_len),
+      extended_source_address,
+      m_len);
+  AES_128.encrypt(x);
+  if(a_len) {
+    x[1] = x[1] ^ a_len;
+    for(i = 2; (i - 2 < a_len) && (i < AES_128_BLOCK_SIZE); i++) {
+      x[i] ^= hdr[i - 2];
+    }
+    AES_128.encrypt(x);
+    
+    pos = 14;
+    while(pos < a_len) {
+      for(i = 0; (pos + i < a_len) && (i < AES_128_BLOCK_SIZE); i++) {
+        x[i] ^= hdr[pos + i];
+      }
+      pos += AES_128_BLOCK_SIZE;
+      AES_128.encrypt(x);
+    }
+  }
+  
+  /*
+   * CBC-MAC over the plaintext and CTR over the message block by block.
+   * The nonce is only built once: the counter blocks differ in their
+   * last byte.
+   */
+  set_nonce(a, CCM_STAR_ENCRYPTION_FLAGS, extended_source_address, 0);
+  pos = 0;
+  while(pos < m_len) {
+    block_len = m_len - pos;
+    if(block_len > AES_128_BLOCK_SIZE) {
+      block_len = AES_128_BLOCK_SIZE;
+    }
+    memcpy(s, a, AES_128_BLOCK_SIZE);
+    s[AES_128_BLOCK_SIZE - 1] = (pos / AES_128_BLOCK_SIZE) + 1;
+    AES_128.encrypt(s);
+    
+    if(!forward) {
+      for(i = 0; i < block_len; i++) {
+        m[pos + i] ^= s[i];
+      }
+    }
+    for(i = 0; i < block_len; i++) {
+      x[i] ^= m[pos + i];
+    }
+    AES_128.encrypt(x);
+    if(forward) {
+      for(i = 0; i < block_len; i++) {
+        m[pos + i] ^= s[i];
+      }
+    }
+    pos += block_len;
+  }
+  
+  /* encrypt the CBC-MAC with K_0 */
+  AES_128.encrypt(a);
+  for(i = 0; i < mic_len; i++) {
+    result[i] = x[i] ^ a[i];
+  }
+}
+/*---------------------------------------------------------------------------*/
 const struct ccm_star_driver ccm_star_driver = {
   mic,
-  ctr
+  ctr,
+  aead
 };
 /*---------------------------------------------------------------------------*/
 
@@ -76,6 +76,20 @@ struct ccm_star_driver {
    * \brief XORs the frame in the packetbuf with the key stream.
    */
   void (* ctr)(const uint8_t *extended_source_address);
+  
+  /**
+   * \brief         Generates the MIC of the frame in the packetbuf and, if
+   *                its security level asks for encryption, XORs it with the
+   *                key stream, in a single pass over the frame.
+   * \param result  The generated MIC will be put here
+   * \param mic_len  <= 16; set to LLSEC802154_MIC_LENGTH to be compliant
+   * \param forward != 0 to secure an outgoing frame, 0 to unsecure an
+   *                incoming one
+   */
+  void (* aead)(const uint8_t *extended_source_address,
+      uint8_t *result,
+      uint8_t mic_len,
+      int forward);
 };
 
 extern const struct ccm_star_driver CCM_STAR;
@@ -106,7 +106,11 @@ static int we_are_receiving_burst = 0;
 
 /* INTER_PACKET_DEADLINE is the maximum time a receiver waits for the
    next packet of a burst when FRAME_PENDING is set. */
+#ifdef CONTIKIMAC_CONF_INTER_PACKET_DEADLINE
+#define INTER_PACKET_DEADLINE               CONTIKIMAC_CONF_INTER_PACKET_DEADLINE
+#else
 #define INTER_PACKET_DEADLINE               CLOCK_SECOND / 32
+#endif
 
 /* ContikiMAC performs periodic channel checks. Each channel check
    consists of two or more CCA checks. CCA_COUNT_MAX is the number of
@@ -173,7 +177,7 @@ static int we_are_receiving_burst = 0;
 
 /* GUARD_TIME is the time before the expected phase of a neighbor that
    a transmitted should begin transmitting packets. */
-#define GUARD_TIME                         10 * CHECK_TIME + CHECK_TIME_TX
+#define GUARD_TIME                         (10 * CHECK_TIME + CHECK_TIME_TX)
 
 /* INTER_PACKET_INTERVAL is the interval between two successive packet transmissions */
 #ifdef CONTIKIMAC_CONF_INTER_PACKET_INTERVAL
@@ -506,6 +510,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   int ret;
   uint8_t contikimac_was_on;
   uint8_t seqno;
+  rtimer_clock_t guard_time = GUARD_TIME;
   
   /* Exit if RDC and radio were explicitly turned off */
    if(!contikimac_is_on && !contikimac_keep_radio_on) {
@@ -566,7 +571,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   if(!is_broadcast && !is_receiver_awake) {
 #if WITH_PHASE_OPTIMIZATION
     ret = phase_wait(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
-                     CYCLE_TIME, GUARD_TIME,
+                     CYCLE_TIME, &guard_time,
                      mac_callback, mac_callback_ptr, buf_list);
     if(ret == PHASE_DEFERRED) {
       return MAC_TX_DEFERRED;
@@ -662,8 +667,11 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
 
     watchdog_periodic();
 
+    /* The guard time of a known receiver grows with the uncertainty
+       of its drift, on both sides of its expected wake-up */
     if(!is_broadcast && (is_receiver_awake || is_known_receiver) &&
-       !RTIMER_CLOCK_LT(RTIMER_NOW(), t0 + MAX_PHASE_STROBE_TIME)) {
+       !RTIMER_CLOCK_LT(RTIMER_NOW(), t0 + MAX_PHASE_STROBE_TIME +
+                        2 * (guard_time - GUARD_TIME))) {
       PRINTF("miss to %d\n", packetbuf_addr(PACKETBUF_ADDR_RECEIVER)->u8[0]);
       break;
     }
@@ -766,7 +774,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   if(!is_broadcast) {
     if(collisions == 0 && is_receiver_awake == 0) {
       phase_update(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
-		   encounter_time, ret);
+		   encounter_time, CYCLE_TIME, ret);
     }
   }
 #endif /* WITH_PHASE_OPTIMIZATION */
@@ -790,6 +798,7 @@ qsend_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
   struct rdc_buf_list *next;
   int ret;
   int is_receiver_awake;
+  int pending;
   
   if(buf_list == NULL) {
     return;
@@ -821,12 +830,19 @@ qsend_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
       }
       
       packetbuf_set_attr(PACKETBUF_ATTR_IS_CREATED_AND_SECURED, 1);
-      queuebuf_update_from_packetbuf(curr->buf);
+      if(!queuebuf_update_from_packetbuf(curr->buf)) {
+        /* The frame could not be kept for the burst */
+        PRINTF("contikimac: could not update queuebuf\n");
+        mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 1);
+        return;
+      }
     }
     curr = next;
   } while(next != NULL);
   
-  /* The receiver needs to be awoken before we send */
+  /* The receiver needs to be awoken before we send. Only the first
+     packet of a burst strobes, and its ACK updates the phase of the
+     receiver. */
   is_receiver_awake = 0;
   curr = buf_list;
   do { /* A loop sending a burst of packets from buf_list */
@@ -834,6 +850,12 @@ qsend_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
 
     /* Prepare the packetbuf */
     queuebuf_to_packetbuf(curr->buf);
+    /* The receiver stays awake only if the packet has FRAME_PENDING
+       set. A packet framed before the next one was queued does not
+       have it: the burst ends there, and the MAC layer sends the rest
+       in its next turn. Read it now, the callback may reuse the
+       packetbuf. */
+    pending = packetbuf_attr(PACKETBUF_ATTR_PENDING);
     
     /* Send the current packet */
     ret = send_packet(sent, ptr, curr, is_receiver_awake);
@@ -851,7 +873,7 @@ qsend_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
       /* The transmission failed, we stop the burst */
       next = NULL;
     }
-  } while((next != NULL) && packetbuf_attr(PACKETBUF_ATTR_PENDING));
+  } while((next != NULL) && pending);
 }
 /*---------------------------------------------------------------------------*/
 /* Timer callback triggered when receiving a burst, after having
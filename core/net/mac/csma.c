@@ -89,6 +89,10 @@ struct qbuf_metadata {
   mac_callback_t sent;
   void *cptr;
   uint8_t max_transmissions;
+  /* PACKETBUF_ATTR_PRIORITY and PACKETBUF_ATTR_PENDING of the packet, kept
+     here so that scheduling does not read packets from the spill store */
+  uint8_t class;
+  uint8_t pending;
 };
 
 /* Every neighbor has its own packet queue */
@@ -98,6 +102,10 @@ struct neighbor_queue {
   struct ctimer transmit_timer;
   uint8_t transmissions;
   uint8_t collisions, deferrals;
+  /* The backoff is over, and the queue waits for its turn */
+  uint8_t ready;
+  /* Bytes the queue may still send before other queues of its class */
+  int16_t deficit;
   LIST_STRUCT(queued_packet_list);
 };
 
@@ -116,13 +124,40 @@ struct neighbor_queue {
 #endif /* CSMA_CONF_MAX_PACKET_PER_NEIGHBOR */
 
 #define MAX_QUEUED_PACKETS QUEUEBUF_NUM
+
+/* The number of queued packets kept for routing and key management:
+   data packets never take the last ones */
+#ifdef CSMA_CONF_RESERVED_PACKETS
+#define CSMA_RESERVED_PACKETS CSMA_CONF_RESERVED_PACKETS
+#else
+#define CSMA_RESERVED_PACKETS (MAX_QUEUED_PACKETS / 4)
+#endif /* CSMA_CONF_RESERVED_PACKETS */
+
+/* The bytes a neighbor queue may send in each round of the deficit
+   round robin between the queues of the same class */
+#ifdef CSMA_CONF_DRR_QUANTUM
+#define CSMA_DRR_QUANTUM CSMA_CONF_DRR_QUANTUM
+#else
+#define CSMA_DRR_QUANTUM PACKETBUF_SIZE
+#endif /* CSMA_CONF_DRR_QUANTUM */
+
+#if CSMA_DRR_QUANTUM < 1
+#error CSMA_CONF_DRR_QUANTUM must be at least 1.
+#endif /* CSMA_DRR_QUANTUM < 1 */
+
 MEMB(neighbor_memb, struct neighbor_queue, CSMA_MAX_NEIGHBOR_QUEUES);
 MEMB(packet_memb, struct rdc_buf_list, MAX_QUEUED_PACKETS);
 MEMB(metadata_memb, struct qbuf_metadata, MAX_QUEUED_PACKETS);
 LIST(neighbor_list);
 
+/* Queued packets of each class (PACKETBUF_ATTR_PRIORITY) */
+static uint8_t class_depth[PACKETBUF_ATTR_PRIORITY_CLASSES];
+/* The queue the round robin visits first */
+static struct neighbor_queue *next_queue;
+static struct ctimer schedule_timer;
+
 static void packet_sent(void *ptr, int status, int num_transmissions);
-static void transmit_packet_list(void *ptr);
+static void schedule(void *ptr);
 
 /*---------------------------------------------------------------------------*/
 static struct neighbor_queue *
@@ -155,19 +190,130 @@ default_timebase(void)
   return time;
 }
 /*---------------------------------------------------------------------------*/
+static uint8_t
+packet_class(struct rdc_buf_list *q)
+{
+  return ((struct qbuf_metadata *)q->ptr)->class;
+}
+/*---------------------------------------------------------------------------*/
+/* The class of a neighbor queue is the class of its first packet */
+static uint8_t
+queue_class(struct neighbor_queue *n)
+{
+  return packet_class(list_head(n->queued_packet_list));
+}
+/*---------------------------------------------------------------------------*/
+/* The length of the first packet of a neighbor queue */
+static int
+head_length(struct neighbor_queue *n)
+{
+  struct rdc_buf_list *q = list_head(n->queued_packet_list);
+  return queuebuf_datalen(q->buf);
+}
+/*---------------------------------------------------------------------------*/
+/* The neighbor queue after n in the round robin */
+static struct neighbor_queue *
+queue_after(struct neighbor_queue *n)
+{
+  n = list_item_next(n);
+  return n != NULL ? n : list_head(neighbor_list);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The next neighbor queue to transmit: a ready queue of the most urgent
+ * class, and among those of that class, the next one in a deficit round
+ * robin on the bytes they send.
+ */
+static struct neighbor_queue *
+select_queue(void)
+{
+  struct neighbor_queue *n;
+  struct neighbor_queue *first;
+  int top = -1;
+
+  for(n = list_head(neighbor_list); n != NULL; n = list_item_next(n)) {
+    if(n->ready && queue_class(n) > top) {
+      top = queue_class(n);
+    }
+  }
+  if(top < 0) {
+    return NULL;
+  }
+
+  first = next_queue != NULL ? next_queue : list_head(neighbor_list);
+  while(1) {
+    n = first;
+    do {
+      if(n->ready && queue_class(n) == top && n->deficit >= head_length(n)) {
+        next_queue = queue_after(n);
+        return n;
+      }
+      n = queue_after(n);
+    } while(n != first);
+
+    /* No queue has enough credit yet: start a new round */
+    for(n = list_head(neighbor_list); n != NULL; n = list_item_next(n)) {
+      if(n->ready && queue_class(n) == top) {
+        n->deficit += CSMA_DRR_QUANTUM;
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Hand the next ready neighbor queue to the RDC layer */
+static void
+schedule(void *ptr)
+{
+  struct neighbor_queue *n;
+  struct rdc_buf_list *q;
+
+  n = select_queue();
+  if(n == NULL) {
+    return;
+  }
+  n->ready = 0;
+
+  /* The RDC layer tries to send the whole queue in a burst. Frames that
+     were swapped out are read now rather than between two transmissions. */
+  for(q = list_head(n->queued_packet_list); q != NULL; q = list_item_next(q)) {
+    queuebuf_prefetch(q->buf);
+  }
+
+  q = list_head(n->queued_packet_list);
+  PRINTF("csma: preparing number %d %p, queue len %d, class %d\n",
+         n->transmissions, q, list_length(n->queued_packet_list),
+         packet_class(q));
+  /* Send packets in the neighbor's list */
+  NETSTACK_RDC.send_list(packet_sent, n, q);
+
+  /* Other queues may be ready too */
+  ctimer_set(&schedule_timer, 0, schedule, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The backoff of a neighbor queue is over. The choice of the next queue
+ * waits for the other timers that expire at the same time.
+ */
 static void
 transmit_packet_list(void *ptr)
 {
   struct neighbor_queue *n = ptr;
-  if(n) {
-    struct rdc_buf_list *q = list_head(n->queued_packet_list);
-    if(q != NULL) {
-      PRINTF("csma: preparing number %d %p, queue len %d\n", n->transmissions, q,
-          list_length(n->queued_packet_list));
-      /* Send packets in the neighbor's list */
-      NETSTACK_RDC.send_list(packet_sent, n, q);
-    }
+
+  if(n != NULL && list_head(n->queued_packet_list) != NULL) {
+    n->ready = 1;
+    ctimer_set(&schedule_timer, 0, schedule, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+free_neighbor(struct neighbor_queue *n)
+{
+  ctimer_stop(&n->transmit_timer);
+  if(next_queue == n) {
+    next_queue = list_item_next(n);
   }
+  list_remove(neighbor_list, n);
+  memb_free(&neighbor_memb, n);
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -177,13 +323,16 @@ free_packet(struct neighbor_queue *n, struct rdc_buf_list *p)
     /* Remove packet from list and deallocate */
     list_remove(n->queued_packet_list, p);
 
+    class_depth[packet_class(p)]--;
     queuebuf_free(p->buf);
     memb_free(&metadata_memb, p->ptr);
     memb_free(&packet_memb, p);
     PRINTF("csma: free_queued_packet, queue length %d, free packets %d\n",
            list_length(n->queued_packet_list), memb_numfree(&packet_memb));
     if(list_head(n->queued_packet_list) != NULL) {
-      /* There is a next packet. We reset current tx information */
+      /* There is a next packet. We reset current tx information, and read
+         it during the backoff if it was swapped out. */
+      queuebuf_prefetch(((struct rdc_buf_list *)list_head(n->queued_packet_list))->buf);
       n->transmissions = 0;
       n->collisions = 0;
       n->deferrals = 0;
@@ -192,9 +341,7 @@ free_packet(struct neighbor_queue *n, struct rdc_buf_list *p)
                  transmit_packet_list, n);
     } else {
       /* This was the last packet in the queue, we free the neighbor */
-      ctimer_stop(&n->transmit_timer);
-      list_remove(neighbor_list, n);
-      memb_free(&neighbor_memb, n);
+      free_neighbor(n);
     }
   }
 }
@@ -239,6 +386,11 @@ packet_sent(void *ptr, int status, int num_transmissions)
   }
 
   if(q != NULL) {
+    /* The RDC layer may end a burst before the end of the queue, so the
+       round robin is charged for the packets it did send */
+    if(status == MAC_TX_OK || status == MAC_TX_NOACK) {
+      n->deficit -= queuebuf_datalen(q->buf);
+    }
     metadata = (struct qbuf_metadata *)q->ptr;
 
     if(metadata != NULL) {
@@ -288,8 +440,11 @@ packet_sent(void *ptr, int status, int num_transmissions)
           ctimer_set(&n->transmit_timer, time,
                      transmit_packet_list, n);
           /* This is needed to correctly attribute energy that we spent
-             transmitting this packet. */
-          queuebuf_update_attr_from_packetbuf(q->buf);
+             transmitting this packet. If the packet is swapped out and
+             the spill store is full, it is sent again as it was queued. */
+          if(!queuebuf_update_attr_from_packetbuf(q->buf)) {
+            PRINTF("csma: could not update the attributes of %p\n", q);
+          }
         } else {
           PRINTF("csma: drop with status %d after %d transmissions, %d collisions\n",
                  status, n->transmissions, n->collisions);
@@ -313,6 +468,37 @@ packet_sent(void *ptr, int status, int num_transmissions)
   }
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Queue a packet after the last packet of its class or of a more urgent
+ * one. The first packet of the queue may be in transmission, so q never
+ * goes before it. The fragments of a datagram are sent in a burst: if q
+ * would follow a packet with the pending bit, it goes after the rest of
+ * that datagram, which is queued next and has the same class.
+ */
+static void
+enqueue(struct neighbor_queue *n, struct rdc_buf_list *q)
+{
+  struct rdc_buf_list *prev;
+  struct rdc_buf_list *it;
+
+  prev = list_head(n->queued_packet_list);
+  if(prev == NULL) {
+    list_add(n->queued_packet_list, q);
+    return;
+  }
+  for(it = list_item_next(prev); it != NULL; it = list_item_next(it)) {
+    if(packet_class(it) >= packet_class(q)) {
+      prev = it;
+    }
+  }
+  while((it = list_item_next(prev)) != NULL &&
+        ((struct qbuf_metadata *)prev->ptr)->pending &&
+        packet_class(it) == packet_class(prev)) {
+    prev = it;
+  }
+  list_insert(n->queued_packet_list, prev, q);
+}
+/*---------------------------------------------------------------------------*/
 static void
 send_packet(mac_callback_t sent, void *ptr)
 {
@@ -346,6 +532,8 @@ send_packet(mac_callback_t sent, void *ptr)
       n->transmissions = 0;
       n->collisions = 0;
       n->deferrals = 0;
+      n->ready = 0;
+      n->deficit = 0;
       /* Init packet list for this neighbor */
       LIST_STRUCT_INIT(n, queued_packet_list);
       /* Add neighbor to the list */
@@ -355,7 +543,10 @@ send_packet(mac_callback_t sent, void *ptr)
 
   if(n != NULL) {
     /* Add packet to the neighbor's queue */
-    if(list_length(n->queued_packet_list) < CSMA_MAX_PACKET_PER_NEIGHBOR) {
+    if(list_length(n->queued_packet_list) < CSMA_MAX_PACKET_PER_NEIGHBOR &&
+       (packetbuf_attr(PACKETBUF_ATTR_PRIORITY) != PACKETBUF_ATTR_PRIORITY_DATA ||
+        class_depth[PACKETBUF_ATTR_PRIORITY_DATA] <
+        MAX_QUEUED_PACKETS - CSMA_RESERVED_PACKETS)) {
       q = memb_alloc(&packet_memb);
       if(q != NULL) {
         q->ptr = memb_alloc(&metadata_memb);
@@ -373,13 +564,19 @@ send_packet(mac_callback_t sent, void *ptr)
             }
             metadata->sent = sent;
             metadata->cptr = ptr;
+            metadata->class = packetbuf_attr(PACKETBUF_ATTR_PRIORITY);
+            if(metadata->class >= PACKETBUF_ATTR_PRIORITY_CLASSES) {
+              metadata->class = PACKETBUF_ATTR_PRIORITY_DATA;
+            }
+            metadata->pending = packetbuf_attr(PACKETBUF_ATTR_PENDING);
 
             if(packetbuf_attr(PACKETBUF_ATTR_PACKET_TYPE) ==
                PACKETBUF_ATTR_PACKET_TYPE_ACK) {
               list_push(n->queued_packet_list, q);
             } else {
-              list_add(n->queued_packet_list, q);
+              enqueue(n, q);
             }
+            class_depth[packet_class(q)]++;
 
             PRINTF("csma: send_packet, queue length %d, free packets %d\n",
                    list_length(n->queued_packet_list), memb_numfree(&packet_memb));
@@ -397,11 +594,10 @@ send_packet(mac_callback_t sent, void *ptr)
       }
       /* The packet allocation failed. Remove and free neighbor entry if empty. */
       if(list_length(n->queued_packet_list) == 0) {
-        list_remove(neighbor_list, n);
-        memb_free(&neighbor_memb, n);
+        free_neighbor(n);
       }
     } else {
-      PRINTF("csma: Neighbor queue full\n");
+      PRINTF("csma: Neighbor queue full, or no room left for data\n");
     }
     PRINTF("csma: could not allocate packet, dropping packet\n");
   } else {
@@ -443,6 +639,7 @@ init(void)
   memb_init(&packet_memb);
   memb_init(&metadata_memb);
   memb_init(&neighbor_memb);
+  memset(class_depth, 0, sizeof(class_depth));
 }
 /*---------------------------------------------------------------------------*/
 const struct mac_driver csma_driver = {
@@ -44,16 +44,45 @@
 #include "net/queuebuf.h"
 #include "net/nbr-table.h"
 
-#if PHASE_CONF_DRIFT_CORRECT
+#ifdef PHASE_CONF_DRIFT_CORRECT
 #define PHASE_DRIFT_CORRECT PHASE_CONF_DRIFT_CORRECT
 #else
-#define PHASE_DRIFT_CORRECT 0
+#define PHASE_DRIFT_CORRECT 1
 #endif
 
+#if PHASE_DRIFT_CORRECT
+/* The drift of the phase of a neighbor is in rtimer ticks per
+   PHASE_DRIFT_PERIOD seconds */
+#define PHASE_DRIFT_PERIOD    256
+
+/* The drift is measured over at least this many seconds, so that the
+   jitter of the encounter time does not dominate */
+#define PHASE_DRIFT_MIN_INTERVAL 16
+
+/* The largest drift between the clocks of two neighbors, assumed until
+   their drift has been measured */
+#ifdef PHASE_CONF_MAX_DRIFT_PPM
+#define PHASE_MAX_DRIFT_PPM   PHASE_CONF_MAX_DRIFT_PPM
+#else
+#define PHASE_MAX_DRIFT_PPM   80
+#endif
+#define PHASE_MAX_DRIFT \
+  ((int32_t)((uint64_t)PHASE_MAX_DRIFT_PPM * RTIMER_ARCH_SECOND * \
+             PHASE_DRIFT_PERIOD / 1000000))
+#endif /* PHASE_DRIFT_CORRECT */
+
 struct phase {
+  /* The last time the neighbor acknowledged a wake-up strobe */
   rtimer_clock_t time;
 #if PHASE_DRIFT_CORRECT
-  rtimer_clock_t drift;
+  /* The encounter the drift is measured from, and the seconds of both */
+  rtimer_clock_t ref_time;
+  uint16_t ref_seconds;
+  uint16_t seconds;
+  /* Estimated drift and its mean deviation */
+  int16_t drift;
+  uint16_t deviation;
+  uint8_t drift_known;
 #endif
   uint8_t noacks;
   struct timer noacks_timer;
@@ -87,18 +116,95 @@ NBR_TABLE(struct phase, nbr_phase);
 #define PRINTDEBUG(...)
 #endif
 /*---------------------------------------------------------------------------*/
+/* The offset of an interval from a whole number of cycles, between
+   -cycle_time / 2 and cycle_time / 2 */
+static int32_t
+phase_offset(int32_t interval, rtimer_clock_t cycle_time)
+{
+  int32_t offset;
+
+  offset = interval % (int32_t)cycle_time;
+  if(offset < 0) {
+    offset += (int32_t)cycle_time;
+  }
+  if(offset > (int32_t)cycle_time / 2) {
+    offset -= (int32_t)cycle_time;
+  }
+  return offset;
+}
+/*---------------------------------------------------------------------------*/
+#if PHASE_DRIFT_CORRECT
+/* The drift accumulated in a number of seconds. The product is taken in
+   64 bits: twice the largest deviation over a long silence overflows 32 */
+static int32_t
+drift_over(int32_t drift, uint16_t seconds)
+{
+  return (int64_t)drift * seconds / PHASE_DRIFT_PERIOD;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Learn the drift of a neighbor from a new encounter. The phase moved
+ * from the reference encounter by the predicted drift plus an error;
+ * the error corrects the drift and its mean deviation, as the RTT and
+ * its variation of RFC 6298.
+ */
+static void
+drift_update(struct phase *e, rtimer_clock_t time, uint16_t now,
+             rtimer_clock_t cycle_time)
+{
+  uint16_t elapsed;
+  int32_t predicted;
+  int32_t error;
+  int32_t sample;
+  int32_t delta;
+
+  elapsed = now - e->ref_seconds;
+  if(elapsed < PHASE_DRIFT_MIN_INTERVAL) {
+    return;
+  }
+
+  predicted = e->drift_known ? drift_over(e->drift, elapsed) : 0;
+  error = phase_offset((int32_t)(rtimer_clock_t)(time - e->ref_time) - predicted,
+                       cycle_time);
+  sample = (e->drift_known ? e->drift : 0) +
+    error * PHASE_DRIFT_PERIOD / elapsed;
+
+  if(sample > INT16_MAX || sample < -INT16_MAX) {
+    /* Not a drift: the neighbor changed its phase */
+    e->drift_known = 0;
+  } else if(!e->drift_known) {
+    e->drift = sample;
+    e->deviation = (sample < 0 ? -sample : sample) / 2;
+    e->drift_known = 1;
+  } else {
+    delta = sample - e->drift;
+    e->drift += delta / 4;
+    e->deviation = (3 * (int32_t)e->deviation + (delta < 0 ? -delta : delta)) / 4;
+  }
+  PRINTF("phase drift %d deviation %u over %u s\n",
+         e->drift, e->deviation, elapsed);
+
+  e->ref_time = time;
+  e->ref_seconds = now;
+}
+#endif /* PHASE_DRIFT_CORRECT */
+/*---------------------------------------------------------------------------*/
 void
 phase_update(const linkaddr_t *neighbor, rtimer_clock_t time,
-             int mac_status)
+             rtimer_clock_t cycle_time, int mac_status)
 {
   struct phase *e;
+#if PHASE_DRIFT_CORRECT
+  uint16_t now = clock_seconds();
+#endif
 
   /* If we have an entry for this neighbor already, we renew it. */
   e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
   if(e != NULL) {
     if(mac_status == MAC_TX_OK) {
 #if PHASE_DRIFT_CORRECT
-      e->drift = time-e->time;
+      drift_update(e, time, now, cycle_time);
+      e->seconds = now;
 #endif
       e->time = time;
     }
@@ -126,9 +232,14 @@ phase_update(const linkaddr_t *neighbor, rtimer_clock_t time,
       if(e) {
         e->time = time;
 #if PHASE_DRIFT_CORRECT
-      e->drift = 0;
+        e->ref_time = time;
+        e->ref_seconds = now;
+        e->seconds = now;
+        e->drift = 0;
+        e->deviation = 0;
+        e->drift_known = 0;
 #endif
-      e->noacks = 0;
+        e->noacks = 0;
       }
     }
   }
@@ -152,7 +263,7 @@ send_packet(void *ptr)
 /*---------------------------------------------------------------------------*/
 phase_status_t
 phase_wait(const linkaddr_t *neighbor, rtimer_clock_t cycle_time,
-           rtimer_clock_t guard_time,
+           rtimer_clock_t *guard,
            mac_callback_t mac_callback, void *mac_callback_ptr,
            struct rdc_buf_list *buf_list)
 {
@@ -165,6 +276,7 @@ phase_wait(const linkaddr_t *neighbor, rtimer_clock_t cycle_time,
   e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
   if(e != NULL) {
     rtimer_clock_t wait, now, expected, sync;
+    rtimer_clock_t guard_time;
     clock_time_t ctimewait;
     
     /* We expect phases to happen every CYCLE_TIME time
@@ -184,15 +296,28 @@ phase_wait(const linkaddr_t *neighbor, rtimer_clock_t cycle_time,
     now = RTIMER_NOW();
 
     sync = (e == NULL) ? now : e->time;
+    guard_time = *guard;
 
 #if PHASE_DRIFT_CORRECT
     {
-      int32_t s;
-      if(e->drift > cycle_time) {
-        s = e->drift % cycle_time / (e->drift / cycle_time);  /* drift per cycle */
-        s = s * (now - sync) / cycle_time;                    /* estimated drift to now */
-        sync += s;                                            /* add it in */
+      /* Predict the drift since the last encounter, and widen the guard
+         time by how wrong the prediction may be */
+      uint16_t elapsed;
+      int32_t uncertainty;
+
+      elapsed = (uint16_t)clock_seconds() - e->seconds;
+      if(e->drift_known) {
+        sync += drift_over(e->drift, elapsed);
+        uncertainty = drift_over(2 * (int32_t)e->deviation, elapsed);
+      } else {
+        uncertainty = drift_over(PHASE_MAX_DRIFT, elapsed);
+      }
+      if(uncertainty >= (int32_t)cycle_time / 2) {
+        /* Strobing for a whole cycle is cheaper */
+        return PHASE_UNKNOWN;
       }
+      guard_time += uncertainty;
+      *guard = guard_time;
     }
 #endif
 
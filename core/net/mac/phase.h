@@ -55,12 +55,18 @@ typedef enum {
 
 
 void phase_init(void);
+/**
+ * \brief Wait for the next wake-up of a neighbor
+ * \param guard The time to wake up before the expected phase. It is
+ *              widened by the uncertainty of the drift of the neighbor
+ *              since its last wake-up, and the widened value returned.
+ */
 phase_status_t phase_wait(const linkaddr_t *neighbor,
-                          rtimer_clock_t cycle_time, rtimer_clock_t wait_before,
+                          rtimer_clock_t cycle_time, rtimer_clock_t *guard,
                           mac_callback_t mac_callback, void *mac_callback_ptr,
                           struct rdc_buf_list *buf_list);
-void phase_update(const linkaddr_t *neighbor,
-                  rtimer_clock_t time, int mac_status);
+void phase_update(const linkaddr_t *neighbor, rtimer_clock_t time,
+                  rtimer_clock_t cycle_time, int mac_status);
 void phase_remove(const linkaddr_t *neighbor);
 
 #endif /* PHASE_H */
@@ -43,6 +43,9 @@
 /* List of link-layer addresses of the neighbors, used as key in the tables */
 typedef struct nbr_table_key {
   struct nbr_table_key *next;
+#if NBR_TABLE_HASH_SIZE
+  struct nbr_table_key *hash_next;
+#endif /* NBR_TABLE_HASH_SIZE */
   linkaddr_t lladdr;
 } nbr_table_key_t;
 
@@ -62,6 +65,11 @@ static unsigned num_tables;
 MEMB(neighbor_addr_mem, nbr_table_key_t, NBR_TABLE_MAX_NEIGHBORS);
 LIST(nbr_table_keys);
 
+#if NBR_TABLE_HASH_SIZE
+/* Hash index over the link-layer addresses of the keys */
+static nbr_table_key_t *key_hash[NBR_TABLE_HASH_SIZE];
+#endif /* NBR_TABLE_HASH_SIZE */
+
 /*---------------------------------------------------------------------------*/
 /* Get a key from a neighbor index */
 static nbr_table_key_t *
@@ -105,16 +113,49 @@ key_from_item(nbr_table_t *table, const nbr_table_item_t *item)
   return key_from_index(index_from_item(table, item));
 }
 /*---------------------------------------------------------------------------*/
+#if NBR_TABLE_HASH_SIZE
+/* Get the hash bucket of a link-layer address */
+static nbr_table_key_t **
+hash_bucket(const linkaddr_t *lladdr)
+{
+  unsigned hash = 0;
+  int i;
+  for(i = 0; i < LINKADDR_SIZE; i++) {
+    hash = hash * 31 + lladdr->u8[i];
+  }
+  return &key_hash[hash % NBR_TABLE_HASH_SIZE];
+}
+/*---------------------------------------------------------------------------*/
+/* Remove a key from the hash index */
+static void
+hash_remove(nbr_table_key_t *key)
+{
+  nbr_table_key_t **prev;
+  for(prev = hash_bucket(&key->lladdr); *prev != NULL; prev = &(*prev)->hash_next) {
+    if(*prev == key) {
+      *prev = key->hash_next;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+#endif /* NBR_TABLE_HASH_SIZE */
 /* Get the index of a neighbor from its link-layer address */
 static int
 index_from_lladdr(const linkaddr_t *lladdr)
 {
   nbr_table_key_t *key;
-  /* Allow lladdr-free insertion, useful e.g. for IPv6 ND.
-   * Only one such entry is possible at a time, indexed by linkaddr_null. */
+  /* lladdr-free entries are indexed by linkaddr_null */
   if(lladdr == NULL) {
     lladdr = &linkaddr_null;
   }
+#if NBR_TABLE_HASH_SIZE
+  for(key = *hash_bucket(lladdr); key != NULL; key = key->hash_next) {
+    if(linkaddr_cmp(lladdr, &key->lladdr)) {
+      return index_from_key(key);
+    }
+  }
+#else /* NBR_TABLE_HASH_SIZE */
   key = list_head(nbr_table_keys);
   while(key != NULL) {
     if(lladdr && linkaddr_cmp(lladdr, &key->lladdr)) {
@@ -122,6 +163,7 @@ index_from_lladdr(const linkaddr_t *lladdr)
     }
     key = list_item_next(key);
   }
+#endif /* NBR_TABLE_HASH_SIZE */
   return -1;
 }
 /*---------------------------------------------------------------------------*/
@@ -218,6 +260,9 @@ nbr_table_allocate(void)
       used_map[index_from_key(least_used_key)] = 0;
       /* Remove neighbor from list */
       list_remove(nbr_table_keys, least_used_key);
+#if NBR_TABLE_HASH_SIZE
+      hash_remove(least_used_key);
+#endif /* NBR_TABLE_HASH_SIZE */
       /* Return associated key */
       return least_used_key;
     }
@@ -274,14 +319,21 @@ nbr_table_add_lladdr(nbr_table_t *table, const linkaddr_t *lladdr)
   int index;
   nbr_table_item_t *item;
   nbr_table_key_t *key;
+#if NBR_TABLE_HASH_SIZE
+  nbr_table_key_t **bucket;
+#endif /* NBR_TABLE_HASH_SIZE */
 
-  /* Allow lladdr-free insertion, useful e.g. for IPv6 ND.
-   * Only one such entry is possible at a time, indexed by linkaddr_null. */
+  /* Allow lladdr-free insertion, useful e.g. for IPv6 ND. Each insertion
+   * gets a new entry, indexed by linkaddr_null until nbr_table_set_lladdr()
+   * gives it its address, so that several neighbors can be resolved at once. */
   if(lladdr == NULL) {
     lladdr = &linkaddr_null;
+    index = -1;
+  } else {
+    index = index_from_lladdr(lladdr);
   }
 
-  if((index = index_from_lladdr(lladdr)) == -1) {
+  if(index == -1) {
      /* Neighbor not yet in table, let's try to allocate one */
     key = nbr_table_allocate();
 
@@ -298,6 +350,13 @@ nbr_table_add_lladdr(nbr_table_t *table, const linkaddr_t *lladdr)
 
     /* Set link-layer address */
     linkaddr_copy(&key->lladdr, lladdr);
+
+#if NBR_TABLE_HASH_SIZE
+    /* Add neighbor to hash index */
+    bucket = hash_bucket(lladdr);
+    key->hash_next = *bucket;
+    *bucket = key;
+#endif /* NBR_TABLE_HASH_SIZE */
   }
 
   /* Get item in the current table */
@@ -348,3 +407,27 @@ nbr_table_get_lladdr(nbr_table_t *table, const void *item)
   nbr_table_key_t *key = key_from_item(table, item);
   return key != NULL ? &key->lladdr : NULL;
 }
+/*---------------------------------------------------------------------------*/
+/* Set the link-layer address of an item, for all the tables that use it */
+int
+nbr_table_set_lladdr(nbr_table_t *table, const void *item, const linkaddr_t *lladdr)
+{
+  nbr_table_key_t *key = key_from_item(table, item);
+#if NBR_TABLE_HASH_SIZE
+  nbr_table_key_t **bucket;
+#endif /* NBR_TABLE_HASH_SIZE */
+
+  if(key == NULL) {
+    return 0;
+  }
+#if NBR_TABLE_HASH_SIZE
+  hash_remove(key);
+#endif /* NBR_TABLE_HASH_SIZE */
+  linkaddr_copy(&key->lladdr, lladdr);
+#if NBR_TABLE_HASH_SIZE
+  bucket = hash_bucket(lladdr);
+  key->hash_next = *bucket;
+  *bucket = key;
+#endif /* NBR_TABLE_HASH_SIZE */
+  return 1;
+}
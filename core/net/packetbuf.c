@@ -64,6 +64,9 @@ static uint8_t *packetbuf = (uint8_t *)packetbuf_aligned;
 
 static uint8_t *packetbufptr;
 
+/* The data is borrowed from its owner until the packetbuf is compacted */
+static uint8_t borrowed;
+
 #define DEBUG 0
 #if DEBUG
 #include <stdio.h>
@@ -80,6 +83,7 @@ packetbuf_clear(void)
   hdrptr = PACKETBUF_HDR_SIZE;
 
   packetbufptr = &packetbuf[PACKETBUF_HDR_SIZE];
+  borrowed = 0;
   packetbuf_attr_clear();
 }
 /*---------------------------------------------------------------------------*/
@@ -106,7 +110,11 @@ packetbuf_compact(void)
 {
   int i, len;
 
-  if(packetbuf_is_reference()) {
+  if(borrowed) {
+    memcpy(&packetbuf[PACKETBUF_HDR_SIZE], packetbufptr, packetbuf_datalen());
+    packetbufptr = &packetbuf[PACKETBUF_HDR_SIZE];
+    borrowed = 0;
+  } else if(packetbuf_is_reference()) {
     memcpy(&packetbuf[PACKETBUF_HDR_SIZE], packetbuf_reference_ptr(),
 	   packetbuf_datalen());
   } else if(bufptr > 0) {
@@ -206,12 +214,18 @@ packetbuf_set_datalen(uint16_t len)
 void *
 packetbuf_dataptr(void)
 {
+  if(borrowed) {
+    packetbuf_compact();
+  }
   return (void *)(&packetbuf[bufptr + PACKETBUF_HDR_SIZE]);
 }
 /*---------------------------------------------------------------------------*/
 void *
 packetbuf_hdrptr(void)
 {
+  if(borrowed) {
+    packetbuf_compact();
+  }
   return (void *)(&packetbuf[hdrptr]);
 }
 /*---------------------------------------------------------------------------*/
@@ -223,10 +237,19 @@ packetbuf_reference(void *ptr, uint16_t len)
   buflen = len;
 }
 /*---------------------------------------------------------------------------*/
+void
+packetbuf_borrow(const void *ptr, uint16_t len)
+{
+  packetbufptr = (uint8_t *)ptr;
+  bufptr = 0;
+  buflen = len;
+  borrowed = 1;
+}
+/*---------------------------------------------------------------------------*/
 int
 packetbuf_is_reference(void)
 {
-  return packetbufptr != &packetbuf[PACKETBUF_HDR_SIZE];
+  return packetbufptr != &packetbuf[PACKETBUF_HDR_SIZE] && !borrowed;
 }
 /*---------------------------------------------------------------------------*/
 void *
@@ -194,6 +194,27 @@ void packetbuf_set_datalen(uint16_t len);
  */
 void packetbuf_reference(void *ptr, uint16_t len);
 
+/**
+ * \brief      Borrow the data of an outbound packet from its owner
+ * \param ptr  A pointer to the data
+ * \param len  The length of the data
+ *
+ *             The packetbuf data is made to point to the data of
+ *             another buffer, such as uip_buf, without copying it.
+ *             Unlike packetbuf_reference(), the header and the
+ *             attributes are kept, and the data is only valid until
+ *             the packetbuf is handed back to the owner. A MAC layer
+ *             that queues the packet copies it with
+ *             packetbuf_copyto(), or queuebuf_new_from_packetbuf(),
+ *             straight from the owner's buffer.
+ *
+ *             The data is copied into the packetbuf (compacted) the
+ *             first time packetbuf_dataptr() or packetbuf_hdrptr() is
+ *             called, so a packet that is framed and sent right away
+ *             is copied once, as it would have been without borrowing.
+ */
+void packetbuf_borrow(const void *ptr, uint16_t len);
+
 /**
  * \brief      Check if the packetbuf references external data
  * \retval     Non-zero if the packetbuf references external data, zero otherwise.
@@ -333,6 +354,12 @@ struct packetbuf_addr {
 #define PACKETBUF_ATTR_PACKET_TYPE_STREAM_END 3
 #define PACKETBUF_ATTR_PACKET_TYPE_TIMESTAMP 4
 
+/* Classes of PACKETBUF_ATTR_PRIORITY, the most urgent last */
+#define PACKETBUF_ATTR_PRIORITY_DATA           0
+#define PACKETBUF_ATTR_PRIORITY_KEY_MANAGEMENT 1
+#define PACKETBUF_ATTR_PRIORITY_CONTROL        2
+#define PACKETBUF_ATTR_PRIORITY_CLASSES        3
+
 enum {
   PACKETBUF_ATTR_NONE,
 
@@ -349,6 +376,7 @@ enum {
   PACKETBUF_ATTR_MAC_SEQNO,
   PACKETBUF_ATTR_MAC_ACK,
   PACKETBUF_ATTR_IS_CREATED_AND_SECURED,
+  PACKETBUF_ATTR_PRIORITY,
   
   /* Scope 1 attributes: used between two neighbors only. */
   PACKETBUF_ATTR_RELIABLE,
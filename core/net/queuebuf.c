@@ -32,7 +32,7 @@
 
 /**
  * \file
- *         Implementation of the Rime queue buffers
+ *         Implementation of the queue buffers
  * \author
  *         Adam Dunkels <adam@sics.se>
  */
@@ -44,10 +44,11 @@
 
 #include "contiki-net.h"
 #if WITH_SWAP
-#include "cfs/cfs.h"
+#include "net/spillbuf.h"
 #endif
 
 #include <string.h> /* for memcpy() */
+#include <stddef.h> /* for offsetof() */
 
 #ifdef QUEUEBUF_CONF_REF_NUM
 #define QUEUEBUF_REF_NUM QUEUEBUF_CONF_REF_NUM
@@ -56,7 +57,7 @@
 #endif
 
 /* Structure pointing to a buffer either stored
-   in RAM or swapped in CFS */
+   in RAM or swapped to the spill store */
 struct queuebuf {
 #if QUEUEBUF_DEBUG
   struct queuebuf *next;
@@ -75,14 +76,17 @@ struct queuebuf {
 #endif
 };
 
-/* The actual queuebuf data */
+/* The actual queuebuf data. The packet comes last so that only its
+   len bytes are written to the spill store. */
 struct queuebuf_data {
-  uint8_t data[PACKETBUF_SIZE];
   uint16_t len;
   struct packetbuf_attr attrs[PACKETBUF_NUM_ATTRS];
   struct packetbuf_addr addrs[PACKETBUF_NUM_ADDRS];
+  uint8_t data[PACKETBUF_SIZE];
 };
 
+#define QUEUEBUF_DATA_LEN(d) (offsetof(struct queuebuf_data, data) + (d)->len)
+
 struct queuebuf_ref {
   uint16_t len;
   uint8_t *ref;
@@ -94,36 +98,6 @@ MEMB(bufmem, struct queuebuf, QUEUEBUF_NUM);
 MEMB(refbufmem, struct queuebuf_ref, QUEUEBUF_REF_NUM);
 MEMB(buframmem, struct queuebuf_data, QUEUEBUFRAM_NUM);
 
-#if WITH_SWAP
-
-/* Swapping allows to store up to QUEUEBUF_NUM - QUEUEBUFRAM_NUM
-   queuebufs in CFS. The swap is made of several large CFS files.
-   Every buffer stored in CFS has a swap id, referring to a specific
-   offset in one of these files. */
-#define NQBUF_FILES 4
-#define NQBUF_PER_FILE 256
-#define QBUF_FILE_SIZE (NQBUF_PER_FILE*sizeof(struct queuebuf_data))
-#define NQBUF_ID (NQBUF_PER_FILE * NQBUF_FILES)
-
-struct qbuf_file {
-  int fd;
-  int usage;
-  int renewable;
-};
-
-/* A statically allocated queuebuf used as a cache for swapped qbufs */
-static struct queuebuf_data tmpdata;
-/* A pointer to the qbuf associated to the data in tmpdata */
-static struct queuebuf *tmpdata_qbuf = NULL;
-/* The swap id counter */
-static int next_swap_id = 0;
-/* The swap files */
-static struct qbuf_file qbuf_files[NQBUF_FILES];
-/* The timer used to renew files during inactivity periods */
-static struct ctimer renew_timer;
-
-#endif
-
 #if QUEUEBUF_DEBUG
 #include "lib/list.h"
 LIST(queuebuf_list);
@@ -149,136 +123,27 @@ uint8_t queuebuf_len, queuebuf_ref_len, queuebuf_max_len;
 
 #if WITH_SWAP
 /*---------------------------------------------------------------------------*/
-static void
-qbuf_renew_file(int file)
-{
-  int ret;
-  char name[2];
-  name[0] = 'a' + file;
-  name[1] = '\0';
-  if(qbuf_files[file].renewable == 1) {
-    PRINTF("qbuf_renew_file: removing file %d\n", file);
-    cfs_remove(name);
-  }
-  ret = cfs_open(name, CFS_READ | CFS_WRITE);
-  if(ret == -1) {
-    PRINTF("qbuf_renew_file: cfs open error\n");
-  }
-  qbuf_files[file].fd = ret;
-  qbuf_files[file].usage = 0;
-  qbuf_files[file].renewable = 0;
-}
-/*---------------------------------------------------------------------------*/
-/* Renews every file with renewable flag set */
-static void
-qbuf_renew_all(void *unused)
-{
-  int i;
-  for(i=0; i<NQBUF_FILES; i++) {
-    if(qbuf_files[i].renewable == 1) {
-      qbuf_renew_file(i);
-    }
-  }
-}
-/*---------------------------------------------------------------------------*/
-/* Removes a queuebuf from its swap file */
-static void
-queuebuf_remove_from_file(int swap_id)
-{
-  int fileid;
-  if(swap_id != -1) {
-    fileid = swap_id / NQBUF_PER_FILE;
-    qbuf_files[fileid].usage--;
-
-    /* The file is full but doesn't contain any more queuebuf, mark it as renewable */
-    if(qbuf_files[fileid].usage == 0 && fileid != next_swap_id / NQBUF_PER_FILE) {
-      qbuf_files[fileid].renewable = 1;
-      /* This file is renewable, set a timer to renew files */
-      ctimer_set(&renew_timer, 0, qbuf_renew_all, NULL);
-    }
-
-    if(tmpdata_qbuf->swap_id == swap_id) {
-      tmpdata_qbuf->swap_id = -1;
-    }
-  }
-}
-/*---------------------------------------------------------------------------*/
-static int
-get_new_swap_id(void)
+/* If the queuebuf is in the spill store, get it from its cache */
+static struct queuebuf_data *
+queuebuf_load_to_ram(struct queuebuf *b)
 {
-  int fileid;
-  int swap_id = next_swap_id;
-  fileid = swap_id / NQBUF_PER_FILE;
-  if(swap_id % NQBUF_PER_FILE == 0) { /* This is the first id in the file */
-    if(qbuf_files[fileid].renewable) {
-      qbuf_renew_file(fileid);
-    }
-    if(qbuf_files[fileid].usage>0) {
-      return -1;
-    }
+  if(b->location == IN_RAM) {
+    return b->ram_ptr;
+  } else {
+    return spillbuf_get(b->swap_id);
   }
-  qbuf_files[fileid].usage++;
-  next_swap_id = (next_swap_id+1) % NQBUF_ID;
-  return swap_id;
 }
 /*---------------------------------------------------------------------------*/
-/* Flush tmpdata to CFS */
+/* Write a modified swapped queuebuf back to the spill store */
 static int
-queuebuf_flush_tmpdata(void)
+queuebuf_flush(struct queuebuf *b, struct queuebuf_data *buframptr)
 {
-  int fileid, fd, ret;
-  cfs_offset_t offset;
-  if(tmpdata_qbuf) {
-    queuebuf_remove_from_file(tmpdata_qbuf->swap_id);
-    tmpdata_qbuf->swap_id = get_new_swap_id();
-    if(tmpdata_qbuf->swap_id == -1) {
-      return -1;
-    }
-    fileid = tmpdata_qbuf->swap_id / NQBUF_PER_FILE;
-    offset = (tmpdata_qbuf->swap_id % NQBUF_PER_FILE) * sizeof(struct queuebuf_data);
-    fd = qbuf_files[fileid].fd;
-    ret = cfs_seek(fd, offset, CFS_SEEK_SET);
-    if(ret == -1) {
-      PRINTF("queuebuf_flush_tmpdata: cfs seek error\n");
-      return -1;
-    }
-    ret = cfs_write(fd, &tmpdata, sizeof(struct queuebuf_data));
-    if(ret == -1) {
-      PRINTF("queuebuf_flush_tmpdata: cfs write error\n");
-      return -1;
-    }
-  }
-  return 0;
-}
-/*---------------------------------------------------------------------------*/
-/* If the queuebuf is in CFS, load it to tmpdata */
-static struct queuebuf_data *
-queuebuf_load_to_ram(struct queuebuf *b)
-{
-  int fileid, fd, ret;
-  cfs_offset_t offset;
-  if(b->location == IN_RAM) { /* the qbuf is loacted in RAM */
-    return b->ram_ptr;
-  } else { /* the qbuf is located in CFS */
-    if(tmpdata_qbuf && tmpdata_qbuf->swap_id == b->swap_id) { /* the qbuf is already in tmpdata */
-      return &tmpdata;
-    } else { /* the qbuf needs to be loaded from CFS */
-      tmpdata_qbuf = b;
-      /* read the qbuf from CFS */
-      fileid = b->swap_id / NQBUF_PER_FILE;
-      offset = (b->swap_id % NQBUF_PER_FILE) * sizeof(struct queuebuf_data);
-      fd = qbuf_files[fileid].fd;
-      ret = cfs_seek(fd, offset, CFS_SEEK_SET);
-      if(ret == -1) {
-        PRINTF("queuebuf_load_to_ram: cfs seek error\n");
-      }
-      ret = cfs_read(fd, &tmpdata, sizeof(struct queuebuf_data));
-      if(ret == -1) {
-        PRINTF("queuebuf_load_to_ram: cfs read error\n");
-      }
-      return &tmpdata;
-    }
+  if(b->location == IN_CFS &&
+     spillbuf_update(b->swap_id, buframptr, QUEUEBUF_DATA_LEN(buframptr)) < 0) {
+    PRINTF("queuebuf_flush: could not update the spill store\n");
+    return 0;
   }
+  return 1;
 }
 #else /* WITH_SWAP */
 /*---------------------------------------------------------------------------*/
@@ -293,11 +158,7 @@ void
 queuebuf_init(void)
 {
 #if WITH_SWAP
-  int i;
-  for(i=0; i<NQBUF_FILES; i++) {
-    qbuf_files[i].renewable = 1;
-    qbuf_renew_file(i);
-  }
+  spillbuf_init();
 #endif
   memb_init(&buframmem);
   memb_init(&bufmem);
@@ -353,15 +214,13 @@ queuebuf_new_from_packetbuf(void)
 #endif /* QUEUEBUF_DEBUG */
       buf->ram_ptr = memb_alloc(&buframmem);
 #if WITH_SWAP
-      /* If the allocation failed, store the qbuf in swap files */
+      /* If the allocation failed, store the qbuf in the spill store */
       if(buf->ram_ptr != NULL) {
         buf->location = IN_RAM;
         buframptr = buf->ram_ptr;
       } else {
         buf->location = IN_CFS;
-        buf->swap_id = -1;
-        tmpdata_qbuf = buf;
-        buframptr = &tmpdata;
+        buframptr = spillbuf_scratch();
       }
 #else
       if(buf->ram_ptr == NULL) {
@@ -377,8 +236,9 @@ queuebuf_new_from_packetbuf(void)
 
 #if WITH_SWAP
       if(buf->location == IN_CFS) {
-        if(queuebuf_flush_tmpdata() == -1) {
-          /* We were unable to write the data in the swap */
+        buf->swap_id = spillbuf_put(buframptr, QUEUEBUF_DATA_LEN(buframptr));
+        if(buf->swap_id == -1) {
+          /* We were unable to write the data in the spill store */
           memb_free(&bufmem, buf);
           return NULL;
         }
@@ -403,28 +263,28 @@ queuebuf_new_from_packetbuf(void)
   }
 }
 /*---------------------------------------------------------------------------*/
-void
+int
 queuebuf_update_attr_from_packetbuf(struct queuebuf *buf)
 {
   struct queuebuf_data *buframptr = queuebuf_load_to_ram(buf);
   packetbuf_attr_copyto(buframptr->attrs, buframptr->addrs);
 #if WITH_SWAP
-  if(buf->location == IN_CFS) {
-    queuebuf_flush_tmpdata();
-  }
+  return queuebuf_flush(buf, buframptr);
+#else
+  return 1;
 #endif
 }
 /*---------------------------------------------------------------------------*/
-void
+int
 queuebuf_update_from_packetbuf(struct queuebuf *buf)
 {
   struct queuebuf_data *buframptr = queuebuf_load_to_ram(buf);
   packetbuf_attr_copyto(buframptr->attrs, buframptr->addrs);
   buframptr->len = packetbuf_copyto(buframptr->data);
 #if WITH_SWAP
-  if(buf->location == IN_CFS) {
-    queuebuf_flush_tmpdata();
-  }
+  return queuebuf_flush(buf, buframptr);
+#else
+  return 1;
 #endif
 }
 /*---------------------------------------------------------------------------*/
@@ -436,7 +296,7 @@ queuebuf_free(struct queuebuf *buf)
     if(buf->location == IN_RAM) {
       memb_free(&buframmem, buf->ram_ptr);
     } else {
-      queuebuf_remove_from_file(buf->swap_id);
+      spillbuf_free(buf->swap_id);
     }
 #else
     memb_free(&buframmem, buf->ram_ptr);
@@ -474,6 +334,16 @@ queuebuf_to_packetbuf(struct queuebuf *b)
   }
 }
 /*---------------------------------------------------------------------------*/
+void
+queuebuf_prefetch(struct queuebuf *b)
+{
+#if WITH_SWAP
+  if(memb_inmemb(&bufmem, b) && b->location == IN_CFS) {
+    spillbuf_prefetch(b->swap_id);
+  }
+#endif
+}
+/*---------------------------------------------------------------------------*/
 void *
 queuebuf_dataptr(struct queuebuf *b)
 {
@@ -492,7 +362,14 @@ queuebuf_dataptr(struct queuebuf *b)
 int
 queuebuf_datalen(struct queuebuf *b)
 {
-  struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
+  struct queuebuf_data *buframptr;
+#if WITH_SWAP
+  /* The spill store knows the length without reading the record */
+  if(memb_inmemb(&bufmem, b) && b->location == IN_CFS) {
+    return spillbuf_len(b->swap_id) - offsetof(struct queuebuf_data, data);
+  }
+#endif
+  buframptr = queuebuf_load_to_ram(b);
   return buframptr->len;
 }
 /*---------------------------------------------------------------------------*/
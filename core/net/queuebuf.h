@@ -64,7 +64,8 @@
 
 /* QUEUEBUFRAM_NUM is the number of queuebufs stored in RAM.
    If QUEUEBUFRAM_CONF_NUM is set lower than QUEUEBUF_NUM,
-   swapping is enabled and queuebufs are stored either in RAM of CFS.
+   swapping is enabled and queuebufs are stored either in RAM or
+   in the spill store (see spillbuf.h).
    If QUEUEBUFRAM_CONF_NUM is unset or >= to QUEUEBUF_NUM, all
    queuebufs are in RAM and swapping is disabled. */
 #ifdef QUEUEBUFRAM_CONF_NUM
@@ -95,10 +96,14 @@ struct queuebuf *queuebuf_new_from_packetbuf_debug(const char *file, int line);
 #else /* QUEUEBUF_DEBUG */
 struct queuebuf *queuebuf_new_from_packetbuf(void);
 #endif /* QUEUEBUF_DEBUG */
-void queuebuf_update_attr_from_packetbuf(struct queuebuf *b);
-void queuebuf_update_from_packetbuf(struct queuebuf *b);
+/* Update a queuebuf from the packetbuf. Return 0 if a swapped queuebuf
+   could not be written back, in which case it keeps its former content. */
+int queuebuf_update_attr_from_packetbuf(struct queuebuf *b);
+int queuebuf_update_from_packetbuf(struct queuebuf *b);
 
 void queuebuf_to_packetbuf(struct queuebuf *b);
+/* Read a swapped queuebuf ahead of its use, e.g., before it is sent */
+void queuebuf_prefetch(struct queuebuf *b);
 void queuebuf_free(struct queuebuf *b);
 
 void *queuebuf_dataptr(struct queuebuf *b);
@@ -170,6 +170,119 @@ rpl_set_preferred_parent(rpl_dag_t *dag, rpl_parent_t *p)
   }
 }
 /*---------------------------------------------------------------------------*/
+/* The candidate parents of a DAG are kept in a binary min-heap by path
+   cost, and a parent is moved in it only when its rank or link metric
+   changes. The preferred parent is then chosen with one comparison. */
+#define PARENT_NOT_IN_HEAP      0xff
+#define INFINITE_PATH_COST      0xffff
+
+static uint16_t
+parent_path_cost(rpl_parent_t *p)
+{
+  rpl_of_t *of;
+  uint16_t cost;
+
+  of = p->dag->instance->of;
+  /* The OF is not known yet while joining an instance */
+  if(p->rank == INFINITE_RANK || of == NULL || of->parent_path_cost == NULL) {
+    return INFINITE_PATH_COST;
+  }
+  cost = of->parent_path_cost(p);
+  return cost < INFINITE_PATH_COST ? cost : INFINITE_PATH_COST - 1;
+}
+/*---------------------------------------------------------------------------*/
+/* The heap is gone with a DAG freed while the parent was kept */
+static int
+in_heap(rpl_parent_t *p)
+{
+  return p->heap_index < p->dag->parent_heap_len &&
+    p->dag->parent_heap[p->heap_index] == p;
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_set(rpl_dag_t *dag, int i, rpl_parent_t *p)
+{
+  dag->parent_heap[i] = p;
+  p->heap_index = i;
+}
+/*---------------------------------------------------------------------------*/
+/* Move the parent at i up or down to its place after a change of cost */
+static void
+heap_sift(rpl_dag_t *dag, int i)
+{
+  rpl_parent_t *p;
+  int child;
+
+  p = dag->parent_heap[i];
+  while(i > 0 && p->path_cost < dag->parent_heap[(i - 1) / 2]->path_cost) {
+    heap_set(dag, i, dag->parent_heap[(i - 1) / 2]);
+    i = (i - 1) / 2;
+  }
+  for(;;) {
+    child = 2 * i + 1;
+    if(child >= dag->parent_heap_len) {
+      break;
+    }
+    if(child + 1 < dag->parent_heap_len &&
+       dag->parent_heap[child + 1]->path_cost < dag->parent_heap[child]->path_cost) {
+      child++;
+    }
+    if(dag->parent_heap[child]->path_cost >= p->path_cost) {
+      break;
+    }
+    heap_set(dag, i, dag->parent_heap[child]);
+    i = child;
+  }
+  heap_set(dag, i, p);
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_add(rpl_parent_t *p)
+{
+  rpl_dag_t *dag;
+
+  dag = p->dag;
+  if(dag->parent_heap_len >= NBR_TABLE_MAX_NEIGHBORS) {
+    return;
+  }
+  p->path_cost = parent_path_cost(p);
+  heap_set(dag, dag->parent_heap_len++, p);
+  heap_sift(dag, p->heap_index);
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_remove(rpl_parent_t *p)
+{
+  rpl_dag_t *dag;
+  int i;
+
+  if(!in_heap(p)) {
+    return;
+  }
+  dag = p->dag;
+  i = p->heap_index;
+  p->heap_index = PARENT_NOT_IN_HEAP;
+  if(i < --dag->parent_heap_len) {
+    heap_set(dag, i, dag->parent_heap[dag->parent_heap_len]);
+    heap_sift(dag, i);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_update(rpl_parent_t *p)
+{
+  uint16_t cost;
+
+  if(!in_heap(p)) {
+    return;
+  }
+  cost = parent_path_cost(p);
+  if(cost != p->path_cost) {
+    p->path_cost = cost;
+    heap_sift(p->dag, p->heap_index);
+  }
+}
+/*---------------------------------------------------------------------------*/
 /* Greater-than function for the lollipop counter.                      */
 /*---------------------------------------------------------------------------*/
 static int
@@ -579,6 +692,11 @@ rpl_add_parent(rpl_dag_t *dag, rpl_dio_t *dio, uip_ipaddr_t *addr)
   PRINT6ADDR(addr);
   PRINTF("\n");
   if(lladdr != NULL) {
+    /* An entry for the address is cleared for the new parent */
+    p = nbr_table_get_from_lladdr(rpl_parents, (linkaddr_t *)lladdr);
+    if(p != NULL) {
+      heap_remove(p);
+    }
     /* Add parent in rpl_parents */
     p = nbr_table_add_lladdr(rpl_parents, (linkaddr_t *)lladdr);
     if(p == NULL) {
@@ -598,6 +716,8 @@ rpl_add_parent(rpl_dag_t *dag, rpl_dio_t *dio, uip_ipaddr_t *addr)
 #if RPL_DAG_MC != RPL_DAG_MC_NONE
       memcpy(&p->mc, &dio->mc, sizeof(p->mc));
 #endif /* RPL_DAG_MC != RPL_DAG_MC_NONE */
+      p->heap_index = PARENT_NOT_IN_HEAP;
+      heap_add(p);
     }
   }
 
@@ -720,8 +840,9 @@ rpl_select_dag(rpl_instance_t *instance, rpl_parent_t *p)
   	(unsigned)old_rank, best_dag->rank);
     RPL_STAT(rpl_stats.parent_switch++);
     if(instance->mop != RPL_MOP_NO_DOWNWARD_ROUTES) {
-      if(last_parent != NULL) {
-        /* Send a No-Path DAO to the removed preferred parent. */
+      if(RPL_IS_STORING(instance) && last_parent != NULL) {
+        /* Send a No-Path DAO to the removed preferred parent. In
+           non-storing mode, the next DAO tells the root of the new one. */
         dao_output(last_parent, RPL_ZERO_LIFETIME);
       }
       /* The DAO parent set changed - schedule a DAO transmission. */
@@ -740,6 +861,32 @@ static rpl_parent_t *
 best_parent(rpl_dag_t *dag)
 {
   rpl_parent_t *p, *best;
+  uint16_t cost;
+
+  if(dag->instance->of->parent_path_cost != NULL) {
+    /* The cheapest candidate, once its cost is known to be current */
+    best = NULL;
+    while(dag->parent_heap_len > 0) {
+      best = dag->parent_heap[0];
+      cost = parent_path_cost(best);
+      if(cost == best->path_cost) {
+        break;
+      }
+      best->path_cost = cost;
+      heap_sift(dag, 0);
+    }
+    if(best == NULL || best->path_cost == INFINITE_PATH_COST) {
+      return NULL;
+    }
+
+    /* The OF keeps the preferred parent if the cheapest one is not
+       enough better */
+    p = dag->preferred_parent;
+    if(p == NULL || p == best || p->rank == INFINITE_RANK) {
+      return best;
+    }
+    return dag->instance->of->best_parent(best, p);
+  }
 
   best = NULL;
 
@@ -779,6 +926,7 @@ rpl_remove_parent(rpl_parent_t *parent)
 
   rpl_nullify_parent(parent);
 
+  heap_remove(parent);
   nbr_table_remove(rpl_parents, parent);
 }
 /*---------------------------------------------------------------------------*/
@@ -831,7 +979,9 @@ rpl_move_parent(rpl_dag_t *dag_src, rpl_dag_t *dag_dst, rpl_parent_t *parent)
   PRINT6ADDR(rpl_get_parent_ipaddr(parent));
   PRINTF("\n");
 
+  heap_remove(parent);
   parent->dag = dag_dst;
+  heap_add(parent);
 }
 /*---------------------------------------------------------------------------*/
 rpl_dag_t *
@@ -1146,6 +1296,9 @@ rpl_process_parent_event(rpl_instance_t *instance, rpl_parent_t *p)
 
   return_value = 1;
 
+  /* The rank or the link metric of the parent has changed */
+  heap_update(p);
+
   if(!acceptable_rank(p->dag, p->rank)) {
     /* The candidate parent is no longer valid: the rank increase resulting
        from the choice of it as a parent would be too high. */
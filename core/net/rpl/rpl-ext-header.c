@@ -48,6 +48,8 @@
 #include "net/ip/tcpip.h"
 #include "net/ipv6/uip-ds6.h"
 #include "net/rpl/rpl-private.h"
+#include "net/rpl/rpl-ns.h"
+#include "net/ipv6/uip-icmp6.h"
 #include "net/packetbuf.h"
 
 #define DEBUG DEBUG_NONE
@@ -64,6 +66,26 @@
 #define UIP_EXT_HDR_OPT_BUF       ((struct uip_ext_hdr_opt *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
 #define UIP_EXT_HDR_OPT_PADN_BUF  ((struct uip_ext_hdr_opt_padn *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
 #define UIP_EXT_HDR_OPT_RPL_BUF   ((struct uip_ext_hdr_opt_rpl *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
+#define UIP_RH_BUF                ((struct uip_routing_hdr *)&uip_buf[uip_l2_l3_hdr_len])
+/*---------------------------------------------------------------------------*/
+#if RPL_WITH_NON_STORING
+/* The DAG of which this node is the non-storing root, or NULL */
+static rpl_dag_t *
+get_ns_root_dag(void)
+{
+  rpl_dag_t *dag;
+
+  if(default_instance == NULL || !default_instance->used ||
+     !RPL_IS_NON_STORING(default_instance)) {
+    return NULL;
+  }
+  dag = default_instance->current_dag;
+  if(dag == NULL || !dag->joined || dag->rank != ROOT_RANK(default_instance)) {
+    return NULL;
+  }
+  return dag;
+}
+#endif /* RPL_WITH_NON_STORING */
 /*---------------------------------------------------------------------------*/
 int
 rpl_verify_header(int uip_ext_opt_offset)
@@ -185,6 +207,14 @@ rpl_update_header_empty(void)
   int last_uip_ext_len;
   rpl_parent_t *parent;
 
+#if RPL_WITH_NON_STORING
+  if(get_ns_root_dag() != NULL) {
+    /* The root sends packets down the DAG with a source routing header
+       instead, see rpl_update_header_srh(). */
+    return 0;
+  }
+#endif /* RPL_WITH_NON_STORING */
+
   last_uip_ext_len = uip_ext_len;
   uip_ext_len = 0;
   uip_ext_opt_offset = 2;
@@ -379,5 +409,282 @@ rpl_insert_header(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if RPL_WITH_NON_STORING
+/* The source routing header of the packet in uip_buf, after its
+   hop-by-hop options if any, or NULL */
+static struct uip_routing_hdr *
+find_srh(void)
+{
+  struct uip_routing_hdr *rh;
+  int offset;
+  uint8_t proto;
+
+  offset = UIP_IPH_LEN;
+  proto = UIP_IP_BUF->proto;
+  if(proto == UIP_PROTO_HBHO && offset + 2 <= uip_len) {
+    proto = ((struct uip_ext_hdr *)((uint8_t *)UIP_IP_BUF + offset))->next;
+    offset += (((struct uip_ext_hdr *)((uint8_t *)UIP_IP_BUF + offset))->len + 1) * 8;
+  }
+  if(proto != UIP_PROTO_ROUTING || offset + RPL_SRH_LEN > uip_len) {
+    return NULL;
+  }
+  rh = (struct uip_routing_hdr *)((uint8_t *)UIP_IP_BUF + offset);
+  return rh->routing_type == RPL_RH_TYPE_SRH ? rh : NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Number of leading octets two addresses have in common, at most 15 */
+static uint8_t
+common_prefix(const uip_ipaddr_t *a, const uip_ipaddr_t *b)
+{
+  uint8_t n;
+
+  n = 0;
+  while(n < 15 && a->u8[n] == b->u8[n]) {
+    n++;
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_update_header_srh(void)
+{
+  rpl_dag_t *dag;
+  rpl_ns_node_t *dest_node;
+  rpl_ns_node_t *node;
+  uip_ipaddr_t first_hop;
+  uip_ipaddr_t addr;
+  uip_ipaddr_t parent_addr;
+  uint8_t *next;
+  uint8_t *hdr;
+  uint8_t *p;
+  uint8_t cmpri;
+  uint8_t cmpre;
+  uint8_t cmpr;
+  int offset;
+  int ext_len;
+  int addrs_len;
+  int pad;
+  int n;
+  int i;
+  uint16_t len;
+
+  dag = get_ns_root_dag();
+  if(dag == NULL || uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) ||
+     find_srh() != NULL) {
+    return 0;
+  }
+  dest_node = rpl_ns_get_node(dag, &UIP_IP_BUF->destipaddr);
+  if(dest_node == NULL || rpl_ns_is_root(dest_node) ||
+     !rpl_ns_is_node_reachable(dag, &UIP_IP_BUF->destipaddr)) {
+    /* Not below us, routed as any other packet */
+    return 0;
+  }
+
+  /* The RPL option is for the way up */
+  offset = UIP_IPH_LEN;
+  next = &UIP_IP_BUF->proto;
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO) {
+    uip_ext_len = 0;
+    if(UIP_HBHO_BUF->len == RPL_HOP_BY_HOP_LEN - 8 &&
+       ((struct uip_ext_hdr_opt *)((uint8_t *)UIP_HBHO_BUF + 2))->type == UIP_EXT_HDR_OPT_RPL) {
+      rpl_remove_header();
+    } else {
+      next = &UIP_HBHO_BUF->next;
+      offset += (UIP_HBHO_BUF->len + 1) * 8;
+    }
+  }
+
+  /* The hops between the first one and the destination, which is an
+     address of the header too */
+  n = 0;
+  for(node = dest_node; !rpl_ns_is_root(node->parent); node = node->parent) {
+    n++;
+  }
+  if(n == 0) {
+    /* A child of ours, which needs no header */
+    return 0;
+  }
+  rpl_ns_get_node_global_addr(&first_hop, node);
+
+  /* The elided prefix of an address is that of the destination address
+     at the time the address is used: the first hop for all but the
+     last, which has the same prefix as the others, and the parent of the
+     destination for the last one. */
+  cmpri = 15;
+  cmpre = 15;
+  for(node = dest_node, i = 0; i < n; node = node->parent, i++) {
+    rpl_ns_get_node_global_addr(&addr, node);
+    if(i == 0) {
+      rpl_ns_get_node_global_addr(&parent_addr, node->parent);
+      cmpre = common_prefix(&addr, &parent_addr);
+    } else {
+      cmpr = common_prefix(&addr, &first_hop);
+      if(cmpr < cmpri) {
+        cmpri = cmpr;
+      }
+    }
+  }
+
+  addrs_len = (n - 1) * (16 - cmpri) + (16 - cmpre);
+  pad = (8 - addrs_len % 8) % 8;
+  ext_len = RPL_SRH_LEN + addrs_len + pad;
+  if(n > 0xff || ext_len > 0x100 * 8 || uip_len + ext_len > UIP_BUFSIZE - UIP_LLH_LEN) {
+    PRINTF("RPL: Packet too long: impossible to add the source routing header\n");
+    return 1;
+  }
+
+  hdr = (uint8_t *)UIP_IP_BUF + offset;
+  memmove(hdr + ext_len, hdr, uip_len - offset);
+  hdr[0] = *next;
+  hdr[1] = ext_len / 8 - 1;
+  hdr[2] = RPL_RH_TYPE_SRH;
+  hdr[3] = n;
+  hdr[4] = (cmpri << 4) | cmpre;
+  hdr[5] = pad << 4;
+  hdr[6] = 0;
+  hdr[7] = 0;
+  *next = UIP_PROTO_ROUTING;
+
+  /* Each address is the parent of the next, the last being the
+     destination */
+  p = hdr + RPL_SRH_LEN + addrs_len;
+  memset(p, 0, pad);
+  for(node = dest_node, i = 0; i < n; node = node->parent, i++) {
+    rpl_ns_get_node_global_addr(&addr, node);
+    cmpr = i == 0 ? cmpre : cmpri;
+    p -= 16 - cmpr;
+    memcpy(p, &addr.u8[cmpr], 16 - cmpr);
+  }
+
+  PRINTF("RPL: Source routing header to ");
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF(" with %d hops, via ", n);
+  PRINT6ADDR(&first_hop);
+  PRINTF("\n");
+
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &first_hop);
+  uip_len += ext_len;
+  len = ((uint16_t)UIP_IP_BUF->len[0] << 8) + UIP_IP_BUF->len[1] + ext_len;
+  UIP_IP_BUF->len[0] = len >> 8;
+  UIP_IP_BUF->len[1] = len & 0xff;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_process_srh_header(void)
+{
+  uint8_t *hdr;
+  uint8_t *a;
+  uip_ipaddr_t addr;
+  uint8_t cmpri;
+  uint8_t cmpre;
+  uint8_t cmpr;
+  uint8_t pad;
+  int hdr_len;
+  int n;
+  int i;
+
+  if(UIP_RH_BUF->routing_type != RPL_RH_TYPE_SRH) {
+    return 0;
+  }
+
+  hdr = (uint8_t *)UIP_RH_BUF;
+  hdr_len = (UIP_RH_BUF->len + 1) * 8;
+  cmpri = hdr[4] >> 4;
+  cmpre = hdr[4] & 0x0f;
+  pad = hdr[5] >> 4;
+  if(hdr_len < RPL_SRH_LEN + pad + 16 - cmpre ||
+     UIP_IPH_LEN + uip_ext_len + hdr_len > uip_len) {
+    PRINTF("RPL: Source routing header has wrong size\n");
+    return 0;
+  }
+
+  /* RFC 6554, 4.2 */
+  n = (hdr_len - RPL_SRH_LEN - pad - (16 - cmpre)) / (16 - cmpri) + 1;
+  if(UIP_RH_BUF->seg_left > n) {
+    PRINTF("RPL: Source routing header has too many segments left\n");
+    return 0;
+  }
+  i = n - UIP_RH_BUF->seg_left + 1;
+  cmpr = i == n ? cmpre : cmpri;
+  a = hdr + RPL_SRH_LEN + (i - 1) * (16 - cmpri);
+
+  uip_ipaddr_copy(&addr, &UIP_IP_BUF->destipaddr);
+  memcpy(&addr.u8[cmpr], a, 16 - cmpr);
+  if(uip_is_addr_mcast(&addr) || uip_ds6_is_my_addr(&addr)) {
+    PRINTF("RPL: Loop or multicast address in source routing header\n");
+    return 0;
+  }
+
+  memcpy(a, &UIP_IP_BUF->destipaddr.u8[cmpr], 16 - cmpr);
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &addr);
+  UIP_RH_BUF->seg_left--;
+
+  if(UIP_IP_BUF->ttl <= 1) {
+    uip_icmp6_error_output(ICMP6_TIME_EXCEEDED, ICMP6_TIME_EXCEED_TRANSIT, 0);
+    return 1;
+  }
+  UIP_IP_BUF->ttl--;
+
+  PRINTF("RPL: Source routing to ");
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF(", %u segments left\n", UIP_RH_BUF->seg_left);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_srh_get_next_hop(uip_ipaddr_t *ipaddr)
+{
+  rpl_dag_t *dag;
+  rpl_ns_node_t *node;
+  uip_ds6_nbr_t *nbr;
+
+  if(find_srh() == NULL) {
+    /* Without header, only the children of the root */
+    dag = get_ns_root_dag();
+    node = dag == NULL ? NULL : rpl_ns_get_node(dag, &UIP_IP_BUF->destipaddr);
+    if(node == NULL || node->parent == NULL || !rpl_ns_is_root(node->parent)) {
+      return 0;
+    }
+  }
+
+  /* The destination is a neighbor. Send to the address the neighbor
+     cache knows it by, usually the link-local address it sent its DIOs
+     from, which shares the interface identifier of its global address.
+     A neighbor not in the cache yet is resolved at the global address. */
+  uip_ipaddr_copy(ipaddr, &UIP_IP_BUF->destipaddr);
+  if(uip_ds6_nbr_lookup(ipaddr) == NULL) {
+    for(nbr = nbr_table_head(ds6_neighbors); nbr != NULL;
+        nbr = nbr_table_next(ds6_neighbors, nbr)) {
+      if(uip_is_addr_link_local(&nbr->ipaddr) &&
+         memcmp(&nbr->ipaddr.u8[8], &ipaddr->u8[8], 8) == 0) {
+        uip_ipaddr_copy(ipaddr, &nbr->ipaddr);
+        break;
+      }
+    }
+  }
+  return 1;
+}
+#else /* RPL_WITH_NON_STORING */
+/*---------------------------------------------------------------------------*/
+int
+rpl_update_header_srh(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_process_srh_header(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_srh_get_next_hop(uip_ipaddr_t *ipaddr)
+{
+  return 0;
+}
+#endif /* RPL_WITH_NON_STORING */
+/*---------------------------------------------------------------------------*/
 
 /** @}*/
@@ -51,6 +51,7 @@
 #include "net/ipv6/uip-nd6.h"
 #include "net/ipv6/uip-icmp6.h"
 #include "net/rpl/rpl-private.h"
+#include "net/rpl/rpl-ns.h"
 #include "net/packetbuf.h"
 #include "net/ipv6/multicast/uip-mcast6.h"
 
@@ -92,6 +93,24 @@ extern rpl_of_t RPL_OF;
 #if RPL_CONF_MULTICAST
 static uip_mcast6_route_t *mcast_group;
 #endif
+
+/* A target of a DAO, with its transit information */
+struct dao_target {
+  uip_ipaddr_t prefix;
+  uint8_t prefixlen;
+  uint8_t lifetime;
+};
+
+#if RPL_DAO_AGGREGATION
+/* The targets for the next DAO to the preferred parent */
+static struct dao_target dao_targets[RPL_DAO_MAX_TARGETS];
+static uint8_t dao_targets_num;
+static rpl_instance_t *dao_targets_instance;
+static struct ctimer dao_aggregation_timer;
+
+static void dao_queue_target(rpl_instance_t *instance,
+                             const struct dao_target *target);
+#endif /* RPL_DAO_AGGREGATION */
 /*---------------------------------------------------------------------------*/
 /* Initialise RPL ICMPv6 message handlers */
 UIP_ICMP6_HANDLER(dis_handler, ICMP6_RPL, RPL_CODE_DIS, dis_input);
@@ -571,6 +590,115 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
 #endif /* RPL_LEAF_ONLY */
 }
 /*---------------------------------------------------------------------------*/
+static int
+dao_option_len(const unsigned char *buffer, int i)
+{
+  if(buffer[i] == RPL_OPTION_PAD1) {
+    return 1;
+  }
+  /* The option consists of a two-byte header and a payload. */
+  return 2 + buffer[i + 1];
+}
+/*---------------------------------------------------------------------------*/
+/* The transit information option that applies to the target option at
+   i is the first one after it, if any */
+static int
+dao_find_transit(const unsigned char *buffer, int i, int buffer_length)
+{
+  for(i += dao_option_len(buffer, i); i < buffer_length;
+      i += dao_option_len(buffer, i)) {
+    if(buffer[i] == RPL_OPTION_TRANSIT) {
+      return i;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+/* Add the route to one target of a DAO. Returns 1 if the target is to
+   be passed on to our preferred parent. */
+static int
+dao_input_target(rpl_dag_t *dag, rpl_parent_t *parent,
+                 uip_ipaddr_t *dao_sender_addr, int learned_from,
+                 uip_ipaddr_t *prefix, uint8_t prefixlen, uint8_t lifetime)
+{
+  rpl_instance_t *instance;
+  uip_ds6_route_t *rep;
+  uip_ds6_nbr_t *nbr;
+
+  instance = dag->instance;
+
+#if RPL_CONF_MULTICAST
+  if(uip_is_addr_mcast_global(prefix)) {
+    mcast_group = uip_mcast6_route_add(prefix);
+    if(mcast_group) {
+      mcast_group->dag = dag;
+      mcast_group->lifetime = RPL_LIFETIME(instance, lifetime);
+    }
+    return learned_from == RPL_ROUTE_FROM_UNICAST_DAO;
+  }
+#endif
+
+  rep = uip_ds6_route_lookup(prefix);
+
+  if(lifetime == RPL_ZERO_LIFETIME) {
+    PRINTF("RPL: No-Path DAO received\n");
+    /* No-Path DAO received; invoke the route purging routine. */
+    if(rep != NULL &&
+       rep->state.nopath_received == 0 &&
+       rep->length == prefixlen &&
+       uip_ds6_route_nexthop(rep) != NULL &&
+       uip_ipaddr_cmp(uip_ds6_route_nexthop(rep), dao_sender_addr)) {
+      PRINTF("RPL: Setting expiration timer for prefix ");
+      PRINT6ADDR(prefix);
+      PRINTF("\n");
+      rep->state.nopath_received = 1;
+      rep->state.lifetime = DAO_EXPIRATION_TIMEOUT;
+      return 1;
+    }
+    return 0;
+  }
+
+  PRINTF("RPL: adding DAO route\n");
+
+  if((nbr = uip_ds6_nbr_lookup(dao_sender_addr)) == NULL) {
+    if((nbr = uip_ds6_nbr_add(dao_sender_addr,
+                              (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                              0, NBR_REACHABLE)) != NULL) {
+      /* set reachable timer */
+      stimer_set(&nbr->reachable, UIP_ND6_REACHABLE_TIME / 1000);
+      PRINTF("RPL: Neighbor added to neighbor cache ");
+      PRINT6ADDR(dao_sender_addr);
+      PRINTF(", ");
+      PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
+      PRINTF("\n");
+    } else {
+      PRINTF("RPL: Out of Memory, dropping DAO from ");
+      PRINT6ADDR(dao_sender_addr);
+      PRINTF(", ");
+      PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
+      PRINTF("\n");
+      return 0;
+    }
+  } else {
+    PRINTF("RPL: Neighbor already in neighbor cache\n");
+  }
+
+  rpl_lock_parent(parent);
+
+  rep = rpl_add_route(dag, prefix, prefixlen, dao_sender_addr);
+  if(rep == NULL) {
+    RPL_STAT(rpl_stats.mem_overflows++);
+    PRINTF("RPL: Could not add a route after receiving a DAO\n");
+    return 0;
+  }
+
+  rep->state.lifetime = RPL_LIFETIME(instance, lifetime);
+  rep->state.learned_from = learned_from;
+  rep->state.nopath_received = 0;
+
+  return learned_from == RPL_ROUTE_FROM_UNICAST_DAO;
+}
+/*---------------------------------------------------------------------------*/
 static void
 dao_input(void)
 {
@@ -583,22 +711,26 @@ dao_input(void)
   uint8_t lifetime;
   uint8_t prefixlen;
   uint8_t flags;
-  uint8_t subopt_type;
   /*
   uint8_t pathcontrol;
   uint8_t pathsequence;
   */
   uip_ipaddr_t prefix;
-  uip_ds6_route_t *rep;
+#if RPL_WITH_NON_STORING
+  uip_ipaddr_t parent_addr;
+  uint8_t failed;
+#endif /* RPL_WITH_NON_STORING */
+#if RPL_DAO_AGGREGATION
+  struct dao_target fwd_targets[RPL_DAO_MAX_TARGETS];
+#endif /* RPL_DAO_AGGREGATION */
   uint8_t buffer_length;
   int pos;
-  int len;
   int i;
+  int transit;
+  int forwarded;
   int learned_from;
   rpl_parent_t *parent;
-  uip_ds6_nbr_t *nbr;
 
-  prefixlen = 0;
   parent = NULL;
 
   uip_ipaddr_copy(&dao_sender_addr, &UIP_IP_BUF->srcipaddr);
@@ -621,8 +753,6 @@ dao_input(void)
     return;
   }
 
-  lifetime = instance->default_lifetime;
-
   flags = buffer[pos++];
   /* reserved */
   pos++;
@@ -666,133 +796,109 @@ dao_input(void)
     }
   }
 
-  /* Check if there are any RPL options present. */
-  for(i = pos; i < buffer_length; i += len) {
-    subopt_type = buffer[i];
-    if(subopt_type == RPL_OPTION_PAD1) {
-      len = 1;
-    } else {
-      /* The option consists of a two-byte header and a payload. */
-      len = 2 + buffer[i + 1];
-    }
+#if RPL_WITH_NON_STORING
+  failed = 0;
+#endif /* RPL_WITH_NON_STORING */
+  forwarded = 0;
 
-    switch(subopt_type) {
-    case RPL_OPTION_TARGET:
-      /* Handle the target option. */
-      prefixlen = buffer[i + 3];
-      memset(&prefix, 0, sizeof(prefix));
-      memcpy(&prefix, buffer + i + 4, (prefixlen + 7) / CHAR_BIT);
-      break;
-    case RPL_OPTION_TRANSIT:
-      /* The path sequence and control are ignored. */
-      /*      pathcontrol = buffer[i + 3];
-              pathsequence = buffer[i + 4];*/
-      lifetime = buffer[i + 5];
-      /* The parent address is also ignored. */
-      break;
+  /* A DAO may carry several targets, each one followed by the transit
+     information that applies to it or shared with the next targets. */
+  for(i = pos; i < buffer_length; i += dao_option_len(buffer, i)) {
+    if(buffer[i] != RPL_OPTION_TARGET) {
+      continue;
     }
-  }
+    prefixlen = buffer[i + 3];
+    memset(&prefix, 0, sizeof(prefix));
+    memcpy(&prefix, buffer + i + 4, (prefixlen + 7) / CHAR_BIT);
 
-  PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
-          (unsigned)lifetime, (unsigned)prefixlen);
-  PRINT6ADDR(&prefix);
-  PRINTF("\n");
-
-#if RPL_CONF_MULTICAST
-  if(uip_is_addr_mcast_global(&prefix)) {
-    mcast_group = uip_mcast6_route_add(&prefix);
-    if(mcast_group) {
-      mcast_group->dag = dag;
-      mcast_group->lifetime = RPL_LIFETIME(instance, lifetime);
+    lifetime = instance->default_lifetime;
+    transit = dao_find_transit(buffer, i, buffer_length);
+    if(transit >= 0) {
+      /* The path sequence and control are ignored. */
+      /*      pathcontrol = buffer[transit + 3];
+              pathsequence = buffer[transit + 4];*/
+      lifetime = buffer[transit + 5];
     }
-    goto fwd_dao;
-  }
-#endif
-
-  rep = uip_ds6_route_lookup(&prefix);
 
-  if(lifetime == RPL_ZERO_LIFETIME) {
-    PRINTF("RPL: No-Path DAO received\n");
-    /* No-Path DAO received; invoke the route purging routine. */
-    if(rep != NULL &&
-       rep->state.nopath_received == 0 &&
-       rep->length == prefixlen &&
-       uip_ds6_route_nexthop(rep) != NULL &&
-       uip_ipaddr_cmp(uip_ds6_route_nexthop(rep), &dao_sender_addr)) {
-      PRINTF("RPL: Setting expiration timer for prefix ");
-      PRINT6ADDR(&prefix);
-      PRINTF("\n");
-      rep->state.nopath_received = 1;
-      rep->state.lifetime = DAO_EXPIRATION_TIMEOUT;
+    PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
+           (unsigned)lifetime, (unsigned)prefixlen);
+    PRINT6ADDR(&prefix);
+    PRINTF("\n");
 
-      /* We forward the incoming no-path DAO to our parent, if we have
-         one. */
-      if(dag->preferred_parent != NULL &&
-         rpl_get_parent_ipaddr(dag->preferred_parent) != NULL) {
-        PRINTF("RPL: Forwarding no-path DAO to parent ");
-        PRINT6ADDR(rpl_get_parent_ipaddr(dag->preferred_parent));
-        PRINTF("\n");
-        uip_icmp6_send(rpl_get_parent_ipaddr(dag->preferred_parent),
-                       ICMP6_RPL, RPL_CODE_DAO, buffer_length);
+#if RPL_WITH_NON_STORING
+    if(RPL_IS_NON_STORING(instance)) {
+      /* Only the root takes DAOs, into the topology of its DAG. The
+         other nodes forward them to the root as any other packet. */
+      if(dag->rank != ROOT_RANK(instance)) {
+        break;
       }
-      if(flags & RPL_DAO_K_FLAG) {
-        dao_ack_output(instance, &dao_sender_addr, sequence);
+      if(lifetime == RPL_ZERO_LIFETIME) {
+        PRINTF("RPL: No-Path DAO received\n");
+        rpl_ns_expire_node(dag, &prefix);
+        continue;
       }
+      /* The parent address, which only non-storing mode uses. */
+      if(transit < 0 ||
+         dao_option_len(buffer, transit) < 6 + sizeof(parent_addr)) {
+        failed++;
+        continue;
+      }
+      memcpy(&parent_addr, buffer + transit + 6, sizeof(parent_addr));
+      if(rpl_ns_update_node(dag, &prefix, &parent_addr,
+                            RPL_LIFETIME(instance, lifetime)) == NULL) {
+        failed++;
+      }
+      continue;
     }
-    return;
-  }
-
-  PRINTF("RPL: adding DAO route\n");
-
-  if((nbr = uip_ds6_nbr_lookup(&dao_sender_addr)) == NULL) {
-    if((nbr = uip_ds6_nbr_add(&dao_sender_addr,
-                              (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER),
-                              0, NBR_REACHABLE)) != NULL) {
-      /* set reachable timer */
-      stimer_set(&nbr->reachable, UIP_ND6_REACHABLE_TIME / 1000);
-      PRINTF("RPL: Neighbor added to neighbor cache ");
-      PRINT6ADDR(&dao_sender_addr);
-      PRINTF(", ");
-      PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
-      PRINTF("\n");
-    } else {
-      PRINTF("RPL: Out of Memory, dropping DAO from ");
-      PRINT6ADDR(&dao_sender_addr);
-      PRINTF(", ");
-      PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
-      PRINTF("\n");
-      return;
+#endif /* RPL_WITH_NON_STORING */
+
+    if(dao_input_target(dag, parent, &dao_sender_addr, learned_from,
+                        &prefix, prefixlen, lifetime)) {
+#if RPL_DAO_AGGREGATION
+      if(forwarded < RPL_DAO_MAX_TARGETS) {
+        uip_ipaddr_copy(&fwd_targets[forwarded].prefix, &prefix);
+        fwd_targets[forwarded].prefixlen = prefixlen;
+        fwd_targets[forwarded].lifetime = lifetime;
+      }
+#endif /* RPL_DAO_AGGREGATION */
+      forwarded++;
     }
-  } else {
-    PRINTF("RPL: Neighbor already in neighbor cache\n");
   }
 
-  rpl_lock_parent(parent);
-
-  rep = rpl_add_route(dag, &prefix, prefixlen, &dao_sender_addr);
-  if(rep == NULL) {
-    RPL_STAT(rpl_stats.mem_overflows++);
-    PRINTF("RPL: Could not add a route after receiving a DAO\n");
+#if RPL_WITH_NON_STORING
+  if(RPL_IS_NON_STORING(instance)) {
+    if(failed > 0) {
+      RPL_STAT(rpl_stats.mem_overflows++);
+      PRINTF("RPL: Could not add a node after receiving a DAO\n");
+    } else if(dag->rank == ROOT_RANK(instance) && (flags & RPL_DAO_K_FLAG)) {
+      dao_ack_output(instance, &dao_sender_addr, sequence);
+    }
+    uip_len = 0;
     return;
   }
+#endif /* RPL_WITH_NON_STORING */
 
-  rep->state.lifetime = RPL_LIFETIME(instance, lifetime);
-  rep->state.learned_from = learned_from;
-  rep->state.nopath_received = 0;
-
-#if RPL_CONF_MULTICAST
-fwd_dao:
-#endif
-
-  if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
+  if(forwarded > 0) {
     if(dag->preferred_parent != NULL &&
        rpl_get_parent_ipaddr(dag->preferred_parent) != NULL) {
-      PRINTF("RPL: Forwarding DAO to parent ");
-      PRINT6ADDR(rpl_get_parent_ipaddr(dag->preferred_parent));
-      PRINTF("\n");
-      uip_icmp6_send(rpl_get_parent_ipaddr(dag->preferred_parent),
-                     ICMP6_RPL, RPL_CODE_DAO, buffer_length);
+#if RPL_DAO_AGGREGATION
+      /* Our parent gets the targets with those of other children, in
+         one DAO. A longer DAO is passed on as it is. */
+      if(forwarded <= RPL_DAO_MAX_TARGETS) {
+        for(i = 0; i < forwarded; i++) {
+          dao_queue_target(instance, &fwd_targets[i]);
+        }
+      } else
+#endif /* RPL_DAO_AGGREGATION */
+      {
+        PRINTF("RPL: Forwarding DAO to parent ");
+        PRINT6ADDR(rpl_get_parent_ipaddr(dag->preferred_parent));
+        PRINTF("\n");
+        uip_icmp6_send(rpl_get_parent_ipaddr(dag->preferred_parent),
+                       ICMP6_RPL, RPL_CODE_DAO, buffer_length);
+      }
     }
+    /* One acknowledgment for all the targets */
     if(flags & RPL_DAO_K_FLAG) {
       dao_ack_output(instance, &dao_sender_addr, sequence);
     }
@@ -815,14 +921,21 @@ dao_output(rpl_parent_t *parent, uint8_t lifetime)
   dao_output_target(parent, &prefix, lifetime);
 }
 /*---------------------------------------------------------------------------*/
-void
-dao_output_target(rpl_parent_t *parent, uip_ipaddr_t *prefix, uint8_t lifetime)
+/* Send one DAO with the targets. Those with the same lifetime share a
+   transit information option. */
+static void
+dao_output_targets(rpl_parent_t *parent, struct dao_target *targets,
+                   uint8_t num)
 {
   rpl_dag_t *dag;
   rpl_instance_t *instance;
+  uip_ipaddr_t *parent_addr;
+  uip_ipaddr_t *dest;
   unsigned char *buffer;
-  uint8_t prefixlen;
+  uint8_t done[RPL_DAO_MAX_TARGETS];
   int pos;
+  int i;
+  int j;
 
   /* Destination Advertisement Object */
 
@@ -848,8 +961,10 @@ dao_output_target(rpl_parent_t *parent, uip_ipaddr_t *prefix, uint8_t lifetime)
     PRINTF("RPL dao_output_target error instance NULL\n");
     return;
   }
-  if(prefix == NULL) {
-    PRINTF("RPL dao_output_target error prefix NULL\n");
+
+  parent_addr = rpl_get_parent_ipaddr(parent);
+  if(parent_addr == NULL) {
+    PRINTF("RPL dao_output_target error parent address NULL\n");
     return;
   }
 #ifdef RPL_DEBUG_DAO_OUTPUT
@@ -877,32 +992,150 @@ dao_output_target(rpl_parent_t *parent, uip_ipaddr_t *prefix, uint8_t lifetime)
   pos+=sizeof(dag->dag_id);
 #endif /* RPL_DAO_SPECIFY_DAG */
 
-  /* create target subopt */
-  prefixlen = sizeof(*prefix) * CHAR_BIT;
-  buffer[pos++] = RPL_OPTION_TARGET;
-  buffer[pos++] = 2 + ((prefixlen + 7) / CHAR_BIT);
-  buffer[pos++] = 0; /* reserved */
-  buffer[pos++] = prefixlen;
-  memcpy(buffer + pos, prefix, (prefixlen + 7) / CHAR_BIT);
-  pos += ((prefixlen + 7) / CHAR_BIT);
-
-  /* Create a transit information sub-option. */
-  buffer[pos++] = RPL_OPTION_TRANSIT;
-  buffer[pos++] = 4;
-  buffer[pos++] = 0; /* flags - ignored */
-  buffer[pos++] = 0; /* path control - ignored */
-  buffer[pos++] = 0; /* path seq - ignored */
-  buffer[pos++] = lifetime;
-
-  PRINTF("RPL: Sending DAO with prefix ");
-  PRINT6ADDR(prefix);
-  PRINTF(" to ");
-  PRINT6ADDR(rpl_get_parent_ipaddr(parent));
+  memset(done, 0, sizeof(done));
+  for(i = 0; i < num; i++) {
+    if(done[i]) {
+      continue;
+    }
+
+    /* create target subopts */
+    for(j = i; j < num; j++) {
+      if(done[j] || targets[j].lifetime != targets[i].lifetime) {
+        continue;
+      }
+      done[j] = 1;
+      buffer[pos++] = RPL_OPTION_TARGET;
+      buffer[pos++] = 2 + ((targets[j].prefixlen + 7) / CHAR_BIT);
+      buffer[pos++] = 0; /* reserved */
+      buffer[pos++] = targets[j].prefixlen;
+      memcpy(buffer + pos, &targets[j].prefix, (targets[j].prefixlen + 7) / CHAR_BIT);
+      pos += ((targets[j].prefixlen + 7) / CHAR_BIT);
+      PRINTF("RPL: DAO target ");
+      PRINT6ADDR(&targets[j].prefix);
+      PRINTF(" with lifetime %u\n", targets[j].lifetime);
+    }
+
+    /* Create a transit information sub-option. */
+    buffer[pos++] = RPL_OPTION_TRANSIT;
+    buffer[pos++] = RPL_IS_NON_STORING(instance) ? 4 + 16 : 4;
+    buffer[pos++] = 0; /* flags - ignored */
+    buffer[pos++] = 0; /* path control - ignored */
+    buffer[pos++] = 0; /* path seq - ignored */
+    buffer[pos++] = targets[i].lifetime;
+
+    if(RPL_IS_NON_STORING(instance)) {
+      /* The root learns our parent by its global address, the prefix of
+         the DAG followed by the interface identifier of the parent. */
+      memcpy(buffer + pos, &dag->dag_id, 8);
+      memcpy(buffer + pos + 8, &parent_addr->u8[8], 8);
+      pos += 16;
+    }
+  }
+
+  /* In non-storing mode, the DAO goes to the root itself. */
+  dest = RPL_IS_NON_STORING(instance) ? &dag->dag_id : parent_addr;
+
+  PRINTF("RPL: Sending DAO with %u targets to ", num);
+  PRINT6ADDR(dest);
   PRINTF("\n");
 
-  if(rpl_get_parent_ipaddr(parent) != NULL) {
-    uip_icmp6_send(rpl_get_parent_ipaddr(parent), ICMP6_RPL, RPL_CODE_DAO, pos);
+  uip_icmp6_send(dest, ICMP6_RPL, RPL_CODE_DAO, pos);
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_DAO_AGGREGATION
+static void
+handle_aggregation_timer(void *ptr)
+{
+  dao_output_flush(dao_targets_instance);
+}
+/*---------------------------------------------------------------------------*/
+/* Add a target to the next DAO to the preferred parent. The DAO goes
+   when it is full, at the end of the aggregation window, or with the
+   next DAO of our own. */
+static void
+dao_queue_target(rpl_instance_t *instance, const struct dao_target *target)
+{
+  int i;
+
+  if(dao_targets_num > 0 && dao_targets_instance != instance) {
+    dao_output_flush(dao_targets_instance);
+  }
+
+  /* A newer advertisement of a target replaces the queued one */
+  for(i = 0; i < dao_targets_num; i++) {
+    if(dao_targets[i].prefixlen == target->prefixlen &&
+       uip_ipaddr_cmp(&dao_targets[i].prefix, &target->prefix)) {
+      dao_targets[i].lifetime = target->lifetime;
+      return;
+    }
+  }
+
+  if(dao_targets_num == RPL_DAO_MAX_TARGETS) {
+    dao_output_flush(instance);
+  }
+
+  memcpy(&dao_targets[dao_targets_num++], target, sizeof(*target));
+  dao_targets_instance = instance;
+  PRINTF("RPL: %u DAO targets queued\n", dao_targets_num);
+
+  if(ctimer_expired(&dao_aggregation_timer)) {
+    ctimer_set(&dao_aggregation_timer, RPL_DAO_AGGREGATION_WINDOW,
+               handle_aggregation_timer, NULL);
+  }
+}
+#endif /* RPL_DAO_AGGREGATION */
+/*---------------------------------------------------------------------------*/
+void
+dao_output_flush(rpl_instance_t *instance)
+{
+#if RPL_DAO_AGGREGATION
+  uint8_t num;
+
+  if(dao_targets_num == 0 || instance != dao_targets_instance) {
+    return;
+  }
+  ctimer_stop(&dao_aggregation_timer);
+
+  num = dao_targets_num;
+  dao_targets_num = 0;
+  /* The preferred parent may have changed while the targets waited */
+  if(instance->used && instance->current_dag != NULL &&
+     instance->current_dag->preferred_parent != NULL) {
+    dao_output_targets(instance->current_dag->preferred_parent,
+                       dao_targets, num);
+  }
+#endif /* RPL_DAO_AGGREGATION */
+}
+/*---------------------------------------------------------------------------*/
+void
+dao_output_target(rpl_parent_t *parent, uip_ipaddr_t *prefix, uint8_t lifetime)
+{
+  struct dao_target target;
+
+  if(prefix == NULL) {
+    PRINTF("RPL dao_output_target error prefix NULL\n");
+    return;
   }
+
+  uip_ipaddr_copy(&target.prefix, prefix);
+  target.prefixlen = sizeof(*prefix) * CHAR_BIT;
+  target.lifetime = lifetime;
+
+#if RPL_DAO_AGGREGATION
+  /* Only the DAOs up the DAG are aggregated, not those to a former
+     parent */
+  if(parent != NULL && parent->dag != NULL &&
+     parent->dag->instance != NULL &&
+     parent->dag->instance->current_dag != NULL &&
+     parent == parent->dag->instance->current_dag->preferred_parent &&
+     !RPL_IS_NON_STORING(parent->dag->instance) &&
+     rpl_get_mode() != RPL_MODE_FEATHER) {
+    dao_queue_target(parent->dag->instance, &target);
+    return;
+  }
+#endif /* RPL_DAO_AGGREGATION */
+
+  dao_output_targets(parent, &target, 1);
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -58,6 +58,7 @@ static rpl_parent_t *best_parent(rpl_parent_t *, rpl_parent_t *);
 static rpl_dag_t *best_dag(rpl_dag_t *, rpl_dag_t *);
 static rpl_rank_t calculate_rank(rpl_parent_t *, rpl_rank_t);
 static void update_metric_container(rpl_instance_t *);
+static uint16_t parent_path_cost(rpl_parent_t *);
 
 rpl_of_t rpl_mrhof = {
   reset,
@@ -66,7 +67,8 @@ rpl_of_t rpl_mrhof = {
   best_dag,
   calculate_rank,
   update_metric_container,
-  1
+  1,
+  parent_path_cost
 };
 
 /* Constants for the ETX moving average */
@@ -111,6 +113,12 @@ calculate_path_metric(rpl_parent_t *p)
 #endif /* RPL_DAG_MC */
 }
 
+static uint16_t
+parent_path_cost(rpl_parent_t *p)
+{
+  return calculate_path_metric(p);
+}
+
 static void
 reset(rpl_dag_t *dag)
 {
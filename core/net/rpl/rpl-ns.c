@@ -0,0 +1,257 @@
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+/**
+ * \file
+ *    Topology of a non-storing RPL DAG, kept at its root
+ */
+
+#include "net/rpl/rpl-ns.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/ip/uip-debug.h"
+
+#if RPL_WITH_NON_STORING
+
+LIST(nodelist);
+MEMB(nodememb, rpl_ns_node_t, RPL_NS_LINK_NUM);
+
+static int num_nodes;
+
+/* Index of the entries by interface identifier */
+static rpl_ns_node_t *node_hash[RPL_NS_HASH_SIZE];
+
+/*---------------------------------------------------------------------------*/
+/* Is addr in the /64 of the DAG ID, which all the nodes share? */
+static int
+in_dag_prefix(const rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  return memcmp(addr, &dag->dag_id, 8) == 0;
+}
+/*---------------------------------------------------------------------------*/
+static rpl_ns_node_t **
+hash_bucket(const unsigned char *link_identifier)
+{
+  unsigned hash = 0;
+  int i;
+
+  for(i = 0; i < 8; i++) {
+    hash = hash * 31 + link_identifier[i];
+  }
+  return &node_hash[hash % RPL_NS_HASH_SIZE];
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_parent(rpl_ns_node_t *node, rpl_ns_node_t *parent)
+{
+  if(node->parent != NULL) {
+    node->parent->num_children--;
+  }
+  if(parent != NULL) {
+    parent->num_children++;
+  }
+  node->parent = parent;
+}
+/*---------------------------------------------------------------------------*/
+static rpl_ns_node_t *
+add_node(rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *node;
+  rpl_ns_node_t **bucket;
+
+  node = memb_alloc(&nodememb);
+  if(node == NULL) {
+    PRINTF("RPL: No space for more non-storing nodes\n");
+    return NULL;
+  }
+  node->dag = dag;
+  memcpy(node->link_identifier, &addr->u8[8], sizeof(node->link_identifier));
+  node->parent = NULL;
+  node->num_children = 0;
+  node->lifetime = 0;
+  bucket = hash_bucket(node->link_identifier);
+  node->hash_next = *bucket;
+  *bucket = node;
+  list_add(nodelist, node);
+  num_nodes++;
+  return node;
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_node(rpl_ns_node_t *node)
+{
+  rpl_ns_node_t **prev;
+
+  for(prev = hash_bucket(node->link_identifier); *prev != NULL;
+      prev = &(*prev)->hash_next) {
+    if(*prev == node) {
+      *prev = node->hash_next;
+      break;
+    }
+  }
+  list_remove(nodelist, node);
+  memb_free(&nodememb, node);
+  num_nodes--;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_init(void)
+{
+  list_init(nodelist);
+  memb_init(&nodememb);
+  memset(node_hash, 0, sizeof(node_hash));
+  num_nodes = 0;
+}
+/*---------------------------------------------------------------------------*/
+rpl_ns_node_t *
+rpl_ns_get_node(const rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *n;
+
+  if(!in_dag_prefix(dag, addr)) {
+    return NULL;
+  }
+  for(n = *hash_bucket(&addr->u8[8]); n != NULL; n = n->hash_next) {
+    if(n->dag == dag &&
+       memcmp(n->link_identifier, &addr->u8[8], sizeof(n->link_identifier)) == 0) {
+      return n;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+rpl_ns_node_t *
+rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child,
+                   const uip_ipaddr_t *parent, uint32_t lifetime)
+{
+  rpl_ns_node_t *child_node;
+  rpl_ns_node_t *parent_node;
+
+  if(!in_dag_prefix(dag, child) || !in_dag_prefix(dag, parent) ||
+     uip_ipaddr_cmp(child, parent)) {
+    PRINTF("RPL: Ignoring a non-storing link outside of the DAG\n");
+    return NULL;
+  }
+
+  child_node = rpl_ns_get_node(dag, child);
+  if(child_node == NULL) {
+    child_node = add_node(dag, child);
+    if(child_node == NULL) {
+      return NULL;
+    }
+  }
+  parent_node = rpl_ns_get_node(dag, parent);
+  if(parent_node == NULL) {
+    /* A new child without a parent is removed by the next aging */
+    parent_node = add_node(dag, parent);
+    if(parent_node == NULL) {
+      return NULL;
+    }
+  }
+
+  set_parent(child_node, parent_node);
+  child_node->lifetime = lifetime;
+
+  PRINTF("RPL: Non-storing link ");
+  PRINT6ADDR(child);
+  PRINTF(" -> ");
+  PRINT6ADDR(parent);
+  PRINTF(" for %lu s\n", (unsigned long)lifetime);
+
+  return child_node;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_expire_node(rpl_dag_t *dag, const uip_ipaddr_t *child)
+{
+  rpl_ns_node_t *node;
+
+  node = rpl_ns_get_node(dag, child);
+  if(node != NULL) {
+    node->lifetime = 0;
+    set_parent(node, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_ns_is_root(const rpl_ns_node_t *node)
+{
+  return memcmp(node->link_identifier, &node->dag->dag_id.u8[8],
+                sizeof(node->link_identifier)) == 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_ns_is_node_reachable(const rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *node;
+  int steps;
+
+  node = rpl_ns_get_node(dag, addr);
+  /* A walk longer than the table is a loop */
+  for(steps = 0; node != NULL && steps <= num_nodes; steps++) {
+    if(rpl_ns_is_root(node)) {
+      return 1;
+    }
+    node = node->parent;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_get_node_global_addr(uip_ipaddr_t *addr, const rpl_ns_node_t *node)
+{
+  memcpy(addr, &node->dag->dag_id, 8);
+  memcpy(&addr->u8[8], node->link_identifier, sizeof(node->link_identifier));
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_remove_dag(const rpl_dag_t *dag)
+{
+  rpl_ns_node_t *n;
+  rpl_ns_node_t *next;
+
+  /* The parents of the entries are in the same DAG, and go too */
+  for(n = list_head(nodelist); n != NULL; n = next) {
+    next = list_item_next(n);
+    if(n->dag == dag) {
+      remove_node(n);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_periodic(void)
+{
+  rpl_ns_node_t *n;
+  rpl_ns_node_t *next;
+
+  /* An expired node stays as the parent of its children, which become
+     unreachable until their next DAO. A parent that loses its last child
+     here goes in the next round at the latest. */
+  for(n = list_head(nodelist); n != NULL; n = next) {
+    next = list_item_next(n);
+    if(n->lifetime > 0 && --n->lifetime == 0) {
+      set_parent(n, NULL);
+    }
+    if(n->lifetime == 0 && n->num_children == 0) {
+      set_parent(n, NULL);
+      remove_node(n);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_ns_num_nodes(void)
+{
+  return num_nodes;
+}
+/*---------------------------------------------------------------------------*/
+#endif /* RPL_WITH_NON_STORING */
+
+/** @} */
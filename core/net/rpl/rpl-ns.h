@@ -0,0 +1,85 @@
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+/**
+ * \file
+ *    Topology of a non-storing RPL DAG, kept at its root
+ * \details
+ *    In non-storing mode, every node reports its preferred parent to
+ *    the root in the transit option of its DAOs. The root keeps one
+ *    entry per node with a pointer to the entry of its parent, and
+ *    builds the source routing header of a packet by following the
+ *    parents from the destination up to itself.
+ *
+ *    A node is identified by the interface identifier of its global
+ *    address, whose prefix is the /64 of the DAG ID. The parents that
+ *    have not sent a DAO of their own yet, the root among them, have
+ *    entries without a parent and without a lifetime, which go away with
+ *    their last child.
+ */
+
+#ifndef RPL_NS_H
+#define RPL_NS_H
+
+#include "net/rpl/rpl-private.h"
+
+/* Number of nodes in the topology table of the root */
+#ifdef RPL_NS_CONF_LINK_NUM
+#define RPL_NS_LINK_NUM RPL_NS_CONF_LINK_NUM
+#else /* RPL_NS_CONF_LINK_NUM */
+#define RPL_NS_LINK_NUM 32
+#endif /* RPL_NS_CONF_LINK_NUM */
+
+/* The entries are hashed on the interface identifier of the node into
+   RPL_NS_HASH_SIZE buckets */
+#ifdef RPL_NS_CONF_HASH_SIZE
+#define RPL_NS_HASH_SIZE RPL_NS_CONF_HASH_SIZE
+#else /* RPL_NS_CONF_HASH_SIZE */
+#define RPL_NS_HASH_SIZE 16
+#endif /* RPL_NS_CONF_HASH_SIZE */
+
+typedef struct rpl_ns_node {
+  struct rpl_ns_node *next;
+  /* Seconds until the entry expires, 0 if it only stands for a parent */
+  uint32_t lifetime;
+  rpl_dag_t *dag;
+  /* Interface identifier of the global address of the node */
+  unsigned char link_identifier[8];
+  struct rpl_ns_node *parent;
+  struct rpl_ns_node *hash_next;
+  /* Number of entries that have this one as parent */
+  uint16_t num_children;
+} rpl_ns_node_t;
+
+void rpl_ns_init(void);
+
+/* Record that child has parent as preferred parent for lifetime seconds */
+rpl_ns_node_t *rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child,
+                                  const uip_ipaddr_t *parent, uint32_t lifetime);
+
+/* Expire the entry of child after a No-Path DAO */
+void rpl_ns_expire_node(rpl_dag_t *dag, const uip_ipaddr_t *child);
+
+rpl_ns_node_t *rpl_ns_get_node(const rpl_dag_t *dag, const uip_ipaddr_t *addr);
+
+/* Is the node the root of its DAG? */
+int rpl_ns_is_root(const rpl_ns_node_t *node);
+
+/* Is there a path of unexpired entries from the root to addr? */
+int rpl_ns_is_node_reachable(const rpl_dag_t *dag, const uip_ipaddr_t *addr);
+
+void rpl_ns_get_node_global_addr(uip_ipaddr_t *addr, const rpl_ns_node_t *node);
+
+/* Remove all the entries of a DAG */
+void rpl_ns_remove_dag(const rpl_dag_t *dag);
+
+/* Age the entries by one second */
+void rpl_ns_periodic(void);
+
+int rpl_ns_num_nodes(void);
+
+#endif /* RPL_NS_H */
+
+/** @} */
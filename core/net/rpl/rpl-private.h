@@ -110,6 +110,22 @@
 #define RPL_DAO_LATENCY                 (CLOCK_SECOND * 4)
 #endif /* RPL_DAO_LATENCY */
 
+/* How long targets for the preferred parent wait to be sent in one DAO
+   with the targets that follow them. 0 sends one DAO per target. */
+#ifdef RPL_CONF_DAO_AGGREGATION_WINDOW
+#define RPL_DAO_AGGREGATION_WINDOW      RPL_CONF_DAO_AGGREGATION_WINDOW
+#else /* RPL_CONF_DAO_AGGREGATION_WINDOW */
+#define RPL_DAO_AGGREGATION_WINDOW      0
+#endif /* RPL_CONF_DAO_AGGREGATION_WINDOW */
+#define RPL_DAO_AGGREGATION             (RPL_DAO_AGGREGATION_WINDOW > 0)
+
+/* Largest number of targets in an aggregated DAO */
+#ifdef RPL_CONF_DAO_MAX_TARGETS
+#define RPL_DAO_MAX_TARGETS             RPL_CONF_DAO_MAX_TARGETS
+#else /* RPL_CONF_DAO_MAX_TARGETS */
+#define RPL_DAO_MAX_TARGETS             4
+#endif /* RPL_CONF_DAO_MAX_TARGETS */
+
 /* Special value indicating immediate removal. */
 #define RPL_ZERO_LIFETIME               0
 
@@ -168,6 +184,18 @@
 #error "RPL Multicast requires RPL_MOP_DEFAULT==3. Check contiki-conf.h"
 #endif
 
+/* In non-storing mode, DAOs go to the root, which keeps the topology
+   of its DAG (rpl-ns.c) and routes downward with source routing
+   headers. The other nodes keep no downward routes. */
+#define RPL_WITH_NON_STORING            (RPL_MOP_DEFAULT == RPL_MOP_NON_STORING)
+#define RPL_IS_NON_STORING(instance)    (RPL_WITH_NON_STORING && \
+                                         (instance)->mop == RPL_MOP_NON_STORING)
+#define RPL_IS_STORING(instance)        ((instance)->mop > RPL_MOP_NON_STORING)
+
+/* RPL source routing header (RFC 6554) */
+#define RPL_RH_TYPE_SRH                 3
+#define RPL_SRH_LEN                     8
+
 /* Multicast Route Lifetime as a multiple of the lifetime unit */
 #ifdef RPL_CONF_MCAST_LIFETIME
 #define RPL_MCAST_LIFETIME RPL_CONF_MCAST_LIFETIME
@@ -269,6 +297,7 @@ void dis_output(uip_ipaddr_t *addr);
 void dio_output(rpl_instance_t *, uip_ipaddr_t *uc_addr);
 void dao_output(rpl_parent_t *, uint8_t lifetime);
 void dao_output_target(rpl_parent_t *, uip_ipaddr_t *, uint8_t lifetime);
+void dao_output_flush(rpl_instance_t *);
 void dao_ack_output(rpl_instance_t *, uip_ipaddr_t *, uint8_t);
 void rpl_icmp6_register_handlers(void);
 
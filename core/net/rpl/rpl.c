@@ -47,6 +47,7 @@
 #include "net/ipv6/uip-ds6.h"
 #include "net/ipv6/uip-icmp6.h"
 #include "net/rpl/rpl-private.h"
+#include "net/rpl/rpl-ns.h"
 #include "net/ipv6/multicast/uip-mcast6.h"
 
 #define DEBUG DEBUG_NONE
@@ -143,8 +144,10 @@ rpl_purge_routes(void)
       if(dag->rank != ROOT_RANK(default_instance)) {
         PRINTF(" -> generate No-Path DAO\n");
         dao_output_target(dag->preferred_parent, &prefix, RPL_ZERO_LIFETIME);
+#if !RPL_DAO_AGGREGATION
         /* Don't schedule more than 1 No-Path DAO, let next iteration handle that */
         return;
+#endif /* !RPL_DAO_AGGREGATION */
       }
       PRINTF("\n");
     } else {
@@ -198,6 +201,10 @@ rpl_remove_routes(rpl_dag_t *dag)
     }
   }
 #endif
+
+#if RPL_WITH_NON_STORING
+  rpl_ns_remove_dag(dag);
+#endif /* RPL_WITH_NON_STORING */
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -300,6 +307,9 @@ rpl_init(void)
   default_instance = NULL;
 
   rpl_dag_init();
+#if RPL_WITH_NON_STORING
+  rpl_ns_init();
+#endif /* RPL_WITH_NON_STORING */
   rpl_reset_periodic_timer();
   rpl_icmp6_register_handlers();
 
@@ -114,6 +114,10 @@ struct rpl_parent {
   rpl_metric_container_t mc;
 #endif /* RPL_DAG_MC != RPL_DAG_MC_NONE */
   rpl_rank_t rank;
+  /* Path cost through the parent when it was last ranked, and its
+     place among the candidate parents of its DAG */
+  uint16_t path_cost;
+  uint8_t heap_index;
   uint8_t dtsn;
   uint8_t flags;
 };
@@ -142,6 +146,9 @@ struct rpl_dag {
   rpl_rank_t rank;
   struct rpl_instance *instance;
   rpl_prefix_t prefix_info;
+  /* The candidate parents, in a binary min-heap by path cost */
+  rpl_parent_t *parent_heap[NBR_TABLE_MAX_NEIGHBORS];
+  uint8_t parent_heap_len;
 };
 typedef struct rpl_dag rpl_dag_t;
 typedef struct rpl_instance rpl_instance_t;
@@ -180,6 +187,13 @@ typedef struct rpl_instance rpl_instance_t;
  *  Updates the metric container for outgoing DIOs in a certain DAG.
  *  If the objective function of the DAG does not use metric containers, 
  *  the function should set the object type to RPL_DAG_MC_NONE.
+ *
+ * parent_path_cost(parent)
+ *
+ *  Returns the cost of the path through a parent, lower being better, in
+ *  the terms best_parent() compares parents in. RPL keeps the candidate
+ *  parents ordered by it and compares only the cheapest one with the
+ *  preferred parent. An OF without it has all its parents compared.
  */
 struct rpl_of {
   void (*reset)(struct rpl_dag *);
@@ -189,6 +203,7 @@ struct rpl_of {
   rpl_rank_t (*calculate_rank)(rpl_parent_t *, rpl_rank_t);
   void (*update_metric_container)( rpl_instance_t *);
   rpl_ocp_t ocp;
+  uint16_t (*parent_path_cost)(rpl_parent_t *);
 };
 typedef struct rpl_of rpl_of_t;
 
@@ -245,6 +260,9 @@ int rpl_verify_header(int);
 void rpl_insert_header(void);
 void rpl_remove_header(void);
 uint8_t rpl_invert_header(void);
+int rpl_update_header_srh(void);
+int rpl_process_srh_header(void);
+int rpl_srh_get_next_hop(uip_ipaddr_t *ipaddr);
 uip_ipaddr_t *rpl_get_parent_ipaddr(rpl_parent_t *nbr);
 rpl_parent_t *rpl_get_parent(uip_lladdr_t *addr);
 rpl_rank_t rpl_get_parent_rank(uip_lladdr_t *addr);
@@ -0,0 +1,487 @@
+/**
+ * \addtogroup rimequeuebuf
+ * @{
+ */
+
+/**
+ * \file
+ *    Implementation of the spill store for queued packets
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "sys/ctimer.h"
+#include "lib/assert.h"
+#include "net/spillbuf.h"
+
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#if SPILLBUF_SEGMENTS > 10
+#error "SPILLBUF_CONF_SEGMENTS cannot be greater than 10"
+#endif
+
+#if SPILLBUF_SEGMENTS < 2
+#error "SPILLBUF_CONF_SEGMENTS must be at least 2"
+#endif
+
+#if SPILLBUF_NUM > 127
+#error "SPILLBUF_CONF_NUM cannot be greater than 127"
+#endif
+
+/* Whatever the records are updated, a segment can always be cleaned to
+   make room for one more (see append()) */
+CTASSERT((unsigned long)SPILLBUF_NUM * SPILLBUF_RECORD_MAXLEN <=
+         (unsigned long)(SPILLBUF_SEGMENTS - 1) *
+         (SPILLBUF_SEGMENT_SIZE - SPILLBUF_RECORD_MAXLEN));
+
+/* Bytes copied at a time when records are moved */
+#define COPY_CHUNK 32
+
+/* The segment of a free record */
+#define NO_SEGMENT 0xff
+
+/* Where a record is in the log */
+struct record {
+  uint16_t offset;
+  uint16_t len;
+  uint8_t segment;
+};
+
+/* A segment file. Records are appended at its end. */
+struct segment {
+  int fd;
+  uint16_t end;
+  /* Number of records whose current copy is in the segment, and their length */
+  uint8_t live;
+  uint16_t live_len;
+  /* The segment holds no live record and is to be removed */
+  uint8_t stale;
+};
+
+struct cache_entry {
+  int8_t id;
+  /* Prefetched and not yet read */
+  uint8_t ahead;
+  /* Time of the last use, for LRU replacement */
+  uint8_t used;
+  uint32_t data[(SPILLBUF_RECORD_MAXLEN + 3) / 4];
+};
+
+static struct record records[SPILLBUF_NUM];
+static struct segment segments[SPILLBUF_SEGMENTS];
+static struct cache_entry cache[SPILLBUF_CACHE_NUM];
+
+/* The segment records are appended to */
+static uint8_t head;
+static uint8_t use_clock;
+static uint8_t initialized;
+static struct ctimer renew_timer;
+/*---------------------------------------------------------------------------*/
+static void
+renew_segment(uint8_t i)
+{
+  char name[] = "spill0";
+
+  name[sizeof(name) - 2] += i;
+  if(segments[i].fd >= 0) {
+    cfs_close(segments[i].fd);
+  }
+  cfs_remove(name);
+  segments[i].fd = cfs_open(name, CFS_READ | CFS_WRITE);
+  if(segments[i].fd < 0) {
+    PRINTF("spillbuf: cannot open segment %u\n", i);
+  }
+  segments[i].end = 0;
+  segments[i].live = 0;
+  segments[i].live_len = 0;
+  segments[i].stale = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Remove the stale segments, out of the way of appends */
+static void
+renew_stale(void *ptr)
+{
+  uint8_t i;
+
+  for(i = 0; i < SPILLBUF_SEGMENTS; i++) {
+    if(segments[i].stale) {
+      renew_segment(i);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The current copy of record r is no longer in its segment */
+static void
+segment_release(struct record *r)
+{
+  struct segment *s = &segments[r->segment];
+
+  s->live--;
+  s->live_len -= r->len;
+  if(s->live == 0 && r->segment != head) {
+    s->stale = 1;
+    ctimer_set(&renew_timer, 0, renew_stale, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Make segment i, which holds no live record, the one appended to */
+static void
+segment_open(uint8_t i)
+{
+  if(segments[i].stale || segments[i].end > 0) {
+    renew_segment(i);
+  }
+  if(segments[head].live == 0) {
+    segments[head].stale = 1;
+    ctimer_set(&renew_timer, 0, renew_stale, NULL);
+  }
+  head = i;
+}
+/*---------------------------------------------------------------------------*/
+/* Copy len bytes at offset from of segment i to the end of the head */
+static int
+copy_to_head(uint8_t i, uint16_t from, uint16_t len)
+{
+  uint8_t buf[COPY_CHUNK];
+  struct segment *src = &segments[i];
+  struct segment *dst = &segments[head];
+  uint16_t n;
+
+  while(len > 0) {
+    n = len < sizeof(buf) ? len : sizeof(buf);
+    if(cfs_seek(src->fd, from, CFS_SEEK_SET) != from ||
+       cfs_read(src->fd, buf, n) != n ||
+       cfs_seek(dst->fd, dst->end, CFS_SEEK_SET) != dst->end ||
+       cfs_write(dst->fd, buf, n) != n) {
+      return -1;
+    }
+    from += n;
+    dst->end += n;
+    len -= n;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Move the live records of the segment that has the fewest live bytes to
+ * the empty segment e, which becomes the head. The cleaned segment is
+ * empty then, and is renewed in the background.
+ */
+static int
+clean(uint8_t e)
+{
+  struct record *r;
+  uint8_t victim = NO_SEGMENT;
+  uint8_t i;
+  uint16_t offset;
+
+  for(i = 0; i < SPILLBUF_SEGMENTS; i++) {
+    if(i != e && (victim == NO_SEGMENT ||
+                  segments[i].live_len < segments[victim].live_len)) {
+      victim = i;
+    }
+  }
+  PRINTF("spillbuf: moving %u records of segment %u to %u\n",
+         segments[victim].live, victim, e);
+
+  segment_open(e);
+  for(r = records; r < &records[SPILLBUF_NUM]; r++) {
+    if(r->segment != victim) {
+      continue;
+    }
+    offset = segments[head].end;
+    if(segments[head].fd < 0 || copy_to_head(victim, r->offset, r->len) < 0) {
+      PRINTF("spillbuf: cannot move record %d\n", (int)(r - records));
+      return -1;
+    }
+    segments[victim].live--;
+    segments[victim].live_len -= r->len;
+    r->segment = head;
+    r->offset = offset;
+    segments[head].live++;
+    segments[head].live_len += r->len;
+  }
+  segments[victim].stale = 1;
+  ctimer_set(&renew_timer, 0, renew_stale, NULL);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Append a copy of a record to the log. When the head is full, the next
+ * empty segment of the ring takes over. One empty segment is kept in
+ * reserve: when it is the last one, the live records of another segment
+ * are moved to it instead, so that the store only runs out of room when
+ * the records themselves fill it.
+ */
+static int
+append(struct record *r, const void *data, uint16_t len)
+{
+  struct segment *s;
+  uint8_t i, empty, first, rounds;
+
+  if(len > SPILLBUF_RECORD_MAXLEN || len > SPILLBUF_SEGMENT_SIZE) {
+    return -1;
+  }
+
+  for(rounds = 0; segments[head].end + len > SPILLBUF_SEGMENT_SIZE; rounds++) {
+    empty = 0;
+    first = NO_SEGMENT;
+    for(i = 1; i < SPILLBUF_SEGMENTS; i++) {
+      if(segments[(head + i) % SPILLBUF_SEGMENTS].live == 0) {
+        if(first == NO_SEGMENT) {
+          first = (head + i) % SPILLBUF_SEGMENTS;
+        }
+        empty++;
+      }
+    }
+    if(first == NO_SEGMENT || rounds == SPILLBUF_SEGMENTS) {
+      PRINTF("spillbuf: full\n");
+      return -1;
+    }
+    if(empty > 1) {
+      segment_open(first);
+    } else if(clean(first) < 0) {
+      return -1;
+    }
+  }
+
+  s = &segments[head];
+  if(s->fd < 0 ||
+     cfs_seek(s->fd, s->end, CFS_SEEK_SET) != s->end ||
+     cfs_write(s->fd, data, len) != len) {
+    PRINTF("spillbuf: cannot write segment %u\n", head);
+    return -1;
+  }
+  r->segment = head;
+  r->offset = s->end;
+  r->len = len;
+  s->end += len;
+  s->live++;
+  s->live_len += len;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static struct cache_entry *
+cache_lookup(int id)
+{
+  uint8_t i;
+
+  for(i = 0; i < SPILLBUF_CACHE_NUM; i++) {
+    if(cache[i].id == id) {
+      return &cache[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static struct cache_entry *
+cache_entry_of(const void *data)
+{
+  uint8_t i;
+
+  for(i = 0; i < SPILLBUF_CACHE_NUM; i++) {
+    if(data == cache[i].data) {
+      return &cache[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The buffer to replace: a free one, else the least recently used one that
+ * is not waiting to be read. Unless for a prefetch, a prefetched buffer is
+ * taken when there is no other.
+ */
+static struct cache_entry *
+cache_victim(uint8_t prefetch)
+{
+  struct cache_entry *victim = NULL;
+  uint8_t i;
+
+  for(i = 0; i < SPILLBUF_CACHE_NUM; i++) {
+    if(cache[i].id < 0) {
+      return &cache[i];
+    }
+    if(cache[i].ahead && prefetch) {
+      continue;
+    }
+    if(victim == NULL || (victim->ahead && !cache[i].ahead) ||
+       (victim->ahead == cache[i].ahead &&
+        (uint8_t)(use_clock - cache[i].used) > (uint8_t)(use_clock - victim->used))) {
+      victim = &cache[i];
+    }
+  }
+  return victim;
+}
+/*---------------------------------------------------------------------------*/
+static void
+cache_load(struct cache_entry *c, int id)
+{
+  struct record *r = &records[id];
+  struct segment *s = &segments[r->segment];
+
+  c->id = id;
+  if(s->fd < 0 ||
+     cfs_seek(s->fd, r->offset, CFS_SEEK_SET) != r->offset ||
+     cfs_read(s->fd, c->data, r->len) != r->len) {
+    PRINTF("spillbuf: cannot read record %d\n", id);
+    memset(c->data, 0, sizeof(c->data));
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+spillbuf_init(void)
+{
+  uint8_t i;
+
+  if(initialized) {
+    return;
+  }
+  initialized = 1;
+  for(i = 0; i < SPILLBUF_NUM; i++) {
+    records[i].segment = NO_SEGMENT;
+  }
+  for(i = 0; i < SPILLBUF_CACHE_NUM; i++) {
+    cache[i].id = -1;
+  }
+  for(i = 0; i < SPILLBUF_SEGMENTS; i++) {
+    segments[i].fd = -1;
+    renew_segment(i);
+  }
+  head = 0;
+}
+/*---------------------------------------------------------------------------*/
+void *
+spillbuf_scratch(void)
+{
+  struct cache_entry *c = cache_victim(0);
+
+  c->id = -1;
+  c->ahead = 0;
+  return c->data;
+}
+/*---------------------------------------------------------------------------*/
+int
+spillbuf_put(const void *data, uint16_t len)
+{
+  struct cache_entry *c;
+  int id;
+
+  for(id = 0; id < SPILLBUF_NUM; id++) {
+    if(records[id].segment == NO_SEGMENT) {
+      break;
+    }
+  }
+  if(id == SPILLBUF_NUM || append(&records[id], data, len) < 0) {
+    return -1;
+  }
+
+  c = cache_entry_of(data);
+  if(c != NULL) {
+    c->id = id;
+    c->used = use_clock++;
+  }
+  return id;
+}
+/*---------------------------------------------------------------------------*/
+int
+spillbuf_update(int id, const void *data, uint16_t len)
+{
+  struct record r;
+  struct cache_entry *c;
+
+  if(append(&r, data, len) < 0) {
+    /* A cached copy that was modified no longer matches the record */
+    c = cache_entry_of(data);
+    if(c != NULL) {
+      c->id = -1;
+      c->ahead = 0;
+    }
+    return -1;
+  }
+  segment_release(&records[id]);
+  records[id] = r;
+
+  /* Keep the cache coherent with the new copy */
+  c = cache_lookup(id);
+  if(c != NULL && c->data != data) {
+    c->id = -1;
+    c->ahead = 0;
+  }
+  c = cache_entry_of(data);
+  if(c != NULL) {
+    c->id = id;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void *
+spillbuf_get(int id)
+{
+  struct cache_entry *c = cache_lookup(id);
+
+  if(c == NULL) {
+    c = cache_victim(0);
+    cache_load(c, id);
+  }
+  c->ahead = 0;
+  c->used = use_clock++;
+  return c->data;
+}
+/*---------------------------------------------------------------------------*/
+void
+spillbuf_prefetch(int id)
+{
+  struct cache_entry *c = cache_lookup(id);
+
+  if(c == NULL) {
+    c = cache_victim(1);
+    if(c == NULL) {
+      return;
+    }
+    cache_load(c, id);
+  }
+  c->ahead = 1;
+  c->used = use_clock++;
+}
+/*---------------------------------------------------------------------------*/
+void
+spillbuf_free(int id)
+{
+  struct cache_entry *c = cache_lookup(id);
+
+  if(c != NULL) {
+    c->id = -1;
+    c->ahead = 0;
+  }
+  segment_release(&records[id]);
+  records[id].segment = NO_SEGMENT;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+spillbuf_len(int id)
+{
+  return records[id].len;
+}
+/*---------------------------------------------------------------------------*/
+int
+spillbuf_numfree(void)
+{
+  int n = 0;
+  uint8_t i;
+
+  for(i = 0; i < SPILLBUF_NUM; i++) {
+    n += records[i].segment == NO_SEGMENT;
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
@@ -0,0 +1,146 @@
+/**
+ * \addtogroup rimequeuebuf
+ * @{
+ */
+
+/**
+ * \file
+ *    Spill store for queued packets
+ * \details
+ *    The spill store keeps packets that do not fit in RAM in CFS (Coffee
+ *    on most platforms). Its user is queuebuf, whose buffers are spilled
+ *    when QUEUEBUFRAM_NUM is lower than QUEUEBUF_NUM, so that the packets
+ *    queued by CSMA, 6LoWPAN fragmentation or any other queuebuf user are
+ *    all served by the same store.
+ *
+ *    The store is a log: records are appended to a ring of
+ *    SPILLBUF_SEGMENTS files of SPILLBUF_SEGMENT_SIZE bytes and never
+ *    written in place. An updated record is appended again, and a segment
+ *    whose records are all freed or updated is removed in the background
+ *    and reused once the ring wraps. Flash is thus written sequentially,
+ *    and a segment is erased as a whole rather than record by record.
+ *    When a few long-lived records would keep every segment in use, they
+ *    are moved to the one segment kept empty for this, and their segment
+ *    is reused.
+ *
+ *    Where a record lives is only known by an index in RAM: the store is
+ *    emptied by spillbuf_init() and does not survive a reboot.
+ *
+ *    Records are read through a cache of SPILLBUF_CACHE_NUM buffers.
+ *    spillbuf_prefetch() loads a record before it is needed, so that a
+ *    layer that knows what it is going to send next, like CSMA when it
+ *    hands a queue to the RDC layer, does not make the radio wait on
+ *    flash. Prefetched records are kept in the cache until they are read.
+ */
+
+#ifndef SPILLBUF_H_
+#define SPILLBUF_H_
+
+#include "net/packetbuf.h"
+
+/* Number of records in the store. The default is the default QUEUEBUF_NUM. */
+#ifdef SPILLBUF_CONF_NUM
+#define SPILLBUF_NUM SPILLBUF_CONF_NUM
+#else
+#define SPILLBUF_NUM 8
+#endif
+
+/* Number of segment files of the ring */
+#ifdef SPILLBUF_CONF_SEGMENTS
+#define SPILLBUF_SEGMENTS SPILLBUF_CONF_SEGMENTS
+#else
+#define SPILLBUF_SEGMENTS 4
+#endif
+
+/* Largest record. The default holds a packetbuf with its attributes. */
+#ifdef SPILLBUF_CONF_RECORD_MAXLEN
+#define SPILLBUF_RECORD_MAXLEN SPILLBUF_CONF_RECORD_MAXLEN
+#else
+#define SPILLBUF_RECORD_MAXLEN (sizeof(uint16_t) + PACKETBUF_SIZE + \
+    PACKETBUF_NUM_ATTRS * sizeof(struct packetbuf_attr) +          \
+    PACKETBUF_NUM_ADDRS * sizeof(struct packetbuf_addr))
+#endif
+
+/* Size of a segment file. With Coffee, COFFEE_DYN_SIZE should be at least
+   this large for a segment to be written without being extended.
+
+   The store keeps one segment empty to clean the others, so that
+   SPILLBUF_NUM records of SPILLBUF_RECORD_MAXLEN bytes fit in the other
+   segments however often they are updated, as long as
+
+   SPILLBUF_NUM * SPILLBUF_RECORD_MAXLEN <=
+     (SPILLBUF_SEGMENTS - 1) * (SPILLBUF_SEGMENT_SIZE - SPILLBUF_RECORD_MAXLEN)
+
+   which the default is the smallest size for. */
+#ifdef SPILLBUF_CONF_SEGMENT_SIZE
+#define SPILLBUF_SEGMENT_SIZE SPILLBUF_CONF_SEGMENT_SIZE
+#else
+#define SPILLBUF_SEGMENT_SIZE (SPILLBUF_RECORD_MAXLEN + \
+    (SPILLBUF_NUM * SPILLBUF_RECORD_MAXLEN + SPILLBUF_SEGMENTS - 2) / \
+    (SPILLBUF_SEGMENTS - 1))
+#endif
+
+/* Number of records cached in RAM */
+#ifdef SPILLBUF_CONF_CACHE_NUM
+#define SPILLBUF_CACHE_NUM SPILLBUF_CONF_CACHE_NUM
+#else
+#define SPILLBUF_CACHE_NUM 2
+#endif
+
+/**
+ * \brief Empty the store. Calls after the first one do nothing.
+ */
+void spillbuf_init(void);
+
+/**
+ * \brief  A cache buffer of SPILLBUF_RECORD_MAXLEN bytes to build a record in
+ *
+ *         A record put from this buffer stays in the cache. The buffer is
+ *         only valid until the next call to the store.
+ */
+void *spillbuf_scratch(void);
+
+/**
+ * \brief  Append a new record to the store
+ * \return The ID of the record, or -1 if the store is full
+ */
+int spillbuf_put(const void *data, uint16_t len);
+
+/**
+ * \brief  Replace the content of a record, which keeps its ID
+ * \return 0, or -1 if the store is full, in which case the record is unchanged
+ */
+int spillbuf_update(int id, const void *data, uint16_t len);
+
+/**
+ * \brief  The content of a record, read from flash unless it is cached
+ *
+ *         The buffer is valid until the cache needs it for another record,
+ *         and is zeroed if the record cannot be read.
+ */
+void *spillbuf_get(int id);
+
+/**
+ * \brief Cache a record that is going to be read soon, if a buffer is
+ *        free of other prefetched records
+ */
+void spillbuf_prefetch(int id);
+
+/**
+ * \brief Free a record
+ */
+void spillbuf_free(int id);
+
+/**
+ * \brief The length of a record
+ */
+uint16_t spillbuf_len(int id);
+
+/**
+ * \brief Number of records that can still be put in the store
+ */
+int spillbuf_numfree(void);
+
+#endif /* SPILLBUF_H_ */
+
+/** @} */
@@ -517,9 +517,24 @@ encrypt(uint8_t *plaintext_and_result)
   RELEASE_LOCK();
 }
 /*---------------------------------------------------------------------------*/
+static void
+expand_key(const uint8_t *key, uint8_t *schedule)
+{
+  /* the CC2420 expands keys itself */
+  memcpy(schedule, key, AES_128_KEY_LENGTH);
+}
+/*---------------------------------------------------------------------------*/
+static void
+load_key_schedule(const uint8_t *schedule)
+{
+  set_key((uint8_t *)schedule);
+}
+/*---------------------------------------------------------------------------*/
 const struct aes_128_driver cc2420_aes_128_driver = {
   set_key,
-  encrypt
+  encrypt,
+  expand_key,
+  load_key_schedule
 };
 /*---------------------------------------------------------------------------*/
 static void
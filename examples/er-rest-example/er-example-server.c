@@ -79,6 +79,9 @@ extern resource_t res_leds, res_toggle;
 #include "dev/light-sensor.h"
 extern resource_t res_light;
 #endif
+#if WITH_CONF_IPSEC_STATS && WITH_CONF_IPSEC_ESP
+extern resource_t res_ipsec_stats;
+#endif
 /*
 #if PLATFORM_HAS_BATTERY
 #include "dev/battery-sensor.h"
@@ -141,6 +144,9 @@ PROCESS_THREAD(er_example_server, ev, data)
   rest_activate_resource(&res_light, "sensors/light"); 
   SENSORS_ACTIVATE(light_sensor);  
 #endif
+#if WITH_CONF_IPSEC_STATS && WITH_CONF_IPSEC_ESP
+  rest_activate_resource(&res_ipsec_stats, "ipsec/stats");
+#endif
 /*
 #if PLATFORM_HAS_BATTERY
   rest_activate_resource(&res_battery, "sensors/battery");  
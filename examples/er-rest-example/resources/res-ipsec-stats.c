@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2014, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *      IPsec statistics resource (see core/net/ipsec/ipsec_stats.h)
+ */
+
+#include "contiki.h"
+#include "ipsec_stats.h"
+
+#if WITH_IPSEC_STATS
+
+#include <string.h>
+#include "rest-engine.h"
+
+#define LINE_MAXLEN 64
+
+static void res_get_handler(void *request, void *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+
+/*
+ * One record per line, as given by ipsec_stats_line(). The representation is generated anew for
+ * every block; the part of it that falls within the requested block is copied to the buffer.
+ */
+RESOURCE(res_ipsec_stats,
+         "title=\"IPsec statistics\";rt=\"Text\"",
+         res_get_handler,
+         NULL,
+         NULL,
+         NULL);
+
+static void
+res_get_handler(void *request, void *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  char line[LINE_MAXLEN + 1];
+  int32_t pos = 0;
+  uint16_t strpos = 0;
+  uint16_t i, len;
+
+  for(i = 0; strpos < preferred_size && (len = ipsec_stats_line(i, line, LINE_MAXLEN)) > 0; ++i) {
+    line[len++] = '\n';
+    if(pos + len > *offset) {
+      /* This line overlaps the requested block */
+      uint16_t skip = *offset > pos ? *offset - pos : 0;
+      uint16_t n = len - skip;
+      if(n > preferred_size - strpos) {
+        n = preferred_size - strpos;
+      }
+      memcpy(buffer + strpos, line + skip, n);
+      strpos += n;
+    }
+    pos += len;
+  }
+
+  if(strpos == 0 && *offset > 0) {
+    REST.set_response_status(response, REST.status.BAD_OPTION);
+    /* A block error message should not exceed the minimum block size (16). */
+    const char *error_msg = "BlockOutOfScope";
+    REST.set_response_payload(response, error_msg, strlen(error_msg));
+    return;
+  }
+
+  REST.set_header_content_type(response, REST.type.TEXT_PLAIN);
+  REST.set_response_payload(response, buffer, strpos);
+
+  /* Signal the end of the representation unless the block was filled */
+  if(strpos < preferred_size || (ipsec_stats_line(i, line, LINE_MAXLEN) == 0 && pos <= *offset + strpos)) {
+    *offset = -1;
+  } else {
+    *offset += strpos;
+  }
+}
+#endif /* WITH_IPSEC_STATS */
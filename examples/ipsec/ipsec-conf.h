@@ -28,6 +28,27 @@
 /* The IKE subsystem is optional if the SAs are manually configured */
 #define WITH_CONF_IPSEC_IKE             1
 
+/*
+ * IKEv2 session resumption (RFC 5723). Tickets are kept in CFS, which must be
+ * available on the platform (e.g. Coffee). The build fails unless
+ * IKE_RESUME_CONF_DEVICE_KEY (or IPSEC_SAD_STORE_CONF_DEVICE_KEY) is set to a
+ * secret unique to the device. See core/net/ipsec/ike/resume.h
+ */
+#define WITH_CONF_IPSEC_IKE_RESUME      0
+
+/*
+ * Checkpoint the SAs negotiated by IKE to CFS and restore them at boot, avoiding
+ * renegotiation after a reset. The build fails unless IPSEC_SAD_STORE_CONF_DEVICE_KEY
+ * is set to a secret unique to the device. See core/net/ipsec/sad_store.h
+ */
+#define WITH_CONF_IPSEC_SAD_STORE       0
+
+/*
+ * Per-SA counters, drop reasons and transform timing. Query them with the shell
+ * command ipsec-stats or the CoAP resource ipsec/stats. See core/net/ipsec/ipsec_stats.h
+ */
+#define WITH_CONF_IPSEC_STATS           0
+
 /*
  * Manual SA configuration allows you as developer to create persistent SAs in the SAD.
  * This is probably what you want to use if WITH_CONF_IPSEC_IKE is set 0, but please note
@@ -44,10 +44,18 @@
 #include "net/ipv6/multicast/uip-mcast6-engines.h"
 
 /* Change this to switch engines. Engine codes in uip-mcast6-engines.h */
+#ifndef UIP_MCAST6_CONF_ENGINE
 #define UIP_MCAST6_CONF_ENGINE UIP_MCAST6_ENGINE_ROLL_TM
+#endif
 
 /* For Imin: Use 16 over NullRDC, 64 over Contiki MAC */
 #define ROLL_TM_CONF_IMIN_1         64
+#define MPL_CONF_DATA_MESSAGE_IMIN  64
+
+/* MPL subscribes to the link-scoped addresses of FF03::FC and our group */
+#if UIP_MCAST6_CONF_ENGINE == UIP_MCAST6_ENGINE_MPL
+#define UIP_CONF_DS6_MADDR_NBU       2
+#endif
 
 #undef UIP_CONF_IPV6_RPL
 #undef UIP_CONF_ND6_SEND_RA
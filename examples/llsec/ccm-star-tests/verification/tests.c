@@ -64,9 +64,12 @@ test_aes_128()
                          0x6A , 0x7B , 0x04 , 0x30 ,
                          0xD8 , 0xCD , 0xB7 , 0x80 ,
                          0x70 , 0xB4 , 0xC5 , 0x5A };
+  uint8_t schedule[AES_128_KEY_SCHEDULE_LENGTH];
+  uint8_t plaintext[16];
   
   printf("Testing AES-128 ... ");
   
+  memcpy(plaintext, data, 16);
   AES_128.set_key(key);
   AES_128.encrypt(data);
   
@@ -75,6 +78,19 @@ test_aes_128()
   } else {
     printf("Failure\n");
   }
+  
+  printf("Testing AES-128 with a key schedule ... ");
+  
+  AES_128.expand_key(key, schedule);
+  AES_128.set_key(plaintext);
+  AES_128.load_key_schedule(schedule);
+  AES_128.encrypt(plaintext);
+  
+  if(memcmp(plaintext, oracle, 16) == 0) {
+    printf("Success\n");
+  } else {
+    printf("Failure\n");
+  }
 }
 /*---------------------------------------------------------------------------*/
 /* Test vector C.2.1.2 from IEEE 802.15.4-2006 */
@@ -120,6 +136,17 @@ test_sec_lvl_2()
   } else {
     printf("Failure\n");
   }
+  
+  printf("Testing single-pass verification ... ");
+  
+  memset(mic, 0, LLSEC802154_MIC_LENGTH);
+  CCM_STAR.aead(extended_source_address, mic, LLSEC802154_MIC_LENGTH, 0);
+  
+  if(memcmp(mic, oracle, LLSEC802154_MIC_LENGTH) == 0) {
+    printf("Success\n");
+  } else {
+    printf("Failure\n");
+  }
 }
 /*---------------------------------------------------------------------------*/
 PROCESS(ccm_star_tests_process, "CCM* tests process");
@@ -214,6 +214,7 @@
 
 #ifndef AES_128_CONF
 #define AES_128_CONF cc2420_aes_128_driver
+#define AES_128_CONF_KEY_SCHEDULE_LENGTH 16
 #endif /* AES_128_CONF */
 
 /* include the project config */
@@ -7004,7 +7004,20 @@ make receiver-node.cooja TARGET=cooja</commands>
 &#xD;
 lostMsgs = 0;&#xD;
 &#xD;
-TIMEOUT(1000000, if(lastMsg != -1 &amp;&amp; lostMsgs == 0) { log.testOK(); } );&#xD;
+/* Count the radio transmissions */&#xD;
+transmissions = 0;&#xD;
+lastConn = null;&#xD;
+sim.getRadioMedium().addRadioMediumObserver(new java.util.Observer({&#xD;
+  update: function(obs, obj) {&#xD;
+    conn = sim.getRadioMedium().getLastConnection();&#xD;
+    if(conn != null &amp;&amp; conn != lastConn) {&#xD;
+      transmissions++;&#xD;
+      lastConn = conn;&#xD;
+    }&#xD;
+  }&#xD;
+}));&#xD;
+&#xD;
+TIMEOUT(1000000, log.log("Radio transmissions: " + transmissions + "\n"); if(lastMsg != -1 &amp;&amp; lostMsgs == 0) { log.testOK(); } );&#xD;
 &#xD;
 lastMsg = -1;&#xD;
 packets = "_________";&#xD;
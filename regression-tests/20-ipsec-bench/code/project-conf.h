@@ -0,0 +1,20 @@
+#ifndef __PROJECT_CONF_H__
+#define __PROJECT_CONF_H__
+
+/* ESP with manually keyed SAs only. The SAs are created by the benchmark. */
+#define WITH_CONF_IPSEC_ESP             1
+#define WITH_CONF_IPSEC_IKE             0
+#define WITH_CONF_MANUAL_SA             0
+
+/* Debug output in the data path would dominate the measurements */
+#define IPSEC_CONF_DEBUG                0
+
+#define CRYPTO_CONF_AES miracl_aes
+
+#undef UIP_CONF_BUFFER_SIZE
+#define UIP_CONF_BUFFER_SIZE            1280
+
+#undef UIP_CONF_UDP_CONNS
+#define UIP_CONF_UDP_CONNS              4
+
+#endif /* __PROJECT_CONF_H__ */
@@ -0,0 +1,11 @@
+#ifndef __PROJECT_CONF_H__
+#define __PROJECT_CONF_H__
+
+/* A border router with a large routing table */
+#undef UIP_CONF_MAX_ROUTES
+#define UIP_CONF_MAX_ROUTES             1024
+
+#define UIP_DS6_ROUTE_CONF_INDEX        1
+#define UIP_DS6_ROUTE_CONF_HASH_SIZE    256
+
+#endif /* __PROJECT_CONF_H__ */
@@ -0,0 +1,196 @@
+/**
+ * \file
+ *         Native benchmark of routing table lookups
+ * \details
+ *         Fills the routing table with host routes, as a storing mode RPL root does, and a
+ *         few prefix routes of different lengths. Then it looks up destinations that hit a
+ *         host route, that only match a prefix route and that match no route at all.
+ *
+ *         Every lookup is checked against a longest prefix match scan of the route list,
+ *         which is also timed for comparison. The benchmark prints one CSV row per kind of
+ *         destination with the nanoseconds per lookup of both, and exits with status 1 if
+ *         they disagree.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/ip/uip-debug.h"
+
+#ifndef ROUTE_BENCH_LOOKUPS
+#define ROUTE_BENCH_LOOKUPS 100000
+#endif
+
+#define NEXTHOPS        4
+#define PREFIX_ROUTES   24
+#define HOST_ROUTES     (UIP_DS6_ROUTE_NB - PREFIX_ROUTES)
+#define DESTINATIONS    256
+
+enum { HOST, PREFIX, MISS, KINDS };
+static const char *const kind_names[KINDS] = { "host", "prefix", "miss" };
+
+static uip_ipaddr_t nexthop[NEXTHOPS];
+static uip_ipaddr_t dest[KINDS][DESTINATIONS];
+
+PROCESS(route_bench_process, "Route lookup benchmark");
+AUTOSTART_PROCESSES(&route_bench_process);
+/*---------------------------------------------------------------------------*/
+static uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+/* Host addresses derived from 802.15.4 EUI-64s, as they are in a DODAG */
+static void
+host_addr(uip_ipaddr_t *addr, uint16_t prefix, uint16_t i)
+{
+  uip_ip6addr(addr, prefix, 0, 0, 0, 0x0212, 0x7400, i >> 8, (i << 8) | (i & 0xff));
+}
+/*---------------------------------------------------------------------------*/
+/* The lookup without index: a longest prefix match scan of the route list */
+static uip_ds6_route_t *
+scan(uip_ipaddr_t *addr)
+{
+  uip_ds6_route_t *r;
+  uip_ds6_route_t *found = NULL;
+
+  for(r = uip_ds6_route_head(); r != NULL; r = uip_ds6_route_next(r)) {
+    if((found == NULL || r->length > found->length) &&
+       uip_ipaddr_prefixcmp(addr, &r->ipaddr, r->length)) {
+      found = r;
+      if(r->length == 128) {
+        break;
+      }
+    }
+  }
+  return found;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_route(uip_ipaddr_t *addr, uint8_t length, uint16_t i)
+{
+  if(uip_ds6_route_add(addr, length, &nexthop[i % NEXTHOPS]) == NULL) {
+    printf("route-bench: Could not add route\n");
+    exit(1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+check(void)
+{
+  uint8_t k;
+  uint16_t i;
+
+  for(k = 0; k < KINDS; k++) {
+    for(i = 0; i < DESTINATIONS; i++) {
+      if(uip_ds6_route_lookup(&dest[k][i]) != scan(&dest[k][i])) {
+        printf("route-bench: Lookup of ");
+        uip_debug_ipaddr_print(&dest[k][i]);
+        printf(" differs from the scan\n");
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(uint8_t kind)
+{
+  uint64_t t, lookup_ns, scan_ns;
+  uint32_t n;
+  volatile uintptr_t sink = 0;
+
+  t = now_ns();
+  for(n = 0; n < ROUTE_BENCH_LOOKUPS; n++) {
+    sink ^= (uintptr_t)uip_ds6_route_lookup(&dest[kind][n % DESTINATIONS]);
+  }
+  lookup_ns = now_ns() - t;
+
+  t = now_ns();
+  for(n = 0; n < ROUTE_BENCH_LOOKUPS; n++) {
+    sink ^= (uintptr_t)scan(&dest[kind][n % DESTINATIONS]);
+  }
+  scan_ns = now_ns() - t;
+
+  printf("%d,%s,%u,%lu.%02lu,%lu.%02lu\n",
+         uip_ds6_route_num_routes(), kind_names[kind], ROUTE_BENCH_LOOKUPS,
+         (unsigned long)(lookup_ns / ROUTE_BENCH_LOOKUPS),
+         (unsigned long)(lookup_ns * 100 / ROUTE_BENCH_LOOKUPS % 100),
+         (unsigned long)(scan_ns / ROUTE_BENCH_LOOKUPS),
+         (unsigned long)(scan_ns * 100 / ROUTE_BENCH_LOOKUPS % 100));
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(route_bench_process, ev, data)
+{
+  uip_lladdr_t lladdr;
+  uip_ipaddr_t addr;
+  uip_ds6_route_t *r;
+  uint16_t i;
+  uint8_t k;
+  uint8_t ok;
+
+  PROCESS_BEGIN();
+
+  for(i = 0; i < NEXTHOPS; i++) {
+    memset(&lladdr, 0, sizeof(lladdr));
+    lladdr.addr[sizeof(lladdr.addr) - 1] = i + 1;
+    uip_ip6addr(&nexthop[i], 0xfe80, 0, 0, 0, 0, 0, 0, i + 1);
+    uip_ds6_nbr_add(&nexthop[i], &lladdr, 1, NBR_REACHABLE);
+  }
+
+  /* Prefix routes of different lengths, none of them of equal length
+     matching the same destination */
+  for(i = 0; i < PREFIX_ROUTES / 3; i++) {
+    uip_ip6addr(&addr, 0xbbbb, i, 0, 0, 0, 0, 0, 0);
+    add_route(&addr, 32, i);
+    uip_ip6addr(&addr, 0xbbbb, i, 1, 0, 0, 0, 0, 0);
+    add_route(&addr, 48, i + 1);
+    uip_ip6addr(&addr, 0xbbbb, i, 1, 1, 0, 0, 0, 0);
+    add_route(&addr, 64, i + 2);
+  }
+  for(i = 0; i < HOST_ROUTES; i++) {
+    host_addr(&addr, 0xaaaa, i);
+    add_route(&addr, 128, i);
+  }
+
+  for(i = 0; i < DESTINATIONS; i++) {
+    host_addr(&dest[HOST][i], 0xaaaa, (i * 7919) % HOST_ROUTES);
+    uip_ip6addr(&dest[PREFIX][i], 0xbbbb, i % (PREFIX_ROUTES / 3), i % 3 ? 1 : 2,
+                i % 3 == 2 ? 1 : 0, 0, 0, 0, i);
+    host_addr(&dest[MISS][i], 0xcccc, i);
+  }
+
+  printf("routes,destination,lookups,lookup_ns,scan_ns\n");
+
+  ok = check();
+  for(k = 0; k < KINDS && ok; k++) {
+    run(k);
+  }
+
+  /* The index has to follow the removal and replacement of routes */
+  for(i = 0, r = uip_ds6_route_head(); r != NULL; i++) {
+    uip_ds6_route_t *next = uip_ds6_route_next(r);
+    if(i % 2) {
+      uip_ds6_route_rm(r);
+    }
+    r = next;
+  }
+  for(i = 0; i < UIP_DS6_ROUTE_NB; i++) {
+    host_addr(&addr, 0xdddd, i);
+    add_route(&addr, 128, i);
+  }
+  ok = ok && check();
+
+  printf("route-bench: %s\n", ok ? "OK" : "FAIL");
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,227 @@
+/**
+ * \file
+ *         Native benchmark of the Internet checksum
+ * \details
+ *         Checks uip_chksum_add() against a reference byte-pairwise sum for every
+ *         alignment and a range of lengths, and uip_chksum_update() against a full
+ *         recomputation after rewriting the addresses of a packet's pseudo-header.
+ *
+ *         Then it times uip_chksum_add() over aligned and unaligned buffers of typical
+ *         packet sizes, and the incremental update after an address rewrite, each next to
+ *         the reference. The benchmark prints one CSV row per measurement with the
+ *         nanoseconds per call of both, and exits with status 1 if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "contiki.h"
+#include "contiki-net.h"
+
+#ifndef CHKSUM_BENCH_ROUNDS
+#define CHKSUM_BENCH_ROUNDS 100000
+#endif
+
+#define MAX_LEN 1280
+
+static const uint16_t sizes[] = { 40, 127, 256, 1280 };
+
+/* Aligned for the word-wise sum, with room to misalign it */
+static union {
+  uint32_t u32[(MAX_LEN + 8) / 4];
+  uint8_t u8[MAX_LEN + 8];
+} buf;
+
+PROCESS(chksum_bench_process, "Checksum benchmark");
+AUTOSTART_PROCESSES(&chksum_bench_process);
+/*---------------------------------------------------------------------------*/
+static uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+/* The byte-pairwise sum that uIP used before */
+static uint16_t
+reference(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  uint16_t t;
+  const uint8_t *dataptr;
+  const uint8_t *last_byte;
+
+  dataptr = data;
+  last_byte = data + len - 1;
+
+  while(dataptr < last_byte) {
+    t = (dataptr[0] << 8) + dataptr[1];
+    sum += t;
+    if(sum < t) {
+      sum++;
+    }
+    dataptr += 2;
+  }
+
+  if(dataptr == last_byte) {
+    t = (dataptr[0] << 8) + 0;
+    sum += t;
+    if(sum < t) {
+      sum++;
+    }
+  }
+  return sum;
+}
+/*---------------------------------------------------------------------------*/
+/* Both one's complement zeros are the same checksum */
+static uint8_t
+same_chksum(uint16_t a, uint16_t b)
+{
+  return a == b || ((uint16_t)(a + 1) <= 1 && (uint16_t)(b + 1) <= 1);
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+check_add(void)
+{
+  uint16_t len, sum;
+  uint8_t offset;
+
+  for(len = 0; len <= MAX_LEN; len += len < 64 ? 1 : 61) {
+    for(offset = 0; offset < 4; offset++) {
+      sum = random_rand();
+      if(!same_chksum(uip_chksum_add(sum, &buf.u8[offset], len),
+                      reference(sum, &buf.u8[offset], len))) {
+        printf("chksum-bench: Sum of %u bytes at offset %u differs from the reference\n",
+               len, offset);
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* The checksum of a packet whose pseudo-header addresses are at the start */
+static uint16_t
+packet_chksum(const uint8_t *packet, uint16_t len)
+{
+  return ~reference(0, packet, len);
+}
+/*---------------------------------------------------------------------------*/
+/* Replace the 32 bytes of addresses at the start of the packet */
+static uint16_t
+rewrite(uint8_t *packet, uint16_t chksum, uint8_t seed)
+{
+  uint16_t old_sum, new_sum;
+  uint8_t i;
+
+  old_sum = uip_chksum_add(0, packet, 32);
+  for(i = 0; i < 32; i++) {
+    packet[i] = seed * 13 + i;
+  }
+  new_sum = uip_chksum_add(0, packet, 32);
+  return uip_chksum_update(chksum, old_sum, new_sum);
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+check_update(void)
+{
+  uint16_t chksum;
+  uint16_t n;
+
+  chksum = packet_chksum(buf.u8, MAX_LEN);
+  for(n = 0; n < 1000; n++) {
+    chksum = rewrite(buf.u8, chksum, n);
+    if(!same_chksum(chksum, packet_chksum(buf.u8, MAX_LEN))) {
+      printf("chksum-bench: Updated checksum differs from the recomputed one\n");
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_row(const char *kind, uint16_t len, uint64_t ns, uint64_t reference_ns)
+{
+  printf("%s,%u,%u,%lu.%02lu,%lu.%02lu\n", kind, len, CHKSUM_BENCH_ROUNDS,
+         (unsigned long)(ns / CHKSUM_BENCH_ROUNDS),
+         (unsigned long)(ns * 100 / CHKSUM_BENCH_ROUNDS % 100),
+         (unsigned long)(reference_ns / CHKSUM_BENCH_ROUNDS),
+         (unsigned long)(reference_ns * 100 / CHKSUM_BENCH_ROUNDS % 100));
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_add(const char *kind, uint8_t offset, uint16_t len)
+{
+  uint64_t t, ns, reference_ns;
+  uint32_t n;
+  volatile uint16_t sink = 0;
+
+  t = now_ns();
+  for(n = 0; n < CHKSUM_BENCH_ROUNDS; n++) {
+    sink += uip_chksum_add(n, &buf.u8[offset], len);
+  }
+  ns = now_ns() - t;
+
+  t = now_ns();
+  for(n = 0; n < CHKSUM_BENCH_ROUNDS; n++) {
+    sink += reference(n, &buf.u8[offset], len);
+  }
+  reference_ns = now_ns() - t;
+
+  print_row(kind, len, ns, reference_ns);
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_update(uint16_t len)
+{
+  uint64_t t, ns, reference_ns;
+  uint32_t n;
+  volatile uint16_t sink = 0;
+  uint16_t chksum = packet_chksum(buf.u8, len);
+
+  t = now_ns();
+  for(n = 0; n < CHKSUM_BENCH_ROUNDS; n++) {
+    chksum = rewrite(buf.u8, chksum, n);
+  }
+  ns = now_ns() - t;
+  sink += chksum;
+
+  t = now_ns();
+  for(n = 0; n < CHKSUM_BENCH_ROUNDS; n++) {
+    rewrite(buf.u8, 0, n);
+    sink += packet_chksum(buf.u8, len);
+  }
+  reference_ns = now_ns() - t;
+
+  print_row("update", len, ns, reference_ns);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(chksum_bench_process, ev, data)
+{
+  uint16_t i;
+  uint8_t ok;
+
+  PROCESS_BEGIN();
+
+  for(i = 0; i < sizeof(buf.u8); i++) {
+    buf.u8[i] = random_rand();
+  }
+
+  printf("kind,bytes,rounds,ns,reference_ns\n");
+
+  ok = check_add() && check_update();
+  for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]) && ok; i++) {
+    run_add("aligned", 0, sizes[i]);
+    run_add("unaligned", 1, sizes[i]);
+  }
+  if(ok) {
+    run_update(MAX_LEN);
+  }
+
+  printf("chksum-bench: %s\n", ok ? "OK" : "FAIL");
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,8 @@
+#ifndef __PROJECT_CONF_H__
+#define __PROJECT_CONF_H__
+
+/* The largest IPv6 packets that uIP handles */
+#undef UIP_CONF_BUFFER_SIZE
+#define UIP_CONF_BUFFER_SIZE            1280
+
+#endif /* __PROJECT_CONF_H__ */
@@ -0,0 +1,11 @@
+#ifndef __PROJECT_CONF_H__
+#define __PROJECT_CONF_H__
+
+/* A gateway with many TCP connections */
+#undef UIP_CONF_MAX_CONNECTIONS
+#define UIP_CONF_MAX_CONNECTIONS        512
+
+/* Debug output in the data path would dominate the measurements */
+#define IPSEC_CONF_DEBUG                0
+
+#endif /* __PROJECT_CONF_H__ */
@@ -0,0 +1,286 @@
+/**
+ * \file
+ *         Native benchmark of the demultiplexing of incoming TCP segments
+ * \details
+ *         Opens 8, 64 and 512 connections from a few remote hosts to a listening port, with
+ *         a handshake each, and feeds the stack acknowledgements for random connections.
+ *         Every segment is checked to reach its own connection, a segment of an unknown
+ *         connection to draw a reset, and SYNs to reach exactly the ports still listened to
+ *         after some of them are unlistened.
+ *
+ *         The benchmark prints one CSV row per number of connections with the nanoseconds
+ *         uip_input() takes per segment, and exits with status 1 if any check fails. It is
+ *         built twice, with the hash table and with UIP_CONF_TCP_CONN_HASH_SIZE 0, so that
+ *         both rows time the same path and differ only in how the connection is found.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "contiki.h"
+#include "contiki-net.h"
+
+#ifndef TCP_DEMUX_BENCH_SEGMENTS
+#define TCP_DEMUX_BENCH_SEGMENTS 200000
+#endif
+
+#define IP_BUF    ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define TCP_BUF   ((struct uip_tcp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+
+#if UIP_TCP_CONN_HASH_SIZE
+#define LOOKUP    "hash"
+#else /* UIP_TCP_CONN_HASH_SIZE */
+#define LOOKUP    "scan"
+#endif /* UIP_TCP_CONN_HASH_SIZE */
+
+#define TCP_SYN   0x02
+#define TCP_RST   0x04
+#define TCP_ACK   0x10
+
+#define PORT      80
+#define HOSTS     8
+#define LISTENERS 16
+
+static const uint16_t sizes[] = { 8, 64, 512 };
+
+static uip_ipaddr_t host[HOSTS];
+static struct uip_conn *conns[UIP_CONNS];
+static uint16_t nconns;
+
+/* A segment for each connection, kept to be copied into uip_buf */
+static uint8_t segment[UIP_CONNS][UIP_IPTCPH_LEN];
+
+PROCESS(tcp_demux_bench_process, "TCP demultiplexing benchmark");
+PROCESS(listener_process, "Listener");
+AUTOSTART_PROCESSES(&listener_process, &tcp_demux_bench_process);
+/*---------------------------------------------------------------------------*/
+static uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+/* The connections belong to this process, which ignores their events */
+PROCESS_THREAD(listener_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  tcp_listen(UIP_HTONS(PORT));
+  while(1) {
+    PROCESS_WAIT_EVENT();
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+static void
+put32(uint8_t *p, uint32_t v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+/*---------------------------------------------------------------------------*/
+/* Write a segment from a remote host into uip_buf */
+static void
+build(uip_ipaddr_t *src, uint16_t srcport, uint16_t destport,
+      uint8_t flags, uint32_t seqno, uint32_t ackno)
+{
+  memset(uip_buf, 0, UIP_IPTCPH_LEN);
+  IP_BUF->vtc = 0x60;
+  IP_BUF->len[1] = UIP_TCPH_LEN;
+  IP_BUF->proto = UIP_PROTO_TCP;
+  IP_BUF->ttl = 64;
+  uip_ipaddr_copy(&IP_BUF->srcipaddr, src);
+  uip_ipaddr_copy(&IP_BUF->destipaddr, &uip_ds6_get_link_local(-1)->ipaddr);
+  TCP_BUF->srcport = UIP_HTONS(srcport);
+  TCP_BUF->destport = UIP_HTONS(destport);
+  put32(TCP_BUF->seqno, seqno);
+  put32(TCP_BUF->ackno, ackno);
+  TCP_BUF->tcpoffset = 5 << 4;
+  TCP_BUF->flags = flags;
+  TCP_BUF->wnd[0] = 0x10;
+  TCP_BUF->tcpchksum = ~uip_tcpchksum();
+  uip_len = UIP_IPTCPH_LEN;
+}
+/*---------------------------------------------------------------------------*/
+/* Open a connection with a handshake and keep its acknowledgement */
+static uint8_t
+open_conn(uip_ipaddr_t *src, uint16_t srcport)
+{
+  uint32_t iss;
+  struct uip_conn *conn;
+
+  build(src, srcport, PORT, TCP_SYN, 1000, 0);
+  uip_input();
+  if(uip_len == 0 || TCP_BUF->flags != (TCP_SYN | TCP_ACK)) {
+    printf("tcp-demux-bench: No SYNACK for connection %u\n", nconns);
+    return 0;
+  }
+  conn = uip_conn;
+  iss = ((uint32_t)TCP_BUF->seqno[0] << 24) | ((uint32_t)TCP_BUF->seqno[1] << 16) |
+    ((uint32_t)TCP_BUF->seqno[2] << 8) | TCP_BUF->seqno[3];
+
+  build(src, srcport, PORT, TCP_ACK, 1001, iss + 1);
+  memcpy(segment[nconns], uip_buf, UIP_IPTCPH_LEN);
+  uip_input();
+  if(uip_conn != conn || (conn->tcpstateflags & UIP_TS_MASK) != UIP_ESTABLISHED) {
+    printf("tcp-demux-bench: Connection %u not established\n", nconns);
+    return 0;
+  }
+  conns[nconns++] = conn;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+close_all(void)
+{
+  struct uip_conn *conn;
+
+  for(conn = &uip_conns[0]; conn < &uip_conns[UIP_CONNS]; ++conn) {
+    if(conn->tcpstateflags != UIP_CLOSED) {
+      build(&conn->ripaddr, UIP_HTONS(conn->rport), UIP_HTONS(conn->lport), TCP_RST, 0, 0);
+      uip_input();
+    }
+  }
+  nconns = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* The connection a segment belongs to, found independently of uip6.c */
+static struct uip_conn *
+scan(const uint8_t *seg)
+{
+  const struct uip_ip_hdr *ip = (const struct uip_ip_hdr *)seg;
+  const struct uip_tcp_hdr *tcp = (const struct uip_tcp_hdr *)(seg + UIP_IPH_LEN);
+  struct uip_conn *conn;
+
+  for(conn = &uip_conns[0]; conn <= &uip_conns[UIP_CONNS - 1]; ++conn) {
+    if(conn->tcpstateflags != UIP_CLOSED &&
+       tcp->destport == conn->lport &&
+       tcp->srcport == conn->rport &&
+       uip_ipaddr_cmp(&ip->srcipaddr, &conn->ripaddr)) {
+      return conn;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+check_demux(void)
+{
+  uint16_t i;
+
+  for(i = 0; i < nconns; i++) {
+    memcpy(uip_buf, segment[i], UIP_IPTCPH_LEN);
+    uip_len = UIP_IPTCPH_LEN;
+    uip_conn = NULL;
+    uip_input();
+    if(uip_conn != conns[i] || scan(segment[i]) != conns[i]) {
+      printf("tcp-demux-bench: Segment %u reached the wrong connection\n", i);
+      return 0;
+    }
+  }
+
+  /* A connection that does not exist */
+  build(&host[0], 9, PORT, TCP_ACK, 1, 1);
+  uip_input();
+  if(uip_len == 0 || !(TCP_BUF->flags & TCP_RST)) {
+    printf("tcp-demux-bench: No reset for an unknown connection\n");
+    return 0;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Listen to more ports, unlisten every third, and check SYNs to each */
+static uint8_t
+check_listen(void)
+{
+  uint16_t i;
+  uint8_t listening, ok = 1;
+
+  for(i = 1; i < LISTENERS; i++) {
+    uip_listen(UIP_HTONS(PORT + i * 257));
+  }
+  for(i = 1; i < LISTENERS; i += 3) {
+    uip_unlisten(UIP_HTONS(PORT + i * 257));
+  }
+
+  for(i = 0; i < LISTENERS && ok; i++) {
+    listening = i == 0 || i % 3 != 1;
+    build(&host[1], 5000 + i, PORT + i * 257, TCP_SYN, 1000, 0);
+    uip_input();
+    if(uip_len == 0 || (TCP_BUF->flags == (TCP_SYN | TCP_ACK)) != listening) {
+      printf("tcp-demux-bench: SYN to port %u %s\n", PORT + i * 257,
+             listening ? "refused" : "accepted");
+      ok = 0;
+    }
+  }
+
+  for(i = 1; i < LISTENERS; i++) {
+    uip_unlisten(UIP_HTONS(PORT + i * 257));
+  }
+  close_all();
+  return ok;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(uint16_t size)
+{
+  uint64_t t, segment_ns;
+  uint32_t n;
+  uint16_t i;
+
+  t = now_ns();
+  for(n = 0; n < TCP_DEMUX_BENCH_SEGMENTS; n++) {
+    i = random_rand() % size;
+    memcpy(uip_buf, segment[i], UIP_IPTCPH_LEN);
+    uip_len = UIP_IPTCPH_LEN;
+    uip_input();
+  }
+  segment_ns = now_ns() - t;
+
+  printf("%s,%u,%u,%lu.%02lu\n", LOOKUP, size, TCP_DEMUX_BENCH_SEGMENTS,
+         (unsigned long)(segment_ns / TCP_DEMUX_BENCH_SEGMENTS),
+         (unsigned long)(segment_ns * 100 / TCP_DEMUX_BENCH_SEGMENTS % 100));
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tcp_demux_bench_process, ev, data)
+{
+  uint16_t i, s;
+  uint8_t ok;
+
+  PROCESS_BEGIN();
+
+  /* Let the listener start */
+  PROCESS_PAUSE();
+
+  for(i = 0; i < HOSTS; i++) {
+    uip_ip6addr(&host[i], 0xfe80, 0, 0, 0, 0x0212, 0x7400, i, 0x0101 * (i + 1));
+  }
+
+  printf("lookup,conns,segments,segment_ns\n");
+
+  ok = check_listen();
+  for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && ok; s++) {
+    close_all();
+    /* Connections from the hosts in turn, with consecutive ports */
+    for(i = 0; i < sizes[s] && ok; i++) {
+      ok = open_conn(&host[i % HOSTS], 40000 + i);
+    }
+    ok = ok && check_demux();
+    if(ok) {
+      run(sizes[s]);
+    }
+  }
+
+  printf("tcp-demux-bench: %s\n", ok ? "OK" : "FAIL");
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,260 @@
+/**
+ * \file
+ *         Native benchmark of the choice of the preferred RPL parent
+ * \details
+ *         Joins a DAG through DIOs from 8, 32 and 64 neighbors, and changes the rank or
+ *         the link metric of random candidate parents, each change followed by
+ *         rpl_process_parent_event() as after a DIO or a link-layer feedback. After every
+ *         change, the preferred parent is checked to cost no more than the cheapest
+ *         candidate plus the switch threshold of MRHOF.
+ *
+ *         The benchmark prints one CSV row per number of parents with the nanoseconds a
+ *         parent event takes, next to a scan of the parent table with the best_parent()
+ *         function of the OF as RPL did it on every event before, and exits with status 1
+ *         if any check fails. The debug output of RPL goes to /dev/null while events are
+ *         timed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/rpl/rpl-private.h"
+
+#ifndef PARENT_SET_BENCH_EVENTS
+#define PARENT_SET_BENCH_EVENTS 200000
+#endif
+
+/* Events after which the preferred parent is checked */
+#define CHECKED_EVENTS  2000
+
+/* MRHOF keeps its preferred parent unless another is cheaper by this */
+#define SWITCH_THRESHOLD (RPL_MIN_HOPRANKINC / 2)
+
+static const uint16_t sizes[] = { 8, 32, 64 };
+
+static rpl_parent_t *parents[NBR_TABLE_MAX_NEIGHBORS];
+static uint16_t nparents;
+static rpl_instance_t *instance;
+
+PROCESS(parent_set_bench_process, "Parent set benchmark");
+AUTOSTART_PROCESSES(&parent_set_bench_process);
+/*---------------------------------------------------------------------------*/
+static uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+static int
+quiet(void)
+{
+  int saved, null;
+
+  fflush(stdout);
+  saved = dup(STDOUT_FILENO);
+  null = open("/dev/null", O_WRONLY);
+  dup2(null, STDOUT_FILENO);
+  close(null);
+  return saved;
+}
+/*---------------------------------------------------------------------------*/
+static void
+loud(int saved)
+{
+  fflush(stdout);
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+}
+/*---------------------------------------------------------------------------*/
+/* A rank between one and three hops from the root */
+static rpl_rank_t
+random_rank(void)
+{
+  return RPL_MIN_HOPRANKINC + random_rand() % (2 * RPL_MIN_HOPRANKINC);
+}
+/*---------------------------------------------------------------------------*/
+/* An ETX between 1 and 5 */
+static uint16_t
+random_link_metric(void)
+{
+  return RPL_DAG_MC_ETX_DIVISOR + random_rand() % (4 * RPL_DAG_MC_ETX_DIVISOR);
+}
+/*---------------------------------------------------------------------------*/
+/* Make a neighbor known and process a DIO from it */
+static uint8_t
+add_parent(uint16_t i)
+{
+  uip_ipaddr_t addr;
+  uip_lladdr_t lladdr;
+  uip_ds6_nbr_t *nbr;
+  rpl_dio_t dio;
+  int saved;
+
+  memset(&lladdr, 0, sizeof(lladdr));
+  lladdr.addr[0] = 0x02;
+  lladdr.addr[sizeof(lladdr) - 2] = i >> 8;
+  lladdr.addr[sizeof(lladdr) - 1] = i;
+  uip_ip6addr(&addr, 0xfe80, 0, 0, 0, 0, 0, 0x0100, i + 1);
+  nbr = uip_ds6_nbr_add(&addr, &lladdr, 1, NBR_REACHABLE);
+  if(nbr == NULL) {
+    printf("parent-set-bench: No room for neighbor %u\n", i);
+    return 0;
+  }
+  nbr->link_metric = random_link_metric();
+
+  memset(&dio, 0, sizeof(dio));
+  uip_ip6addr(&dio.dag_id, 0xfd00, 0, 0, 0, 0, 0, 0, 1);
+  dio.ocp = RPL_OF.ocp;
+  dio.rank = random_rank();
+  dio.mop = RPL_MOP_DEFAULT;
+  dio.instance_id = RPL_DEFAULT_INSTANCE;
+  dio.dag_intdoubl = RPL_DIO_INTERVAL_DOUBLINGS;
+  dio.dag_intmin = RPL_DIO_INTERVAL_MIN;
+  dio.dag_redund = RPL_DIO_REDUNDANCY;
+  dio.default_lifetime = RPL_DEFAULT_LIFETIME;
+  dio.lifetime_unit = RPL_DEFAULT_LIFETIME_UNIT;
+  dio.dag_max_rankinc = RPL_MAX_RANKINC;
+  dio.dag_min_hoprankinc = RPL_MIN_HOPRANKINC;
+  saved = quiet();
+  rpl_process_dio(&addr, &dio);
+  loud(saved);
+
+  instance = rpl_get_instance(RPL_DEFAULT_INSTANCE);
+  parents[i] = rpl_get_parent(&lladdr);
+  if(instance == NULL || parents[i] == NULL) {
+    printf("parent-set-bench: DIO from neighbor %u not processed\n", i);
+    return 0;
+  }
+  nparents = i + 1;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* A new rank or link metric for a random parent */
+static void
+event(uint16_t size)
+{
+  rpl_parent_t *p;
+
+  p = parents[random_rand() % size];
+  if(random_rand() & 1) {
+    p->rank = random_rank();
+  } else {
+    rpl_get_nbr(p)->link_metric = random_link_metric();
+  }
+  rpl_process_parent_event(instance, p);
+}
+/*---------------------------------------------------------------------------*/
+/* The choice of RPL without parent heap: the OF compares all the parents */
+static rpl_parent_t *
+scan(rpl_dag_t *dag, uint16_t size)
+{
+  rpl_parent_t *best;
+  uint16_t i;
+
+  best = NULL;
+  for(i = 0; i < size; i++) {
+    if(parents[i]->dag != dag || parents[i]->rank == INFINITE_RANK) {
+      continue;
+    }
+    best = best == NULL ? parents[i] : instance->of->best_parent(best, parents[i]);
+  }
+  return best;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+check_preferred(uint16_t size)
+{
+  rpl_dag_t *dag;
+  uint32_t min_cost, cost;
+  uint16_t i, n;
+  int saved;
+
+  dag = instance->current_dag;
+  for(n = 0; n < CHECKED_EVENTS; n++) {
+    saved = quiet();
+    event(size);
+    loud(saved);
+
+    min_cost = 0xffff;
+    for(i = 0; i < size; i++) {
+      cost = instance->of->parent_path_cost(parents[i]);
+      if(cost < min_cost) {
+        min_cost = cost;
+      }
+    }
+    if(dag->preferred_parent == NULL ||
+       instance->of->parent_path_cost(dag->preferred_parent) > min_cost + SWITCH_THRESHOLD) {
+      printf("parent-set-bench: Preferred parent not the cheapest after event %u\n", n);
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(uint16_t size)
+{
+  uint64_t t, event_ns, scan_ns;
+  uint32_t n;
+  int saved;
+  volatile uint16_t found = 0;
+
+  saved = quiet();
+  t = now_ns();
+  for(n = 0; n < PARENT_SET_BENCH_EVENTS; n++) {
+    event(size);
+  }
+  event_ns = now_ns() - t;
+  loud(saved);
+
+  t = now_ns();
+  for(n = 0; n < PARENT_SET_BENCH_EVENTS; n++) {
+    found += scan(instance->current_dag, size) != NULL;
+  }
+  scan_ns = now_ns() - t;
+
+  printf("%u,%u,%lu.%02lu,%lu.%02lu\n", size, PARENT_SET_BENCH_EVENTS,
+         (unsigned long)(event_ns / PARENT_SET_BENCH_EVENTS),
+         (unsigned long)(event_ns * 100 / PARENT_SET_BENCH_EVENTS % 100),
+         (unsigned long)(scan_ns / PARENT_SET_BENCH_EVENTS),
+         (unsigned long)(scan_ns * 100 / PARENT_SET_BENCH_EVENTS % 100));
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(parent_set_bench_process, ev, data)
+{
+  uint16_t s;
+  uint8_t ok;
+
+  PROCESS_BEGIN();
+
+  /* Let the network stack start */
+  PROCESS_PAUSE();
+
+  printf("parents,events,event_ns,scan_ns\n");
+
+  ok = 1;
+  for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && ok; s++) {
+    /* More neighbors for each row */
+    while(nparents < sizes[s] && ok) {
+      ok = add_parent(nparents);
+    }
+    ok = ok && check_preferred(sizes[s]);
+    if(ok) {
+      run(sizes[s]);
+    }
+  }
+
+  printf("parent-set-bench: %s\n", ok ? "OK" : "FAIL");
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,8 @@
+#ifndef __PROJECT_CONF_H__
+#define __PROJECT_CONF_H__
+
+/* A node in a dense network, with many candidate parents */
+#undef NBR_TABLE_CONF_MAX_NEIGHBORS
+#define NBR_TABLE_CONF_MAX_NEIGHBORS    64
+
+#endif /* __PROJECT_CONF_H__ */
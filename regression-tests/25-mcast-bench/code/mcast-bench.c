@@ -0,0 +1,113 @@
+/**
+ * \file
+ *         Native benchmark of the multicast engines
+ * \details
+ *         Node 1 of a netsim network is the seed: after a warm-up, it sends
+ *         MCAST_BENCH_MESSAGES datagrams to a global multicast group that
+ *         every other node joins. At the end of the run, each node prints
+ *         one CSV row with the number of datagrams it received and the
+ *         number of frames it sent after the warm-up, so that the delivery
+ *         ratio and the transmissions per datagram of the engine it was
+ *         built with add up from all rows.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/ipv6/multicast/uip-mcast6.h"
+#include "netsim-radio.h"
+
+#ifndef MCAST_BENCH_MESSAGES
+#define MCAST_BENCH_MESSAGES 20
+#endif
+
+#define WARMUP    (5 * CLOCK_SECOND)
+#define INTERVAL  (CLOCK_SECOND / 2)
+#define DRAIN     (15 * CLOCK_SECOND)
+#define UDP_PORT  3001
+
+static struct uip_udp_conn *conn;
+static uint8_t received[(MCAST_BENCH_MESSAGES + 7) / 8];
+static uint16_t received_num;
+/*---------------------------------------------------------------------------*/
+static void
+tcpip_handler(void)
+{
+  uint32_t seq;
+
+  if(!uip_newdata() || uip_datalen() != sizeof(seq)) {
+    return;
+  }
+  memcpy(&seq, uip_appdata, sizeof(seq));
+  seq = uip_ntohl(seq);
+  if(seq < MCAST_BENCH_MESSAGES && !(received[seq / 8] & (1 << (seq % 8)))) {
+    received[seq / 8] |= 1 << (seq % 8);
+    received_num++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(mcast_bench_process, "Multicast benchmark");
+AUTOSTART_PROCESSES(&mcast_bench_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(mcast_bench_process, ev, data)
+{
+  static struct etimer et;
+  static uint32_t seq;
+  static unsigned long tx_start;
+  uip_ipaddr_t addr;
+  uint32_t id;
+
+  PROCESS_BEGIN();
+
+  netsim_init();
+  uip_ip6addr(&addr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&addr, &uip_lladdr);
+  uip_ds6_addr_add(&addr, 0, ADDR_MANUAL);
+
+  uip_ip6addr(&addr, 0xFF1E, 0, 0, 0, 0, 0, 0x89, 0xABCD);
+  if(netsim_id() == 1) {
+    conn = udp_new(&addr, UIP_HTONS(UDP_PORT), NULL);
+  } else {
+    uip_ds6_maddr_add(&addr);
+    conn = udp_new(NULL, UIP_HTONS(0), NULL);
+    udp_bind(conn, UIP_HTONS(UDP_PORT));
+  }
+
+  etimer_set(&et, WARMUP);
+  PROCESS_WAIT_UNTIL(etimer_expired(&et));
+  tx_start = netsim_tx_count();
+
+  etimer_set(&et, INTERVAL);
+  while(seq < MCAST_BENCH_MESSAGES) {
+    PROCESS_WAIT_EVENT();
+    if(ev == tcpip_event) {
+      tcpip_handler();
+    } else if(etimer_expired(&et)) {
+      if(netsim_id() == 1) {
+        id = uip_htonl(seq);
+        uip_udp_packet_send(conn, &id, sizeof(id));
+      }
+      seq++;
+      etimer_reset(&et);
+    }
+  }
+
+  etimer_set(&et, DRAIN);
+  while(!etimer_expired(&et)) {
+    PROCESS_WAIT_EVENT();
+    if(ev == tcpip_event) {
+      tcpip_handler();
+    }
+  }
+
+  printf("node,%u,%s,%u,%lu\n", netsim_id(), UIP_MCAST6.name,
+         netsim_id() == 1 ? MCAST_BENCH_MESSAGES : received_num,
+         netsim_tx_count() - tx_start);
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,38 @@
+#ifndef PROJECT_CONF_H_
+#define PROJECT_CONF_H_
+
+#include "net/ipv6/multicast/uip-mcast6-engines.h"
+
+#ifndef UIP_MCAST6_CONF_ENGINE
+#define UIP_MCAST6_CONF_ENGINE UIP_MCAST6_ENGINE_ROLL_TM
+#endif
+
+#undef NETSTACK_CONF_RADIO
+#define NETSTACK_CONF_RADIO netsim_radio_driver
+
+/* The Imin of both engines for a radio that is always on */
+#define ROLL_TM_CONF_IMIN_1         (CLOCK_SECOND / 8)
+#define MPL_CONF_DATA_MESSAGE_IMIN  (CLOCK_SECOND / 8)
+
+/*
+ * Each node of a line hears two neighbors. With k = 1, the retransmissions
+ * of the upstream neighbor suppress forwarding downstream, and a node that
+ * lacks a datagram is silenced by a neighbor that lacks it too.
+ */
+#define MPL_CONF_DATA_MESSAGE_K     2
+#define MPL_CONF_CONTROL_MESSAGE_K  2
+
+#undef UIP_CONF_DS6_MADDR_NBU
+#define UIP_CONF_DS6_MADDR_NBU       4
+#undef UIP_CONF_ROUTER
+#define UIP_CONF_ROUTER              1
+#undef UIP_CONF_ND6_SEND_RA
+#define UIP_CONF_ND6_SEND_RA         0
+#undef UIP_MCAST6_ROUTE_CONF_ROUTES
+#define UIP_MCAST6_ROUTE_CONF_ROUTES 1
+#undef UIP_CONF_TCP
+#define UIP_CONF_TCP                 0
+
+#define IPSEC_CONF_DEBUG             0
+
+#endif /* PROJECT_CONF_H_ */
@@ -0,0 +1,10 @@
+#ifndef __PROJECT_CONF_H__
+#define __PROJECT_CONF_H__
+
+/* Room for eight segments of 64 bytes in the send buffer */
+#undef UIP_CONF_TCP_MSS
+#define UIP_CONF_TCP_MSS                64
+#undef UIP_CONF_TCP_SNDBUF_SIZE
+#define UIP_CONF_TCP_SNDBUF_SIZE        512
+
+#endif /* __PROJECT_CONF_H__ */
@@ -0,0 +1,279 @@
+/**
+ * \file
+ *         Native test of the TCP send buffer of uIP6
+ * \details
+ *         Plays the remote host of a connection to a listener that always
+ *         has data to send, by feeding uip_input() acknowledgements and
+ *         running the timer of the connection with uip_periodic_conn().
+ *         With a window of four segments, it checks that:
+ *
+ *         - several segments are in flight, and only one of them at a time
+ *           is timed for the round-trip time estimate;
+ *         - three duplicate acknowledgements of a lost segment make uIP
+ *           retransmit it, with the right data;
+ *         - the retransmission time-out resends the oldest segment;
+ *         - segments acknowledged after a retransmission are not timed
+ *           (Karn's rule), and timing resumes with new segments.
+ *
+ *         The test exits with status 1 at the first check that fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "contiki.h"
+#include "contiki-net.h"
+
+#define IP_BUF    ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define TCP_BUF   ((struct uip_tcp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+
+#define TCP_SYN   0x02
+#define TCP_ACK   0x10
+
+#define PORT      80
+#define PEER_PORT 40000
+#define PEER_ISS  1000
+#define WINDOW    (4 * UIP_TCP_MSS)
+
+#define CHECK(cond, ...) do {                   \
+    if(!(cond)) {                               \
+      printf("tcp-sndbuf: " __VA_ARGS__);       \
+      printf("\n");                             \
+      exit(1);                                  \
+    }                                           \
+  } while(0)
+
+static uip_ipaddr_t peer;
+static struct uip_conn *conn;
+static uint32_t iss;
+
+/* What the application has written, and what uIP has sent of it */
+static uint32_t written;
+static uint32_t sent_max;
+/* The last data segment uIP sent, as an offset in the stream */
+static uint32_t seg_off;
+static uint16_t seg_len;
+
+PROCESS(tcp_sndbuf_process, "TCP send buffer test");
+PROCESS(sender_process, "Sender");
+AUTOSTART_PROCESSES(&sender_process, &tcp_sndbuf_process);
+/*---------------------------------------------------------------------------*/
+/* Accepts a connection and keeps the send buffer full of a byte pattern */
+PROCESS_THREAD(sender_process, ev, data)
+{
+  static uint8_t buf[UIP_TCP_MSS];
+  uint16_t i, len;
+
+  PROCESS_BEGIN();
+
+  tcp_listen(UIP_HTONS(PORT));
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == tcpip_event);
+    if(uip_connected() || uip_acked() || uip_poll()) {
+      len = uip_mss() < sizeof(buf) ? uip_mss() : sizeof(buf);
+      for(i = 0; i < len; i++) {
+        buf[i] = written + i;
+      }
+      if(len > 0) {
+        uip_send(buf, len);
+        written += len;
+      }
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+get32(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+    ((uint32_t)p[2] << 8) | p[3];
+}
+/*---------------------------------------------------------------------------*/
+static void
+put32(uint8_t *p, uint32_t v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+/*---------------------------------------------------------------------------*/
+/* Write a segment from the remote host into uip_buf */
+static void
+build(uint8_t flags, uint32_t seqno, uint32_t ackno)
+{
+  memset(uip_buf, 0, UIP_IPTCPH_LEN);
+  IP_BUF->vtc = 0x60;
+  IP_BUF->len[1] = UIP_TCPH_LEN;
+  IP_BUF->proto = UIP_PROTO_TCP;
+  IP_BUF->ttl = 64;
+  uip_ipaddr_copy(&IP_BUF->srcipaddr, &peer);
+  uip_ipaddr_copy(&IP_BUF->destipaddr, &uip_ds6_get_link_local(-1)->ipaddr);
+  TCP_BUF->srcport = UIP_HTONS(PEER_PORT);
+  TCP_BUF->destport = UIP_HTONS(PORT);
+  put32(TCP_BUF->seqno, seqno);
+  put32(TCP_BUF->ackno, ackno);
+  TCP_BUF->tcpoffset = 5 << 4;
+  TCP_BUF->flags = flags;
+  TCP_BUF->wnd[0] = WINDOW >> 8;
+  TCP_BUF->wnd[1] = WINDOW & 0xff;
+  TCP_BUF->tcpchksum = ~uip_tcpchksum();
+  uip_len = UIP_IPTCPH_LEN;
+}
+/*---------------------------------------------------------------------------*/
+/* Note the data segment uIP left in uip_buf, if any, and check its data */
+static uint8_t
+output(void)
+{
+  uint16_t i;
+  uint8_t *payload;
+
+  if(uip_len <= UIP_IPTCPH_LEN) {
+    return 0;
+  }
+  seg_off = get32(TCP_BUF->seqno) - (iss + 1);
+  seg_len = uip_len - UIP_IPTCPH_LEN;
+  payload = &uip_buf[UIP_LLH_LEN + UIP_IPTCPH_LEN];
+  for(i = 0; i < seg_len; i++) {
+    CHECK(payload[i] == (uint8_t)(seg_off + i),
+          "Wrong data at offset %lu", (unsigned long)(seg_off + i));
+  }
+  if(seg_off + seg_len > sent_max) {
+    sent_max = seg_off + seg_len;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Let uIP send what the window allows and return the number of segments */
+static uint8_t
+flush(void)
+{
+  uint8_t n = 0;
+
+  do {
+    uip_poll_conn(conn);
+  } while(output() && ++n);
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+/* Acknowledge the stream up to off, and return whether uIP sent a segment */
+static uint8_t
+ack(uint32_t off)
+{
+  build(TCP_ACK, PEER_ISS + 1, iss + 1 + off);
+  uip_input();
+  return output();
+}
+/*---------------------------------------------------------------------------*/
+/* Run the timer of the connection, and return whether uIP sent a segment */
+static uint8_t
+tick(void)
+{
+  uip_periodic_conn(conn);
+  return output();
+}
+/*---------------------------------------------------------------------------*/
+/* The time-out the estimator gives for a round-trip time of m ticks */
+static uint8_t
+expected_rto(signed char m)
+{
+  uint8_t sa = conn->sa, sv = conn->sv;
+
+  m = m - (sa >> 3);
+  sa += m;
+  if(m < 0) {
+    m = -m;
+  }
+  m = m - (sv >> 2);
+  sv += m;
+  return (sa >> 3) + sv;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tcp_sndbuf_process, ev, data)
+{
+  uint8_t rto, i;
+  uint32_t lost;
+
+  PROCESS_BEGIN();
+
+  /* Let the sender start */
+  PROCESS_PAUSE();
+
+  uip_ip6addr(&peer, 0xfe80, 0, 0, 0, 0x0212, 0x7400, 0, 0x0101);
+
+  build(TCP_SYN, PEER_ISS, 0);
+  uip_input();
+  CHECK(uip_len > 0 && TCP_BUF->flags == (TCP_SYN | TCP_ACK), "No SYNACK");
+  conn = uip_conn;
+  iss = get32(TCP_BUF->seqno);
+  ack(0);
+  CHECK((conn->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED,
+        "Connection not established");
+
+  /* The window fills up with segments, of which the first is timed */
+  flush();
+  CHECK(sent_max == WINDOW, "%lu bytes in flight, not %u",
+        (unsigned long)sent_max, WINDOW);
+  CHECK(conn->rtt_len == UIP_TCP_MSS, "First segment not timed");
+
+  /* Its acknowledgement after 2 ticks gives a round-trip time of 2 ticks,
+     which the acknowledgement of the next one, a tick later, does not
+     change, as the segment sent in between is timed now. */
+  tick();
+  tick();
+  rto = expected_rto(2);
+  ack(UIP_TCP_MSS);
+  CHECK(conn->rto == rto, "RTO %u after a round trip of 2 ticks, not %u",
+        conn->rto, rto);
+  CHECK(conn->rtt_len > 0, "Segment sent after the sample not timed");
+  tick();
+  ack(2 * UIP_TCP_MSS);
+  CHECK(conn->rto == rto, "RTO %u changed by an untimed segment", conn->rto);
+  flush();
+  printf("tcp-sndbuf: round-trip time sampled once, RTO %u ticks\n", rto);
+
+  /* The next segment is lost and the following ones draw duplicate
+     acknowledgements, the third of which makes uIP retransmit it. */
+  lost = 2 * UIP_TCP_MSS;
+  CHECK(!ack(lost) && !ack(lost), "Retransmission after 2 duplicate ACKs");
+  CHECK(ack(lost) && seg_off == lost,
+        "No fast retransmit of offset %lu", (unsigned long)lost);
+  CHECK(conn->rtt_len == 0, "Timing kept across a retransmission");
+  /* The retransmission fills the hole */
+  ack(sent_max);
+  flush();
+  CHECK(conn->rto == rto, "RTO %u sampled from a retransmission", conn->rto);
+  printf("tcp-sndbuf: fast retransmit of offset %lu\n", (unsigned long)lost);
+
+  /* No acknowledgement comes: the time-out resends the oldest segment */
+  lost = sent_max - WINDOW;
+  for(i = 0; i <= rto && !(tick() && seg_off == lost); i++);
+  CHECK(i <= rto && conn->nrtx == 1,
+        "No retransmission of offset %lu after %u ticks", (unsigned long)lost, i);
+  CHECK(conn->rtt_len == 0, "Timing kept across a time-out");
+  ack(sent_max);
+  CHECK(conn->rto == rto, "RTO %u sampled from a retransmission", conn->rto);
+  CHECK(conn->nrtx == 0, "Retransmission count not reset");
+  printf("tcp-sndbuf: time-out retransmission of offset %lu after %u ticks\n",
+         (unsigned long)lost, i);
+
+  /* New segments are timed again */
+  flush();
+  CHECK(conn->rtt_len > 0, "Timing not resumed");
+  tick();
+  tick();
+  tick();
+  rto = expected_rto(3);
+  ack(sent_max);
+  CHECK(conn->rto == rto, "RTO %u after a round trip of 3 ticks, not %u",
+        conn->rto, rto);
+
+  printf("tcp-sndbuf: OK\n");
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
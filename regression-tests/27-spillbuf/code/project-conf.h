@@ -0,0 +1,8 @@
+#ifndef __PROJECT_CONF_H__
+#define __PROJECT_CONF_H__
+
+/* A cache of two records, which the test prefetches and reads */
+#undef SPILLBUF_CONF_CACHE_NUM
+#define SPILLBUF_CONF_CACHE_NUM         2
+
+#endif /* __PROJECT_CONF_H__ */
@@ -0,0 +1,248 @@
+/**
+ * \file
+ *         Native test of the spill store
+ * \details
+ *         Runs the store of the default size through random puts, updates,
+ *         reads and frees of records of random length, with some records
+ *         kept for a long time so that they end up spread over every
+ *         segment. It checks that:
+ *
+ *         - a put never fails while fewer than SPILLBUF_NUM records are
+ *           stored, and an update never fails, so that the store moves the
+ *           long-lived records instead of running out of segments;
+ *         - every record reads back with its last content and length;
+ *         - SPILLBUF_NUM records of SPILLBUF_RECORD_MAXLEN bytes fit and can
+ *           be updated over and over;
+ *         - reading a prefetched record makes no CFS read.
+ *
+ *         cfs_read() is wrapped at link time to count the reads. The test
+ *         exits with status 1 at the first check that fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "lib/random.h"
+#include "net/spillbuf.h"
+
+#ifndef SPILLBUF_TEST_OPS
+#define SPILLBUF_TEST_OPS 20000
+#endif
+
+#define CHECK(cond, ...) do {                   \
+    if(!(cond)) {                               \
+      printf("spillbuf: " __VA_ARGS__);         \
+      printf("\n");                             \
+      exit(1);                                  \
+    }                                           \
+  } while(0)
+
+/* What each record should hold: its content is derived from a version */
+struct expected {
+  uint16_t len;
+  uint16_t version;
+  uint8_t live;
+  /* Operations the record is kept for before it may be freed */
+  uint16_t keep;
+};
+
+static struct expected expected[SPILLBUF_NUM];
+static uint8_t buf[SPILLBUF_RECORD_MAXLEN];
+static uint16_t next_version;
+static unsigned long reads;
+
+int __real_cfs_read(int fd, void *buf, unsigned int len);
+
+PROCESS(spillbuf_test_process, "Spill store test");
+AUTOSTART_PROCESSES(&spillbuf_test_process);
+/*---------------------------------------------------------------------------*/
+int
+__wrap_cfs_read(int fd, void *buf, unsigned int len)
+{
+  reads++;
+  return __real_cfs_read(fd, buf, len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+fill(uint8_t *data, uint16_t len, uint16_t version)
+{
+  uint16_t i;
+
+  for(i = 0; i < len; i++) {
+    data[i] = version * 7 + i;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(int id)
+{
+  uint8_t *data = spillbuf_get(id);
+  uint16_t i;
+
+  CHECK(spillbuf_len(id) == expected[id].len, "Record %d is %u bytes, not %u",
+        id, spillbuf_len(id), expected[id].len);
+  for(i = 0; i < expected[id].len; i++) {
+    CHECK(data[i] == (uint8_t)(expected[id].version * 7 + i),
+          "Record %d differs at byte %u", id, i);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+random_len(void)
+{
+  return 1 + random_rand() % SPILLBUF_RECORD_MAXLEN;
+}
+/*---------------------------------------------------------------------------*/
+static void
+put(uint16_t len, uint16_t keep)
+{
+  int id;
+
+  fill(buf, len, next_version);
+  id = spillbuf_put(buf, len);
+  CHECK(id >= 0, "Put of %u bytes failed with %d records free", len,
+        spillbuf_numfree());
+  CHECK(!expected[id].live, "Record %d given out twice", id);
+  expected[id].len = len;
+  expected[id].version = next_version++;
+  expected[id].live = 1;
+  expected[id].keep = keep;
+}
+/*---------------------------------------------------------------------------*/
+static void
+update(int id, uint16_t len)
+{
+  fill(buf, len, next_version);
+  CHECK(spillbuf_update(id, buf, len) == 0, "Update of record %d failed", id);
+  expected[id].len = len;
+  expected[id].version = next_version++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+free_record(int id)
+{
+  spillbuf_free(id);
+  expected[id].live = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Random operations, a few records of which are kept for long */
+static void
+churn(void)
+{
+  unsigned long n;
+  int id;
+
+  for(n = 0; n < SPILLBUF_TEST_OPS; n++) {
+    id = random_rand() % SPILLBUF_NUM;
+    switch(random_rand() % 4) {
+    case 0:
+      if(spillbuf_numfree() > 0) {
+        put(random_len(), random_rand() % 8 == 0 ? 2000 : 0);
+      }
+      break;
+    case 1:
+      if(expected[id].live) {
+        update(id, random_len());
+      }
+      break;
+    case 2:
+      if(expected[id].live) {
+        check(id);
+      }
+      break;
+    case 3:
+      if(expected[id].live) {
+        if(expected[id].keep > 0) {
+          expected[id].keep--;
+        } else {
+          free_record(id);
+        }
+      }
+      break;
+    }
+  }
+  for(id = 0; id < SPILLBUF_NUM; id++) {
+    if(expected[id].live) {
+      check(id);
+      free_record(id);
+    }
+  }
+  printf("spillbuf: %u random operations\n", SPILLBUF_TEST_OPS);
+}
+/*---------------------------------------------------------------------------*/
+/* Every record at the largest size, updated over and over */
+static void
+fill_up(void)
+{
+  uint16_t round;
+  int id;
+
+  for(id = 0; id < SPILLBUF_NUM; id++) {
+    put(SPILLBUF_RECORD_MAXLEN, 0);
+  }
+  CHECK(spillbuf_numfree() == 0, "%d records free in a full store",
+        spillbuf_numfree());
+  for(round = 0; round < 20; round++) {
+    for(id = round % 3; id < SPILLBUF_NUM; id += 1 + round % 3) {
+      update(id, SPILLBUF_RECORD_MAXLEN);
+    }
+  }
+  for(id = 0; id < SPILLBUF_NUM; id++) {
+    check(id);
+    free_record(id);
+  }
+  printf("spillbuf: %u records of %u bytes in %u segments of %u bytes\n",
+         SPILLBUF_NUM, (unsigned)SPILLBUF_RECORD_MAXLEN, SPILLBUF_SEGMENTS,
+         (unsigned)SPILLBUF_SEGMENT_SIZE);
+}
+/*---------------------------------------------------------------------------*/
+/* Records read after being prefetched come from the cache */
+static void
+prefetch(void)
+{
+  unsigned long before;
+  int id;
+
+  for(id = 0; id < SPILLBUF_NUM; id++) {
+    put(random_len(), 0);
+  }
+  /* Evict them from the cache */
+  for(id = SPILLBUF_NUM - SPILLBUF_CACHE_NUM; id < SPILLBUF_NUM; id++) {
+    check(id);
+  }
+  for(id = 0; id < SPILLBUF_CACHE_NUM; id++) {
+    spillbuf_prefetch(id);
+  }
+  before = reads;
+  for(id = 0; id < SPILLBUF_CACHE_NUM; id++) {
+    check(id);
+  }
+  CHECK(reads == before, "%lu reads of prefetched records", reads - before);
+  for(id = 0; id < SPILLBUF_NUM; id++) {
+    free_record(id);
+  }
+  printf("spillbuf: prefetched records read from the cache\n");
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(spillbuf_test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  random_init(1);
+  spillbuf_init();
+
+  churn();
+  /* Let the store renew the segments that were emptied */
+  PROCESS_PAUSE();
+  fill_up();
+  prefetch();
+
+  printf("spillbuf: OK\n");
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
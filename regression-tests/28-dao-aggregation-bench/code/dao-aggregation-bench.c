@@ -0,0 +1,85 @@
+/**
+ * \file
+ *         Native benchmark of the aggregation of DAOs in storing mode
+ * \details
+ *         Node 1 of a netsim network is the root of a RPL DAG, and every
+ *         other node joins it and advertises its global address with DAOs.
+ *         uip_icmp6_send() is wrapped at link time to count the DAOs each
+ *         node sends, whether its own or forwarded for its children, and
+ *         their bytes. At the end of the run, each node prints one CSV row
+ *         with these counts and the number of frames it sent. The root
+ *         also prints a row each second its number of downward routes
+ *         changes, so that the time it took to reach every node adds up
+ *         too, and the builds with and without
+ *         RPL_CONF_DAO_AGGREGATION_WINDOW compare from all rows.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/rpl/rpl-private.h"
+#include "netsim-radio.h"
+
+#ifndef DAO_AGGREGATION_BENCH_SECONDS
+#define DAO_AGGREGATION_BENCH_SECONDS 120
+#endif
+
+static unsigned long daos;
+static unsigned long dao_bytes;
+
+void __real_uip_icmp6_send(const uip_ipaddr_t *dest, int type, int code,
+                           int payload_len);
+
+PROCESS(dao_aggregation_bench_process, "DAO aggregation benchmark");
+AUTOSTART_PROCESSES(&dao_aggregation_bench_process);
+/*---------------------------------------------------------------------------*/
+void
+__wrap_uip_icmp6_send(const uip_ipaddr_t *dest, int type, int code,
+                      int payload_len)
+{
+  if(type == ICMP6_RPL && code == RPL_CODE_DAO) {
+    daos++;
+    dao_bytes += payload_len;
+  }
+  __real_uip_icmp6_send(dest, type, code, payload_len);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(dao_aggregation_bench_process, ev, data)
+{
+  static struct etimer et;
+  static uint16_t seconds;
+  static int routes;
+  uip_ipaddr_t addr;
+  rpl_dag_t *dag;
+
+  PROCESS_BEGIN();
+
+  netsim_init();
+  if(netsim_id() == 1) {
+    uip_ip6addr(&addr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+    uip_ds6_set_addr_iid(&addr, &uip_lladdr);
+    uip_ds6_addr_add(&addr, 0, ADDR_MANUAL);
+    dag = rpl_set_root(RPL_DEFAULT_INSTANCE, &addr);
+    rpl_set_prefix(dag, &addr, 64);
+  }
+
+  etimer_set(&et, CLOCK_SECOND);
+  for(seconds = 1; seconds <= DAO_AGGREGATION_BENCH_SECONDS; seconds++) {
+    PROCESS_WAIT_UNTIL(etimer_expired(&et));
+    etimer_reset(&et);
+    if(netsim_id() == 1 && uip_ds6_route_num_routes() != routes) {
+      routes = uip_ds6_route_num_routes();
+      printf("routes,%u,%d\n", seconds, routes);
+    }
+  }
+
+  printf("node,%u,%lu,%lu,%lu\n", netsim_id(), daos, dao_bytes,
+         netsim_tx_count());
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,14 @@
+#ifndef PROJECT_CONF_H_
+#define PROJECT_CONF_H_
+
+#undef NETSTACK_CONF_RADIO
+#define NETSTACK_CONF_RADIO netsim_radio_driver
+
+#undef UIP_CONF_ROUTER
+#define UIP_CONF_ROUTER              1
+#undef UIP_CONF_ND6_SEND_RA
+#define UIP_CONF_ND6_SEND_RA         0
+#undef UIP_CONF_TCP
+#define UIP_CONF_TCP                 0
+
+#endif /* PROJECT_CONF_H_ */
@@ -0,0 +1,166 @@
+/**
+ * \file
+ *         Native test of the adaptivesec llsec driver
+ * \details
+ *         Three netsim nodes in range of each other take turns to send
+ *         datagrams to a neighbor or to all of them, one a second, and
+ *         each frame is sent a second time with NETSTACK_RADIO.transmit(),
+ *         as an attacker that replays it would. The order of the turns
+ *         covers:
+ *
+ *         - a unicast frame from a node that is not a neighbor yet, which
+ *           the receiver checks with a pairwise key it derives for the
+ *           frame only and then keeps for the new neighbor;
+ *         - a unicast frame back, secured with that key;
+ *         - a broadcast frame from a node that is not a neighbor yet,
+ *           after which the receivers derive its pairwise key;
+ *         - unicast frames between neighbors that met by broadcast;
+ *         - broadcast frames from a neighbor;
+ *         - the replay of each of these frames, first contacts included.
+ *
+ *         Each datagram must be received exactly once by the nodes it is
+ *         for. Each node prints whether it did and exits with status 1 if
+ *         not.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/netstack.h"
+#include "netsim-radio.h"
+
+#define UDP_PORT  5678
+#define NODES     3
+
+/* Who sends which datagram to whom, 0 for all */
+struct turn {
+  uint8_t sender;
+  uint8_t receiver;
+};
+
+static const struct turn turns[] = {
+  { 2, 1 }, /* first contact by unicast */
+  { 1, 2 }, /* the key of the first contact, the other way */
+  { 3, 0 }, /* first contact by broadcast */
+  { 1, 3 }, /* unicast with the key derived after a broadcast */
+  { 2, 0 }, /* broadcast, known to 1, first contact for 3 */
+  { 3, 2 }, /* unicast between nodes that met by broadcast */
+  { 2, 1 }, /* unicast between neighbors */
+};
+
+#define TURNS (sizeof(turns) / sizeof(turns[0]))
+
+static struct uip_udp_conn *conn;
+static uint8_t received[TURNS];
+/*---------------------------------------------------------------------------*/
+static void
+set_link_local(uip_ipaddr_t *addr, uint8_t id)
+{
+  uip_ip6addr(addr, 0xfe80, 0, 0, 0, 0x0212, 0x7400, 0, id);
+}
+/*---------------------------------------------------------------------------*/
+/* Let uIP know the link-layer addresses, so that the first frame of a node
+   to another is the datagram and not a neighbor solicitation */
+static void
+add_neighbors(void)
+{
+  uip_ipaddr_t addr;
+  uip_lladdr_t lladdr;
+  uint8_t id;
+
+  for(id = 1; id <= NODES; id++) {
+    if(id == netsim_id()) {
+      continue;
+    }
+    set_link_local(&addr, id);
+    memset(&lladdr, 0, sizeof(lladdr));
+    lladdr.addr[1] = 0x12;
+    lladdr.addr[2] = 0x74;
+    lladdr.addr[sizeof(lladdr.addr) - 1] = id;
+    uip_ds6_nbr_add(&addr, &lladdr, 0, NBR_REACHABLE);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+tcpip_handler(void)
+{
+  uint8_t turn;
+
+  if(!uip_newdata() || uip_datalen() != 1) {
+    return;
+  }
+  turn = *(uint8_t *)uip_appdata;
+  if(turn < TURNS && received[turn] < 255) {
+    received[turn]++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_turn(uint8_t turn)
+{
+  uip_ipaddr_t addr;
+
+  if(turns[turn].receiver == 0) {
+    uip_create_linklocal_allnodes_mcast(&addr);
+  } else {
+    set_link_local(&addr, turns[turn].receiver);
+  }
+  uip_udp_packet_sendto(conn, &turn, 1, &addr, UIP_HTONS(UDP_PORT));
+  /* The frame is still in the radio: send it again */
+  NETSTACK_RADIO.transmit(0);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(adaptivesec_test_process, "adaptivesec test");
+AUTOSTART_PROCESSES(&adaptivesec_test_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(adaptivesec_test_process, ev, data)
+{
+  static struct etimer et;
+  static uint8_t turn;
+  uint8_t expected;
+  uint8_t ok;
+  uint8_t i;
+
+  PROCESS_BEGIN();
+
+  netsim_init();
+  add_neighbors();
+  conn = udp_new(NULL, UIP_HTONS(UDP_PORT), NULL);
+  udp_bind(conn, UIP_HTONS(UDP_PORT));
+
+  /* Let all nodes start */
+  etimer_set(&et, 2 * CLOCK_SECOND);
+  for(turn = 0; turn <= TURNS; turn++) {
+    while(!etimer_expired(&et)) {
+      PROCESS_WAIT_EVENT();
+      if(ev == tcpip_event) {
+        tcpip_handler();
+      }
+    }
+    if(turn < TURNS && turns[turn].sender == netsim_id()) {
+      send_turn(turn);
+    }
+    etimer_set(&et, CLOCK_SECOND);
+  }
+
+  ok = 1;
+  for(i = 0; i < TURNS; i++) {
+    expected = turns[i].sender != netsim_id() &&
+      (turns[i].receiver == 0 || turns[i].receiver == netsim_id());
+    if(received[i] != expected) {
+      printf("adaptivesec: node %u received datagram %u %u times, not %u\n",
+             netsim_id(), i, received[i], expected);
+      ok = 0;
+    }
+  }
+  if(ok) {
+    printf("adaptivesec: node %u OK\n", netsim_id());
+  }
+  exit(!ok);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,22 @@
+#ifndef PROJECT_CONF_H_
+#define PROJECT_CONF_H_
+
+#undef NETSTACK_CONF_RADIO
+#define NETSTACK_CONF_RADIO netsim_radio_driver
+#undef NETSTACK_CONF_LLSEC
+#define NETSTACK_CONF_LLSEC adaptivesec_driver
+/* Encryption and a MIC of 8 bytes */
+#undef LLSEC802154_CONF_SECURITY_LEVEL
+#define LLSEC802154_CONF_SECURITY_LEVEL 6
+
+/* No frames but those of the test */
+#undef UIP_CONF_ND6_DEF_MAXDADNS
+#define UIP_CONF_ND6_DEF_MAXDADNS    0
+#undef UIP_CONF_ROUTER
+#define UIP_CONF_ROUTER              1
+#undef UIP_CONF_ND6_SEND_RA
+#define UIP_CONF_ND6_SEND_RA         0
+#undef UIP_CONF_TCP
+#define UIP_CONF_TCP                 0
+
+#endif /* PROJECT_CONF_H_ */
@@ -0,0 +1,239 @@
+/**
+ * \file
+ *         Native test of the priority classes of the CSMA queues
+ * \details
+ *         Three netsim nodes in range of each other. Node 1 queues a burst
+ *         of twice QUEUEBUF_NUM data datagrams in one go, to nodes 2 and 3
+ *         in turn, so that CSMA holds a queue for each of them. It then
+ *         queues for node 2 an IKE datagram large enough to be fragmented,
+ *         and a neighbor solicitation, in that order. The burst is larger
+ *         than the queue buffers, so without priority classes the IKE
+ *         datagram and the neighbor solicitation would be dropped, or sent
+ *         after all the queued data.
+ *
+ *         Nodes 2 and 3 wrap tcpip_input() at link time to see the order in
+ *         which the packets arrive. Node 2 also wraps recv() to see the
+ *         frames node 1 sends. Node 2 checks that:
+ *
+ *         - the neighbor solicitation and the IKE datagram both arrive;
+ *         - the neighbor solicitation, a control packet, comes before the
+ *           IKE datagram, although it was queued after it;
+ *         - at most one data datagram, the one CSMA had already started
+ *           with, comes before either of them;
+ *         - the fragments of the IKE datagram go out one after the other,
+ *           with no data frame between them;
+ *         - some data still gets through.
+ *
+ *         Node 3 checks that the queue of the second neighbor gets its
+ *         turns, and that its data gets through too.
+ *
+ *         Nodes 2 and 3 print what they saw and exit with status 1 if a
+ *         check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/ipv6/uip-nd6.h"
+#include "net/ipv6/sicslowpan.h"
+#include "net/mac/frame802154.h"
+#include "net/queuebuf.h"
+#include "ipsec/ike/machine.h"
+#include "netsim-radio.h"
+
+#define UDP_PORT  5678
+#define BURST     (2 * QUEUEBUF_NUM)
+#define DATA_LEN  40
+#define IKE_LEN   150
+
+#define UIP_IP_BUF   ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_UDP_BUF  ((struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+#define UIP_ICMP_BUF ((struct uip_icmp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+
+static struct uip_udp_conn *data_conn;
+static struct uip_udp_conn *ike_conn;
+
+/* Arrivals: the test packets seen so far, and the position of the neighbor
+   solicitation and of the IKE datagram among them, -1 until then */
+static int arrivals;
+static int data_received;
+static int ns_position = -1;
+static int ike_position = -1;
+
+/* Frames of node 1: fragments, and runs of consecutive fragments */
+static int fragments;
+static int fragment_runs;
+static uint8_t in_run;
+
+void __real_tcpip_input(void);
+ssize_t __real_recv(int fd, void *buf, size_t len, int flags);
+
+PROCESS(csma_priority_test_process, "CSMA priority test");
+AUTOSTART_PROCESSES(&csma_priority_test_process);
+/*---------------------------------------------------------------------------*/
+void
+__wrap_tcpip_input(void)
+{
+  if(UIP_IP_BUF->proto == UIP_PROTO_ICMP6 &&
+     UIP_ICMP_BUF->type == ICMP6_NS) {
+    if(ns_position < 0) {
+      ns_position = arrivals;
+    }
+    arrivals++;
+  } else if(UIP_IP_BUF->proto == UIP_PROTO_UDP &&
+            UIP_UDP_BUF->destport == UIP_HTONS(UDP_PORT)) {
+    if(UIP_UDP_BUF->srcport == UIP_HTONS(IKE_UDP_PORT)) {
+      if(ike_position < 0) {
+        ike_position = arrivals;
+      }
+    } else {
+      data_received++;
+    }
+    arrivals++;
+  }
+  __real_tcpip_input();
+}
+/*---------------------------------------------------------------------------*/
+ssize_t
+__wrap_recv(int fd, void *buf, size_t len, int flags)
+{
+  static uint8_t frame[128];
+  frame802154_t pf;
+  ssize_t ret;
+  int hdrlen;
+  uint8_t dispatch;
+
+  ret = __real_recv(fd, buf, len, flags);
+  if(ret <= 0 || ret > (ssize_t)sizeof(frame)) {
+    return ret;
+  }
+  /* frame802154_parse() points into the frame it parses: keep it intact */
+  memcpy(frame, buf, ret);
+  hdrlen = frame802154_parse(frame, ret, &pf);
+  if(hdrlen == 0 || pf.fcf.frame_type != FRAME802154_DATAFRAME ||
+     pf.src_addr[sizeof(linkaddr_t) - 1] != 1 || pf.payload_len == 0) {
+    return ret;
+  }
+  dispatch = pf.payload[0] & 0xf8;
+  if(dispatch == SICSLOWPAN_DISPATCH_FRAG1 ||
+     dispatch == SICSLOWPAN_DISPATCH_FRAGN) {
+    fragments++;
+    if(!in_run) {
+      fragment_runs++;
+      in_run = 1;
+    }
+  } else {
+    in_run = 0;
+  }
+  return ret;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_link_local(uip_ipaddr_t *addr, uint8_t id)
+{
+  uip_ip6addr(addr, 0xfe80, 0, 0, 0, 0x0212, 0x7400, 0, id);
+}
+/*---------------------------------------------------------------------------*/
+/* Let uIP know the link-layer address of the other node, so that it sends
+   no neighbor solicitation but the one of the test */
+static void
+add_neighbor(uint8_t id)
+{
+  uip_ipaddr_t addr;
+  uip_lladdr_t lladdr;
+
+  set_link_local(&addr, id);
+  memset(&lladdr, 0, sizeof(lladdr));
+  lladdr.addr[1] = 0x12;
+  lladdr.addr[2] = 0x74;
+  lladdr.addr[sizeof(lladdr.addr) - 1] = id;
+  uip_ds6_nbr_add(&addr, &lladdr, 0, NBR_REACHABLE);
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_burst(void)
+{
+  static uint8_t data[IKE_LEN];
+  uip_ipaddr_t addr;
+  uint8_t i;
+
+  for(i = 0; i < BURST; i++) {
+    set_link_local(&addr, 2 + i % 2);
+    memset(data, i, DATA_LEN);
+    uip_udp_packet_sendto(data_conn, data, DATA_LEN,
+                          &addr, UIP_HTONS(UDP_PORT));
+  }
+  set_link_local(&addr, 2);
+  memset(data, 0xff, sizeof(data));
+  uip_udp_packet_sendto(ike_conn, data, sizeof(data),
+                        &addr, UIP_HTONS(UDP_PORT));
+  uip_nd6_ns_output(NULL, &addr, &addr);
+  tcpip_ipv6_output();
+  printf("csma-priority: node 1 queued %u data datagrams, "
+         "an IKE datagram of %u bytes and a neighbor solicitation\n",
+         BURST, IKE_LEN);
+}
+/*---------------------------------------------------------------------------*/
+static int
+check(void)
+{
+  if(netsim_id() == 3) {
+    printf("csma-priority: node 3 got %d data\n", data_received);
+    return data_received > 0;
+  }
+  printf("csma-priority: neighbor solicitation %d, IKE %d, %d data of %d\n",
+         ns_position, ike_position, data_received, arrivals);
+  printf("csma-priority: %d IKE fragments in %d runs\n",
+         fragments, fragment_runs);
+  return ns_position >= 0 && ike_position >= 0
+    && ns_position < ike_position
+    && ns_position <= 1 && ike_position <= 2
+    && fragments > 1 && fragment_runs == 1
+    && data_received > 0;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(csma_priority_test_process, ev, data)
+{
+  static struct etimer et;
+  int ok;
+
+  PROCESS_BEGIN();
+
+  netsim_init();
+  if(netsim_id() == 1) {
+    add_neighbor(2);
+    add_neighbor(3);
+  } else {
+    add_neighbor(1);
+  }
+  data_conn = udp_new(NULL, UIP_HTONS(UDP_PORT), NULL);
+  udp_bind(data_conn, UIP_HTONS(UDP_PORT));
+  /* Sent from the IKE port, so that the IKE process does not get it */
+  ike_conn = udp_new(NULL, UIP_HTONS(UDP_PORT), NULL);
+  udp_bind(ike_conn, UIP_HTONS(IKE_UDP_PORT));
+
+  /* Let all the nodes start */
+  etimer_set(&et, 2 * CLOCK_SECOND);
+  PROCESS_WAIT_UNTIL(etimer_expired(&et));
+  if(netsim_id() == 1) {
+    send_burst();
+  }
+
+  etimer_set(&et, 3 * CLOCK_SECOND);
+  PROCESS_WAIT_UNTIL(etimer_expired(&et));
+  if(netsim_id() == 1) {
+    exit(0);
+  }
+  ok = check();
+  if(ok) {
+    printf("csma-priority: node %u OK\n", netsim_id());
+  }
+  exit(!ok);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,152 @@
+/**
+ * \file
+ *         Native simulation of the drift estimator of the phase table
+ * \details
+ *         A sender reports to a ContikiMAC receiver every five minutes. The
+ *         clock of the receiver runs 30 ppm fast, and each acknowledged
+ *         strobe tells its wake-up time with up to 16 ticks of jitter. Times
+ *         are in ticks of a 32768 Hz rtimer with 8 wake-ups a second, as on
+ *         the sky. The test checks that:
+ *
+ *         - after 20 reports, the estimated drift is within 10% of the
+ *           true one;
+ *         - the wake-up predicted for the next report is off by no more
+ *           than the widening of the guard time plus the jitter, and by
+ *           far less than without the drift model;
+ *         - a neighbor with the largest deviation, silent for 60000
+ *           seconds, is treated as unknown instead of making the guard
+ *           time overflow.
+ *
+ *         phase.c is included to reach the entries of the phase table.
+ *         clock_seconds() is wrapped at link time to simulate the time
+ *         between reports. The test exits with status 1 at the first check
+ *         that fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "contiki.h"
+#include "lib/random.h"
+#include "net/mac/phase.c"
+
+#define CYCLE_TIME       (32768 / 8)
+#define TICKS_PER_SECOND 32768.0
+#define DRIFT_PPM        30
+#define REPORT_INTERVAL  300
+#define REPORTS          20
+#define JITTER           16
+
+#define CHECK(cond, ...) do {                   \
+    if(!(cond)) {                               \
+      printf("phase-drift: " __VA_ARGS__);      \
+      printf("\n");                             \
+      exit(1);                                  \
+    }                                           \
+  } while(0)
+
+static unsigned long seconds;
+static const linkaddr_t receiver = { { 0x00, 0x12, 0x74, 0x00,
+                                       0x00, 0x00, 0x00, 0x02 } };
+
+PROCESS(phase_drift_test_process, "Phase drift test");
+AUTOSTART_PROCESSES(&phase_drift_test_process);
+/*---------------------------------------------------------------------------*/
+unsigned long
+__wrap_clock_seconds(void)
+{
+  return seconds;
+}
+/*---------------------------------------------------------------------------*/
+static rtimer_clock_t
+jittered(double wakeup)
+{
+  return (rtimer_clock_t)((unsigned long)wakeup
+                          + random_rand() % (2 * JITTER + 1) - JITTER);
+}
+/*---------------------------------------------------------------------------*/
+static int32_t
+distance(int32_t offset)
+{
+  return offset < 0 ? -offset : offset;
+}
+/*---------------------------------------------------------------------------*/
+/* Reports every REPORT_INTERVAL seconds to a drifting receiver */
+static void
+learn(void)
+{
+  struct phase *e;
+  double wakeup;
+  double truth;
+  int32_t predicted;
+  int32_t uncertainty;
+  int32_t naive;
+  uint8_t i;
+
+  wakeup = 1000;
+  for(i = 0; i < REPORTS; i++) {
+    phase_update(&receiver, jittered(wakeup), CYCLE_TIME, MAC_TX_OK);
+    seconds += REPORT_INTERVAL;
+    wakeup += REPORT_INTERVAL * TICKS_PER_SECOND * (1 + DRIFT_PPM * 1e-6);
+  }
+
+  e = nbr_table_get_from_lladdr(nbr_phase, &receiver);
+  CHECK(e != NULL, "No phase for the receiver");
+  truth = DRIFT_PPM * 1e-6 * TICKS_PER_SECOND * PHASE_DRIFT_PERIOD;
+  printf("phase-drift: drift %d ticks per %u s (true %.1f), deviation %u\n",
+         e->drift, PHASE_DRIFT_PERIOD, truth, e->deviation);
+  CHECK(e->drift_known, "Drift not learned after %u reports", REPORTS);
+  CHECK(distance(e->drift - (int32_t)truth) <= truth / 10,
+        "Drift %d is more than 10%% off", e->drift);
+
+  /* Where phase_wait() would aim at the next report */
+  predicted = phase_offset((int32_t)(rtimer_clock_t)
+                           ((rtimer_clock_t)wakeup - e->time)
+                           - drift_over(e->drift, REPORT_INTERVAL),
+                           CYCLE_TIME);
+  naive = phase_offset((int32_t)(rtimer_clock_t)
+                       ((rtimer_clock_t)wakeup - e->time), CYCLE_TIME);
+  uncertainty = drift_over(2 * (int32_t)e->deviation, REPORT_INTERVAL);
+  printf("phase-drift: aims %ld ticks off after %u s, guard time widened by "
+         "%ld, %ld ticks off without the model\n", (long)predicted,
+         REPORT_INTERVAL, (long)uncertainty, (long)naive);
+  CHECK(distance(predicted) <= uncertainty + JITTER,
+        "Prediction outside the guard time");
+  CHECK(distance(predicted) * 4 < distance(naive),
+        "Prediction no better than without the model");
+}
+/*---------------------------------------------------------------------------*/
+/* A long silence with the largest deviation must not overflow */
+static void
+silence(void)
+{
+  struct phase *e;
+  rtimer_clock_t guard;
+  phase_status_t status;
+
+  e = nbr_table_get_from_lladdr(nbr_phase, &receiver);
+  e->deviation = UINT16_MAX;
+  seconds = e->seconds + 60000;
+  guard = CYCLE_TIME / 16;
+  status = phase_wait(&receiver, CYCLE_TIME, &guard, NULL, NULL, NULL);
+  CHECK(status == PHASE_UNKNOWN,
+        "Phase still known after 60000 s, guard time %u", guard);
+  printf("phase-drift: unknown after a long silence\n");
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(phase_drift_test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  random_init(1);
+  phase_init();
+
+  learn();
+  silence();
+
+  printf("phase-drift: OK\n");
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,258 @@
+/**
+ * \file
+ *         A radio for native nodes that run as separate processes
+ */
+
+#include "netsim-radio.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/linkaddr.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_NEIGHBORS 16
+#define MAX_FRAME_LEN 127
+
+static int fd = -1;
+static uint8_t id;
+static uint8_t neighbors[MAX_NEIGHBORS];
+static uint8_t neighbor_num;
+static uint8_t loss;
+static uint16_t port;
+static unsigned long tx_count;
+static uint8_t frame[MAX_FRAME_LEN];
+static unsigned short frame_len;
+/*---------------------------------------------------------------------------*/
+static uint16_t
+port_of(uint8_t node)
+{
+  return port + node;
+}
+/*---------------------------------------------------------------------------*/
+static int
+set_fd(fd_set *rset, fd_set *wset)
+{
+  FD_SET(fd, rset);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_fd(fd_set *rset, fd_set *wset)
+{
+  int len;
+
+  if(!FD_ISSET(fd, rset)) {
+    return;
+  }
+  packetbuf_clear();
+  len = recv(fd, packetbuf_dataptr(), MAX_FRAME_LEN, 0);
+  if(len > 0) {
+    packetbuf_set_datalen(len);
+    NETSTACK_RDC.input();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static const struct select_callback radio_fd = { set_fd, handle_fd };
+/*---------------------------------------------------------------------------*/
+static int
+init(void)
+{
+  struct sockaddr_in addr;
+  linkaddr_t lladdr;
+  char *s;
+
+  s = getenv("NETSIM_ID");
+  id = s != NULL ? atoi(s) : 0;
+  if(id == 0) {
+    fprintf(stderr, "netsim: NETSIM_ID is not set\n");
+    exit(1);
+  }
+  s = getenv("NETSIM_LOSS");
+  loss = s != NULL ? atoi(s) : 0;
+  s = getenv("NETSIM_PORT");
+  port = s != NULL ? atoi(s) : 20000;
+  for(s = getenv("NETSIM_NEIGHBORS"); s != NULL && *s != '\0' &&
+        neighbor_num < MAX_NEIGHBORS; s = strchr(s, ',')) {
+    if(*s == ',') {
+      s++;
+    }
+    neighbors[neighbor_num++] = atoi(s);
+  }
+  srand(id ^ getpid());
+
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port_of(id));
+  if(fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    perror("netsim");
+    exit(1);
+  }
+  select_set_callback(fd, &radio_fd);
+
+  memset(&lladdr, 0, sizeof(lladdr));
+  lladdr.u8[1] = 0x12;
+  lladdr.u8[2] = 0x74;
+  lladdr.u8[sizeof(lladdr.u8) - 1] = id;
+  linkaddr_set_node_addr(&lladdr);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+prepare(const void *payload, unsigned short payload_len)
+{
+  if(payload_len > MAX_FRAME_LEN) {
+    return 1;
+  }
+  memcpy(frame, payload, payload_len);
+  frame_len = payload_len;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+transmit(unsigned short transmit_len)
+{
+  struct sockaddr_in addr;
+  uint8_t i;
+
+  tx_count++;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for(i = 0; i < neighbor_num; i++) {
+    if(rand() % 100 < loss) {
+      continue;
+    }
+    addr.sin_port = htons(port_of(neighbors[i]));
+    sendto(fd, frame, frame_len, 0, (struct sockaddr *)&addr, sizeof(addr));
+  }
+  return RADIO_TX_OK;
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_send(const void *payload, unsigned short payload_len)
+{
+  if(prepare(payload, payload_len)) {
+    return RADIO_TX_ERR;
+  }
+  return transmit(payload_len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_read(void *buf, unsigned short buf_len)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+channel_clear(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+receiving_packet(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+pending_packet(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+on(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+off(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+get_value(radio_param_t param, radio_value_t *value)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+set_value(radio_param_t param, radio_value_t value)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+get_object(radio_param_t param, void *dest, size_t size)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+set_object(radio_param_t param, const void *src, size_t size)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+const struct radio_driver netsim_radio_driver = {
+  init,
+  prepare,
+  transmit,
+  radio_send,
+  radio_read,
+  channel_clear,
+  receiving_packet,
+  pending_packet,
+  on,
+  off,
+  get_value,
+  set_value,
+  get_object,
+  set_object
+};
+/*---------------------------------------------------------------------------*/
+void
+netsim_init(void)
+{
+  uip_ds6_addr_t *lladdr;
+  uip_ipaddr_t ipaddr;
+
+  /* The platform set the link-local address from its fixed serial ID */
+  memcpy(&uip_lladdr.addr, &linkaddr_node_addr, sizeof(uip_lladdr.addr));
+  lladdr = uip_ds6_get_link_local(-1);
+  if(lladdr != NULL) {
+    uip_ds6_addr_rm(lladdr);
+  }
+  uip_create_linklocal_prefix(&ipaddr);
+  uip_ds6_set_addr_iid(&ipaddr, &uip_lladdr);
+  lladdr = uip_ds6_addr_add(&ipaddr, 0, ADDR_AUTOCONF);
+  if(lladdr != NULL) {
+    lladdr->state = ADDR_PREFERRED;
+  }
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+netsim_id(void)
+{
+  return id;
+}
+/*---------------------------------------------------------------------------*/
+unsigned long
+netsim_tx_count(void)
+{
+  return tx_count;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,42 @@
+/**
+ * \file
+ *         A radio for native nodes that run as separate processes
+ * \details
+ *         Frames go over UDP on the loopback interface to the neighbors
+ *         of the node, so that native tests can run a small multi-hop
+ *         network without Cooja. Each node reads its place in the
+ *         network from the environment:
+ *
+ *         NETSIM_ID        ID of the node, 1 to 254 (required)
+ *         NETSIM_NEIGHBORS IDs of the nodes in range, e.g. "2,3"
+ *         NETSIM_LOSS      Percentage of frames lost on each link
+ *         NETSIM_PORT      UDP port of node 0, 20000 by default
+ *
+ *         The link-layer address of node i is 00:12:74:00:00:00:00:i.
+ */
+
+#ifndef NETSIM_RADIO_H_
+#define NETSIM_RADIO_H_
+
+#include "contiki.h"
+#include "dev/radio.h"
+
+extern const struct radio_driver netsim_radio_driver;
+
+/**
+ * \brief Give the node the addresses of its ID. To be called first by the
+ *        application, as the native platform sets a fixed address.
+ */
+void netsim_init(void);
+
+/**
+ * \brief The ID of the node
+ */
+uint8_t netsim_id(void);
+
+/**
+ * \brief Number of frames the node has sent
+ */
+unsigned long netsim_tx_count(void);
+
+#endif /* NETSIM_RADIO_H_ */
@@ -0,0 +1,47 @@
+#!/bin/sh
+# Runs a network of netsim nodes and prints the output of each node, one
+# after the other. The nodes must exit by themselves.
+#
+# usage: netsim-run.sh BINARY TOPOLOGY [LOSS] [PORT]
+#   TOPOLOGY  line:N  nodes 1 to N in a line, node i in range of i-1 and i+1
+#             mesh:N  nodes 1 to N all in range of each other
+#             grid:W  nodes 1 to W*W in rows of W, each in range of the
+#                     nodes left, right, above and below it
+#   LOSS      percentage of frames lost on each link (default 0)
+#   PORT      UDP port of node 0 (default 20000)
+
+BINARY=$1
+SHAPE=${2%%:*}
+NODES=${2##*:}
+[ $SHAPE = grid ] && WIDTH=$NODES && NODES=$(($NODES * $NODES))
+LOSS=${3:-0}
+PORT=${4:-20000}
+OUT=`mktemp -d`
+
+neighbors() {
+  if [ $SHAPE = line ] ; then
+    N=""
+    [ $1 -gt 1 ] && N=$(($1 - 1))
+    [ $1 -lt $NODES ] && N="$N${N:+,}$(($1 + 1))"
+    echo $N
+  elif [ $SHAPE = grid ] ; then
+    N=""
+    [ $((($1 - 1) % $WIDTH)) -gt 0 ] && N=$(($1 - 1))
+    [ $(($1 % $WIDTH)) -gt 0 ] && N="$N${N:+,}$(($1 + 1))"
+    [ $1 -gt $WIDTH ] && N="$N${N:+,}$(($1 - $WIDTH))"
+    [ $1 -le $(($NODES - $WIDTH)) ] && N="$N${N:+,}$(($1 + $WIDTH))"
+    echo $N
+  else
+    seq -s, 1 $NODES | tr ',' '\n' | grep -vx $1 | paste -sd,
+  fi
+}
+
+for i in `seq 1 $NODES` ; do
+  NETSIM_ID=$i NETSIM_NEIGHBORS=`neighbors $i` NETSIM_LOSS=$LOSS \
+  NETSIM_PORT=$PORT $BINARY < /dev/null > $OUT/$i.log 2>&1 &
+done
+wait
+for i in `seq 1 $NODES` ; do
+  cat $OUT/$i.log
+done
+rm -rf $OUT